@@ -0,0 +1,229 @@
+// Measures the peak memory of the collection phase: the replacements of many
+// headers, each read by several translation units that find the same edits,
+// merged into a single context. The interned flat records of
+// ReplacementsContext are compared with the maps of clang Replacements it
+// used to keep, one layout per forked process so that neither sees the
+// allocations of the other.
+//
+// Usage: ./collection_benchmark [files] [classes per file]
+//            [translation units per file]
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/mutex_lock.h"
+#include "modernizer/replacements.h"
+
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace {
+
+// The layout of the collection phase before the flat records: a map of
+// files, each with a map of edit locations to clang Replacements, which each
+// hold a copy of the file path.
+struct LegacyLocation {
+  int line;
+  int column;
+
+  bool operator<(const LegacyLocation& other) const {
+    return std::tie(line, column) < std::tie(other.line, other.column);
+  }
+};
+
+struct LegacyFileReplacements {
+  std::shared_ptr<const modernizer::FileSystemCache::Contents> contents;
+  std::map<LegacyLocation, Replacements> replacements;
+};
+
+using LegacyContext = std::map<std::string, LegacyFileReplacements>;
+
+struct Workload {
+  int num_files = 0;
+  int num_classes = 0;
+  int num_translation_units = 0;
+};
+
+struct Edit {
+  unsigned offset;
+  unsigned length;
+  std::string text;
+};
+
+// Every class of a file is 120 bytes long, with its deleted members
+// inserted after the constructor and its macro removed.
+std::vector<std::pair<Edit, Edit>> GetEdits(int num_classes) {
+  std::vector<std::pair<Edit, Edit>> edits;
+  for (int i = 0; i < num_classes; ++i) {
+    std::string name = "GeneratedClass" + std::to_string(i);
+    unsigned class_offset = static_cast<unsigned>(i) * 120;
+    edits.emplace_back(
+        Edit{.offset = class_offset + 40,
+             .length = 0,
+             .text = "\n\n" + name + "(const " + name + "&) = delete;\n" +
+                     name + "& operator=(const " + name + "&) = delete;\n"},
+        Edit{.offset = class_offset + 80, .length = 35, .text = ""});
+  }
+  return edits;
+}
+
+std::string GetFilePath(int file) {
+  return "gen/third_party/generated/protocol/messages_" +
+         std::to_string(file) + ".h";
+}
+
+std::shared_ptr<const modernizer::FileSystemCache::Contents> GetContents(
+    const std::string& file_path) {
+  auto contents = std::make_shared<modernizer::FileSystemCache::Contents>();
+  contents->buffer = llvm::MemoryBuffer::getMemBuffer("");
+  contents->real_path = "/src/out/" + file_path;
+  contents->hash = 1;
+  return contents;
+}
+
+void CollectLegacy(const Workload& workload) {
+  LegacyContext context;
+  std::vector<std::pair<Edit, Edit>> edits = GetEdits(workload.num_classes);
+  for (int tu = 0; tu < workload.num_translation_units; ++tu) {
+    for (int file = 0; file < workload.num_files; ++file) {
+      // Each translation unit collects into its own map, which is then
+      // merged into the context.
+      std::string file_path = GetFilePath(file);
+      std::map<LegacyLocation, Replacements> tu_replacements;
+      for (size_t i = 0; i < edits.size(); ++i) {
+        const auto& [insertion, removal] = edits[i];
+        Replacements& replacements =
+            tu_replacements[{static_cast<int>(i) * 7 + 6, 3}];
+        llvm::consumeError(replacements.add(Replacement(
+            file_path, insertion.offset, insertion.length, insertion.text)));
+        llvm::consumeError(replacements.add(Replacement(
+            file_path, removal.offset, removal.length, removal.text)));
+      }
+      auto [iter, inserted] = context.try_emplace(file_path);
+      if (inserted) {
+        iter->second.contents = GetContents(file_path);
+      }
+      for (const auto& loc_replacement : tu_replacements) {
+        iter->second.replacements.insert(loc_replacement);
+      }
+    }
+  }
+}
+
+void CollectFlat(const Workload& workload) {
+  modernizer::ReplacementsContext context;
+  modernizer::MutexLock guard(context);
+  std::vector<std::pair<Edit, Edit>> edits = GetEdits(workload.num_classes);
+  std::vector<std::shared_ptr<const modernizer::FileSystemCache::Contents>>
+      contents(workload.num_files);
+  for (int tu = 0; tu < workload.num_translation_units; ++tu) {
+    for (int file = 0; file < workload.num_files; ++file) {
+      std::string file_path = GetFilePath(file);
+      if (!contents[file]) {
+        contents[file] = GetContents(file_path);
+      }
+      std::vector<modernizer::ReplacementRecord> records;
+      for (const auto& [insertion, removal] : edits) {
+        records.push_back({.key_offset = insertion.offset,
+                           .offset = insertion.offset,
+                           .length = insertion.length,
+                           .text = insertion.text});
+        records.push_back({.key_offset = insertion.offset,
+                           .offset = removal.offset,
+                           .length = removal.length,
+                           .text = removal.text});
+      }
+      context.Add(file_path, contents[file], records);
+    }
+  }
+}
+
+int64_t GetPeakRssKilobytes() {
+  rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Runs |collect| in a child process and returns how much it grew the peak
+// resident set size of the child, in kilobytes, or -1 on error.
+int64_t MeasureInChild(const Workload& workload,
+                       void (*collect)(const Workload& workload),
+                       double* milliseconds) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    int64_t before = GetPeakRssKilobytes();
+    auto start = std::chrono::steady_clock::now();
+    collect(workload);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::pair<int64_t, double> result(GetPeakRssKilobytes() - before,
+                                      elapsed.count());
+    bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  std::pair<int64_t, double> result(-1, 0);
+  bool read_ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0 || !read_ok) {
+    return -1;
+  }
+  *milliseconds = result.second;
+  return result.first;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Workload workload{.num_files = argc >= 2 ? std::atoi(argv[1]) : 2000,
+                    .num_classes = argc >= 3 ? std::atoi(argv[2]) : 50,
+                    .num_translation_units =
+                        argc >= 4 ? std::atoi(argv[3]) : 4};
+  if (workload.num_files <= 0 || workload.num_classes <= 0 ||
+      workload.num_translation_units <= 0) {
+    llvm::errs() << "Usage: " << argv[0]
+                 << " [files] [classes per file] [translation units per "
+                    "file]\n";
+    return 1;
+  }
+
+  double legacy_milliseconds = 0;
+  int64_t legacy_kilobytes =
+      MeasureInChild(workload, CollectLegacy, &legacy_milliseconds);
+  double flat_milliseconds = 0;
+  int64_t flat_kilobytes =
+      MeasureInChild(workload, CollectFlat, &flat_milliseconds);
+  if (legacy_kilobytes < 0 || flat_kilobytes < 0) {
+    llvm::errs() << "Measuring in a child process failed\n";
+    return 1;
+  }
+  llvm::outs() << workload.num_files * workload.num_classes * 2
+               << " replacements in " << workload.num_files << " files, "
+               << workload.num_translation_units
+               << " translation units each: peak RSS grew by "
+               << legacy_kilobytes << " KB with maps ("
+               << llvm::format("%.1f", legacy_milliseconds) << " ms), "
+               << flat_kilobytes << " KB with flat records ("
+               << llvm::format("%.1f", flat_milliseconds) << " ms)\n";
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "modernizer/compilation_database.h"
+
+#include <unordered_set>
+#include <utility>
+
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/compile_command_key.h"
+#include "modernizer/filesystem.h"
+
+using clang::tooling::CompileCommand;
+using clang::tooling::JSONCommandLineSyntax;
+using clang::tooling::JSONCompilationDatabase;
+
+namespace modernizer {
+
+std::vector<CompileCommand> StoredCompilationDatabase::getCompileCommands(
+    llvm::StringRef file_path) const {
+  std::vector<CompileCommand> result;
+  auto iter = impl_.lower_bound(file_path.str());
+  const auto iter_end = impl_.upper_bound(file_path.str());
+  for (; iter != impl_.end() && iter != iter_end; ++iter) {
+    result.emplace_back(iter->second.directory, iter->first,
+                        iter->second.command_line, iter->second.output);
+  }
+  return result;
+}
+
+std::vector<std::string> StoredCompilationDatabase::getAllFiles() const {
+  std::vector<std::string> result;
+  for (const auto& iter : impl_) {
+    result.push_back(iter.first);
+  }
+  return result;
+}
+
+std::vector<CompileCommand> StoredCompilationDatabase::getAllCompileCommands()
+    const {
+  std::vector<CompileCommand> result;
+  for (const auto& iter : impl_) {
+    result.emplace_back(iter.second.directory, iter.first,
+                        iter.second.command_line, iter.second.output);
+  }
+  return result;
+}
+
+void StoredCompilationDatabase::Add(std::string&& file_name,
+                                    std::string&& directory,
+                                    std::vector<std::string>&& command_line,
+                                    std::string&& output) {
+  impl_.insert(
+      std::make_pair(file_name, CompilationData{.directory = directory,
+                                                .command_line = command_line,
+                                                .output = output}));
+}
+
+size_t StoredCompilationDatabase::Deduplicate(bool keep_define_variants) {
+  size_t num_removed = 0;
+  auto iter = impl_.begin();
+  while (iter != impl_.end()) {
+    const auto iter_end = impl_.upper_bound(iter->first);
+    std::unordered_set<std::string> keys;
+    while (iter != iter_end) {
+      if (keys.insert(GetPreprocessorKey(iter->second.command_line,
+                                         keep_define_variants))
+              .second) {
+        ++iter;
+      } else {
+        iter = impl_.erase(iter);
+        ++num_removed;
+      }
+    }
+  }
+  return num_removed;
+}
+
+bool AddCompileCommands(std::vector<CompileCommand> compile_commands,
+                        const std::filesystem::path& project_root,
+                        const std::optional<PathPattern>& source_file_pattern,
+                        LoadedCompilationDatabase* loaded) {
+  for (CompileCommand& compile_command : compile_commands) {
+    if (loaded->build_root.empty()) {
+      loaded->build_root = compile_command.Directory;
+    } else if (loaded->build_root != compile_command.Directory) {
+      llvm::errs() << "Multiple directory not supported: first: "
+                   << loaded->build_root.string()
+                   << ", second: " << compile_command.Directory << "\n";
+      return false;
+    }
+    std::filesystem::path file_path(compile_command.Filename);
+    if (file_path.is_relative()) {
+      auto new_file_path = std::filesystem::path(
+          compile_command.Directory /
+          std::filesystem::path(compile_command.Filename));
+      auto file_path_result = Canonical(new_file_path);
+      if (!file_path_result) {
+        llvm::errs() << "filesystem::canonical for " << new_file_path
+                     << " returned error: "
+                     << llvm::toString(file_path_result.takeError()) << "\n";
+        continue;
+      }
+      file_path = *file_path_result;
+    }
+    if (source_file_pattern) {
+      auto relative_file_path = Relative(file_path, project_root);
+      if (!relative_file_path) {
+        llvm::errs() << "filesystem::relative for " << file_path
+                     << " returned error: "
+                     << llvm::toString(relative_file_path.takeError()) << "\n";
+        continue;
+      }
+      if (!source_file_pattern->Match(relative_file_path->string())) {
+        llvm::errs() << "Skip " << *relative_file_path
+                     << " because it does not match the source file pattern\n";
+        continue;
+      }
+    }
+    loaded->source_paths.push_back(file_path.string());
+    loaded->compilation_database.Add(file_path.string(),
+                                     std::move(compile_command.Directory),
+                                     std::move(compile_command.CommandLine),
+                                     std::move(compile_command.Output));
+  }
+  return true;
+}
+
+bool LoadCompilationDatabase(
+    const std::filesystem::path& compile_commands,
+    const std::filesystem::path& project_root,
+    const std::optional<PathPattern>& source_file_pattern,
+    LoadedCompilationDatabase* loaded) {
+  std::string error_message;
+  auto json_compilation_database = JSONCompilationDatabase::loadFromFile(
+      compile_commands.string(), error_message, JSONCommandLineSyntax::Gnu);
+  if (!json_compilation_database) {
+    llvm::errs() << "Parsing compile_commands.json failed: " << error_message
+                 << "\n";
+    return false;
+  }
+  return AddCompileCommands(json_compilation_database->getAllCompileCommands(),
+                            project_root, source_file_pattern, loaded);
+}
+
+std::shared_ptr<const LoadedCompilationDatabase> CompilationDatabaseCache::Find(
+    const std::string& key,
+    const llvm::sys::fs::file_status& status) const {
+  absl::MutexLock lock(&mutex_);
+  auto iter = entries_.find(key);
+  if (iter == entries_.end() ||
+      iter->second.unique_id != status.getUniqueID() ||
+      iter->second.size != status.getSize() ||
+      iter->second.modification_time != status.getLastModificationTime()) {
+    return nullptr;
+  }
+  return iter->second.loaded;
+}
+
+void CompilationDatabaseCache::Store(
+    const std::string& key,
+    const llvm::sys::fs::file_status& status,
+    std::shared_ptr<const LoadedCompilationDatabase> loaded) {
+  absl::MutexLock lock(&mutex_);
+  entries_[key] = Entry{.unique_id = status.getUniqueID(),
+                        .size = status.getSize(),
+                        .modification_time = status.getLastModificationTime(),
+                        .loaded = std::move(loaded)};
+}
+
+void CompilationDatabaseCache::Clear() {
+  absl::MutexLock lock(&mutex_);
+  entries_.clear();
+}
+
+}  // namespace modernizer
@@ -0,0 +1,118 @@
+#ifndef MODERNIZER_COMPILATION_DATABASE_H_
+#define MODERNIZER_COMPILATION_DATABASE_H_
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "modernizer/path_pattern.h"
+
+namespace modernizer {
+
+class StoredCompilationDatabase : public clang::tooling::CompilationDatabase {
+ public:
+  ~StoredCompilationDatabase() override = default;
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(
+      llvm::StringRef file_path) const override;
+  std::vector<std::string> getAllFiles() const override;
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands()
+      const override;
+
+  void Add(std::string&& file_name,
+           std::string&& directory,
+           std::vector<std::string>&& command_line,
+           std::string&& output);
+
+  // Drops the compile commands of a file that preprocess it like an earlier
+  // one, as told by GetPreprocessorKey(). Returns the number dropped.
+  size_t Deduplicate(bool keep_define_variants);
+
+  size_t GetNumCompileCommands() const { return impl_.size(); }
+
+ private:
+  struct CompilationData {
+    std::string directory;
+    std::vector<std::string> command_line;
+    std::string output;
+  };
+
+  std::multimap<std::string, CompilationData> impl_;
+};
+
+// A compile database loaded for a run, with what was derived from it.
+struct LoadedCompilationDatabase {
+  StoredCompilationDatabase compilation_database;
+  std::filesystem::path build_root;
+  // The canonical paths of the files to parse.
+  std::vector<std::string> source_paths;
+  // Before and by Deduplicate().
+  size_t num_compile_commands = 0;
+  size_t num_removed = 0;
+};
+
+// Adds |compile_commands| to |loaded|, keeping the files that match
+// |source_file_pattern| if set. Returns false on error.
+bool AddCompileCommands(
+    std::vector<clang::tooling::CompileCommand> compile_commands,
+    const std::filesystem::path& project_root,
+    const std::optional<PathPattern>& source_file_pattern,
+    LoadedCompilationDatabase* loaded);
+
+// Loads |compile_commands| into |loaded| like AddCompileCommands().
+bool LoadCompilationDatabase(
+    const std::filesystem::path& compile_commands,
+    const std::filesystem::path& project_root,
+    const std::optional<PathPattern>& source_file_pattern,
+    LoadedCompilationDatabase* loaded);
+
+// Compile databases loaded from compile_commands.json files, kept between
+// runs of a long-lived process so that an unchanged file is not parsed
+// again. An entry is only found while the file has the status it was loaded
+// with. The canonical source paths of an entry are not checked again, so a
+// source file that is moved without touching the compile database keeps its
+// old path until Clear().
+class CompilationDatabaseCache {
+ public:
+  CompilationDatabaseCache() = default;
+  ~CompilationDatabaseCache() = default;
+
+  CompilationDatabaseCache(const CompilationDatabaseCache&) = delete;
+  CompilationDatabaseCache& operator=(const CompilationDatabaseCache&) =
+      delete;
+
+  // |key| covers everything besides the file itself that went into the
+  // entry, like the path of the file and the source file pattern.
+  std::shared_ptr<const LoadedCompilationDatabase> Find(
+      const std::string& key,
+      const llvm::sys::fs::file_status& status) const;
+  void Store(const std::string& key,
+             const llvm::sys::fs::file_status& status,
+             std::shared_ptr<const LoadedCompilationDatabase> loaded);
+
+  void Clear();
+
+ private:
+  struct Entry {
+    llvm::sys::fs::UniqueID unique_id;
+    uint64_t size = 0;
+    llvm::sys::TimePoint<> modification_time;
+    std::shared_ptr<const LoadedCompilationDatabase> loaded;
+  };
+
+  mutable absl::Mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_ GUARDED_BY(mutex_);
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_COMPILATION_DATABASE_H_
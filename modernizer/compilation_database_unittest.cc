@@ -0,0 +1,92 @@
+#include "modernizer/compilation_database.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using clang::tooling::CompileCommand;
+using modernizer::LoadedCompilationDatabase;
+
+CompileCommand MakeCompileCommand(const std::string& file,
+                                  std::vector<std::string> arguments) {
+  arguments.insert(arguments.begin(), "clang++");
+  arguments.push_back(file);
+  return CompileCommand("/src/out", file, std::move(arguments), "a.o");
+}
+
+TEST(CompilationDatabaseTest, AddsMatchingFiles) {
+  std::optional<modernizer::PathPattern> pattern =
+      modernizer::PathPattern::Create("api/.*");
+  ASSERT_TRUE(pattern);
+  LoadedCompilationDatabase loaded;
+  ASSERT_TRUE(modernizer::AddCompileCommands(
+      {MakeCompileCommand("/src/api/a.cc", {}),
+       MakeCompileCommand("/src/base/b.cc", {})},
+      "/src", pattern, &loaded));
+  EXPECT_EQ(loaded.build_root, "/src/out");
+  EXPECT_EQ(loaded.source_paths, std::vector<std::string>{"/src/api/a.cc"});
+  EXPECT_EQ(loaded.compilation_database.getAllFiles(),
+            std::vector<std::string>{"/src/api/a.cc"});
+}
+
+TEST(CompilationDatabaseTest, RejectsSeveralDirectories) {
+  LoadedCompilationDatabase loaded;
+  EXPECT_FALSE(modernizer::AddCompileCommands(
+      {MakeCompileCommand("/src/a.cc", {}),
+       CompileCommand("/src/out2", "/src/b.cc", {"clang++", "/src/b.cc"},
+                      "b.o")},
+      "/src", std::nullopt, &loaded));
+}
+
+TEST(CompilationDatabaseTest, DeduplicatesCompileCommands) {
+  LoadedCompilationDatabase loaded;
+  ASSERT_TRUE(modernizer::AddCompileCommands(
+      {MakeCompileCommand("/src/a.cc", {"-Wall"}),
+       MakeCompileCommand("/src/a.cc", {"-Wextra"}),
+       MakeCompileCommand("/src/a.cc", {"-DFOO"})},
+      "/src", std::nullopt, &loaded));
+  EXPECT_EQ(loaded.compilation_database.GetNumCompileCommands(), 3u);
+  EXPECT_EQ(loaded.compilation_database.Deduplicate(
+                /*keep_define_variants=*/true),
+            1u);
+  EXPECT_EQ(loaded.compilation_database.getCompileCommands("/src/a.cc").size(),
+            2u);
+}
+
+TEST(CompilationDatabaseCacheTest, DropsChangedFile) {
+  llvm::SmallString<128> path;
+  int fd;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("compile_commands", "json",
+                                                  fd, path));
+  {
+    llvm::raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << "[]\n";
+  }
+  llvm::sys::fs::file_status status;
+  ASSERT_FALSE(llvm::sys::fs::status(path, status));
+
+  modernizer::CompilationDatabaseCache cache;
+  auto loaded = std::make_shared<LoadedCompilationDatabase>();
+  cache.Store("key", status, loaded);
+  EXPECT_EQ(cache.Find("key", status), loaded);
+  EXPECT_FALSE(cache.Find("other key", status));
+
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream stream(path, ec);
+    ASSERT_FALSE(ec);
+    stream << "[ ]\n";
+  }
+  ASSERT_FALSE(llvm::sys::fs::status(path, status));
+  EXPECT_FALSE(cache.Find("key", status));
+  llvm::sys::fs::remove(path);
+}
+
+}  // namespace
@@ -0,0 +1,87 @@
+#include "modernizer/compile_command_key.h"
+
+#include <string_view>
+
+namespace modernizer {
+
+namespace {
+
+// Options taking a value, either joined or as the next argument. Longer
+// options come before their prefixes.
+constexpr std::string_view kOptionsWithValue[] = {
+    "-idirafter", "-imacros", "-include-pch", "-include", "-iquote",
+    "-isysroot",  "-isystem", "-target",      "--target", "-arch",
+    "--sysroot",  "-D",       "-F",           "-I",       "-U",
+    "-x",
+};
+
+// -O sets __OPTIMIZE__ and __OPTIMIZE_SIZE__, so its level is part of the
+// key.
+constexpr std::string_view kJoinedOptions[] = {
+    "-std=",  "--target=", "--sysroot=", "-march=",
+    "-mcpu=", "-stdlib=",  "-O",
+};
+
+// -fno-exceptions and -fno-rtti unset __EXCEPTIONS and __GXX_RTTI.
+constexpr std::string_view kFlags[] = {
+    "-m32",         "-m64",         "-nostdinc",       "-nostdinc++",
+    "-nostdlibinc", "-fexceptions", "-fno-exceptions", "-frtti",
+    "-fno-rtti",
+};
+
+void AppendToKey(std::string_view option,
+                 std::string_view value,
+                 std::string& key) {
+  key += option;
+  key.push_back('\0');
+  key += value;
+  key.push_back('\0');
+}
+
+}  // namespace
+
+std::string GetPreprocessorKey(const std::vector<std::string>& command_line,
+                               bool include_defines) {
+  std::string key;
+  // The first argument is the compiler.
+  for (size_t i = 1; i < command_line.size(); ++i) {
+    std::string_view arg = command_line[i];
+    bool handled = false;
+    for (std::string_view option : kJoinedOptions) {
+      if (arg.substr(0, option.size()) == option) {
+        AppendToKey(option, arg.substr(option.size()), key);
+        handled = true;
+        break;
+      }
+    }
+    if (handled) {
+      continue;
+    }
+    for (std::string_view option : kOptionsWithValue) {
+      if (arg.substr(0, option.size()) != option) {
+        continue;
+      }
+      std::string_view value = arg.substr(option.size());
+      if (value.empty() && i + 1 < command_line.size()) {
+        value = command_line[++i];
+      }
+      if (include_defines || (option != "-D" && option != "-U")) {
+        AppendToKey(option, value, key);
+      }
+      handled = true;
+      break;
+    }
+    if (handled) {
+      continue;
+    }
+    for (std::string_view flag : kFlags) {
+      if (arg == flag) {
+        AppendToKey(flag, "", key);
+        break;
+      }
+    }
+  }
+  return key;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,20 @@
+#ifndef MODERNIZER_COMPILE_COMMAND_KEY_H_
+#define MODERNIZER_COMPILE_COMMAND_KEY_H_
+
+#include <string>
+#include <vector>
+
+namespace modernizer {
+
+// Returns the arguments of |command_line| that change how a file is
+// preprocessed: include paths, forced includes and precompiled headers, the
+// language and its standard, the target, the optimization level, exceptions
+// and RTTI, and also -D and -U if |include_defines| is set. Two compile
+// commands of the same file with equal keys see the same code, so only one
+// of them needs to be parsed.
+std::string GetPreprocessorKey(const std::vector<std::string>& command_line,
+                               bool include_defines);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_COMPILE_COMMAND_KEY_H_
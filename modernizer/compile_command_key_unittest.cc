@@ -0,0 +1,82 @@
+#include "modernizer/compile_command_key.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(CompileCommandKeyTest, IgnoresFlagsNotAffectingPreprocessing) {
+  EXPECT_EQ(modernizer::GetPreprocessorKey(
+                {"clang++", "-I../..", "-std=c++17", "-O2", "-g", "-c",
+                 "../../foo.cc", "-o", "obj/debug/foo.o"},
+                true),
+            modernizer::GetPreprocessorKey(
+                {"clang++", "-I", "../..", "-std=c++17", "-O2", "-Wall", "-c",
+                 "../../foo.cc", "-o", "obj/warnings/foo.o"},
+                true));
+}
+
+TEST(CompileCommandKeyTest, ComparesTargetsAndIncludes) {
+  std::string x64_key = modernizer::GetPreprocessorKey(
+      {"clang++", "--target=x86_64-linux-gnu", "-I../..", "-c", "foo.cc"},
+      false);
+  EXPECT_NE(x64_key, modernizer::GetPreprocessorKey(
+                         {"clang++", "--target=aarch64-linux-gnu", "-I../..",
+                          "-c", "foo.cc"},
+                         false));
+  EXPECT_NE(x64_key, modernizer::GetPreprocessorKey(
+                         {"clang++", "--target=x86_64-linux-gnu", "-I../..",
+                          "-include", "config.h", "-c", "foo.cc"},
+                         false));
+  EXPECT_NE(x64_key, modernizer::GetPreprocessorKey(
+                         {"clang++", "--target=x86_64-linux-gnu", "-I../..",
+                          "-Igen", "-c", "foo.cc"},
+                         false));
+}
+
+TEST(CompileCommandKeyTest, ComparesPrecompiledHeaders) {
+  std::string a_key = modernizer::GetPreprocessorKey(
+      {"clang++", "-include-pch", "a.pch", "-c", "foo.cc"}, false);
+  EXPECT_NE(a_key, modernizer::GetPreprocessorKey(
+                       {"clang++", "-include-pch", "b.pch", "-c", "foo.cc"},
+                       false));
+  EXPECT_NE(a_key, modernizer::GetPreprocessorKey(
+                       {"clang++", "-include", "a.pch", "-c", "foo.cc"},
+                       false));
+}
+
+TEST(CompileCommandKeyTest, ComparesOptionsSettingPredefinedMacros) {
+  std::vector<std::string> base = {"clang++", "-x", "c++", "-O2", "-c",
+                                   "foo.cc"};
+  std::string base_key = modernizer::GetPreprocessorKey(base, false);
+  EXPECT_EQ(base_key,
+            modernizer::GetPreprocessorKey(
+                {"clang++", "-xc++", "-O2", "-g", "-c", "foo.cc"}, false));
+  EXPECT_NE(base_key,
+            modernizer::GetPreprocessorKey(
+                {"clang++", "-x", "c", "-O2", "-c", "foo.cc"}, false));
+  EXPECT_NE(base_key,
+            modernizer::GetPreprocessorKey(
+                {"clang++", "-x", "c++", "-Os", "-c", "foo.cc"}, false));
+  for (const char* flag : {"-fno-exceptions", "-fno-rtti"}) {
+    std::vector<std::string> command_line = base;
+    command_line.insert(command_line.end() - 2, flag);
+    EXPECT_NE(base_key, modernizer::GetPreprocessorKey(command_line, false))
+        << flag;
+  }
+}
+
+TEST(CompileCommandKeyTest, DefinesOnlyWhenAsked) {
+  std::vector<std::string> debug = {"clang++", "-DDEBUG", "-I../..", "-c",
+                                    "foo.cc"};
+  std::vector<std::string> release = {"clang++", "-D", "NDEBUG", "-I../..",
+                                      "-c", "foo.cc"};
+  EXPECT_EQ(modernizer::GetPreprocessorKey(debug, false),
+            modernizer::GetPreprocessorKey(release, false));
+  EXPECT_NE(modernizer::GetPreprocessorKey(debug, true),
+            modernizer::GetPreprocessorKey(release, true));
+}
+
+}  // namespace
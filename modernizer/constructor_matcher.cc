@@ -0,0 +1,16 @@
+#include "modernizer/constructor_matcher.h"
+
+namespace modernizer {
+
+using namespace clang::ast_matchers;
+
+DeclarationMatcher MacroConstructorMatcher(
+    const std::string& macro_name,
+    clang::TraversalKind traversal_kind) {
+  return traverse(traversal_kind,
+                  namedDecl(cxxConstructorDecl(),
+                            isExpandedFromMacro(macro_name))
+                      .bind("decl"));
+}
+
+}  // namespace modernizer
@@ -0,0 +1,21 @@
+#ifndef MODERNIZER_CONSTRUCTOR_MATCHER_H_
+#define MODERNIZER_CONSTRUCTOR_MATCHER_H_
+
+#include <string>
+
+#include "clang/AST/ASTTypeTraits.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+
+namespace modernizer {
+
+// Matches the constructors declared by an expansion of |macro_name|, bound to
+// "decl". With TK_IgnoreUnlessSpelledInSource, a class template is only
+// matched through its pattern, not again for every implicit instantiation.
+clang::ast_matchers::DeclarationMatcher MacroConstructorMatcher(
+    const std::string& macro_name,
+    clang::TraversalKind traversal_kind =
+        clang::TK_IgnoreUnlessSpelledInSource);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_CONSTRUCTOR_MATCHER_H_
@@ -0,0 +1,82 @@
+#include "modernizer/constructor_matcher.h"
+
+#include <memory>
+
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using namespace clang::ast_matchers;
+
+constexpr char kMacro[] = "RTC_DISALLOW_COPY_AND_ASSIGN";
+
+constexpr char kCode[] = R"cc(
+#define RTC_DISALLOW_COPY_AND_ASSIGN(TypeName) \
+  TypeName(const TypeName&) = delete;          \
+  TypeName& operator=(const TypeName&) = delete
+
+class Plain {
+ public:
+  Plain();
+
+ private:
+  RTC_DISALLOW_COPY_AND_ASSIGN(Plain);
+};
+
+template <typename T>
+class Box {
+ public:
+  Box();
+
+ private:
+  RTC_DISALLOW_COPY_AND_ASSIGN(Box);
+};
+
+Box<int> int_box;
+Box<char> char_box;
+)cc";
+
+class ConstructorMatcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ast_ = clang::tooling::buildASTFromCodeWithArgs(kCode, {"-std=c++17"});
+    ASSERT_TRUE(ast_);
+  }
+
+  // Returns how many times the callback of a MatchFinder runs, which is the
+  // number of candidates the modernizer counts.
+  int CountCandidates(clang::TraversalKind traversal_kind) {
+    class Counter : public MatchFinder::MatchCallback {
+     public:
+      void run(const MatchFinder::MatchResult& result) override {
+        EXPECT_TRUE(result.Nodes.getNodeAs<clang::CXXConstructorDecl>("decl"));
+        ++count;
+      }
+
+      int count = 0;
+    } counter;
+    MatchFinder finder;
+    finder.addMatcher(
+        modernizer::MacroConstructorMatcher(kMacro, traversal_kind), &counter);
+    finder.matchAST(ast_->getASTContext());
+    return counter.count;
+  }
+
+  std::unique_ptr<clang::ASTUnit> ast_;
+};
+
+TEST_F(ConstructorMatcherTest, SkipsImplicitInstantiations) {
+  // Plain and the pattern of Box.
+  EXPECT_EQ(CountCandidates(clang::TK_IgnoreUnlessSpelledInSource), 2);
+}
+
+TEST_F(ConstructorMatcherTest, MatchesImplicitInstantiationsAsIs) {
+  // Plain, the pattern of Box, Box<int> and Box<char>: the candidates counted
+  // before the matcher only looked at constructors as spelled.
+  EXPECT_EQ(CountCandidates(clang::TK_AsIs), 4);
+}
+
+}  // namespace
@@ -0,0 +1,137 @@
+#include "modernizer/depfile.h"
+
+#include <set>
+
+namespace modernizer {
+
+namespace {
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t';
+}
+
+bool IsNewline(char c) {
+  return c == '\n' || c == '\r';
+}
+
+}  // namespace
+
+std::optional<std::filesystem::path> FindDepfilePath(
+    const std::vector<std::string>& command_line,
+    const std::filesystem::path& directory) {
+  std::optional<std::filesystem::path> depfile;
+  std::optional<std::filesystem::path> output;
+  bool writes_depfile = false;
+  for (size_t i = 0; i < command_line.size(); ++i) {
+    std::string_view arg = command_line[i];
+    if (arg == "-MF" && i + 1 < command_line.size()) {
+      depfile = command_line[++i];
+    } else if (arg.size() > 3 && arg.substr(0, 3) == "-MF") {
+      depfile = arg.substr(3);
+    } else if (arg == "-MD" || arg == "-MMD") {
+      writes_depfile = true;
+    } else if (arg.substr(0, 8) == "-Wp,-MD," ||
+               arg.substr(0, 9) == "-Wp,-MMD,") {
+      depfile = arg.substr(arg.find(',', 4) + 1);
+    } else if (arg == "-o" && i + 1 < command_line.size()) {
+      output = command_line[++i];
+    } else if (arg.size() > 2 && arg.substr(0, 2) == "-o") {
+      output = arg.substr(2);
+    }
+  }
+  if (!depfile && writes_depfile && output) {
+    depfile = *output;
+    depfile->replace_extension(".d");
+  }
+  if (!depfile) {
+    return std::nullopt;
+  }
+  if (depfile->is_relative()) {
+    return directory / *depfile;
+  }
+  return depfile;
+}
+
+std::optional<std::vector<std::string>> ParseDepfile(
+    std::string_view contents) {
+  std::vector<std::string> dependencies;
+  std::set<std::string> seen;
+  std::string token;
+  bool in_prerequisites = false;
+  bool line_has_tokens = false;
+
+  auto finish_token = [&]() {
+    if (token.empty()) {
+      return;
+    }
+    line_has_tokens = true;
+    if (in_prerequisites) {
+      if (seen.insert(token).second) {
+        dependencies.push_back(token);
+      }
+    } else if (token.back() == ':') {
+      in_prerequisites = true;
+      token.pop_back();
+    }
+    token.clear();
+  };
+
+  for (size_t i = 0; i < contents.size(); ++i) {
+    char c = contents[i];
+    if (c == '\\' && i + 1 < contents.size()) {
+      char next = contents[i + 1];
+      if (IsNewline(next)) {
+        // Line continuation.
+        finish_token();
+        ++i;
+        if (next == '\r' && i + 1 < contents.size() &&
+            contents[i + 1] == '\n') {
+          ++i;
+        }
+        continue;
+      }
+      if (IsSpace(next) || next == '#' || next == '\\') {
+        token.push_back(next);
+        ++i;
+        continue;
+      }
+      token.push_back(c);
+      continue;
+    }
+    if (c == '$' && i + 1 < contents.size() && contents[i + 1] == '$') {
+      token.push_back('$');
+      ++i;
+      continue;
+    }
+    if (IsSpace(c)) {
+      finish_token();
+      continue;
+    }
+    if (IsNewline(c)) {
+      finish_token();
+      if (line_has_tokens && !in_prerequisites) {
+        return std::nullopt;
+      }
+      in_prerequisites = false;
+      line_has_tokens = false;
+      continue;
+    }
+    if (c == ':' && !in_prerequisites && i + 1 < contents.size() &&
+        !IsSpace(contents[i + 1]) && !IsNewline(contents[i + 1])) {
+      // A colon inside a target name, like a drive letter.
+      token.push_back(c);
+      continue;
+    }
+    token.push_back(c);
+    if (c == ':' && !in_prerequisites) {
+      finish_token();
+    }
+  }
+  finish_token();
+  if (line_has_tokens && !in_prerequisites) {
+    return std::nullopt;
+  }
+  return dependencies;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,25 @@
+#ifndef MODERNIZER_DEPFILE_H_
+#define MODERNIZER_DEPFILE_H_
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace modernizer {
+
+// Returns the dependency file a compiler invocation writes (-MF, or the
+// output with a ".d" suffix for -MD/-MMD), resolved against |directory|.
+std::optional<std::filesystem::path> FindDepfilePath(
+    const std::vector<std::string>& command_line,
+    const std::filesystem::path& directory);
+
+// Parses a Makefile-style dependency file as written by clang and gcc, and
+// returns the prerequisites of all of its rules in order of appearance,
+// without duplicates. Returns std::nullopt if |contents| is not a depfile.
+std::optional<std::vector<std::string>> ParseDepfile(std::string_view contents);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_DEPFILE_H_
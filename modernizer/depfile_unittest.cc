@@ -0,0 +1,48 @@
+#include "modernizer/depfile.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using ::testing::ElementsAre;
+
+TEST(DepfileTest, FindDepfilePath) {
+  EXPECT_EQ(modernizer::FindDepfilePath(
+                {"clang++", "-MMD", "-MF", "obj/foo.o.d", "-c", "../../foo.cc",
+                 "-o", "obj/foo.o"},
+                "/src/out/Debug"),
+            std::filesystem::path("/src/out/Debug/obj/foo.o.d"));
+  EXPECT_EQ(modernizer::FindDepfilePath(
+                {"clang++", "-MD", "-c", "foo.cc", "-o", "obj/foo.o"}, "/out"),
+            std::filesystem::path("/out/obj/foo.d"));
+  EXPECT_EQ(modernizer::FindDepfilePath(
+                {"clang++", "-Wp,-MD,/tmp/foo.d", "-c", "foo.cc"}, "/out"),
+            std::filesystem::path("/tmp/foo.d"));
+  EXPECT_FALSE(modernizer::FindDepfilePath(
+      {"clang++", "-c", "foo.cc", "-o", "obj/foo.o"}, "/out"));
+}
+
+TEST(DepfileTest, Simple) {
+  auto dependencies = modernizer::ParseDepfile(
+      "obj/foo.o: ../../foo.cc ../../foo.h \\\n"
+      "  ../../bar/bar.h\n");
+  ASSERT_TRUE(dependencies);
+  EXPECT_THAT(*dependencies,
+              ElementsAre("../../foo.cc", "../../foo.h", "../../bar/bar.h"));
+}
+
+TEST(DepfileTest, EscapesAndPhonyTargets) {
+  auto dependencies = modernizer::ParseDepfile(
+      "obj/foo.o: foo.cc dir\\ with\\ spaces/a.h cost$$.h \\\r\n"
+      "  foo.h\n"
+      "\n"
+      "foo.h:\n"
+      "dir\\ with\\ spaces/a.h:\n");
+  ASSERT_TRUE(dependencies);
+  EXPECT_THAT(*dependencies, ElementsAre("foo.cc", "dir with spaces/a.h",
+                                         "cost$.h", "foo.h"));
+}
+
+TEST(DepfileTest, Malformed) {
+  EXPECT_FALSE(modernizer::ParseDepfile("foo.cc foo.h\n"));
+  EXPECT_TRUE(modernizer::ParseDepfile(""));
+}
@@ -0,0 +1,105 @@
+#include "modernizer/file_coverage.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace modernizer {
+
+void FileCoverage::AddTranslationUnit(
+    const std::string& tu,
+    const std::optional<std::vector<std::string>>& dependencies) {
+  absl::MutexLock lock(&mutex_);
+  auto [iter, inserted] = pending_tus_.try_emplace(tu);
+  PendingTranslationUnit& pending_tu = iter->second;
+  if (!inserted && !pending_tu.file_ids) {
+    return;
+  }
+  if (!dependencies) {
+    if (pending_tu.file_ids) {
+      for (int file_id : *pending_tu.file_ids) {
+        --pending_readers_[file_id];
+      }
+    }
+    pending_tu.file_ids = std::nullopt;
+    ++pending_unknown_tus_;
+    return;
+  }
+  if (inserted) {
+    pending_tu.file_ids.emplace();
+  }
+
+  std::vector<int> file_ids;
+  file_ids.reserve(dependencies->size());
+  for (const std::string& dependency : *dependencies) {
+    file_ids.push_back(GetFileId(dependency));
+  }
+  std::sort(file_ids.begin(), file_ids.end());
+  file_ids.erase(std::unique(file_ids.begin(), file_ids.end()),
+                 file_ids.end());
+
+  // |pending_tu.file_ids| is kept sorted, so only count new files.
+  std::vector<int> merged_file_ids;
+  merged_file_ids.reserve(pending_tu.file_ids->size() + file_ids.size());
+  std::set_union(pending_tu.file_ids->begin(), pending_tu.file_ids->end(),
+                 file_ids.begin(), file_ids.end(),
+                 std::back_inserter(merged_file_ids));
+  std::vector<int> new_file_ids;
+  std::set_difference(file_ids.begin(), file_ids.end(),
+                      pending_tu.file_ids->begin(), pending_tu.file_ids->end(),
+                      std::back_inserter(new_file_ids));
+  for (int file_id : new_file_ids) {
+    ++pending_readers_[file_id];
+  }
+  pending_tu.file_ids = std::move(merged_file_ids);
+}
+
+std::optional<std::vector<std::string>> FileCoverage::CompleteTranslationUnit(
+    const std::string& tu) {
+  absl::MutexLock lock(&mutex_);
+  std::vector<std::string> final_files;
+  auto iter = pending_tus_.find(tu);
+  if (iter == pending_tus_.end()) {
+    return final_files;
+  }
+  std::optional<std::vector<int>> file_ids = std::move(iter->second.file_ids);
+  pending_tus_.erase(iter);
+  if (!file_ids) {
+    if (--pending_unknown_tus_ == 0) {
+      return std::nullopt;
+    }
+    return final_files;
+  }
+  for (int file_id : *file_ids) {
+    if (--pending_readers_[file_id] == 0 && pending_unknown_tus_ == 0) {
+      final_files.push_back(*files_[file_id]);
+    }
+  }
+  return final_files;
+}
+
+bool FileCoverage::IsFinal(const std::string& file) const {
+  absl::MutexLock lock(&mutex_);
+  if (pending_unknown_tus_ > 0) {
+    return false;
+  }
+  auto iter = file_ids_.find(file);
+  return iter == file_ids_.end() || pending_readers_[iter->second] == 0;
+}
+
+size_t FileCoverage::GetNumPendingTranslationUnits() const {
+  absl::MutexLock lock(&mutex_);
+  return pending_tus_.size();
+}
+
+int FileCoverage::GetFileId(const std::string& file) {
+  auto [iter, inserted] =
+      file_ids_.try_emplace(file, static_cast<int>(pending_readers_.size()));
+  if (inserted) {
+    files_.push_back(&iter->first);
+    pending_readers_.push_back(0);
+  }
+  return iter->second;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,66 @@
+#ifndef MODERNIZER_FILE_COVERAGE_H_
+#define MODERNIZER_FILE_COVERAGE_H_
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace modernizer {
+
+// Tracks which translation units may still read a file. Once no pending TU
+// can read a file, every result for the file is known and it can be emitted
+// before the whole run finishes.
+class FileCoverage {
+ public:
+  FileCoverage() = default;
+  ~FileCoverage() = default;
+
+  FileCoverage(const FileCoverage&) = delete;
+  FileCoverage& operator=(const FileCoverage&) = delete;
+
+  // Registers a pending TU together with the files it reads. If
+  // |dependencies| is std::nullopt, the TU may read any file and no file is
+  // final until it completes. Registering a TU twice merges the dependencies.
+  void AddTranslationUnit(
+      const std::string& tu,
+      const std::optional<std::vector<std::string>>& dependencies);
+
+  // Returns the files that became final when |tu| completed, so that callers
+  // do not have to look at every file again, or std::nullopt if |tu| was the
+  // last pending TU of unknown dependencies, which makes every file not read
+  // by a pending TU final at once. A file is returned again if a TU reading
+  // it was added after it was returned.
+  std::optional<std::vector<std::string>> CompleteTranslationUnit(
+      const std::string& tu);
+
+  // Returns true if no pending TU reads |file|.
+  bool IsFinal(const std::string& file) const;
+
+  size_t GetNumPendingTranslationUnits() const;
+
+ private:
+  int GetFileId(const std::string& file) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  struct PendingTranslationUnit {
+    // std::nullopt if the dependencies are unknown.
+    std::optional<std::vector<int>> file_ids;
+  };
+
+  mutable absl::Mutex mutex_;
+  std::unordered_map<std::string, int> file_ids_ GUARDED_BY(mutex_);
+  // Point to the keys of |file_ids_|, indexed by file id.
+  std::vector<const std::string*> files_ GUARDED_BY(mutex_);
+  // Number of pending TUs reading each file, indexed by file id.
+  std::vector<int> pending_readers_ GUARDED_BY(mutex_);
+  std::unordered_map<std::string, PendingTranslationUnit> pending_tus_
+      GUARDED_BY(mutex_);
+  int pending_unknown_tus_ GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_FILE_COVERAGE_H_
@@ -0,0 +1,55 @@
+#include "modernizer/file_coverage.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using FinalFiles = std::optional<std::vector<std::string>>;
+
+const FinalFiles kNoFiles = std::vector<std::string>();
+
+TEST(FileCoverageTest, FinalWhenReadersComplete) {
+  modernizer::FileCoverage coverage;
+  coverage.AddTranslationUnit("a.cc", {{"a.cc", "common.h", "a.h"}});
+  coverage.AddTranslationUnit("b.cc", {{"b.cc", "common.h"}});
+
+  EXPECT_FALSE(coverage.IsFinal("a.h"));
+  EXPECT_FALSE(coverage.IsFinal("common.h"));
+  EXPECT_TRUE(coverage.IsFinal("unrelated.h"));
+
+  EXPECT_EQ(coverage.CompleteTranslationUnit("a.cc"),
+            FinalFiles({"a.cc", "a.h"}));
+  EXPECT_TRUE(coverage.IsFinal("a.h"));
+  EXPECT_FALSE(coverage.IsFinal("common.h"));
+
+  EXPECT_EQ(coverage.CompleteTranslationUnit("b.cc"),
+            FinalFiles({"common.h", "b.cc"}));
+  EXPECT_TRUE(coverage.IsFinal("common.h"));
+  EXPECT_EQ(coverage.CompleteTranslationUnit("b.cc"), kNoFiles);
+  EXPECT_EQ(coverage.GetNumPendingTranslationUnits(), 0u);
+}
+
+TEST(FileCoverageTest, UnknownDependenciesBlockEverything) {
+  modernizer::FileCoverage coverage;
+  coverage.AddTranslationUnit("a.cc", {{"a.cc", "a.h"}});
+  coverage.AddTranslationUnit("b.cc", std::nullopt);
+
+  EXPECT_EQ(coverage.CompleteTranslationUnit("a.cc"), kNoFiles);
+  EXPECT_FALSE(coverage.IsFinal("a.h"));
+
+  EXPECT_EQ(coverage.CompleteTranslationUnit("b.cc"), std::nullopt);
+  EXPECT_TRUE(coverage.IsFinal("a.h"));
+}
+
+TEST(FileCoverageTest, MergesDependencies) {
+  modernizer::FileCoverage coverage;
+  coverage.AddTranslationUnit("a.cc", {{"a.cc", "a.h"}});
+  coverage.AddTranslationUnit("a.cc", {{"a.cc", "arm64.h"}});
+  EXPECT_EQ(coverage.GetNumPendingTranslationUnits(), 1u);
+
+  coverage.CompleteTranslationUnit("a.cc");
+  EXPECT_TRUE(coverage.IsFinal("a.h"));
+  EXPECT_TRUE(coverage.IsFinal("arm64.h"));
+}
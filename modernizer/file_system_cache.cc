@@ -0,0 +1,391 @@
+#include "modernizer/file_system_cache.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
+
+namespace modernizer {
+
+namespace {
+
+class CachedFile : public llvm::vfs::File {
+ public:
+  CachedFile(llvm::vfs::Status status,
+             std::shared_ptr<const FileSystemCache::Contents> contents)
+      : status_(std::move(status)), contents_(std::move(contents)) {}
+
+  ~CachedFile() override = default;
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override { return status_; }
+
+  llvm::ErrorOr<std::string> getName() override {
+    return contents_->real_path;
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(
+      const llvm::Twine& name,
+      int64_t file_size,
+      bool requires_null_terminator,
+      bool is_volatile) override {
+    // The cached buffer is always null terminated and outlives every user, so
+    // hand out a non-owning view instead of copying.
+    return llvm::MemoryBuffer::getMemBuffer(contents_->buffer->getBuffer(),
+                                            name.str(),
+                                            requires_null_terminator);
+  }
+
+  std::error_code close() override { return {}; }
+
+ private:
+  llvm::vfs::Status status_;
+  std::shared_ptr<const FileSystemCache::Contents> contents_;
+};
+
+}  // namespace
+
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+ public:
+  CachingFileSystem(FileSystemCache* cache,
+                    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : ProxyFileSystem(std::move(underlying)), cache_(cache) {
+    if (llvm::ErrorOr<std::string> working_directory =
+            getUnderlyingFS().getCurrentWorkingDirectory()) {
+      working_directory_ = std::move(*working_directory);
+    }
+  }
+
+  ~CachingFileSystem() override = default;
+
+  // The working directory is kept here rather than in the underlying file
+  // system, which may be shared with other views, and every path is made
+  // absolute before it is passed down.
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return working_directory_;
+  }
+
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine& path) override {
+    llvm::SmallString<256> absolute_path;
+    if (std::error_code ec = MakeAbsolute(path, absolute_path)) {
+      return ec;
+    }
+    auto status = cache_->Status(absolute_path, getUnderlyingFS());
+    if (!status) {
+      return status.getError();
+    }
+    if (!status->isDirectory()) {
+      return std::make_error_code(std::errc::not_a_directory);
+    }
+    working_directory_ = std::string(absolute_path);
+    return {};
+  }
+
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine& dir,
+                                          std::error_code& ec) override {
+    llvm::SmallString<256> absolute_path;
+    if ((ec = MakeAbsolute(dir, absolute_path))) {
+      return {};
+    }
+    return ProxyFileSystem::dir_begin(absolute_path, ec);
+  }
+
+  std::error_code getRealPath(
+      const llvm::Twine& path,
+      llvm::SmallVectorImpl<char>& output) const override {
+    llvm::SmallString<256> absolute_path;
+    if (std::error_code ec = MakeAbsolute(path, absolute_path)) {
+      return ec;
+    }
+    return ProxyFileSystem::getRealPath(absolute_path, output);
+  }
+
+  std::error_code isLocal(const llvm::Twine& path, bool& result) override {
+    llvm::SmallString<256> absolute_path;
+    if (std::error_code ec = MakeAbsolute(path, absolute_path)) {
+      return ec;
+    }
+    return ProxyFileSystem::isLocal(absolute_path, result);
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    llvm::SmallString<256> absolute_path;
+    if (std::error_code ec = MakeAbsolute(path, absolute_path)) {
+      return ec;
+    }
+    auto status = cache_->Status(absolute_path, getUnderlyingFS());
+    if (!status) {
+      return status.getError();
+    }
+    return llvm::vfs::Status::copyWithNewName(*status, path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+      const llvm::Twine& path) override {
+    llvm::SmallString<256> absolute_path;
+    if (std::error_code ec = MakeAbsolute(path, absolute_path)) {
+      return ec;
+    }
+    auto status = cache_->Status(absolute_path, getUnderlyingFS());
+    if (!status) {
+      return status.getError();
+    }
+    auto contents = cache_->Open(absolute_path, getUnderlyingFS());
+    if (!contents) {
+      return contents.getError();
+    }
+    return std::unique_ptr<llvm::vfs::File>(std::make_unique<CachedFile>(
+        llvm::vfs::Status::copyWithNewName(*status, path),
+        std::move(*contents)));
+  }
+
+ private:
+  std::error_code MakeAbsolute(const llvm::Twine& path,
+                               llvm::SmallVectorImpl<char>& output) const {
+    path.toVector(output);
+    if (std::error_code ec = makeAbsolute(output)) {
+      return ec;
+    }
+    // Only fold "." components. Folding ".." is not safe in the presence of
+    // symlinks, and the cache key does not need to be canonical to be useful.
+    llvm::sys::path::remove_dots(output, /*remove_dot_dot=*/false);
+    return {};
+  }
+
+  FileSystemCache* cache_;
+  std::string working_directory_;
+};
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+FileSystemCache::CreateFileSystem(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying) {
+  return llvm::makeIntrusiveRefCnt<CachingFileSystem>(this,
+                                                      std::move(underlying));
+}
+
+FileSystemCache::Statistics FileSystemCache::GetStatistics() const {
+  return Statistics{.status_requests = status_requests_.load(),
+                    .status_misses = status_misses_.load(),
+                    .open_requests = open_requests_.load(),
+                    .open_misses = open_misses_.load(),
+                    .bytes_read = bytes_read_.load(),
+                    .verification_reads = verification_reads_.load()};
+}
+
+std::shared_ptr<const FileSystemCache::Contents> FileSystemCache::FindContents(
+    llvm::StringRef real_path) const {
+  absl::MutexLock lock(&real_path_mutex_);
+  auto iter = real_path_index_.find(std::string(real_path));
+  if (iter == real_path_index_.end()) {
+    return nullptr;
+  }
+  return iter->second;
+}
+
+bool FileSystemCache::IsUnchangedOnDisk(const Contents& contents,
+                                        llvm::vfs::FileSystem* file_system) {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> real_file_system;
+  if (!file_system) {
+    real_file_system = llvm::vfs::getRealFileSystem();
+    file_system = real_file_system.get();
+  }
+  llvm::ErrorOr<llvm::vfs::Status> status =
+      file_system->status(contents.real_path);
+  if (!status) {
+    return false;
+  }
+  if (status->getSize() == contents.buffer->getBufferSize() &&
+      status->getLastModificationTime() == contents.modification_time) {
+    return true;
+  }
+  ++verification_reads_;
+  auto buffer = file_system->getBufferForFile(contents.real_path);
+  if (!buffer) {
+    return false;
+  }
+  return llvm::xxHash64((*buffer)->getBuffer()) == contents.hash;
+}
+
+void FileSystemCache::Invalidate(const std::vector<std::string>& paths) {
+  if (paths.empty()) {
+    return;
+  }
+  std::unordered_set<std::string> invalid_paths(paths.begin(), paths.end());
+  {
+    absl::MutexLock lock(&real_path_mutex_);
+    for (const std::string& path : paths) {
+      real_path_index_.erase(path);
+    }
+  }
+  // A path is also invalid if one of its parents is, like the entries under
+  // a directory that was created, removed or renamed.
+  auto is_invalid_path = [&](llvm::StringRef path) {
+    for (; !path.empty(); path = llvm::sys::path::parent_path(path)) {
+      if (invalid_paths.count(path.str())) {
+        return true;
+      }
+    }
+    return false;
+  };
+  {
+    // Invalidated directories are reported again once something under them
+    // is cached again, since their watch may be gone.
+    absl::MutexLock lock(&directories_mutex_);
+    for (auto iter = directories_.begin(); iter != directories_.end();) {
+      if (is_invalid_path(*iter)) {
+        iter = directories_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+  // A file can be cached under any name that leads to it, so every entry has
+  // to be checked. This is one pass for any number of paths.
+  for (Shard& shard : shards_) {
+    absl::MutexLock lock(&shard.mutex);
+    for (auto iter = shard.entries.begin(); iter != shard.entries.end();) {
+      const Entry& entry = iter->second;
+      // Keys keep ".." components, like the ones of missing files probed
+      // through relative include paths.
+      llvm::SmallString<256> normalized_path(iter->first);
+      llvm::sys::path::remove_dots(normalized_path, /*remove_dot_dot=*/true);
+      bool is_invalid =
+          is_invalid_path(iter->first) || is_invalid_path(normalized_path) ||
+          (entry.contents && invalid_paths.count(entry.contents->real_path));
+      if (is_invalid) {
+        iter = shard.entries.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+}
+
+std::vector<std::string> FileSystemCache::TakeNewDirectories() {
+  absl::MutexLock lock(&directories_mutex_);
+  return std::move(new_directories_);
+}
+
+FileSystemCache::Shard& FileSystemCache::GetShard(
+    llvm::StringRef absolute_path) {
+  return shards_[llvm::hash_value(absolute_path) % kNumShards];
+}
+
+void FileSystemCache::AddDirectory(llvm::StringRef absolute_path) {
+  llvm::SmallString<256> directory(absolute_path);
+  llvm::sys::path::remove_dots(directory, /*remove_dot_dot=*/true);
+  llvm::sys::path::remove_filename(directory);
+  absl::MutexLock lock(&directories_mutex_);
+  if (directories_.insert(std::string(directory)).second) {
+    new_directories_.push_back(std::string(directory));
+  }
+}
+
+llvm::ErrorOr<llvm::vfs::Status> FileSystemCache::Status(
+    llvm::StringRef absolute_path,
+    llvm::vfs::FileSystem& underlying) {
+  ++status_requests_;
+  Shard& shard = GetShard(absolute_path);
+  {
+    absl::MutexLock lock(&shard.mutex);
+    auto iter = shard.entries.find(std::string(absolute_path));
+    if (iter != shard.entries.end() && iter->second.status) {
+      return *iter->second.status;
+    }
+  }
+
+  // Do the system call without holding the lock. If another thread races us,
+  // both results are equivalent and the first one wins.
+  ++status_misses_;
+  llvm::ErrorOr<llvm::vfs::Status> status = underlying.status(absolute_path);
+
+  absl::MutexLock lock(&shard.mutex);
+  auto [iter, inserted] = shard.entries.try_emplace(std::string(absolute_path));
+  if (inserted) {
+    AddDirectory(absolute_path);
+  }
+  Entry& entry = iter->second;
+  if (!entry.status) {
+    entry.status = std::move(status);
+  }
+  return *entry.status;
+}
+
+llvm::ErrorOr<std::shared_ptr<const FileSystemCache::Contents>>
+FileSystemCache::Open(llvm::StringRef absolute_path,
+                      llvm::vfs::FileSystem& underlying) {
+  ++open_requests_;
+  Shard& shard = GetShard(absolute_path);
+  {
+    absl::MutexLock lock(&shard.mutex);
+    auto iter = shard.entries.find(std::string(absolute_path));
+    if (iter != shard.entries.end()) {
+      if (iter->second.contents) {
+        return iter->second.contents;
+      }
+      if (iter->second.contents_error) {
+        return iter->second.contents_error;
+      }
+    }
+  }
+
+  ++open_misses_;
+  std::error_code error;
+  std::shared_ptr<Contents> contents;
+  if (auto file = underlying.openFileForRead(absolute_path)) {
+    auto status = (*file)->status();
+    auto real_path = (*file)->getName();
+    // Read rather than mapped: the buffer can outlive the run in a
+    // long-lived process, and a mapping of a file truncated in place would
+    // crash it, or change under the hash.
+    auto buffer = (*file)->getBuffer(absolute_path,
+                                     status ? status->getSize() : -1,
+                                     /*RequiresNullTerminator=*/true,
+                                     /*IsVolatile=*/true);
+    if (buffer) {
+      bytes_read_ += (*buffer)->getBufferSize();
+      contents = std::make_shared<Contents>();
+      contents->buffer = std::move(*buffer);
+      contents->real_path =
+          real_path ? std::move(*real_path) : std::string(absolute_path);
+      contents->hash = llvm::xxHash64(contents->buffer->getBuffer());
+      if (status) {
+        contents->modification_time = status->getLastModificationTime();
+      }
+    } else {
+      error = buffer.getError();
+    }
+  } else {
+    error = file.getError();
+  }
+
+  // Files are opened after their status was cached, which recorded their
+  // directory.
+  absl::MutexLock lock(&shard.mutex);
+  Entry& entry = shard.entries[std::string(absolute_path)];
+  if (entry.contents) {
+    return entry.contents;
+  }
+  if (!contents) {
+    entry.contents_error = error;
+    return error;
+  }
+  entry.contents = contents;
+  {
+    absl::MutexLock real_path_lock(&real_path_mutex_);
+    real_path_index_.emplace(contents->real_path, contents);
+  }
+  return entry.contents;
+}
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> CreateCachedFileSystem(
+    FileSystemCache& file_system_cache,
+    const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>& base_file_system) {
+  if (base_file_system) {
+    return file_system_cache.CreateFileSystem(base_file_system);
+  }
+  return file_system_cache.CreateFileSystem(
+      llvm::vfs::createPhysicalFileSystem().release());
+}
+
+}  // namespace modernizer
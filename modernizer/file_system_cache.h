@@ -0,0 +1,140 @@
+#ifndef MODERNIZER_FILE_SYSTEM_CACHE_H_
+#define MODERNIZER_FILE_SYSTEM_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace modernizer {
+
+// Process-wide cache of file status and file contents, shared by every
+// worker thread and by the output phase. Each file is stat'ed and read at most
+// once per process; the cache assumes that the files do not change while it
+// is alive, unless they are passed to Invalidate().
+//
+// The cache itself is not a file system. Use CreateFileSystem() to get a
+// file system view for each user (each view has its own working directory).
+class FileSystemCache {
+ public:
+  struct Statistics {
+    uint64_t status_requests = 0;
+    uint64_t status_misses = 0;
+    uint64_t open_requests = 0;
+    uint64_t open_misses = 0;
+    uint64_t bytes_read = 0;
+    uint64_t verification_reads = 0;
+  };
+
+  // The bytes of a file as seen by the parser. Handed out as shared pointers
+  // so that results computed against a buffer can keep it alive and refer to
+  // it later.
+  struct Contents {
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    std::string real_path;
+    uint64_t hash = 0;
+    llvm::sys::TimePoint<> modification_time;
+  };
+
+  FileSystemCache() = default;
+  ~FileSystemCache() = default;
+
+  FileSystemCache(const FileSystemCache&) = delete;
+  FileSystemCache& operator=(const FileSystemCache&) = delete;
+
+  // Returns a file system which serves status and contents from this cache
+  // and falls back to |underlying| on a miss. The cache must outlive the
+  // returned file system.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> CreateFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying);
+
+  // Returns the contents that were read for |real_path|, or nullptr if the
+  // file has not been read through this cache.
+  std::shared_ptr<const Contents> FindContents(llvm::StringRef real_path) const;
+
+  // Returns true if the file on disk, or in |file_system| if set, still has
+  // the bytes of |contents|. Only reads the file again if its size or
+  // modification time changed.
+  bool IsUnchangedOnDisk(const Contents& contents,
+                         llvm::vfs::FileSystem* file_system = nullptr);
+
+  // Forgets everything cached about |paths|, whether they were looked up
+  // under that name or are the real path of a cached file, and about every
+  // path under them. Results holding the old contents keep them.
+  void Invalidate(const std::vector<std::string>& paths);
+
+  // Returns the directories of the paths cached since the previous call,
+  // missing ones included, that were not returned before or were
+  // invalidated since, so that the caller can watch them.
+  std::vector<std::string> TakeNewDirectories();
+
+  Statistics GetStatistics() const;
+
+ private:
+  friend class CachingFileSystem;
+
+  struct Entry {
+    std::optional<llvm::ErrorOr<llvm::vfs::Status>> status;
+    std::shared_ptr<const Contents> contents;
+    std::error_code contents_error;
+  };
+
+  struct Shard {
+    mutable absl::Mutex mutex;
+    std::unordered_map<std::string, Entry> entries GUARDED_BY(mutex);
+  };
+
+  static constexpr size_t kNumShards = 64;
+
+  Shard& GetShard(llvm::StringRef absolute_path);
+
+  // Records the directory of |absolute_path|, whose first entry was just
+  // created, for TakeNewDirectories().
+  void AddDirectory(llvm::StringRef absolute_path);
+
+  // |absolute_path| must be absolute. The returned status keeps the name
+  // it was first looked up with; callers rename it as needed.
+  llvm::ErrorOr<llvm::vfs::Status> Status(llvm::StringRef absolute_path,
+                                          llvm::vfs::FileSystem& underlying);
+
+  llvm::ErrorOr<std::shared_ptr<const Contents>> Open(
+      llvm::StringRef absolute_path,
+      llvm::vfs::FileSystem& underlying);
+
+  std::array<Shard, kNumShards> shards_;
+
+  mutable absl::Mutex real_path_mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const Contents>>
+      real_path_index_ GUARDED_BY(real_path_mutex_);
+
+  absl::Mutex directories_mutex_;
+  std::unordered_set<std::string> directories_ GUARDED_BY(directories_mutex_);
+  std::vector<std::string> new_directories_ GUARDED_BY(directories_mutex_);
+
+  std::atomic<uint64_t> status_requests_{0};
+  std::atomic<uint64_t> status_misses_{0};
+  std::atomic<uint64_t> open_requests_{0};
+  std::atomic<uint64_t> open_misses_{0};
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> verification_reads_{0};
+};
+
+// Returns a view of |file_system_cache| over |base_file_system|, or over the
+// real file system if it is not set.
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> CreateCachedFileSystem(
+    FileSystemCache& file_system_cache,
+    const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>& base_file_system);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_FILE_SYSTEM_CACHE_H_
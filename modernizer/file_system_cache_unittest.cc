@@ -0,0 +1,194 @@
+#include "modernizer/file_system_cache.h"
+
+#include "gtest/gtest.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+class CountingFileSystem : public llvm::vfs::ProxyFileSystem {
+ public:
+  explicit CountingFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : ProxyFileSystem(std::move(underlying)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    ++status_count;
+    return ProxyFileSystem::status(path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(
+      const llvm::Twine& path) override {
+    ++open_count;
+    return ProxyFileSystem::openFileForRead(path);
+  }
+
+  int status_count = 0;
+  int open_count = 0;
+};
+
+class FileSystemCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto in_memory = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    in_memory->addFile("/src/api/foo.h", 0,
+                       llvm::MemoryBuffer::getMemBuffer("int foo;\n"));
+    in_memory->addFile("/src/out/Debug/foo.cc", 0,
+                       llvm::MemoryBuffer::getMemBuffer("#include foo.h\n"));
+    counting_ = llvm::makeIntrusiveRefCnt<CountingFileSystem>(in_memory);
+  }
+
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> counting_;
+  modernizer::FileSystemCache cache_;
+};
+
+TEST_F(FileSystemCacheTest, StatusIsCached) {
+  auto fs = cache_.CreateFileSystem(counting_);
+  auto first = fs->status("/src/api/foo.h");
+  auto second = fs->status("/src/api/foo.h");
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  EXPECT_EQ(first->getSize(), second->getSize());
+  EXPECT_EQ(second->getName(), "/src/api/foo.h");
+  EXPECT_EQ(counting_->status_count, 1);
+}
+
+TEST_F(FileSystemCacheTest, MissingFileIsCached) {
+  auto fs = cache_.CreateFileSystem(counting_);
+  EXPECT_FALSE(fs->status("/src/api/missing.h"));
+  EXPECT_FALSE(fs->status("/src/api/missing.h"));
+  EXPECT_EQ(counting_->status_count, 1);
+}
+
+TEST_F(FileSystemCacheTest, ContentsAreSharedAcrossFileSystems) {
+  auto first_fs = cache_.CreateFileSystem(counting_);
+  auto second_fs = cache_.CreateFileSystem(counting_);
+  ASSERT_FALSE(second_fs->setCurrentWorkingDirectory("/src/out/Debug"));
+
+  auto first = first_fs->getBufferForFile("/src/api/foo.h");
+  auto second = second_fs->getBufferForFile("../../api/foo.h");
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  EXPECT_EQ((*first)->getBuffer(), "int foo;\n");
+  EXPECT_EQ((*second)->getBuffer(), "int foo;\n");
+
+  auto third = second_fs->getBufferForFile("../../api/foo.h");
+  ASSERT_TRUE(third);
+  EXPECT_EQ((*second)->getBufferStart(), (*third)->getBufferStart());
+  EXPECT_EQ(counting_->open_count, 2);
+
+  modernizer::FileSystemCache::Statistics statistics = cache_.GetStatistics();
+  EXPECT_EQ(statistics.open_requests, 3u);
+  EXPECT_EQ(statistics.open_misses, 2u);
+  EXPECT_EQ(statistics.bytes_read, 18u);
+}
+
+TEST_F(FileSystemCacheTest, WorkingDirectoryIsPerFileSystem) {
+  auto first_fs = cache_.CreateFileSystem(counting_);
+  auto second_fs = cache_.CreateFileSystem(counting_);
+  ASSERT_FALSE(first_fs->setCurrentWorkingDirectory("/src/api"));
+  ASSERT_FALSE(second_fs->setCurrentWorkingDirectory("/src/out/Debug"));
+  EXPECT_TRUE(first_fs->setCurrentWorkingDirectory("foo.h"));
+  EXPECT_EQ(*first_fs->getCurrentWorkingDirectory(), "/src/api");
+  EXPECT_EQ(*second_fs->getCurrentWorkingDirectory(), "/src/out/Debug");
+  EXPECT_TRUE(first_fs->status("foo.h"));
+  EXPECT_TRUE(second_fs->status("foo.cc"));
+  EXPECT_FALSE(second_fs->status("foo.h"));
+}
+
+TEST_F(FileSystemCacheTest, DetectsModifiedFileInFileSystem) {
+  auto fs = cache_.CreateFileSystem(counting_);
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  std::shared_ptr<const modernizer::FileSystemCache::Contents> contents =
+      cache_.FindContents("/src/api/foo.h");
+  ASSERT_TRUE(contents);
+  EXPECT_TRUE(cache_.IsUnchangedOnDisk(*contents, counting_.get()));
+
+  auto modified = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  modified->addFile("/src/api/foo.h", 0,
+                    llvm::MemoryBuffer::getMemBuffer("long foo;\n"));
+  EXPECT_FALSE(cache_.IsUnchangedOnDisk(*contents, modified.get()));
+  EXPECT_FALSE(cache_.IsUnchangedOnDisk(*contents));
+}
+
+TEST_F(FileSystemCacheTest, InvalidateForgetsPaths) {
+  auto fs = cache_.CreateFileSystem(counting_);
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  EXPECT_FALSE(fs->status("/src/api/bar.h"));
+  EXPECT_TRUE(fs->status("/src/out/Debug/foo.cc"));
+  EXPECT_EQ(counting_->status_count, 3);
+  EXPECT_EQ(counting_->open_count, 1);
+
+  cache_.Invalidate({"/src/api/foo.h", "/src/api/bar.h"});
+  EXPECT_FALSE(cache_.FindContents("/src/api/foo.h"));
+
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  EXPECT_FALSE(fs->status("/src/api/bar.h"));
+  EXPECT_TRUE(fs->status("/src/out/Debug/foo.cc"));
+  EXPECT_EQ(counting_->status_count, 5);
+  EXPECT_EQ(counting_->open_count, 2);
+}
+
+TEST_F(FileSystemCacheTest, ReportsDirectoriesOfCachedPaths) {
+  auto fs = cache_.CreateFileSystem(counting_);
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  EXPECT_FALSE(fs->status("/src/gen/missing.h"));
+  EXPECT_FALSE(fs->status("/src/out/Debug/../../api/bar.h"));
+  EXPECT_EQ(cache_.TakeNewDirectories(),
+            (std::vector<std::string>{"/src/api", "/src/gen"}));
+  EXPECT_TRUE(cache_.TakeNewDirectories().empty());
+
+  // Invalidating a directory forgets the missing files under it, and
+  // reports it again once something under it is cached again.
+  cache_.Invalidate({"/src/gen"});
+  EXPECT_FALSE(fs->status("/src/gen/missing.h"));
+  EXPECT_EQ(counting_->status_count, 4);
+  EXPECT_EQ(cache_.TakeNewDirectories(),
+            std::vector<std::string>{"/src/gen"});
+
+  cache_.Invalidate({"/src/api"});
+  EXPECT_FALSE(fs->status("/src/out/Debug/../../api/bar.h"));
+  EXPECT_EQ(counting_->status_count, 5);
+}
+
+TEST_F(FileSystemCacheTest, CachedFileSystemReadsBaseFileSystem) {
+  auto fs = modernizer::CreateCachedFileSystem(cache_, counting_);
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  ASSERT_TRUE(fs->getBufferForFile("/src/api/foo.h"));
+  EXPECT_EQ(counting_->open_count, 1);
+  EXPECT_TRUE(cache_.FindContents("/src/api/foo.h"));
+
+  // Without a base file system, files are read from disk.
+  fs = modernizer::CreateCachedFileSystem(cache_, nullptr);
+  EXPECT_FALSE(fs->status("/src/out/Debug/foo.cc"));
+}
+
+TEST(FileSystemCacheDiskTest, DetectsModifiedFile) {
+  llvm::SmallString<128> path;
+  int fd;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("modernizer", "h", fd, path));
+  {
+    llvm::raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << "class Foo {};\n";
+  }
+
+  modernizer::FileSystemCache cache;
+  auto fs = cache.CreateFileSystem(llvm::vfs::getRealFileSystem());
+  ASSERT_TRUE(fs->getBufferForFile(path));
+  std::shared_ptr<const modernizer::FileSystemCache::Contents> contents =
+      cache.FindContents(path);
+  ASSERT_TRUE(contents);
+  EXPECT_TRUE(cache.IsUnchangedOnDisk(*contents));
+
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream stream(path, ec);
+    ASSERT_FALSE(ec);
+    stream << "class Foo { int x; };\n";
+  }
+  EXPECT_FALSE(cache.IsUnchangedOnDisk(*contents));
+  llvm::sys::fs::remove(path);
+}
+
+}  // namespace
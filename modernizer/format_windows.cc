@@ -0,0 +1,395 @@
+#include "modernizer/format_windows.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "modernizer/raw_token_cache.h"
+
+namespace modernizer {
+namespace {
+
+// A declaration at namespace scope, with the whole lines it spans.
+struct Declaration {
+  // The start of the line of the first token.
+  unsigned begin;
+  unsigned first_token;
+  unsigned last_token_end;
+  // Right after the newline ending the line of the last token.
+  unsigned end;
+};
+
+class DeclarationSplitter {
+ public:
+  explicit DeclarationSplitter(llvm::StringRef code)
+      : code_(code), tokens_(LexRawTokens(code, GetCpp17LangOptions())) {}
+
+  // Returns std::nullopt if declarations at namespace scope cannot be told
+  // apart by their tokens, or share lines.
+  std::optional<std::vector<Declaration>> Split() {
+    if (!Prepare()) {
+      return std::nullopt;
+    }
+    std::vector<Declaration> declarations;
+    int namespace_depth = 0;
+    size_t directive = 0;
+    std::optional<size_t> begin;
+    for (size_t i = 0; i < code_tokens_.size();) {
+      for (; directive < directives_.size() && directives_[directive] <= i;
+           ++directive) {
+        // A directive within a declaration at namespace scope.
+        if (begin && directives_[directive] > *begin) {
+          return std::nullopt;
+        }
+      }
+      if (!begin) {
+        if (Is(i, clang::tok::r_brace)) {
+          if (namespace_depth == 0) {
+            return std::nullopt;
+          }
+          --namespace_depth;
+          namespace_closers_.push_back(Offset(i));
+          ++i;
+          continue;
+        }
+        if (Is(i, clang::tok::semi)) {
+          ++i;
+          continue;
+        }
+        if (std::optional<size_t> open = FindNamespaceBody(i)) {
+          ++namespace_depth;
+          i = *open + 1;
+          continue;
+        }
+        if (!AtStartOfLine(i)) {
+          return std::nullopt;
+        }
+        begin = i;
+      }
+      switch (Kind(i)) {
+        case clang::tok::l_paren:
+        case clang::tok::l_square:
+          i = match_[i] + 1;
+          break;
+        case clang::tok::l_brace: {
+          size_t close = match_[i];
+          // Either a body ending the declaration, as of a function or a
+          // namespace-like block, or one followed by the rest of it, as in
+          // "struct Foo {...} foo;".
+          if (close + 1 < code_tokens_.size() &&
+              (Is(close + 1, clang::tok::semi) || !AtStartOfLine(close + 1))) {
+            i = close + 1;
+            break;
+          }
+          if (!AddDeclaration(*begin, close, &declarations)) {
+            return std::nullopt;
+          }
+          begin.reset();
+          i = close + 1;
+          break;
+        }
+        case clang::tok::semi:
+          if (!AddDeclaration(*begin, i, &declarations)) {
+            return std::nullopt;
+          }
+          begin.reset();
+          ++i;
+          break;
+        case clang::tok::r_brace:
+          // Closes a namespace before the declaration ends.
+          return std::nullopt;
+        default:
+          ++i;
+          break;
+      }
+    }
+    if (begin || namespace_depth != 0) {
+      return std::nullopt;
+    }
+    return declarations;
+  }
+
+  // The offsets of the braces closing namespaces, after Split().
+  const std::vector<unsigned>& namespace_closers() const {
+    return namespace_closers_;
+  }
+
+ private:
+  // Separates the tokens of directives from the others, and matches the
+  // brackets of the others. Returns false if a conditional other than the
+  // include guard shows up, or the brackets do not balance.
+  bool Prepare() {
+    auto is_directive = [&](size_t i, llvm::StringRef name) {
+      return i + 1 < tokens_.size() && tokens_[i].kind == clang::tok::hash &&
+             tokens_[i].at_start_of_line && TokenText(i + 1) == name;
+    };
+    // "#ifndef FOO_H_" and "#define FOO_H_" opening the file.
+    bool has_include_guard =
+        tokens_.size() >= 6 && is_directive(0, "ifndef") &&
+        is_directive(3, "define") && TokenText(2) == TokenText(5) &&
+        (tokens_.size() == 6 || tokens_[6].at_start_of_line);
+    int num_open_conditionals = 0;
+    for (size_t i = 0; i < tokens_.size();) {
+      if (tokens_[i].kind != clang::tok::hash || !tokens_[i].at_start_of_line) {
+        code_tokens_.push_back(i);
+        ++i;
+        continue;
+      }
+      size_t end = i + 1;
+      while (end < tokens_.size() && !tokens_[end].at_start_of_line) {
+        ++end;
+      }
+      llvm::StringRef name = i + 1 < end ? TokenText(i + 1) : "";
+      if (name == "if" || name == "ifdef" || name == "ifndef" ||
+          name == "elif" || name == "else") {
+        if (!has_include_guard || i != 0) {
+          return false;
+        }
+        ++num_open_conditionals;
+      } else if (name == "endif") {
+        if (num_open_conditionals == 0) {
+          return false;
+        }
+        --num_open_conditionals;
+      }
+      directives_.push_back(code_tokens_.size());
+      i = end;
+    }
+
+    match_.assign(code_tokens_.size(), 0);
+    std::vector<size_t> open_brackets;
+    for (size_t i = 0; i < code_tokens_.size(); ++i) {
+      clang::tok::TokenKind kind = Kind(i);
+      if (kind == clang::tok::l_paren || kind == clang::tok::l_square ||
+          kind == clang::tok::l_brace) {
+        open_brackets.push_back(i);
+        continue;
+      }
+      clang::tok::TokenKind open_kind;
+      if (kind == clang::tok::r_paren) {
+        open_kind = clang::tok::l_paren;
+      } else if (kind == clang::tok::r_square) {
+        open_kind = clang::tok::l_square;
+      } else if (kind == clang::tok::r_brace) {
+        open_kind = clang::tok::l_brace;
+      } else {
+        continue;
+      }
+      if (open_brackets.empty() || Kind(open_brackets.back()) != open_kind) {
+        return false;
+      }
+      match_[i] = open_brackets.back();
+      match_[open_brackets.back()] = i;
+      open_brackets.pop_back();
+    }
+    return open_brackets.empty();
+  }
+
+  // Returns the brace opening the body of the namespace declared at
+  // |index|, or std::nullopt if there is none, as for namespace aliases.
+  std::optional<size_t> FindNamespaceBody(size_t index) const {
+    if (Text(index) == "inline") {
+      ++index;
+    }
+    if (Text(index) != "namespace") {
+      return std::nullopt;
+    }
+    ++index;
+    while (Is(index, clang::tok::raw_identifier) ||
+           Is(index, clang::tok::coloncolon)) {
+      ++index;
+    }
+    if (!Is(index, clang::tok::l_brace)) {
+      return std::nullopt;
+    }
+    return index;
+  }
+
+  // Adds the declaration from |first| to |last| with the lines around it.
+  // Returns false if the lines hold more than the declaration and comments.
+  bool AddDeclaration(size_t first,
+                      size_t last,
+                      std::vector<Declaration>* declarations) const {
+    Declaration declaration;
+    declaration.first_token = Offset(first);
+    size_t line_start = code_.rfind('\n', declaration.first_token);
+    declaration.begin =
+        line_start == llvm::StringRef::npos ? 0 : line_start + 1;
+    // Like the end of a block comment.
+    if (!code_.slice(declaration.begin, declaration.first_token)
+             .trim()
+             .empty()) {
+      return false;
+    }
+    declaration.last_token_end = Offset(last) + Length(last);
+    size_t line_end = code_.find('\n', declaration.last_token_end);
+    declaration.end =
+        line_end == llvm::StringRef::npos ? code_.size() : line_end + 1;
+    // Like the start of a block comment, or a brace closing a namespace.
+    if (code_.slice(declaration.last_token_end, declaration.end)
+            .contains("/*") ||
+        (last + 1 < code_tokens_.size() && !AtStartOfLine(last + 1))) {
+      return false;
+    }
+    declarations->push_back(declaration);
+    return true;
+  }
+
+  bool Is(size_t index, clang::tok::TokenKind kind) const {
+    return index < code_tokens_.size() && Kind(index) == kind;
+  }
+
+  bool AtStartOfLine(size_t index) const {
+    return tokens_[code_tokens_[index]].at_start_of_line;
+  }
+
+  clang::tok::TokenKind Kind(size_t index) const {
+    return tokens_[code_tokens_[index]].kind;
+  }
+
+  llvm::StringRef Text(size_t index) const {
+    return index < code_tokens_.size() ? TokenText(code_tokens_[index]) : "";
+  }
+
+  unsigned Offset(size_t index) const {
+    return tokens_[code_tokens_[index]].offset;
+  }
+
+  unsigned Length(size_t index) const {
+    return tokens_[code_tokens_[index]].length;
+  }
+
+  llvm::StringRef TokenText(size_t token) const {
+    return code_.substr(tokens_[token].offset, tokens_[token].length);
+  }
+
+  llvm::StringRef code_;
+  std::vector<RawToken> tokens_;
+  // Indices of the tokens outside of directives.
+  std::vector<size_t> code_tokens_;
+  // The index in |code_tokens_| of the token following each directive.
+  std::vector<size_t> directives_;
+  // For each bracket in |code_tokens_|, the index of the matching one.
+  std::vector<size_t> match_;
+  std::vector<unsigned> namespace_closers_;
+};
+
+}  // namespace
+
+std::optional<std::vector<FormatWindow>> GetFormatWindows(
+    llvm::StringRef code,
+    llvm::ArrayRef<clang::tooling::Range> ranges) {
+  if (code.contains("clang-format off")) {
+    return std::nullopt;
+  }
+  DeclarationSplitter splitter(code);
+  std::optional<std::vector<Declaration>> declarations = splitter.Split();
+  if (!declarations) {
+    return std::nullopt;
+  }
+
+  // The first declaration whose last token ends after |offset|.
+  auto find = [&](unsigned offset) {
+    return std::upper_bound(declarations->begin(), declarations->end(),
+                            offset,
+                            [](unsigned value, const Declaration& declaration) {
+                              return value < declaration.last_token_end;
+                            });
+  };
+  // Trailing comments and assignments are aligned over runs of consecutive
+  // lines, which may span several declarations. Only an empty line ends a
+  // run, so windows only start or end at one.
+  auto separated = [&](const Declaration& before, const Declaration& after) {
+    for (llvm::StringRef gap = code.slice(before.end, after.begin);
+         !gap.empty();) {
+      auto [line, rest] = gap.split('\n');
+      if (line.trim().empty()) {
+        return true;
+      }
+      gap = rest;
+    }
+    return false;
+  };
+  std::vector<FormatWindow> windows;
+  for (const clang::tooling::Range& range : ranges) {
+    unsigned begin = std::min<unsigned>(range.getOffset(), code.size());
+    unsigned end = std::min<unsigned>(begin + range.getLength(), code.size());
+    // Outside of a declaration, a range changes the whitespace before the
+    // next one. The window starts at the previous one rather than between
+    // them, where the first line would get the formatting of the first line
+    // of a file.
+    auto first = find(begin);
+    bool between = first == declarations->end() || first->first_token >= begin;
+    if (between && first == declarations->begin()) {
+      begin = 0;
+    } else {
+      if (between) {
+        --first;
+      }
+      while (first != declarations->begin() &&
+             !separated(*std::prev(first), *first)) {
+        --first;
+      }
+      begin = first->begin;
+    }
+    auto last = find(end);
+    if (last == declarations->end()) {
+      end = code.size();
+    } else {
+      while (std::next(last) != declarations->end() &&
+             !separated(*last, *std::next(last))) {
+        ++last;
+      }
+      end = last->end;
+    }
+    windows.push_back({.offset = begin, .length = end - begin});
+  }
+
+  std::sort(windows.begin(), windows.end(),
+            [](const FormatWindow& lhs, const FormatWindow& rhs) {
+              return lhs.offset < rhs.offset;
+            });
+  std::vector<FormatWindow> merged_windows;
+  for (const FormatWindow& window : windows) {
+    if (!merged_windows.empty() &&
+        window.offset <=
+            merged_windows.back().offset + merged_windows.back().length) {
+      FormatWindow& back = merged_windows.back();
+      back.length = std::max(back.offset + back.length,
+                             window.offset + window.length) -
+                    back.offset;
+      continue;
+    }
+    merged_windows.push_back(window);
+  }
+  // Only windows between declarations may hold a brace closing a namespace,
+  // which clang-format would take as closing a block of the window.
+  const std::vector<unsigned>& namespace_closers = splitter.namespace_closers();
+  for (const FormatWindow& window : merged_windows) {
+    auto closer = std::lower_bound(namespace_closers.begin(),
+                                   namespace_closers.end(), window.offset);
+    if (closer != namespace_closers.end() &&
+        *closer < window.offset + window.length) {
+      return std::nullopt;
+    }
+  }
+  return merged_windows;
+}
+
+llvm::StringRef GetIncludeLines(llvm::StringRef code) {
+  size_t end = 0;
+  for (size_t line_start = 0; line_start < code.size();) {
+    size_t line_end = code.find('\n', line_start);
+    line_end = line_end == llvm::StringRef::npos ? code.size() : line_end + 1;
+    llvm::StringRef line = code.slice(line_start, line_end).ltrim(" \t");
+    if (line.consume_front("#")) {
+      line = line.ltrim(" \t");
+      if (line.startswith("include") || line.startswith("import")) {
+        end = line_end;
+      }
+    }
+    line_start = line_end;
+  }
+  return code.take_front(end);
+}
+
+}  // namespace modernizer
@@ -0,0 +1,38 @@
+#ifndef MODERNIZER_FORMAT_WINDOWS_H_
+#define MODERNIZER_FORMAT_WINDOWS_H_
+
+#include <optional>
+#include <vector>
+
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace modernizer {
+
+// Whole lines of a file that clang-format can format on their own, with the
+// same result as within the file.
+struct FormatWindow {
+  unsigned offset;
+  unsigned length;
+};
+
+// Returns the windows to format instead of the whole |code| for the lines
+// touched by |ranges|. Each range widens to the declarations at namespace
+// scope around it and to those not separated from them by an empty line,
+// whose trailing comments or assignments may be aligned with theirs, and to
+// the start of the file when it is in the include block. Namespace bodies
+// are taken as not indented. Returns std::nullopt if the whole file must be
+// formatted, as with conditional directives other than the include guard, or
+// formatting turned off somewhere.
+std::optional<std::vector<FormatWindow>> GetFormatWindows(
+    llvm::StringRef code,
+    llvm::ArrayRef<clang::tooling::Range> ranges);
+
+// Returns |code| up to the end of the line of its last include directive,
+// which holds every include block clang-format sorts.
+llvm::StringRef GetIncludeLines(llvm::StringRef code);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_FORMAT_WINDOWS_H_
@@ -0,0 +1,176 @@
+#include "modernizer/format_windows.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+using clang::tooling::Range;
+using modernizer::FormatWindow;
+using modernizer::GetFormatWindows;
+using modernizer::GetIncludeLines;
+
+constexpr char kHeader[] =
+    "#ifndef FOO_H_\n"
+    "#define FOO_H_\n"
+    "\n"
+    "#include <string>\n"
+    "\n"
+    "\n"
+    "namespace foo {\n"
+    "\n"
+    "// Comment.\n"
+    "class Foo {\n"
+    " public:\n"
+    "  Foo();\n"
+    "  ~Foo();\n"
+    "\n"
+    "};\n"
+    "\n"
+    "void Bar();\n"
+    "\n"
+    "template <class T>\n"
+    "class Baz {\n"
+    " public:\n"
+    "  Baz() {}\n"
+    "};\n"
+    "\n"
+    "}  // namespace foo\n"
+    "\n"
+    "#endif  // FOO_H_\n";
+
+std::string GetText(const std::string& code, const FormatWindow& window) {
+  return code.substr(window.offset, window.length);
+}
+
+TEST(FormatWindowsTest, WidensRangesToDeclarations) {
+  std::string code = kHeader;
+  std::optional<std::vector<FormatWindow>> windows =
+      GetFormatWindows(code, {Range(code.find("  ~Foo();") + 9, 1),
+                              Range(code.find("  Baz() {}"), 2)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 2u);
+  EXPECT_EQ(GetText(code, (*windows)[0]),
+            "class Foo {\n public:\n  Foo();\n  ~Foo();\n\n};\n");
+  EXPECT_EQ(GetText(code, (*windows)[1]),
+            "template <class T>\nclass Baz {\n public:\n  Baz() {}\n};\n");
+}
+
+TEST(FormatWindowsTest, IncludeBlockStartsAtTopOfFile) {
+  std::string code = kHeader;
+  unsigned include_end = code.find("#include <string>\n") + 18;
+  std::optional<std::vector<FormatWindow>> windows =
+      GetFormatWindows(code, {Range(include_end, 0)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 1u);
+  EXPECT_EQ((*windows)[0].offset, 0u);
+  EXPECT_EQ((*windows)[0].length, code.find("\nvoid Bar();"));
+
+  // Windows that overlap are merged.
+  windows = GetFormatWindows(
+      code, {Range(include_end, 0), Range(code.find("\nvoid Bar();"), 1)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 1u);
+  EXPECT_EQ(GetText(code, (*windows)[0]),
+            code.substr(0, code.find("\ntemplate")));
+}
+
+TEST(FormatWindowsTest, RangeBetweenDeclarationsStartsAtPreviousOne) {
+  std::string code = kHeader;
+  std::optional<std::vector<FormatWindow>> windows =
+      GetFormatWindows(code, {Range(code.find("\ntemplate"), 1)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 1u);
+  EXPECT_EQ(GetText(code, (*windows)[0]),
+            "void Bar();\n\ntemplate <class T>\nclass Baz {\n public:\n"
+            "  Baz() {}\n};\n");
+}
+
+TEST(FormatWindowsTest, KeepsAlignedLinesTogether) {
+  std::string code =
+      "namespace foo {\n"
+      "\n"
+      "int a;   // A.\n"
+      "int bb;  // B.\n"
+      "class Foo {\n"
+      "  Foo();\n"
+      "};  // Foo.\n"
+      "\n"
+      "int c = 1;\n"
+      "int dd = 2;\n"
+      "\n"
+      "void Bar();\n"
+      "\n"
+      "}  // namespace foo\n";
+  // The trailing comments of "int a;", "int bb;" and "};" are aligned
+  // together, so they are formatted together.
+  std::optional<std::vector<FormatWindow>> windows =
+      GetFormatWindows(code, {Range(code.find("  Foo();"), 2)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 1u);
+  EXPECT_EQ(GetText(code, (*windows)[0]),
+            "int a;   // A.\nint bb;  // B.\nclass Foo {\n  Foo();\n"
+            "};  // Foo.\n");
+
+  // So are the assignments of "c" and "dd", but not the declaration after
+  // the empty line.
+  windows = GetFormatWindows(code, {Range(code.find("c = 1"), 1)});
+  ASSERT_TRUE(windows);
+  ASSERT_EQ(windows->size(), 1u);
+  EXPECT_EQ(GetText(code, (*windows)[0]), "int c = 1;\nint dd = 2;\n");
+}
+
+TEST(FormatWindowsTest, FormatsWholeFile) {
+  const char* texts[] = {
+      // A conditional other than the include guard.
+      "#if defined(BAR)\n"
+      "class Foo {\n"
+      "  Foo();\n"
+      "};\n"
+      "#endif\n",
+      // Formatting turned off.
+      "// clang-format off\n"
+      "class Foo {\n"
+      "  Foo();\n"
+      "};\n",
+      // Declarations sharing a line.
+      "class Foo {\n"
+      "  Foo();\n"
+      "}; class Bar {\n"
+      "  Bar();\n"
+      "};\n",
+      // A declaration ending a namespace on its line.
+      "namespace foo {\n"
+      "class Foo {\n"
+      "  Foo();\n"
+      "}; }\n",
+      // Unbalanced braces.
+      "class Foo {\n"
+      "  Foo();\n",
+  };
+  for (const char* text : texts) {
+    unsigned offset = std::string(text).find("Foo();");
+    EXPECT_FALSE(GetFormatWindows(text, {Range(offset, 0)})) << text;
+  }
+
+  // The range is between the declarations of two namespaces.
+  EXPECT_FALSE(GetFormatWindows(
+      "namespace foo {\n"
+      "class Foo {};\n"
+      "}  // namespace foo\n"
+      "namespace bar {\n"
+      "class Bar {};\n"
+      "}  // namespace bar\n",
+      {Range(47, 0)}));
+}
+
+TEST(FormatWindowsTest, GetIncludeLines) {
+  EXPECT_EQ(GetIncludeLines(kHeader),
+            "#ifndef FOO_H_\n#define FOO_H_\n\n#include <string>\n");
+  EXPECT_EQ(GetIncludeLines("# include \"foo.h\"\n#import <bar.h>\nint x;\n"),
+            "# include \"foo.h\"\n#import <bar.h>\n");
+  EXPECT_EQ(GetIncludeLines("int x;\n"), "");
+}
+
+}  // namespace
@@ -0,0 +1,108 @@
+#include "modernizer/git.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+
+namespace modernizer {
+
+namespace {
+
+// Runs git in |directory| and returns its standard output.
+llvm::Expected<std::string> RunGit(const std::filesystem::path& directory,
+                                   llvm::ArrayRef<llvm::StringRef> arguments) {
+  llvm::ErrorOr<std::string> git = llvm::sys::findProgramByName("git");
+  if (!git) {
+    return llvm::createStringError(git.getError(), "Cannot find git");
+  }
+  llvm::SmallString<128> output_path;
+  if (std::error_code ec = llvm::sys::fs::createTemporaryFile(
+          "modernizer-git", "txt", output_path)) {
+    return llvm::createStringError(ec, "Cannot create a temporary file");
+  }
+  llvm::FileRemover output_remover(output_path);
+
+  std::string directory_str = directory.string();
+  std::vector<llvm::StringRef> argv = {"git", "-C", directory_str};
+  argv.insert(argv.end(), arguments.begin(), arguments.end());
+  llvm::Optional<llvm::StringRef> redirects[] = {
+      llvm::StringRef(""), llvm::StringRef(output_path), llvm::None};
+  std::string error_message;
+  int result = llvm::sys::ExecuteAndWait(*git, argv, llvm::None, redirects,
+                                         /*SecondsToWait=*/0,
+                                         /*MemoryLimit=*/0, &error_message);
+  if (result) {
+    std::string command = llvm::join(argv, " ");
+    return llvm::createStringError(
+        llvm::inconvertibleErrorCode(), "%s failed%s%s", command.c_str(),
+        error_message.empty() ? "" : ": ", error_message.c_str());
+  }
+
+  auto buffer = llvm::MemoryBuffer::getFile(output_path, /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return llvm::createStringError(buffer.getError(),
+                                   "Cannot read the output of git");
+  }
+  return (*buffer)->getBuffer().str();
+}
+
+}  // namespace
+
+llvm::Expected<std::vector<std::filesystem::path>> GetChangedFiles(
+    const std::filesystem::path& directory,
+    const std::string& revision) {
+  // git would parse such a revision as an option, like --output=<path>.
+  if (revision.empty() || revision[0] == '-') {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "Bad revision: %s", revision.c_str());
+  }
+  auto top_level = RunGit(directory, {"rev-parse", "--show-toplevel"});
+  if (!top_level) {
+    return top_level.takeError();
+  }
+  std::filesystem::path work_tree(llvm::StringRef(*top_level).rtrim().str());
+
+  // "--" keeps a revision that is also a file name from being taken as one.
+  auto changed = RunGit(work_tree, {"diff", "--name-only", "--no-renames",
+                                    "-z", revision, "--"});
+  if (!changed) {
+    return changed.takeError();
+  }
+  auto untracked = RunGit(
+      work_tree, {"ls-files", "--others", "--exclude-standard", "--full-name",
+                  "-z"});
+  if (!untracked) {
+    return untracked.takeError();
+  }
+
+  std::vector<std::filesystem::path> paths;
+  for (const std::string* output : {&*changed, &*untracked}) {
+    for (const std::string& path : SplitNulSeparated(*output)) {
+      paths.push_back(work_tree / path);
+    }
+  }
+  return paths;
+}
+
+std::vector<std::string> SplitNulSeparated(std::string_view output) {
+  std::vector<std::string> result;
+  while (!output.empty()) {
+    size_t end = output.find('\0');
+    if (end == std::string_view::npos) {
+      end = output.size();
+    }
+    if (end) {
+      result.emplace_back(output.substr(0, end));
+    }
+    output.remove_prefix(std::min(end + 1, output.size()));
+  }
+  return result;
+}
+
+}  // namespace modernizer
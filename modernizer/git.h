@@ -0,0 +1,26 @@
+#ifndef MODERNIZER_GIT_H_
+#define MODERNIZER_GIT_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+
+namespace modernizer {
+
+// Returns the absolute paths of the files in the work tree containing
+// |directory| that differ from |revision|, whether committed, staged or not,
+// including deleted files and untracked files that are not ignored.
+// |revision| must not start with '-'.
+llvm::Expected<std::vector<std::filesystem::path>> GetChangedFiles(
+    const std::filesystem::path& directory,
+    const std::string& revision);
+
+// Splits the output of a git command run with -z. Exposed for testing.
+std::vector<std::string> SplitNulSeparated(std::string_view output);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_GIT_H_
@@ -0,0 +1,40 @@
+#include "modernizer/git.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+namespace {
+
+TEST(GitTest, SplitNulSeparated) {
+  using namespace std::string_view_literals;
+  EXPECT_THAT(modernizer::SplitNulSeparated(""), IsEmpty());
+  EXPECT_THAT(modernizer::SplitNulSeparated("a.h\0b c.cc\0"sv),
+              ElementsAre("a.h", "b c.cc"));
+  EXPECT_THAT(modernizer::SplitNulSeparated("a.h\0\0b.h"sv),
+              ElementsAre("a.h", "b.h"));
+}
+
+TEST(GitTest, GetChangedFilesFailsOutsideWorkTree) {
+  llvm::SmallString<128> directory;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("modernizer", directory));
+  auto changed_files =
+      modernizer::GetChangedFiles(std::string(directory), "HEAD");
+  EXPECT_FALSE(changed_files);
+  llvm::consumeError(changed_files.takeError());
+  llvm::sys::fs::remove_directories(directory);
+}
+
+TEST(GitTest, GetChangedFilesRejectsOptions) {
+  auto changed_files =
+      modernizer::GetChangedFiles(".", "--output=/tmp/modernizer-git-output");
+  EXPECT_FALSE(changed_files);
+  llvm::consumeError(changed_files.takeError());
+  EXPECT_FALSE(llvm::sys::fs::exists("/tmp/modernizer-git-output"));
+}
+
+}  // namespace
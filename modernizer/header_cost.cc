@@ -0,0 +1,281 @@
+#include "modernizer/header_cost.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+namespace modernizer {
+
+namespace {
+
+void AddCost(const HeaderCost& cost, HeaderCost* total) {
+  total->total_microseconds += cost.total_microseconds;
+  total->self_microseconds += cost.self_microseconds;
+  total->inclusions += cost.inclusions;
+  total->translation_units += cost.inclusions ? 1 : 0;
+}
+
+bool IsMoreExpensive(const HeaderCostTable::Entry& a,
+                     const HeaderCostTable::Entry& b) {
+  if (a.cost.total_microseconds != b.cost.total_microseconds) {
+    return a.cost.total_microseconds > b.cost.total_microseconds;
+  }
+  return a.chain < b.chain;
+}
+
+void WriteCost(const HeaderCost& cost, llvm::json::OStream& json) {
+  json.attribute("total_microseconds", cost.total_microseconds);
+  json.attribute("self_microseconds", cost.self_microseconds);
+  json.attribute("inclusions", static_cast<int64_t>(cost.inclusions));
+  json.attribute("translation_units",
+                 static_cast<int64_t>(cost.translation_units));
+}
+
+void PrintRow(const HeaderCost& cost,
+              int64_t total_microseconds,
+              const std::string& name,
+              llvm::raw_ostream& out) {
+  double percent = total_microseconds
+                       ? 100.0 * cost.total_microseconds / total_microseconds
+                       : 0;
+  out << llvm::format("%12.3f %12.3f %6.1f%% %10zu %8zu  ",
+                      cost.total_microseconds / 1e6,
+                      cost.self_microseconds / 1e6, percent, cost.inclusions,
+                      cost.translation_units)
+      << name << "\n";
+}
+
+}  // namespace
+
+int64_t GetThreadCpuMicroseconds() {
+  timespec time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+    return 0;
+  }
+  return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
+
+HeaderCostRecorder::HeaderCostRecorder() : chain_nodes_(1) {}
+
+void HeaderCostRecorder::EnterFile(llvm::StringRef path,
+                                   int64_t microseconds) {
+  uint32_t path_id = GetPathId(path);
+  if (open_files_.empty()) {
+    open_files_.push_back(OpenFile{.path_id = path_id,
+                                   .chain_node = 0,
+                                   .start_microseconds = microseconds});
+    return;
+  }
+  uint32_t parent = open_files_.back().chain_node;
+  auto [iter, inserted] =
+      chain_children_.try_emplace({parent, path_id}, chain_nodes_.size());
+  if (inserted) {
+    chain_nodes_.push_back(ChainNode{.parent = parent, .path_id = path_id});
+  }
+  ++chain_nodes_[iter->second].cost.inclusions;
+  ++headers_[path_id].inclusions;
+  ++open_counts_[path_id];
+  open_files_.push_back(OpenFile{.path_id = path_id,
+                                 .chain_node = iter->second,
+                                 .start_microseconds = microseconds});
+}
+
+void HeaderCostRecorder::ExitFile(int64_t microseconds) {
+  if (open_files_.empty()) {
+    return;
+  }
+  OpenFile file = open_files_.back();
+  open_files_.pop_back();
+  int64_t elapsed = microseconds - file.start_microseconds;
+  if (open_files_.empty()) {
+    total_microseconds_ += elapsed;
+    return;
+  }
+  open_files_.back().child_microseconds += elapsed;
+  int64_t self = elapsed - file.child_microseconds;
+  HeaderCost& header = headers_[file.path_id];
+  header.self_microseconds += self;
+  if (--open_counts_[file.path_id] == 0) {
+    header.total_microseconds += elapsed;
+  }
+  HeaderCost& chain = chain_nodes_[file.chain_node].cost;
+  chain.total_microseconds += elapsed;
+  chain.self_microseconds += self;
+}
+
+void HeaderCostRecorder::ExitAllFiles(int64_t microseconds) {
+  while (!open_files_.empty()) {
+    ExitFile(microseconds);
+  }
+}
+
+uint32_t HeaderCostRecorder::GetPathId(llvm::StringRef path) {
+  auto [iter, inserted] = path_ids_.try_emplace(path, paths_.size());
+  if (inserted) {
+    paths_.push_back(path.str());
+    headers_.emplace_back();
+    open_counts_.push_back(0);
+  }
+  return iter->second;
+}
+
+HeaderCostTable::HeaderCostTable() : chain_nodes_(1) {}
+
+void HeaderCostTable::AddTranslationUnit(const HeaderCostRecorder& recorder) {
+  absl::MutexLock lock(&mutex_);
+  ++num_translation_units_;
+  total_microseconds_ += recorder.total_microseconds_;
+  std::vector<uint32_t> path_ids;
+  path_ids.reserve(recorder.paths_.size());
+  for (size_t i = 0; i < recorder.paths_.size(); ++i) {
+    path_ids.push_back(GetPathId(recorder.paths_[i]));
+    AddCost(recorder.headers_[i], &headers_[path_ids.back()]);
+  }
+  // A node is added after its parent, so parents are mapped first.
+  std::vector<uint32_t> chain_nodes(recorder.chain_nodes_.size(), 0);
+  for (size_t i = 1; i < recorder.chain_nodes_.size(); ++i) {
+    const HeaderCostRecorder::ChainNode& node = recorder.chain_nodes_[i];
+    uint32_t parent = chain_nodes[node.parent];
+    uint32_t path_id = path_ids[node.path_id];
+    auto [iter, inserted] =
+        chain_children_.try_emplace({parent, path_id}, chain_nodes_.size());
+    if (inserted) {
+      chain_nodes_.push_back(HeaderCostRecorder::ChainNode{
+          .parent = parent, .path_id = path_id});
+    }
+    chain_nodes[i] = iter->second;
+    AddCost(node.cost, &chain_nodes_[iter->second].cost);
+  }
+}
+
+std::vector<HeaderCostTable::Entry> HeaderCostTable::GetHeaders() const {
+  absl::MutexLock lock(&mutex_);
+  std::vector<Entry> entries;
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    if (headers_[i].inclusions) {
+      entries.push_back(Entry{.chain = {paths_[i]}, .cost = headers_[i]});
+    }
+  }
+  std::sort(entries.begin(), entries.end(), IsMoreExpensive);
+  return entries;
+}
+
+std::vector<HeaderCostTable::Entry> HeaderCostTable::GetIncludeChains(
+    size_t max_chains) const {
+  absl::MutexLock lock(&mutex_);
+  std::vector<uint32_t> nodes(chain_nodes_.size() - 1);
+  std::iota(nodes.begin(), nodes.end(), 1);
+  auto middle = nodes.begin() + std::min(max_chains, nodes.size());
+  std::partial_sort(
+      nodes.begin(), middle, nodes.end(), [&](uint32_t a, uint32_t b) {
+        const HeaderCost& a_cost = chain_nodes_[a].cost;
+        const HeaderCost& b_cost = chain_nodes_[b].cost;
+        if (a_cost.total_microseconds != b_cost.total_microseconds) {
+          return a_cost.total_microseconds > b_cost.total_microseconds;
+        }
+        return a < b;
+      });
+  std::vector<Entry> entries;
+  for (auto iter = nodes.begin(); iter != middle; ++iter) {
+    Entry& entry = entries.emplace_back();
+    entry.cost = chain_nodes_[*iter].cost;
+    for (uint32_t node = *iter; node; node = chain_nodes_[node].parent) {
+      entry.chain.push_back(paths_[chain_nodes_[node].path_id]);
+    }
+    std::reverse(entry.chain.begin(), entry.chain.end());
+  }
+  return entries;
+}
+
+size_t HeaderCostTable::GetNumTranslationUnits() const {
+  absl::MutexLock lock(&mutex_);
+  return num_translation_units_;
+}
+
+int64_t HeaderCostTable::GetTotalMicroseconds() const {
+  absl::MutexLock lock(&mutex_);
+  return total_microseconds_;
+}
+
+uint32_t HeaderCostTable::GetPathId(const std::string& path) {
+  auto [iter, inserted] = path_ids_.try_emplace(path, paths_.size());
+  if (inserted) {
+    paths_.push_back(path);
+    headers_.emplace_back();
+  }
+  return iter->second;
+}
+
+void PrintHeaderCosts(const HeaderCostTable& table,
+                      size_t max_rows,
+                      llvm::raw_ostream& out) {
+  int64_t total_microseconds = table.GetTotalMicroseconds();
+  out << "Header costs over " << table.GetNumTranslationUnits()
+      << " translation units, "
+      << llvm::format("%.3f", total_microseconds / 1e6)
+      << " s of CPU time in total:\n";
+  auto print_columns = [&](const char* name) {
+    const char* columns[] = {"total s", "self s", "total", "inclusions",
+                             "units"};
+    out << llvm::format("%12s %12s %7s %10s %8s  ", columns[0], columns[1],
+                        columns[2], columns[3], columns[4])
+        << name << "\n";
+  };
+  print_columns("header");
+  std::vector<HeaderCostTable::Entry> headers = table.GetHeaders();
+  for (size_t i = 0; i < std::min(max_rows, headers.size()); ++i) {
+    PrintRow(headers[i].cost, total_microseconds, headers[i].chain.front(),
+             out);
+  }
+  print_columns("include chain");
+  for (const HeaderCostTable::Entry& entry :
+       table.GetIncludeChains(max_rows)) {
+    std::string chain;
+    for (const std::string& path : entry.chain) {
+      if (!chain.empty()) {
+        chain += " > ";
+      }
+      chain += path;
+    }
+    PrintRow(entry.cost, total_microseconds, chain, out);
+  }
+}
+
+void WriteHeaderCostJson(const HeaderCostTable& table,
+                         size_t max_chains,
+                         llvm::raw_ostream& out) {
+  llvm::json::OStream json(out, /*IndentSize=*/2);
+  json.object([&] {
+    json.attribute("translation_units",
+                   static_cast<int64_t>(table.GetNumTranslationUnits()));
+    json.attribute("total_microseconds", table.GetTotalMicroseconds());
+    json.attributeArray("headers", [&] {
+      for (const HeaderCostTable::Entry& entry : table.GetHeaders()) {
+        json.object([&] {
+          json.attribute("path", entry.chain.front());
+          WriteCost(entry.cost, json);
+        });
+      }
+    });
+    json.attributeArray("include_chains", [&] {
+      for (const HeaderCostTable::Entry& entry :
+           table.GetIncludeChains(max_chains)) {
+        json.object([&] {
+          json.attributeArray("chain", [&] {
+            for (const std::string& path : entry.chain) {
+              json.value(path);
+            }
+          });
+          WriteCost(entry.cost, json);
+        });
+      }
+    });
+  });
+  out << "\n";
+}
+
+}  // namespace modernizer
@@ -0,0 +1,139 @@
+#ifndef MODERNIZER_HEADER_COST_H_
+#define MODERNIZER_HEADER_COST_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace modernizer {
+
+struct HeaderCost {
+  // Time between entering the header and leaving it, including the headers
+  // it includes. A header entered again while it is open, without include
+  // guards, is only counted once.
+  int64_t total_microseconds = 0;
+  // |total_microseconds| without the headers it includes.
+  int64_t self_microseconds = 0;
+  size_t inclusions = 0;
+  size_t translation_units = 0;
+};
+
+// Returns the CPU time of the calling thread.
+int64_t GetThreadCpuMicroseconds();
+
+// Times the files of one translation unit as the preprocessor enters and
+// leaves them. The parser pulls tokens from the preprocessor as it goes, so
+// the time spent in a header includes parsing its declarations. Work left
+// for the end of the translation unit, like most template instantiations,
+// is not attributed to any header. The first file entered is the main file,
+// which is not reported as a header. Several parses of the translation unit,
+// one per compile command, may be recorded one after another.
+class HeaderCostRecorder {
+ public:
+  HeaderCostRecorder();
+  ~HeaderCostRecorder() = default;
+
+  HeaderCostRecorder(const HeaderCostRecorder&) = delete;
+  HeaderCostRecorder& operator=(const HeaderCostRecorder&) = delete;
+
+  // Enters |path|, included by the file entered last.
+  void EnterFile(llvm::StringRef path, int64_t microseconds);
+  // Leaves the file entered last. Leaving the main file ends the parse.
+  void ExitFile(int64_t microseconds);
+  // Leaves every file still entered, if the parse stopped early.
+  void ExitAllFiles(int64_t microseconds);
+
+ private:
+  friend class HeaderCostTable;
+
+  // A node of the tree of include chains. The root stands for the main file.
+  struct ChainNode {
+    uint32_t parent = 0;
+    uint32_t path_id = 0;
+    HeaderCost cost = {};
+  };
+
+  struct OpenFile {
+    uint32_t path_id;
+    uint32_t chain_node;
+    int64_t start_microseconds;
+    int64_t child_microseconds = 0;
+  };
+
+  uint32_t GetPathId(llvm::StringRef path);
+
+  std::vector<std::string> paths_;
+  llvm::StringMap<uint32_t> path_ids_;
+  // Indexed by path id.
+  std::vector<HeaderCost> headers_;
+  std::vector<int> open_counts_;
+  std::vector<ChainNode> chain_nodes_;
+  // The child of a chain node including a path, keyed by both.
+  llvm::DenseMap<std::pair<uint32_t, uint32_t>, uint32_t> chain_children_;
+  std::vector<OpenFile> open_files_;
+  int64_t total_microseconds_ = 0;
+};
+
+// The costs of every header over the translation units of a run.
+class HeaderCostTable {
+ public:
+  struct Entry {
+    // A header, or the chain of headers from one included by a main file to
+    // the header whose cost it is.
+    std::vector<std::string> chain;
+    HeaderCost cost;
+  };
+
+  HeaderCostTable();
+  ~HeaderCostTable() = default;
+
+  HeaderCostTable(const HeaderCostTable&) = delete;
+  HeaderCostTable& operator=(const HeaderCostTable&) = delete;
+
+  // Thread-safe.
+  void AddTranslationUnit(const HeaderCostRecorder& recorder);
+
+  // Sorted by total time, the largest first.
+  std::vector<Entry> GetHeaders() const;
+  // The |max_chains| most expensive include chains, sorted by total time.
+  std::vector<Entry> GetIncludeChains(size_t max_chains) const;
+
+  size_t GetNumTranslationUnits() const;
+  // The time spent in the main files and everything they include.
+  int64_t GetTotalMicroseconds() const;
+
+ private:
+  uint32_t GetPathId(const std::string& path) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  std::vector<std::string> paths_ GUARDED_BY(mutex_);
+  llvm::StringMap<uint32_t> path_ids_ GUARDED_BY(mutex_);
+  std::vector<HeaderCost> headers_ GUARDED_BY(mutex_);
+  std::vector<HeaderCostRecorder::ChainNode> chain_nodes_ GUARDED_BY(mutex_);
+  llvm::DenseMap<std::pair<uint32_t, uint32_t>, uint32_t> chain_children_
+      GUARDED_BY(mutex_);
+  size_t num_translation_units_ GUARDED_BY(mutex_) = 0;
+  int64_t total_microseconds_ GUARDED_BY(mutex_) = 0;
+};
+
+// Prints the |max_rows| most expensive headers and include chains.
+void PrintHeaderCosts(const HeaderCostTable& table,
+                      size_t max_rows,
+                      llvm::raw_ostream& out);
+
+// Writes every header and the |max_chains| most expensive include chains.
+void WriteHeaderCostJson(const HeaderCostTable& table,
+                         size_t max_chains,
+                         llvm::raw_ostream& out);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_HEADER_COST_H_
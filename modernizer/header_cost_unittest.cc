@@ -0,0 +1,120 @@
+#include "modernizer/header_cost.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using modernizer::HeaderCostRecorder;
+using modernizer::HeaderCostTable;
+
+TEST(HeaderCostTest, SplitsTotalAndSelfTime) {
+  HeaderCostRecorder recorder;
+  recorder.EnterFile("a.cc", 0);
+  recorder.EnterFile("a.h", 10);
+  recorder.EnterFile("common.h", 15);
+  recorder.ExitFile(45);
+  recorder.ExitFile(50);
+  recorder.EnterFile("common.h", 60);
+  recorder.ExitFile(65);
+  recorder.ExitFile(100);
+
+  HeaderCostTable table;
+  table.AddTranslationUnit(recorder);
+  EXPECT_EQ(table.GetNumTranslationUnits(), 1u);
+  EXPECT_EQ(table.GetTotalMicroseconds(), 100);
+
+  std::vector<HeaderCostTable::Entry> headers = table.GetHeaders();
+  ASSERT_EQ(headers.size(), 2u);
+  EXPECT_EQ(headers[0].chain, std::vector<std::string>{"a.h"});
+  EXPECT_EQ(headers[0].cost.total_microseconds, 40);
+  EXPECT_EQ(headers[0].cost.self_microseconds, 10);
+  EXPECT_EQ(headers[0].cost.inclusions, 1u);
+  EXPECT_EQ(headers[0].cost.translation_units, 1u);
+  EXPECT_EQ(headers[1].chain, std::vector<std::string>{"common.h"});
+  EXPECT_EQ(headers[1].cost.total_microseconds, 35);
+  EXPECT_EQ(headers[1].cost.self_microseconds, 35);
+  EXPECT_EQ(headers[1].cost.inclusions, 2u);
+
+  std::vector<HeaderCostTable::Entry> chains = table.GetIncludeChains(2);
+  ASSERT_EQ(chains.size(), 2u);
+  EXPECT_EQ(chains[0].chain, std::vector<std::string>{"a.h"});
+  EXPECT_EQ(chains[0].cost.total_microseconds, 40);
+  EXPECT_EQ(chains[1].chain, (std::vector<std::string>{"a.h", "common.h"}));
+  EXPECT_EQ(chains[1].cost.total_microseconds, 30);
+}
+
+TEST(HeaderCostTest, AggregatesTranslationUnits) {
+  HeaderCostTable table;
+  for (const char* main_file : {"a.cc", "b.cc"}) {
+    HeaderCostRecorder recorder;
+    recorder.EnterFile(main_file, 0);
+    recorder.EnterFile("common.h", 0);
+    recorder.ExitFile(20);
+    recorder.ExitFile(30);
+    table.AddTranslationUnit(recorder);
+  }
+
+  std::vector<HeaderCostTable::Entry> headers = table.GetHeaders();
+  ASSERT_EQ(headers.size(), 1u);
+  EXPECT_EQ(headers[0].cost.total_microseconds, 40);
+  EXPECT_EQ(headers[0].cost.inclusions, 2u);
+  EXPECT_EQ(headers[0].cost.translation_units, 2u);
+  std::vector<HeaderCostTable::Entry> chains = table.GetIncludeChains(10);
+  ASSERT_EQ(chains.size(), 1u);
+  EXPECT_EQ(chains[0].cost.translation_units, 2u);
+  EXPECT_EQ(table.GetTotalMicroseconds(), 60);
+}
+
+TEST(HeaderCostTest, CountsReentrantHeaderOnce) {
+  // A header without include guards including itself.
+  HeaderCostRecorder recorder;
+  recorder.EnterFile("a.cc", 0);
+  recorder.EnterFile("x.h", 0);
+  recorder.EnterFile("x.h", 5);
+  recorder.ExitFile(10);
+  recorder.ExitAllFiles(20);
+
+  HeaderCostTable table;
+  table.AddTranslationUnit(recorder);
+  std::vector<HeaderCostTable::Entry> headers = table.GetHeaders();
+  ASSERT_EQ(headers.size(), 1u);
+  EXPECT_EQ(headers[0].cost.total_microseconds, 20);
+  EXPECT_EQ(headers[0].cost.self_microseconds, 20);
+  EXPECT_EQ(headers[0].cost.inclusions, 2u);
+  EXPECT_EQ(table.GetTotalMicroseconds(), 20);
+}
+
+TEST(HeaderCostTest, WritesJson) {
+  HeaderCostRecorder recorder;
+  recorder.EnterFile("a.cc", 0);
+  recorder.EnterFile("a.h", 0);
+  recorder.ExitAllFiles(7);
+  HeaderCostTable table;
+  table.AddTranslationUnit(recorder);
+
+  std::string json;
+  llvm::raw_string_ostream stream(json);
+  modernizer::WriteHeaderCostJson(table, 10, stream);
+  stream.flush();
+  llvm::Expected<llvm::json::Value> value = llvm::json::parse(json);
+  ASSERT_TRUE(static_cast<bool>(value)) << llvm::toString(value.takeError());
+  const llvm::json::Object* object = value->getAsObject();
+  ASSERT_TRUE(object);
+  EXPECT_EQ(object->getInteger("translation_units"), int64_t{1});
+  const llvm::json::Array* headers = object->getArray("headers");
+  ASSERT_TRUE(headers);
+  ASSERT_EQ(headers->size(), 1u);
+  const llvm::json::Object* header = (*headers)[0].getAsObject();
+  EXPECT_EQ(header->getString("path"), llvm::StringRef("a.h"));
+  EXPECT_EQ(header->getInteger("total_microseconds"), int64_t{7});
+  const llvm::json::Array* chains = object->getArray("include_chains");
+  ASSERT_TRUE(chains);
+  EXPECT_EQ(chains->size(), 1u);
+}
+
+}  // namespace
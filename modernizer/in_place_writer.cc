@@ -0,0 +1,191 @@
+#include "modernizer/in_place_writer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#include <string_view>
+
+#include "absl/synchronization/mutex.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "modernizer/posix_io.h"
+
+namespace modernizer {
+
+namespace {
+
+enum class WriteResult {
+  kWritten,
+  kUnchanged,
+  kFailed,
+};
+
+std::error_code GetErrno() {
+  return std::error_code(errno, std::generic_category());
+}
+
+// Flushes the entries of |directory| to disk, so that a rename into it
+// survives a crash of the machine.
+std::error_code SyncDirectory(const std::string& directory) {
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return GetErrno();
+  }
+  std::error_code ec;
+  if (::fsync(fd) != 0) {
+    ec = GetErrno();
+  }
+  ::close(fd);
+  return ec;
+}
+
+WriteResult WriteFileInPlace(const InPlaceWrite& write, bool skip_unchanged) {
+  if (skip_unchanged) {
+    auto buffer = llvm::MemoryBuffer::getFile(write.path);
+    if (buffer && (*buffer)->getBuffer() == write.contents) {
+      return WriteResult::kUnchanged;
+    }
+  }
+
+  llvm::ErrorOr<llvm::sys::fs::perms> permissions =
+      llvm::sys::fs::getPermissions(write.path);
+  if (!permissions) {
+    llvm::errs() << "getPermissions failed for " << write.path << ": "
+                 << permissions.getError().message() << "\n";
+    return WriteResult::kFailed;
+  }
+
+  int fd;
+  llvm::SmallString<256> temp_path;
+  std::error_code ec = llvm::sys::fs::createUniqueFile(
+      write.path + "-%%%%%%%%.tmp", fd, temp_path);
+  if (ec) {
+    llvm::errs() << "Creating a temporary file for " << write.path
+                 << " failed: " << ec.message() << "\n";
+    return WriteResult::kFailed;
+  }
+
+  // Synced before the rename, so that the new name never points to contents
+  // still in the page cache only.
+  if (!WriteAll(fd, std::string_view(write.contents.data(),
+                                      write.contents.size())) ||
+      ::fsync(fd) != 0) {
+    ec = GetErrno();
+  }
+  std::error_code close_ec =
+      llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  if (!ec) {
+    ec = close_ec;
+  }
+  if (!ec) {
+    ec = llvm::sys::fs::setPermissions(temp_path, *permissions);
+  }
+  if (!ec) {
+    ec = llvm::sys::fs::rename(temp_path, write.path);
+  }
+  if (ec) {
+    llvm::errs() << "write to file failed for " << write.path << ": "
+                 << ec.message() << "\n";
+    llvm::sys::fs::remove(temp_path);
+    return WriteResult::kFailed;
+  }
+  return WriteResult::kWritten;
+}
+
+}  // namespace
+
+InPlaceWriteStatistics WriteFilesInPlace(
+    const std::vector<InPlaceWrite>& writes,
+    int num_jobs,
+    bool skip_unchanged) {
+  auto start_time = std::chrono::steady_clock::now();
+  std::atomic<int> files_written{0};
+  std::atomic<int> files_unchanged{0};
+  std::atomic<int> files_failed{0};
+  std::atomic<uint64_t> bytes_written{0};
+  absl::Mutex directories_mutex;
+  // The number of files renamed into each directory. Guarded by
+  // |directories_mutex|.
+  std::map<std::string, int> directories;
+
+  auto write_file = [&](const InPlaceWrite& write) {
+    switch (WriteFileInPlace(write, skip_unchanged)) {
+      case WriteResult::kWritten: {
+        ++files_written;
+        bytes_written += write.contents.size();
+        absl::MutexLock lock(&directories_mutex);
+        ++directories[llvm::sys::path::parent_path(write.path).str()];
+        break;
+      }
+      case WriteResult::kUnchanged:
+        ++files_unchanged;
+        break;
+      case WriteResult::kFailed:
+        ++files_failed;
+        break;
+    }
+  };
+
+  if (num_jobs <= 1 || writes.size() <= 1) {
+    for (const InPlaceWrite& write : writes) {
+      write_file(write);
+    }
+  } else {
+    llvm::ThreadPool pool(llvm::hardware_concurrency(num_jobs));
+    for (const InPlaceWrite& write : writes) {
+      pool.async([&write_file, &write] { write_file(write); });
+    }
+    pool.wait();
+  }
+
+  // Each directory is synced once, after every rename into it.
+  for (const auto& [directory, num_files] : directories) {
+    if (std::error_code ec = SyncDirectory(directory)) {
+      llvm::errs() << "Syncing " << directory << " failed: " << ec.message()
+                   << "\n";
+      files_written -= num_files;
+      files_failed += num_files;
+    }
+  }
+
+  return InPlaceWriteStatistics{
+      .files_written = files_written.load(),
+      .files_unchanged = files_unchanged.load(),
+      .files_failed = files_failed.load(),
+      .bytes_written = bytes_written.load(),
+      .seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count()};
+}
+
+void PrintInPlaceWriteStatistics(const InPlaceWriteStatistics& statistics,
+                                 llvm::raw_ostream& stream) {
+  double seconds = std::max(statistics.seconds, 1e-9);
+  stream << "Wrote " << statistics.files_written << " files ("
+         << statistics.bytes_written << " bytes) in "
+         << llvm::format("%.3f", statistics.seconds) << "s: "
+         << llvm::format("%.1f", statistics.files_written / seconds)
+         << " files/s, "
+         << llvm::format("%.1f", statistics.bytes_written / seconds)
+         << " bytes/s";
+  if (statistics.files_unchanged) {
+    stream << ", " << statistics.files_unchanged << " unchanged";
+  }
+  if (statistics.files_failed) {
+    stream << ", " << statistics.files_failed << " failed";
+  }
+  stream << "\n";
+}
+
+}  // namespace modernizer
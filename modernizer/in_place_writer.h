@@ -0,0 +1,42 @@
+#ifndef MODERNIZER_IN_PLACE_WRITER_H_
+#define MODERNIZER_IN_PLACE_WRITER_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace modernizer {
+
+struct InPlaceWrite {
+  // Absolute path of the file to overwrite.
+  std::string path;
+  llvm::StringRef contents;
+};
+
+struct InPlaceWriteStatistics {
+  int files_written = 0;
+  int files_unchanged = 0;
+  int files_failed = 0;
+  uint64_t bytes_written = 0;
+  double seconds = 0;
+};
+
+// Overwrites every file in |writes| on a pool of |num_jobs| threads. Each file
+// is written to a temporary file in the same directory, synced and renamed
+// over the original, and each directory is synced after its renames, so a
+// crash neither leaves a partially written file behind nor loses a rename.
+// The original permissions are kept. If |skip_unchanged| is set, files whose
+// contents on disk already equal the new contents are not touched.
+InPlaceWriteStatistics WriteFilesInPlace(
+    const std::vector<InPlaceWrite>& writes,
+    int num_jobs,
+    bool skip_unchanged);
+
+void PrintInPlaceWriteStatistics(const InPlaceWriteStatistics& statistics,
+                                 llvm::raw_ostream& stream);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_IN_PLACE_WRITER_H_
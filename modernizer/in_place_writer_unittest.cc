@@ -0,0 +1,98 @@
+#include "modernizer/in_place_writer.h"
+
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+
+class InPlaceWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("modernizer", directory_));
+  }
+
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory_);
+  }
+
+  std::string CreateFile(llvm::StringRef name, llvm::StringRef contents) {
+    llvm::SmallString<128> path(directory_);
+    llvm::sys::path::append(path, name);
+    std::error_code ec;
+    llvm::raw_fd_ostream stream(path, ec);
+    EXPECT_FALSE(ec);
+    stream << contents;
+    return std::string(path);
+  }
+
+  static std::string ReadFile(const std::string& path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    EXPECT_TRUE(buffer);
+    return buffer ? (*buffer)->getBuffer().str() : std::string();
+  }
+
+  llvm::SmallString<128> directory_;
+};
+
+TEST_F(InPlaceWriterTest, WritesFiles) {
+  std::string foo = CreateFile("foo.h", "class Foo {};\n");
+  std::string bar = CreateFile("bar.h", "class Bar {};\n");
+  ASSERT_FALSE(llvm::sys::fs::setPermissions(
+      bar, llvm::sys::fs::owner_read | llvm::sys::fs::owner_write |
+               llvm::sys::fs::owner_exe));
+
+  modernizer::InPlaceWriteStatistics statistics = modernizer::WriteFilesInPlace(
+      {{.path = foo, .contents = "class Foo { int x; };\n"},
+       {.path = bar, .contents = "class Bar { int y; };\n"}},
+      /*num_jobs=*/2, /*skip_unchanged=*/false);
+
+  EXPECT_EQ(statistics.files_written, 2);
+  EXPECT_EQ(statistics.files_failed, 0);
+  EXPECT_EQ(statistics.bytes_written, 44u);
+  EXPECT_EQ(ReadFile(foo), "class Foo { int x; };\n");
+  EXPECT_EQ(ReadFile(bar), "class Bar { int y; };\n");
+
+  auto permissions = llvm::sys::fs::getPermissions(bar);
+  ASSERT_TRUE(permissions);
+  EXPECT_EQ(*permissions, llvm::sys::fs::owner_read |
+                              llvm::sys::fs::owner_write |
+                              llvm::sys::fs::owner_exe);
+
+  // No temporary files are left behind.
+  std::error_code ec;
+  int num_entries = 0;
+  for (llvm::sys::fs::directory_iterator iter(directory_, ec), end;
+       iter != end && !ec; iter.increment(ec)) {
+    ++num_entries;
+  }
+  EXPECT_EQ(num_entries, 2);
+}
+
+TEST_F(InPlaceWriterTest, SkipsUnchangedFiles) {
+  std::string foo = CreateFile("foo.h", "class Foo {};\n");
+
+  modernizer::InPlaceWriteStatistics statistics = modernizer::WriteFilesInPlace(
+      {{.path = foo, .contents = "class Foo {};\n"}}, /*num_jobs=*/1,
+      /*skip_unchanged=*/true);
+
+  EXPECT_EQ(statistics.files_written, 0);
+  EXPECT_EQ(statistics.files_unchanged, 1);
+}
+
+TEST_F(InPlaceWriterTest, ReportsMissingFile) {
+  llvm::SmallString<128> path(directory_);
+  llvm::sys::path::append(path, "missing.h");
+
+  modernizer::InPlaceWriteStatistics statistics = modernizer::WriteFilesInPlace(
+      {{.path = std::string(path), .contents = "class Foo {};\n"}},
+      /*num_jobs=*/1, /*skip_unchanged=*/false);
+
+  EXPECT_EQ(statistics.files_written, 0);
+  EXPECT_EQ(statistics.files_failed, 1);
+}
+
+}  // namespace
@@ -0,0 +1,364 @@
+#include "modernizer/include_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace modernizer {
+
+namespace {
+
+// The file is a header followed by these arrays, each aligned for its type
+// as long as the file is:
+//   uint64_t hashes[num_files]
+//   int64_t modification_times[num_files]
+//   uint64_t sizes[num_files]
+//   uint32_t path_offsets[num_files + 1]
+//   uint32_t forward_offsets[num_files + 1]
+//   uint32_t forward_edges[num_edges]
+//   uint32_t reverse_offsets[num_files + 1]
+//   uint32_t reverse_edges[num_edges]
+//   uint8_t flags[num_files]
+//   char build_root[build_root_size]
+//   char paths[paths_size]
+constexpr char kMagic[8] = {'M', 'O', 'D', 'I', 'D', 'X', '0', '1'};
+
+struct Header {
+  char magic[8];
+  uint32_t num_files;
+  uint32_t num_edges;
+  uint32_t build_root_size;
+  uint32_t paths_size;
+};
+
+constexpr uint8_t kTranslationUnit = 1;
+constexpr uint8_t kDependenciesKnown = 2;
+
+llvm::Error MakeError(const std::string& message) {
+  return llvm::make_error<llvm::StringError>(message,
+                                             llvm::inconvertibleErrorCode());
+}
+
+template <typename T>
+void AppendArray(const std::vector<T>& values, std::string& out) {
+  out.append(reinterpret_cast<const char*>(values.data()),
+             values.size() * sizeof(T));
+}
+
+// Builds the CSR offsets of |lists| and appends their concatenation to
+// |edges|.
+std::vector<uint32_t> Flatten(const std::vector<std::vector<uint32_t>>& lists,
+                              std::vector<uint32_t>& edges) {
+  std::vector<uint32_t> offsets;
+  offsets.reserve(lists.size() + 1);
+  offsets.push_back(0);
+  for (const std::vector<uint32_t>& list : lists) {
+    edges.insert(edges.end(), list.begin(), list.end());
+    offsets.push_back(edges.size());
+  }
+  return offsets;
+}
+
+// Checks that |offsets| starts at 0, never decreases and ends at |size|.
+bool AreValidOffsets(const uint32_t* offsets, uint32_t count, uint64_t size) {
+  if (offsets[0] != 0 || offsets[count] != size) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    if (offsets[i] > offsets[i + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsSortedAndUnique(llvm::ArrayRef<uint32_t> ids) {
+  return std::adjacent_find(ids.begin(), ids.end(),
+                            std::greater_equal<uint32_t>()) == ids.end();
+}
+
+}  // namespace
+
+IncludeIndexBuilder::IncludeIndexBuilder(std::string build_root)
+    : build_root_(std::move(build_root)) {}
+
+uint32_t IncludeIndexBuilder::AddFile(std::string_view path) {
+  auto [iter, inserted] = ids_.try_emplace(std::string(path), files_.size());
+  if (inserted) {
+    files_.emplace_back().path = std::string(path);
+  }
+  return iter->second;
+}
+
+void IncludeIndexBuilder::SetStatus(uint32_t id,
+                                    const IncludeIndexFileStatus& status) {
+  files_[id].status = status;
+}
+
+void IncludeIndexBuilder::SetTranslationUnit(
+    uint32_t id,
+    const std::optional<std::vector<uint32_t>>& dependencies) {
+  File& file = files_[id];
+  file.flags = kTranslationUnit;
+  file.dependencies.clear();
+  if (dependencies) {
+    file.flags |= kDependenciesKnown;
+    file.dependencies = *dependencies;
+  }
+}
+
+std::string IncludeIndexBuilder::Build() const {
+  // Ids of the index are positions in path order.
+  std::vector<uint32_t> order(files_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+    return files_[lhs].path < files_[rhs].path;
+  });
+  std::vector<uint32_t> new_ids(files_.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    new_ids[order[i]] = i;
+  }
+
+  std::vector<uint64_t> hashes;
+  std::vector<int64_t> modification_times;
+  std::vector<uint64_t> sizes;
+  std::vector<uint32_t> path_offsets = {0};
+  std::vector<uint8_t> flags;
+  std::string paths;
+  std::vector<std::vector<uint32_t>> forward(files_.size());
+  std::vector<std::vector<uint32_t>> reverse(files_.size());
+  for (uint32_t id = 0; id < order.size(); ++id) {
+    const File& file = files_[order[id]];
+    hashes.push_back(file.status.hash);
+    modification_times.push_back(file.status.modification_time);
+    sizes.push_back(file.status.size);
+    flags.push_back(file.flags);
+    paths += file.path;
+    path_offsets.push_back(paths.size());
+
+    std::vector<uint32_t>& dependencies = forward[id];
+    for (uint32_t dependency : file.dependencies) {
+      if (new_ids[dependency] != id) {
+        dependencies.push_back(new_ids[dependency]);
+      }
+    }
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()),
+                       dependencies.end());
+    // Visiting ids in order keeps every reverse list sorted.
+    for (uint32_t dependency : dependencies) {
+      reverse[dependency].push_back(id);
+    }
+  }
+
+  std::vector<uint32_t> forward_edges;
+  std::vector<uint32_t> forward_offsets = Flatten(forward, forward_edges);
+  std::vector<uint32_t> reverse_edges;
+  std::vector<uint32_t> reverse_offsets = Flatten(reverse, reverse_edges);
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_files = files_.size();
+  header.num_edges = forward_edges.size();
+  header.build_root_size = build_root_.size();
+  header.paths_size = paths.size();
+
+  std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+  AppendArray(hashes, data);
+  AppendArray(modification_times, data);
+  AppendArray(sizes, data);
+  AppendArray(path_offsets, data);
+  AppendArray(forward_offsets, data);
+  AppendArray(forward_edges, data);
+  AppendArray(reverse_offsets, data);
+  AppendArray(reverse_edges, data);
+  AppendArray(flags, data);
+  data += build_root_;
+  data += paths;
+  return data;
+}
+
+llvm::Expected<std::unique_ptr<IncludeIndex>> IncludeIndex::Open(
+    const std::string& path) {
+  // Large files are mapped instead of read.
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return llvm::createStringError(buffer.getError(),
+                                   "Cannot read include index %s",
+                                   path.c_str());
+  }
+  return Create(std::move(*buffer));
+}
+
+llvm::Expected<std::unique_ptr<IncludeIndex>> IncludeIndex::Create(
+    std::unique_ptr<llvm::MemoryBuffer> buffer) {
+  std::unique_ptr<IncludeIndex> index(new IncludeIndex(std::move(buffer)));
+  llvm::StringRef data = index->buffer_->getBuffer();
+  if (data.size() < sizeof(Header) ||
+      std::memcmp(data.data(), kMagic, sizeof(kMagic))) {
+    return MakeError("Not an include index");
+  }
+  if (reinterpret_cast<uintptr_t>(data.data()) % alignof(uint64_t)) {
+    return MakeError("Include index is not aligned");
+  }
+  Header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  uint64_t num_files = header.num_files;
+  uint64_t num_edges = header.num_edges;
+  uint64_t expected_size = sizeof(Header) + num_files * 3 * sizeof(uint64_t) +
+                           (num_files + 1) * 3 * sizeof(uint32_t) +
+                           num_edges * 2 * sizeof(uint32_t) + num_files +
+                           header.build_root_size + header.paths_size;
+  if (data.size() != expected_size) {
+    return MakeError("Include index is truncated");
+  }
+
+  const char* position = data.data() + sizeof(Header);
+  auto take = [&position](auto*& array, uint64_t count) {
+    array = reinterpret_cast<std::remove_reference_t<decltype(array)>>(
+        position);
+    position += count * sizeof(*array);
+  };
+  index->num_files_ = header.num_files;
+  index->num_edges_ = header.num_edges;
+  take(index->hashes_, num_files);
+  take(index->modification_times_, num_files);
+  take(index->sizes_, num_files);
+  take(index->path_offsets_, num_files + 1);
+  take(index->forward_offsets_, num_files + 1);
+  take(index->forward_edges_, num_edges);
+  take(index->reverse_offsets_, num_files + 1);
+  take(index->reverse_edges_, num_edges);
+  take(index->flags_, num_files);
+  index->build_root_ = std::string_view(position, header.build_root_size);
+  index->strings_ = position + header.build_root_size;
+
+  if (!AreValidOffsets(index->path_offsets_, num_files, header.paths_size) ||
+      !AreValidOffsets(index->forward_offsets_, num_files, num_edges) ||
+      !AreValidOffsets(index->reverse_offsets_, num_files, num_edges)) {
+    return MakeError("Include index has invalid offsets");
+  }
+  for (uint64_t i = 0; i < num_edges; ++i) {
+    if (index->forward_edges_[i] >= num_files ||
+        index->reverse_edges_[i] >= num_files) {
+      return MakeError("Include index has invalid file ids");
+    }
+  }
+  return index;
+}
+
+IncludeIndex::IncludeIndex(std::unique_ptr<llvm::MemoryBuffer> buffer)
+    : buffer_(std::move(buffer)) {}
+
+llvm::Error IncludeIndex::Verify() const {
+  for (uint32_t id = 1; id < num_files_; ++id) {
+    if (GetPath(id - 1) >= GetPath(id)) {
+      return MakeError("Include index paths are not sorted: " +
+                       std::string(GetPath(id)));
+    }
+  }
+  for (uint32_t id = 0; id < num_files_; ++id) {
+    llvm::ArrayRef<uint32_t> dependencies = GetDependencies(id);
+    if (!IsSortedAndUnique(dependencies) ||
+        !IsSortedAndUnique(GetDependents(id))) {
+      return MakeError("Include index edges are not sorted: " +
+                       std::string(GetPath(id)));
+    }
+    if (!dependencies.empty() && !IsTranslationUnit(id)) {
+      return MakeError("Include index has dependencies of a header: " +
+                       std::string(GetPath(id)));
+    }
+    // Both directions hold the same number of unique edges, so finding
+    // every forward edge reversed means they match exactly.
+    for (uint32_t dependency : dependencies) {
+      llvm::ArrayRef<uint32_t> dependents = GetDependents(dependency);
+      if (!std::binary_search(dependents.begin(), dependents.end(), id)) {
+        return MakeError("Include index is missing the reverse edge from " +
+                         std::string(GetPath(dependency)) + " to " +
+                         std::string(GetPath(id)));
+      }
+    }
+  }
+  return llvm::Error::success();
+}
+
+std::string_view IncludeIndex::GetBuildRoot() const {
+  return build_root_;
+}
+
+std::optional<uint32_t> IncludeIndex::Find(std::string_view path) const {
+  uint32_t low = 0;
+  uint32_t high = num_files_;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (GetPath(middle) < path) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < num_files_ && GetPath(low) == path) {
+    return low;
+  }
+  return std::nullopt;
+}
+
+std::string_view IncludeIndex::GetPath(uint32_t id) const {
+  return std::string_view(strings_ + path_offsets_[id],
+                          path_offsets_[id + 1] - path_offsets_[id]);
+}
+
+IncludeIndexFileStatus IncludeIndex::GetStatus(uint32_t id) const {
+  return {.hash = hashes_[id],
+          .modification_time = modification_times_[id],
+          .size = sizes_[id]};
+}
+
+bool IncludeIndex::IsTranslationUnit(uint32_t id) const {
+  return flags_[id] & kTranslationUnit;
+}
+
+bool IncludeIndex::AreDependenciesKnown(uint32_t id) const {
+  return flags_[id] & kDependenciesKnown;
+}
+
+llvm::ArrayRef<uint32_t> IncludeIndex::GetDependencies(uint32_t id) const {
+  return llvm::ArrayRef<uint32_t>(forward_edges_ + forward_offsets_[id],
+                                  forward_edges_ + forward_offsets_[id + 1]);
+}
+
+llvm::ArrayRef<uint32_t> IncludeIndex::GetDependents(uint32_t id) const {
+  return llvm::ArrayRef<uint32_t>(reverse_edges_ + reverse_offsets_[id],
+                                  reverse_edges_ + reverse_offsets_[id + 1]);
+}
+
+std::vector<uint32_t> IncludeIndex::GetAffectedTranslationUnits(
+    llvm::ArrayRef<uint32_t> ids) const {
+  std::vector<bool> visited(num_files_);
+  std::vector<uint32_t> pending;
+  for (uint32_t id : ids) {
+    if (!visited[id]) {
+      visited[id] = true;
+      pending.push_back(id);
+    }
+  }
+  std::vector<uint32_t> result;
+  while (!pending.empty()) {
+    uint32_t id = pending.back();
+    pending.pop_back();
+    if (IsTranslationUnit(id)) {
+      result.push_back(id);
+    }
+    for (uint32_t dependent : GetDependents(id)) {
+      if (!visited[dependent]) {
+        visited[dependent] = true;
+        pending.push_back(dependent);
+      }
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,137 @@
+#ifndef MODERNIZER_INCLUDE_INDEX_H_
+#define MODERNIZER_INCLUDE_INDEX_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace modernizer {
+
+// What the index knows about the contents of a file when it was built.
+struct IncludeIndexFileStatus {
+  uint64_t hash = 0;
+  int64_t modification_time = 0;
+  uint64_t size = 0;
+
+  bool operator==(const IncludeIndexFileStatus& other) const {
+    return hash == other.hash &&
+           modification_time == other.modification_time &&
+           size == other.size;
+  }
+};
+
+// Collects files and the files each translation unit reads, and writes them
+// in the format read by IncludeIndex.
+class IncludeIndexBuilder {
+ public:
+  explicit IncludeIndexBuilder(std::string build_root);
+
+  // Returns the id of |path|, adding it if needed. Ids are only meaningful
+  // to this builder.
+  uint32_t AddFile(std::string_view path);
+
+  uint32_t GetNumFiles() const { return files_.size(); }
+
+  const std::string& GetPath(uint32_t id) const { return files_[id].path; }
+
+  void SetStatus(uint32_t id, const IncludeIndexFileStatus& status);
+
+  // Marks |id| as a translation unit reading |dependencies|, or whose
+  // dependencies are unknown if std::nullopt.
+  void SetTranslationUnit(
+      uint32_t id,
+      const std::optional<std::vector<uint32_t>>& dependencies);
+
+  std::string Build() const;
+
+ private:
+  struct File {
+    std::string path;
+    IncludeIndexFileStatus status;
+    uint8_t flags = 0;
+    std::vector<uint32_t> dependencies;
+  };
+
+  std::string build_root_;
+  std::vector<File> files_;
+  std::unordered_map<std::string, uint32_t> ids_;
+};
+
+// Read-only view of an index of the files of a build and which translation
+// units read them. Files are numbered densely in path order. The files read
+// by each file, and the files reading it, are stored as CSR arrays, so the
+// index can be used straight from a mapped file without parsing.
+class IncludeIndex {
+ public:
+  static llvm::Expected<std::unique_ptr<IncludeIndex>> Open(
+      const std::string& path);
+
+  // Checks that the offsets and ids of |buffer| are in range, so that the
+  // accessors below are safe to call.
+  static llvm::Expected<std::unique_ptr<IncludeIndex>> Create(
+      std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+  // Checks the invariants Create() does not: paths are sorted and unique,
+  // and the reverse edges are exactly the forward edges reversed.
+  llvm::Error Verify() const;
+
+  std::string_view GetBuildRoot() const;
+
+  uint32_t GetNumFiles() const { return num_files_; }
+
+  uint32_t GetNumEdges() const { return num_edges_; }
+
+  size_t GetSizeInBytes() const { return buffer_->getBufferSize(); }
+
+  std::optional<uint32_t> Find(std::string_view path) const;
+
+  std::string_view GetPath(uint32_t id) const;
+
+  IncludeIndexFileStatus GetStatus(uint32_t id) const;
+
+  bool IsTranslationUnit(uint32_t id) const;
+
+  // Set for a translation unit whose depfile was readable.
+  bool AreDependenciesKnown(uint32_t id) const;
+
+  // The files |id| reads.
+  llvm::ArrayRef<uint32_t> GetDependencies(uint32_t id) const;
+
+  // The files that read |id|.
+  llvm::ArrayRef<uint32_t> GetDependents(uint32_t id) const;
+
+  // Returns the translation units that read any of |ids|, directly or
+  // through other files, sorted by id.
+  std::vector<uint32_t> GetAffectedTranslationUnits(
+      llvm::ArrayRef<uint32_t> ids) const;
+
+ private:
+  explicit IncludeIndex(std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+  std::unique_ptr<llvm::MemoryBuffer> buffer_;
+  uint32_t num_files_ = 0;
+  uint32_t num_edges_ = 0;
+  const uint64_t* hashes_ = nullptr;
+  const int64_t* modification_times_ = nullptr;
+  const uint64_t* sizes_ = nullptr;
+  const uint32_t* path_offsets_ = nullptr;
+  const uint32_t* forward_offsets_ = nullptr;
+  const uint32_t* forward_edges_ = nullptr;
+  const uint32_t* reverse_offsets_ = nullptr;
+  const uint32_t* reverse_edges_ = nullptr;
+  const uint8_t* flags_ = nullptr;
+  std::string_view build_root_;
+  const char* strings_ = nullptr;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_INCLUDE_INDEX_H_
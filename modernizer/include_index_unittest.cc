@@ -0,0 +1,109 @@
+#include "modernizer/include_index.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+namespace {
+
+std::unique_ptr<modernizer::IncludeIndex> CreateIndex(std::string data) {
+  auto index = modernizer::IncludeIndex::Create(
+      llvm::MemoryBuffer::getMemBufferCopy(data));
+  EXPECT_TRUE(static_cast<bool>(index)) << llvm::toString(index.takeError());
+  return index ? std::move(*index) : nullptr;
+}
+
+std::vector<std::string_view> GetPaths(
+    const modernizer::IncludeIndex& index,
+    llvm::ArrayRef<uint32_t> ids) {
+  std::vector<std::string_view> paths;
+  for (uint32_t id : ids) {
+    paths.push_back(index.GetPath(id));
+  }
+  return paths;
+}
+
+// b.cc reads b.h and common.h, a.cc reads common.h, and c.cc has no depfile.
+std::string BuildTestIndex() {
+  modernizer::IncludeIndexBuilder builder("/src/out");
+  uint32_t b_cc = builder.AddFile("../../b.cc");
+  uint32_t b_h = builder.AddFile("../../b.h");
+  uint32_t common_h = builder.AddFile("../../common.h");
+  uint32_t a_cc = builder.AddFile("../../a.cc");
+  uint32_t c_cc = builder.AddFile("../../c.cc");
+  builder.SetStatus(b_h, {.hash = 1, .modification_time = 2, .size = 3});
+  builder.SetTranslationUnit(b_cc,
+                             std::vector<uint32_t>{b_cc, common_h, b_h});
+  builder.SetTranslationUnit(a_cc, std::vector<uint32_t>{a_cc, common_h});
+  builder.SetTranslationUnit(c_cc, std::nullopt);
+  return builder.Build();
+}
+
+TEST(IncludeIndexTest, BuildAndQuery) {
+  auto index = CreateIndex(BuildTestIndex());
+  ASSERT_TRUE(index);
+  EXPECT_FALSE(index->Verify());
+  EXPECT_EQ(index->GetBuildRoot(), "/src/out");
+  EXPECT_EQ(index->GetNumFiles(), 5u);
+  EXPECT_EQ(index->GetNumEdges(), 3u);
+  EXPECT_FALSE(index->Find("../../d.h"));
+
+  std::optional<uint32_t> common_h = index->Find("../../common.h");
+  std::optional<uint32_t> b_h = index->Find("../../b.h");
+  std::optional<uint32_t> b_cc = index->Find("../../b.cc");
+  std::optional<uint32_t> c_cc = index->Find("../../c.cc");
+  ASSERT_TRUE(common_h && b_h && b_cc && c_cc);
+  EXPECT_EQ(index->GetStatus(*b_h),
+            (modernizer::IncludeIndexFileStatus{
+                .hash = 1, .modification_time = 2, .size = 3}));
+  EXPECT_FALSE(index->IsTranslationUnit(*b_h));
+  EXPECT_TRUE(index->IsTranslationUnit(*b_cc));
+  EXPECT_TRUE(index->AreDependenciesKnown(*b_cc));
+  EXPECT_TRUE(index->IsTranslationUnit(*c_cc));
+  EXPECT_FALSE(index->AreDependenciesKnown(*c_cc));
+
+  EXPECT_THAT(GetPaths(*index, index->GetDependencies(*b_cc)),
+              ElementsAre("../../b.h", "../../common.h"));
+  EXPECT_THAT(GetPaths(*index, index->GetDependents(*common_h)),
+              ElementsAre("../../a.cc", "../../b.cc"));
+  EXPECT_THAT(GetPaths(*index, index->GetAffectedTranslationUnits({*b_h})),
+              ElementsAre("../../b.cc"));
+  EXPECT_THAT(
+      GetPaths(*index, index->GetAffectedTranslationUnits({*common_h})),
+      ElementsAre("../../a.cc", "../../b.cc"));
+  EXPECT_THAT(GetPaths(*index, index->GetAffectedTranslationUnits({*c_cc})),
+              ElementsAre("../../c.cc"));
+}
+
+TEST(IncludeIndexTest, EmptyIndex) {
+  auto index = CreateIndex(modernizer::IncludeIndexBuilder("/out").Build());
+  ASSERT_TRUE(index);
+  EXPECT_FALSE(index->Verify());
+  EXPECT_EQ(index->GetNumFiles(), 0u);
+  EXPECT_FALSE(index->Find("a.h"));
+  EXPECT_THAT(index->GetAffectedTranslationUnits({}), IsEmpty());
+}
+
+TEST(IncludeIndexTest, RejectsCorruptData) {
+  std::string data = BuildTestIndex();
+  for (std::string corrupt_data :
+       {std::string(), data.substr(0, data.size() - 1), data + "x",
+        "X" + data.substr(1)}) {
+    auto index = modernizer::IncludeIndex::Create(
+        llvm::MemoryBuffer::getMemBufferCopy(corrupt_data));
+    EXPECT_FALSE(index);
+    llvm::consumeError(index.takeError());
+  }
+
+  // An edge pointing past the last file.
+  size_t edges_offset = 24 + 5 * 3 * 8 + 6 * 2 * 4;
+  data[edges_offset] = 100;
+  auto index = modernizer::IncludeIndex::Create(
+      llvm::MemoryBuffer::getMemBufferCopy(data));
+  EXPECT_FALSE(index);
+  llvm::consumeError(index.takeError());
+}
+
+}  // namespace
@@ -0,0 +1,163 @@
+#include "modernizer/journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "modernizer/posix_io.h"
+
+namespace modernizer {
+
+namespace {
+
+// The file starts with kMagic and the key. Each record is the size of its
+// payload, the hash of the payload and the payload, which is the size of the
+// TU name, the TU name and the data.
+constexpr std::string_view kMagic = "MODJRNL1";
+constexpr size_t kHeaderSize = kMagic.size() + sizeof(uint64_t);
+constexpr size_t kRecordHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+template <typename T>
+void AppendFixed(T value, std::string& out) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T ReadFixed(const char* data) {
+  T value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+llvm::Error MakeError(const std::string& message, const std::string& path) {
+  return llvm::make_error<llvm::StringError>(
+      message + " " + path + ": " + std::strerror(errno),
+      llvm::inconvertibleErrorCode());
+}
+
+// Replays the records of |contents| and returns the size of the valid
+// prefix, or 0 if the journal has to be started over.
+size_t Replay(llvm::StringRef contents,
+              uint64_t key,
+              const Journal::ReplayFunction& replay) {
+  if (contents.size() < kHeaderSize || !contents.startswith(kMagic) ||
+      ReadFixed<uint64_t>(contents.data() + kMagic.size()) != key) {
+    return 0;
+  }
+  size_t offset = kHeaderSize;
+  while (contents.size() - offset >= kRecordHeaderSize) {
+    const char* record = contents.data() + offset;
+    uint32_t payload_size = ReadFixed<uint32_t>(record);
+    uint64_t payload_hash = ReadFixed<uint64_t>(record + sizeof(uint32_t));
+    if (contents.size() - offset - kRecordHeaderSize < payload_size) {
+      break;
+    }
+    llvm::StringRef payload(record + kRecordHeaderSize, payload_size);
+    if (llvm::xxHash64(payload) != payload_hash ||
+        payload.size() < sizeof(uint32_t)) {
+      break;
+    }
+    uint32_t tu_size = ReadFixed<uint32_t>(payload.data());
+    if (payload.size() - sizeof(uint32_t) < tu_size) {
+      break;
+    }
+    replay(std::string_view(payload.data() + sizeof(uint32_t), tu_size),
+           std::string_view(payload.data() + sizeof(uint32_t) + tu_size,
+                            payload.size() - sizeof(uint32_t) - tu_size));
+    offset += kRecordHeaderSize + payload_size;
+  }
+  return offset;
+}
+
+}  // namespace
+
+llvm::Expected<std::unique_ptr<Journal>> Journal::Open(
+    const std::string& path,
+    uint64_t key,
+    const ReplayFunction& replay,
+    std::chrono::milliseconds sync_interval) {
+  size_t valid_size = 0;
+  if (auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                                /*RequiresNullTerminator=*/
+                                                false)) {
+    valid_size = Replay((*buffer)->getBuffer(), key, replay);
+    if (!valid_size && (*buffer)->getBufferSize()) {
+      llvm::errs() << "Journal " << path
+                   << " belongs to a different compile database; starting "
+                      "over\n";
+    }
+  }
+
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return MakeError("Cannot open journal", path);
+  }
+  std::unique_ptr<Journal> journal(new Journal(fd, path, sync_interval));
+  // Drops a record torn by a crash, or the whole journal if it is stale.
+  if (ftruncate(fd, valid_size) || lseek(fd, valid_size, SEEK_SET) < 0) {
+    return MakeError("Cannot truncate journal", path);
+  }
+  if (!valid_size) {
+    std::string header(kMagic);
+    AppendFixed(key, header);
+    if (!WriteAll(fd, header) || fsync(fd)) {
+      return MakeError("Cannot write journal", path);
+    }
+  }
+  return journal;
+}
+
+Journal::Journal(int fd,
+                 std::string path,
+                 std::chrono::milliseconds sync_interval)
+    : fd_(fd),
+      path_(std::move(path)),
+      sync_interval_(sync_interval),
+      last_sync_(std::chrono::steady_clock::now()) {}
+
+Journal::~Journal() {
+  absl::MutexLock lock(&mutex_);
+  if (needs_sync_) {
+    fsync(fd_);
+  }
+  close(fd_);
+}
+
+llvm::Error Journal::Append(std::string_view tu, std::string_view data) {
+  std::string payload;
+  payload.reserve(sizeof(uint32_t) + tu.size() + data.size());
+  AppendFixed(static_cast<uint32_t>(tu.size()), payload);
+  payload.append(tu);
+  payload.append(data);
+
+  std::string record;
+  record.reserve(kRecordHeaderSize + payload.size());
+  AppendFixed(static_cast<uint32_t>(payload.size()), record);
+  AppendFixed(llvm::xxHash64(payload), record);
+  record.append(payload);
+
+  absl::MutexLock lock(&mutex_);
+  // A single write per record, so a crash of this process leaves at most the
+  // last record torn. fsync only protects against a crash of the machine,
+  // which is rare enough to batch it.
+  if (!WriteAll(fd_, record)) {
+    return MakeError("Cannot write journal", path_);
+  }
+  needs_sync_ = true;
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_sync_ >= sync_interval_) {
+    if (fsync(fd_)) {
+      return MakeError("Cannot sync journal", path_);
+    }
+    last_sync_ = now;
+    needs_sync_ = false;
+  }
+  return llvm::Error::success();
+}
+
+}  // namespace modernizer
@@ -0,0 +1,55 @@
+#ifndef MODERNIZER_JOURNAL_H_
+#define MODERNIZER_JOURNAL_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/Support/Error.h"
+
+namespace modernizer {
+
+// Append-only log of completed translation units and their serialized
+// results, so that an interrupted run can resume where it stopped. Records
+// are written as soon as they are appended and synced to disk in batches;
+// a record torn by a crash is dropped on the next open.
+class Journal {
+ public:
+  using ReplayFunction =
+      std::function<void(std::string_view tu, std::string_view data)>;
+
+  // Opens the journal at |path|, creating it if needed. If the journal was
+  // written for the same |key|, calls |replay| for every complete record and
+  // appends after them. Otherwise the journal is started over.
+  static llvm::Expected<std::unique_ptr<Journal>> Open(
+      const std::string& path,
+      uint64_t key,
+      const ReplayFunction& replay,
+      std::chrono::milliseconds sync_interval = std::chrono::seconds(1));
+
+  ~Journal();
+
+  Journal(const Journal&) = delete;
+  Journal& operator=(const Journal&) = delete;
+
+  // Thread-safe.
+  llvm::Error Append(std::string_view tu, std::string_view data);
+
+ private:
+  Journal(int fd, std::string path, std::chrono::milliseconds sync_interval);
+
+  absl::Mutex mutex_;
+  const int fd_;
+  const std::string path_;
+  const std::chrono::milliseconds sync_interval_;
+  std::chrono::steady_clock::time_point last_sync_ GUARDED_BY(mutex_);
+  bool needs_sync_ GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_JOURNAL_H_
@@ -0,0 +1,111 @@
+#include "modernizer/journal.h"
+
+#include <unistd.h>
+
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::Pair;
+
+namespace {
+
+class JournalTest : public ::testing::Test {
+ protected:
+  using Records = std::vector<std::pair<std::string, std::string>>;
+
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("modernizer", directory_));
+    llvm::SmallString<128> path(directory_);
+    llvm::sys::path::append(path, "journal");
+    path_ = std::string(path);
+  }
+
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory_);
+  }
+
+  std::unique_ptr<modernizer::Journal> Open(uint64_t key, Records* records) {
+    auto journal = modernizer::Journal::Open(
+        path_, key, [&](std::string_view tu, std::string_view data) {
+          records->emplace_back(tu, data);
+        });
+    EXPECT_TRUE(!!journal) << llvm::toString(journal.takeError());
+    return journal ? std::move(*journal) : nullptr;
+  }
+
+  llvm::SmallString<128> directory_;
+  std::string path_;
+};
+
+TEST_F(JournalTest, ReplaysRecords) {
+  Records records;
+  {
+    auto journal = Open(1, &records);
+    ASSERT_TRUE(journal);
+    EXPECT_FALSE(journal->Append("a.cc", "data of a"));
+    EXPECT_FALSE(journal->Append("b.cc", std::string_view("\0\1", 2)));
+  }
+  EXPECT_THAT(records, IsEmpty());
+
+  {
+    auto journal = Open(1, &records);
+    ASSERT_TRUE(journal);
+    EXPECT_FALSE(journal->Append("c.cc", ""));
+  }
+  EXPECT_THAT(records,
+              ElementsAre(Pair("a.cc", "data of a"),
+                          Pair("b.cc", std::string("\0\1", 2))));
+
+  records.clear();
+  Open(1, &records);
+  EXPECT_EQ(records.size(), 3u);
+}
+
+TEST_F(JournalTest, StartsOverForDifferentKey) {
+  Records records;
+  {
+    auto journal = Open(1, &records);
+    ASSERT_TRUE(journal);
+    EXPECT_FALSE(journal->Append("a.cc", "data of a"));
+  }
+  Open(2, &records);
+  EXPECT_THAT(records, IsEmpty());
+  Open(1, &records);
+  EXPECT_THAT(records, IsEmpty());
+}
+
+TEST_F(JournalTest, DropsTornRecord) {
+  Records records;
+  {
+    auto journal = Open(1, &records);
+    ASSERT_TRUE(journal);
+    EXPECT_FALSE(journal->Append("a.cc", "data of a"));
+    EXPECT_FALSE(journal->Append("b.cc", "data of b"));
+  }
+  // Cut the last record short, as a crash in the middle of a write would.
+  uint64_t size;
+  ASSERT_FALSE(llvm::sys::fs::file_size(path_, size));
+  ASSERT_EQ(truncate(path_.c_str(), size - 5), 0);
+  {
+    auto journal = Open(1, &records);
+    ASSERT_TRUE(journal);
+    EXPECT_FALSE(journal->Append("c.cc", "data of c"));
+  }
+  EXPECT_THAT(records, ElementsAre(Pair("a.cc", "data of a")));
+
+  records.clear();
+  Open(1, &records);
+  EXPECT_THAT(records, ElementsAre(Pair("a.cc", "data of a"),
+                                   Pair("c.cc", "data of c")));
+}
+
+}  // namespace
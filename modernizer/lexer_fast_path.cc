@@ -0,0 +1,698 @@
+#include "modernizer/lexer_fast_path.h"
+
+#include <algorithm>
+#include <optional>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "modernizer/modernizer.h"
+
+namespace modernizer {
+namespace {
+
+enum class Access { kPublic, kProtected, kPrivate };
+
+enum class MemberKind {
+  kAccessSpecifier,
+  kMacro,
+  kConstructor,
+  kDestructor,
+  kMethod,
+  // Fields and static data members.
+  kField,
+  // Declarations the AST path does not collect, such as nested types,
+  // aliases, friends and templates.
+  kOther,
+};
+
+struct Member {
+  MemberKind kind;
+  // Indices of the first and the last token, which is the semicolon or the
+  // closing brace of the body.
+  size_t begin;
+  size_t end;
+  Access access = Access::kPublic;
+  bool has_body = false;
+  bool is_defaulted = false;
+  // Set for declarations clang considers inline without a body, like
+  // "constexpr Foo();", or deleted ones. The AST path does not look for
+  // their semicolon.
+  bool no_semicolon_lookup = false;
+};
+
+constexpr size_t kNoMatch = static_cast<size_t>(-1);
+
+bool IsDeclSpecifier(llvm::StringRef text) {
+  return llvm::StringSwitch<bool>(text)
+      .Cases("virtual", "explicit", "static", "inline", "constexpr", true)
+      .Cases("consteval", "constinit", "mutable", "extern", "thread_local",
+             true)
+      .Default(false);
+}
+
+// Identifiers like FRIEND_TEST or Q_OBJECT, which may expand to anything.
+bool LooksLikeMacro(llvm::StringRef text) {
+  return text.size() >= 2 && llvm::all_of(text, [](char c) {
+           return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+         });
+}
+
+class MacroUseClassifier {
+ public:
+  explicit MacroUseClassifier(const FileTokens& file_tokens)
+      : file_tokens_(file_tokens) {}
+
+  LexerFastPathResult Classify() {
+    LexerFastPathResult result;
+    if (!file_tokens_.buffer.contains(kModernizeMacro)) {
+      return result;
+    }
+    if (!Prepare()) {
+      for (size_t i = 0; i < file_tokens_.tokens.size(); ++i) {
+        if (file_tokens_.GetText(i) == kModernizeMacro) {
+          ++result.num_macro_uses;
+        }
+      }
+      result.num_fallbacks = result.num_macro_uses;
+      return result;
+    }
+    // Uses in directives, like in the definition of another macro.
+    result.num_macro_uses = num_directive_uses_;
+    result.num_fallbacks = num_directive_uses_;
+    for (size_t i = 0; i < code_.size(); ++i) {
+      if (Text(i) != kModernizeMacro) {
+        continue;
+      }
+      ++result.num_macro_uses;
+      std::optional<MacroUseEdits> edits;
+      if (!ClassifyUse(i, &edits)) {
+        ++result.num_fallbacks;
+      } else if (edits) {
+        result.edits.push_back(std::move(*edits));
+      }
+    }
+    return result;
+  }
+
+ private:
+  // Separates the tokens of directives from the others, and matches the
+  // brackets of the others. Returns false if they do not balance.
+  bool Prepare() {
+    const std::vector<RawToken>& tokens = file_tokens_.tokens;
+    auto is_directive = [&](size_t i, llvm::StringRef name) {
+      return i + 1 < tokens.size() && tokens[i].kind == clang::tok::hash &&
+             tokens[i].at_start_of_line &&
+             file_tokens_.GetText(i + 1) == name;
+    };
+    // "#ifndef FOO_H_" and "#define FOO_H_" opening the file.
+    bool has_include_guard =
+        tokens.size() >= 6 && is_directive(0, "ifndef") &&
+        is_directive(3, "define") &&
+        file_tokens_.GetText(2) == file_tokens_.GetText(5) &&
+        (tokens.size() == 6 || tokens[6].at_start_of_line);
+
+    // Whether each open conditional is the include guard.
+    std::vector<bool> conditionals;
+    int depth = 0;
+    for (size_t i = 0; i < tokens.size();) {
+      if (tokens[i].kind != clang::tok::hash || !tokens[i].at_start_of_line) {
+        code_.push_back(i);
+        conditional_.push_back(depth > 0);
+        ++i;
+        continue;
+      }
+      size_t end = i + 1;
+      while (end < tokens.size() && !tokens[end].at_start_of_line) {
+        if (file_tokens_.GetText(end) == kModernizeMacro) {
+          ++num_directive_uses_;
+        }
+        ++end;
+      }
+      llvm::StringRef name = i + 1 < end ? file_tokens_.GetText(i + 1) : "";
+      if (name == "if" || name == "ifdef" || name == "ifndef") {
+        bool is_include_guard = has_include_guard && i == 0;
+        conditionals.push_back(is_include_guard);
+        depth += !is_include_guard;
+      } else if (name == "endif") {
+        if (conditionals.empty()) {
+          return false;
+        }
+        depth -= !conditionals.back();
+        conditionals.pop_back();
+      }
+      directives_.push_back(code_.size());
+      i = end;
+    }
+    if (!conditionals.empty()) {
+      return false;
+    }
+
+    match_.assign(code_.size(), kNoMatch);
+    std::vector<size_t> open_brackets;
+    for (size_t i = 0; i < code_.size(); ++i) {
+      clang::tok::TokenKind kind = Kind(i);
+      if (kind == clang::tok::l_paren || kind == clang::tok::l_square ||
+          kind == clang::tok::l_brace) {
+        open_brackets.push_back(i);
+        continue;
+      }
+      clang::tok::TokenKind open_kind;
+      if (kind == clang::tok::r_paren) {
+        open_kind = clang::tok::l_paren;
+      } else if (kind == clang::tok::r_square) {
+        open_kind = clang::tok::l_square;
+      } else if (kind == clang::tok::r_brace) {
+        open_kind = clang::tok::l_brace;
+      } else {
+        continue;
+      }
+      if (open_brackets.empty() || Kind(open_brackets.back()) != open_kind) {
+        return false;
+      }
+      match_[i] = open_brackets.back();
+      match_[open_brackets.back()] = i;
+      open_brackets.pop_back();
+    }
+    return open_brackets.empty();
+  }
+
+  // Returns false if the use at |macro| needs the AST path. Otherwise sets
+  // |edits| to the edits the AST path makes, if any.
+  bool ClassifyUse(size_t macro, std::optional<MacroUseEdits>* edits) {
+    // The shape FindMacro() accepts, with a plain class name.
+    if (macro + 4 >= code_.size() || conditional_[macro] ||
+        !Is(macro + 1, clang::tok::l_paren) ||
+        !Is(macro + 2, clang::tok::raw_identifier) ||
+        !Is(macro + 3, clang::tok::r_paren) ||
+        !Is(macro + 4, clang::tok::semi) ||
+        Offset(macro + 3) + 1 != Offset(macro + 4)) {
+      return false;
+    }
+    llvm::StringRef class_name = Text(macro + 2);
+
+    std::optional<size_t> open = FindEnclosingBrace(macro);
+    if (!open || conditional_[*open]) {
+      return false;
+    }
+    size_t close = match_[*open];
+    // A directive within the body may change the members the compiler sees.
+    auto directive =
+        std::upper_bound(directives_.begin(), directives_.end(), *open);
+    if (directive != directives_.end() && *directive <= close) {
+      return false;
+    }
+    std::optional<Access> default_access = ParseClassHead(*open, class_name);
+    if (!default_access) {
+      return false;
+    }
+    std::optional<std::vector<Member>> members =
+        ParseMembers(*open, close, class_name);
+    if (!members) {
+      return false;
+    }
+
+    const Member* removed_access_specifier = nullptr;
+    if (!FindRemovedAccessSpecifier(*members, *default_access,
+                                    &removed_access_specifier)) {
+      return false;
+    }
+    const Member* selected = nullptr;
+    if (!SelectMemberToInsertAfter(*members, *default_access, &selected)) {
+      return false;
+    }
+    if (!selected) {
+      return true;
+    }
+    unsigned remove_offset = removed_access_specifier
+                                 ? Offset(removed_access_specifier->begin)
+                                 : Offset(macro);
+    *edits = MacroUseEdits{
+        .class_name = class_name.str(),
+        .remove_offset = remove_offset,
+        .remove_length = Offset(macro + 4) + 1 - remove_offset,
+        // After the closing brace of an inline body, or the semicolon,
+        // which is the first one after the end of the declaration.
+        .insert_offset = Offset(selected->end) + 1};
+    return true;
+  }
+
+  // Returns the brace of the class body directly holding |index|, or
+  // std::nullopt if it is within parentheses or at file scope.
+  std::optional<size_t> FindEnclosingBrace(size_t index) const {
+    for (size_t i = index; i-- > 0;) {
+      switch (Kind(i)) {
+        case clang::tok::r_paren:
+        case clang::tok::r_square:
+        case clang::tok::r_brace:
+          i = match_[i];
+          break;
+        case clang::tok::l_brace:
+          return i;
+        case clang::tok::l_paren:
+        case clang::tok::l_square:
+          return std::nullopt;
+        default:
+          break;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Returns the default access of the class named |class_name| whose body
+  // opens at |open|, or std::nullopt if the tokens before |open| are not
+  // the head of such a class or struct.
+  std::optional<Access> ParseClassHead(size_t open,
+                                       llvm::StringRef class_name) const {
+    size_t head = open;
+    while (head > 0) {
+      clang::tok::TokenKind kind = Kind(head - 1);
+      if (kind == clang::tok::semi || kind == clang::tok::l_brace ||
+          kind == clang::tok::r_brace) {
+        break;
+      }
+      head = (kind == clang::tok::r_paren || kind == clang::tok::r_square)
+                 ? match_[head - 1]
+                 : head - 1;
+    }
+    for (size_t i = head; i < open; ++i) {
+      llvm::StringRef text = Text(i);
+      if (text != "class" && text != "struct") {
+        continue;
+      }
+      if (i > head && Text(i - 1) == "enum") {
+        return std::nullopt;
+      }
+      // Skips attributes and export macros, as in
+      // "class RTC_EXPORT Foo final : public Bar {".
+      size_t name = i + 1;
+      while (name < open) {
+        if (Is(name, clang::tok::l_square)) {
+          name = match_[name] + 1;
+        } else if (Is(name, clang::tok::raw_identifier) &&
+                   Text(name) != class_name &&
+                   (Is(name + 1, clang::tok::raw_identifier) ||
+                    Is(name + 1, clang::tok::l_paren))) {
+          name = Is(name + 1, clang::tok::l_paren) ? match_[name + 1] + 1
+                                                   : name + 1;
+        } else {
+          break;
+        }
+      }
+      if (name >= open || Text(name) != class_name) {
+        continue;
+      }
+      size_t next = name + 1;
+      if (Text(next) == "final") {
+        ++next;
+      }
+      if (next != open && !Is(next, clang::tok::colon)) {
+        return std::nullopt;
+      }
+      return text == "class" ? Access::kPrivate : Access::kPublic;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<std::vector<Member>> ParseMembers(
+      size_t open,
+      size_t close,
+      llvm::StringRef class_name) const {
+    std::vector<Member> members;
+    bool has_macro = false;
+    for (size_t i = open + 1; i < close;) {
+      if (Is(i, clang::tok::semi)) {
+        ++i;
+        continue;
+      }
+      if (std::optional<Access> access = GetAccess(i)) {
+        members.push_back({.kind = MemberKind::kAccessSpecifier,
+                           .begin = i,
+                           .end = i + 1,
+                           .access = *access});
+        i += 2;
+        continue;
+      }
+      if (Text(i) == kModernizeMacro) {
+        // The use being classified is the only one, at a member boundary.
+        if (has_macro || i + 4 >= close) {
+          return std::nullopt;
+        }
+        has_macro = true;
+        members.push_back(
+            {.kind = MemberKind::kMacro, .begin = i, .end = i + 4});
+        i += 5;
+        continue;
+      }
+      std::optional<Member> member = ParseMember(i, close, class_name);
+      if (!member) {
+        return std::nullopt;
+      }
+      members.push_back(*member);
+      i = member->end + 1;
+    }
+    if (!has_macro) {
+      return std::nullopt;
+    }
+    return members;
+  }
+
+  // Parses the member declaration starting at |begin|, or returns
+  // std::nullopt if its kind or its end is not certain.
+  std::optional<Member> ParseMember(size_t begin,
+                                    size_t close,
+                                    llvm::StringRef class_name) const {
+    Member member{.kind = MemberKind::kField, .begin = begin, .end = begin};
+    llvm::StringRef first = Text(begin);
+    bool is_other = llvm::StringSwitch<bool>(first)
+                        .Cases("typedef", "using", "friend", "template", true)
+                        .Case("static_assert", true)
+                        .Default(false);
+    bool is_type = first == "class" || first == "struct" || first == "enum";
+    if (first == "union" || (first != "enum" && is_type &&
+                             Is(begin + 1, clang::tok::l_brace))) {
+      // Anonymous unions and structs add implicit fields.
+      return std::nullopt;
+    }
+
+    size_t name = begin;
+    bool is_inline = false;
+    while (name < close) {
+      if (Is(name, clang::tok::l_square) &&
+          Is(name + 1, clang::tok::l_square)) {
+        name = match_[name] + 1;
+        continue;
+      }
+      llvm::StringRef text = Text(name);
+      if (!Is(name, clang::tok::raw_identifier) || !IsDeclSpecifier(text)) {
+        break;
+      }
+      if (text == "explicit" && Is(name + 1, clang::tok::l_paren)) {
+        return std::nullopt;
+      }
+      is_inline |= text == "inline" || text == "constexpr" ||
+                   text == "consteval";
+      ++name;
+    }
+    if (!is_other && !is_type) {
+      if (Is(name, clang::tok::tilde)) {
+        if (Text(name + 1) != class_name ||
+            !Is(name + 2, clang::tok::l_paren)) {
+          return std::nullopt;
+        }
+        member.kind = MemberKind::kDestructor;
+      } else if (Text(name) == class_name &&
+                 Is(name + 1, clang::tok::l_paren)) {
+        member.kind = MemberKind::kConstructor;
+      } else if (LooksLikeMacro(Text(name))) {
+        return std::nullopt;
+      }
+    }
+
+    bool has_parameters = false;
+    bool has_initializer = false;
+    bool in_constructor_initializers = false;
+    size_t last_brace = kNoMatch;
+    // The name of a destructor is checked above.
+    size_t i = member.kind == MemberKind::kDestructor ? name + 2 : name;
+    while (true) {
+      if (i >= close || Text(i) == kModernizeMacro || Text(i) == "try" ||
+          (i > name && GetAccess(i))) {
+        return std::nullopt;
+      }
+      clang::tok::TokenKind kind = Kind(i);
+      if (kind == clang::tok::semi) {
+        member.end = i;
+        break;
+      }
+      if (i > name && !is_other &&
+          (kind == clang::tok::tilde ||
+           (Text(i) == class_name && Is(i + 1, clang::tok::l_paren)))) {
+        // A constructor or destructor after a macro or an attribute.
+        return std::nullopt;
+      }
+      if (kind == clang::tok::l_paren) {
+        has_parameters |= !has_initializer;
+        i = match_[i] + 1;
+        continue;
+      }
+      if (kind == clang::tok::l_square) {
+        i = match_[i] + 1;
+        continue;
+      }
+      if (kind == clang::tok::equal && !in_constructor_initializers) {
+        has_initializer = true;
+      } else if (kind == clang::tok::colon && has_parameters &&
+                 !has_initializer) {
+        in_constructor_initializers = true;
+      } else if (kind == clang::tok::l_brace) {
+        // Within constructor initializers, braces after a name initialize
+        // a member and braces after another initializer open the body.
+        bool is_body = in_constructor_initializers
+                           ? (Is(i - 1, clang::tok::r_paren) ||
+                              Is(i - 1, clang::tok::r_brace))
+                           : has_parameters && !has_initializer;
+        if (is_body) {
+          member.has_body = true;
+          member.end = match_[i];
+          break;
+        }
+        last_brace = i;
+        i = match_[i] + 1;
+        continue;
+      }
+      ++i;
+    }
+
+    if (is_type) {
+      // "class Foo;" and "enum E { ... };" declare no member, unlike
+      // "struct Foo { ... } foo_;" or "class Foo* foo_;".
+      if (member.end != begin + 2 &&
+          (member.has_body || last_brace == kNoMatch ||
+           match_[last_brace] + 1 != member.end)) {
+        return std::nullopt;
+      }
+      member.kind = MemberKind::kOther;
+      return member;
+    }
+    if (is_other) {
+      member.kind = MemberKind::kOther;
+      return member;
+    }
+    if (member.kind == MemberKind::kField && has_parameters) {
+      member.kind = MemberKind::kMethod;
+    }
+    if (member.kind == MemberKind::kField) {
+      return member;
+    }
+    if (member.has_body) {
+      // "std::function<void()> callback_{};" looks like a method with a
+      // body followed by a semicolon.
+      if (member.kind == MemberKind::kMethod &&
+          Is(member.end + 1, clang::tok::semi)) {
+        return std::nullopt;
+      }
+      return member;
+    }
+    bool is_deleted = false;
+    if (member.end >= begin + 2 && Is(member.end - 2, clang::tok::equal)) {
+      member.is_defaulted = Text(member.end - 1) == "default";
+      is_deleted = Text(member.end - 1) == "delete";
+    }
+    member.no_semicolon_lookup =
+        !member.is_defaulted && (is_inline || is_deleted);
+    return member;
+  }
+
+  // Reproduces CheckIfRemovablePrivateDeclLocation(). Sets |access_specifier|
+  // to the "private:" removed along with the macro, if any. Returns false
+  // if that cannot be told from the tokens.
+  static bool FindRemovedAccessSpecifier(const std::vector<Member>& members,
+                                         Access default_access,
+                                         const Member** access_specifier) {
+    Access access = default_access;
+    const Member* candidate = nullptr;
+    bool maybe_remove = false;
+    for (const Member& member : members) {
+      if (member.kind == MemberKind::kOther) {
+        continue;
+      }
+      if (member.kind == MemberKind::kAccessSpecifier) {
+        access = member.access;
+        if (maybe_remove && access != Access::kPrivate) {
+          candidate = nullptr;
+          maybe_remove = false;
+          break;
+        } else if (!maybe_remove && access == Access::kPrivate) {
+          candidate = &member;
+          maybe_remove = true;
+        }
+        continue;
+      }
+      if (member.kind == MemberKind::kMacro) {
+        if (access != Access::kPrivate) {
+          return true;
+        }
+        maybe_remove = true;
+        continue;
+      }
+      if (maybe_remove) {
+        candidate = nullptr;
+        maybe_remove = false;
+        break;
+      }
+    }
+    if (!maybe_remove) {
+      return true;
+    }
+    // Without a "private:" of its own, the AST path has nothing to remove
+    // but does not expect that.
+    if (!candidate) {
+      return false;
+    }
+    // Declarations the AST path does not see would be removed with it.
+    for (const Member* member = candidate;
+         member->kind != MemberKind::kMacro; ++member) {
+      if (member->kind == MemberKind::kOther) {
+        return false;
+      }
+    }
+    *access_specifier = candidate;
+    return true;
+  }
+
+  // Reproduces FindInsertableLocation(). Sets |selected| to the member the
+  // deleted members go after, or to nullptr if there is none. Returns false
+  // if that cannot be told from the tokens.
+  static bool SelectMemberToInsertAfter(const std::vector<Member>& members,
+                                        Access default_access,
+                                        const Member** selected) {
+    auto select = [&](auto predicate, bool last) {
+      Access access = default_access;
+      const Member* result = nullptr;
+      for (const Member& member : members) {
+        if (member.kind == MemberKind::kAccessSpecifier) {
+          access = member.access;
+        } else if (predicate(member, access)) {
+          result = &member;
+          if (!last) {
+            break;
+          }
+        }
+      }
+      return result;
+    };
+    // The macro declares a constructor.
+    auto is_constructor = [](const Member& member) {
+      return member.kind == MemberKind::kConstructor ||
+             member.kind == MemberKind::kMacro;
+    };
+
+    const Member* result = select(
+        [](const Member& member, Access access) {
+          return member.kind == MemberKind::kDestructor &&
+                 access == Access::kPublic;
+        },
+        /*last=*/false);
+    if (!result) {
+      result = select(
+          [&](const Member& member, Access access) {
+            return is_constructor(member) && access == Access::kPublic;
+          },
+          /*last=*/true);
+    }
+    if (!result) {
+      result = select(
+          [](const Member& member, Access access) {
+            return member.kind == MemberKind::kDestructor;
+          },
+          /*last=*/false);
+    }
+    if (!result) {
+      // The last member of the first public section followed by another.
+      Access access = default_access;
+      const Member* candidate = nullptr;
+      for (const Member& member : members) {
+        if (member.kind == MemberKind::kOther) {
+          continue;
+        }
+        if (member.kind == MemberKind::kAccessSpecifier) {
+          Access previous_access = access;
+          access = member.access;
+          if (previous_access == Access::kPublic && access != previous_access &&
+              candidate) {
+            result = candidate;
+            break;
+          }
+          continue;
+        }
+        if (access == Access::kPublic) {
+          candidate = &member;
+        }
+      }
+    }
+    // The end of the members the macro declares is in the macro expansion.
+    if (result && (result->kind == MemberKind::kMacro ||
+                   result->no_semicolon_lookup)) {
+      return false;
+    }
+    *selected = result;
+    return true;
+  }
+
+  std::optional<Access> GetAccess(size_t index) const {
+    if (!Is(index + 1, clang::tok::colon)) {
+      return std::nullopt;
+    }
+    return llvm::StringSwitch<std::optional<Access>>(Text(index))
+        .Case("public", Access::kPublic)
+        .Case("protected", Access::kProtected)
+        .Case("private", Access::kPrivate)
+        .Default(std::nullopt);
+  }
+
+  bool Is(size_t index, clang::tok::TokenKind kind) const {
+    return index < code_.size() && Kind(index) == kind;
+  }
+
+  clang::tok::TokenKind Kind(size_t index) const {
+    return file_tokens_.tokens[code_[index]].kind;
+  }
+
+  llvm::StringRef Text(size_t index) const {
+    return index < code_.size() ? file_tokens_.GetText(code_[index]) : "";
+  }
+
+  unsigned Offset(size_t index) const {
+    return file_tokens_.tokens[code_[index]].offset;
+  }
+
+  const FileTokens& file_tokens_;
+  // Indices of the tokens outside of directives, which the indices below
+  // refer to.
+  std::vector<size_t> code_;
+  // Whether each token is within a conditional directive other than the
+  // include guard.
+  std::vector<bool> conditional_;
+  // The number of tokens before each directive.
+  std::vector<size_t> directives_;
+  // The matching bracket of each bracket.
+  std::vector<size_t> match_;
+  size_t num_directive_uses_ = 0;
+};
+
+}  // namespace
+
+LexerFastPathResult ClassifyMacroUses(const FileTokens& file_tokens) {
+  return MacroUseClassifier(file_tokens).Classify();
+}
+
+LexerFastPathResult ClassifyMacroUses(llvm::StringRef buffer) {
+  if (!buffer.contains(kModernizeMacro)) {
+    return LexerFastPathResult();
+  }
+  FileTokens file_tokens{.buffer = buffer,
+                         .tokens = LexRawTokens(buffer, GetCpp17LangOptions())};
+  return ClassifyMacroUses(file_tokens);
+}
+
+}  // namespace modernizer
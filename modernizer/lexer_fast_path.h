@@ -0,0 +1,45 @@
+#ifndef MODERNIZER_LEXER_FAST_PATH_H_
+#define MODERNIZER_LEXER_FAST_PATH_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "modernizer/raw_token_cache.h"
+
+namespace modernizer {
+
+// The edits of one use of kModernizeMacro, as the AST path finds them.
+struct MacroUseEdits {
+  std::string class_name;
+  // The macro and its semicolon, starting at the access specifier of the
+  // "private:" section if it holds nothing else.
+  unsigned remove_offset;
+  unsigned remove_length;
+  // Right after the semicolon or the closing brace of the member that the
+  // deleted members follow.
+  unsigned insert_offset;
+};
+
+struct LexerFastPathResult {
+  std::vector<MacroUseEdits> edits;
+  size_t num_macro_uses = 0;
+  // Uses that cannot be classified from the tokens alone. The file needs
+  // the AST path unless this is zero.
+  size_t num_fallbacks = 0;
+};
+
+// Classifies every use of kModernizeMacro in |file_tokens| with a brace and
+// access specifier tracker over the raw tokens, and reproduces the edits of
+// the AST path for regular classes. Classes under conditional directives,
+// with members that look like macros, or with members the tokens cannot
+// tell apart are left to the AST path. Uses for which the AST path finds no
+// member to insert after get no edits.
+LexerFastPathResult ClassifyMacroUses(const FileTokens& file_tokens);
+
+// Lexes |buffer| as C++17 first.
+LexerFastPathResult ClassifyMacroUses(llvm::StringRef buffer);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_LEXER_FAST_PATH_H_
@@ -0,0 +1,183 @@
+#include "modernizer/lexer_fast_path.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+using modernizer::ClassifyMacroUses;
+using modernizer::LexerFastPathResult;
+
+unsigned OffsetAfter(const std::string& text, const std::string& needle) {
+  return text.find(needle) + needle.size();
+}
+
+TEST(LexerFastPathTest, RemovesTrailingPrivateSection) {
+  std::string text =
+      "#ifndef BYTE_BUFFER_H_\n"
+      "#define BYTE_BUFFER_H_\n"
+      "\n"
+      "class ByteBufferReader {\n"
+      " public:\n"
+      "  ByteBufferReader(const char* bytes, size_t len);\n"
+      "  explicit ByteBufferReader(const char* bytes);\n"
+      "  bool Consume(size_t size);\n"
+      "\n"
+      " protected:\n"
+      "  const char* bytes_;\n"
+      "\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(ByteBufferReader);\n"
+      "};\n"
+      "\n"
+      "#endif  // BYTE_BUFFER_H_\n";
+  LexerFastPathResult result = ClassifyMacroUses(text);
+  EXPECT_EQ(result.num_macro_uses, 1u);
+  EXPECT_EQ(result.num_fallbacks, 0u);
+  ASSERT_EQ(result.edits.size(), 1u);
+  EXPECT_EQ(result.edits[0].class_name, "ByteBufferReader");
+  EXPECT_EQ(result.edits[0].remove_offset, text.find("private:"));
+  EXPECT_EQ(result.edits[0].remove_offset + result.edits[0].remove_length,
+            OffsetAfter(text, "(ByteBufferReader);"));
+  EXPECT_EQ(result.edits[0].insert_offset,
+            OffsetAfter(text, "(const char* bytes);"));
+}
+
+TEST(LexerFastPathTest, KeepsPrivateSectionWithOtherMembers) {
+  std::string text =
+      "class Foo {\n"
+      " public:\n"
+      "  Foo();\n"
+      "  ~Foo() = default;\n"
+      "\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "  std::string foo_{\"foo\"};\n"
+      "};\n"
+      "\n"
+      "template <class T>\n"
+      "class SCOPED_LOCKABLE Bar final : public Base<Bar<T>> {\n"
+      " public:\n"
+      "  explicit Bar(T t) : Base(t), t_{t} { Init(); }\n"
+      "  ~Bar() { t_ = T(); }\n"
+      "\n"
+      " private:\n"
+      "  T t_;\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Bar);\n"
+      "};\n";
+  LexerFastPathResult result = ClassifyMacroUses(text);
+  EXPECT_EQ(result.num_macro_uses, 2u);
+  EXPECT_EQ(result.num_fallbacks, 0u);
+  ASSERT_EQ(result.edits.size(), 2u);
+  EXPECT_EQ(result.edits[0].remove_offset, text.find("RTC_"));
+  EXPECT_EQ(result.edits[0].insert_offset, OffsetAfter(text, "= default;"));
+  EXPECT_EQ(result.edits[1].class_name, "Bar");
+  EXPECT_EQ(result.edits[1].remove_offset, text.rfind("RTC_"));
+  EXPECT_EQ(result.edits[1].insert_offset, OffsetAfter(text, "t_ = T(); }"));
+}
+
+TEST(LexerFastPathTest, InsertsAfterLastMemberOfFirstPublicSection) {
+  std::string text =
+      "class Decoder final {\n"
+      " public:\n"
+      "  static bool IsSuitable(const std::string& input);\n"
+      "\n"
+      " private:\n"
+      "  static std::unique_ptr<Decoder> Create(const std::string& input);\n"
+      "  Decoder(BitstreamReader reader);\n"
+      "  ~Decoder();\n"
+      "\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Decoder);\n"
+      "};\n"
+      "\n"
+      "struct Options {\n"
+      "  using Callback = std::function<void()>;\n"
+      "  int value = 0;\n"
+      "\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Options);\n"
+      "};\n";
+  LexerFastPathResult result = ClassifyMacroUses(text);
+  EXPECT_EQ(result.num_fallbacks, 0u);
+  ASSERT_EQ(result.edits.size(), 2u);
+  // A destructor is preferred even if it is not public.
+  EXPECT_EQ(result.edits[0].insert_offset, OffsetAfter(text, "~Decoder();"));
+  EXPECT_EQ(result.edits[0].remove_offset, text.find("RTC_"));
+  EXPECT_EQ(result.edits[1].insert_offset,
+            OffsetAfter(text, "int value = 0;"));
+  EXPECT_EQ(result.edits[1].remove_offset, text.rfind("private:"));
+}
+
+TEST(LexerFastPathTest, NoEditsWithoutMemberToInsertAfter) {
+  LexerFastPathResult result = ClassifyMacroUses(
+      "class Foo {\n"
+      " private:\n"
+      "  int foo_;\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n");
+  EXPECT_EQ(result.num_macro_uses, 1u);
+  EXPECT_EQ(result.num_fallbacks, 0u);
+  EXPECT_TRUE(result.edits.empty());
+}
+
+TEST(LexerFastPathTest, FallsBackOnAmbiguousClasses) {
+  const char* texts[] = {
+      // A directive in the body.
+      "class Foo {\n"
+      " public:\n"
+      "  Foo();\n"
+      "#if defined(BAR)\n"
+      "  void Bar();\n"
+      "#endif\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n",
+      // A class under a conditional other than the include guard.
+      "#ifndef FOO_H_\n"
+      "#define FOO_H_\n"
+      "#if defined(BAR)\n"
+      "class Foo {\n"
+      " public:\n"
+      "  Foo();\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n"
+      "#endif\n"
+      "#endif\n",
+      // A macro that may declare members.
+      "class Foo {\n"
+      " public:\n"
+      "  Foo();\n"
+      " private:\n"
+      "  FRIEND_TEST(FooTest, Bar);\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n",
+      // A field with braces that look like a body.
+      "class Foo {\n"
+      " public:\n"
+      "  std::function<void()> callback_{};\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n",
+      // The macro in the public section.
+      "class Foo {\n"
+      " public:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+      "};\n",
+      // A use without a semicolon.
+      "class Foo {\n"
+      " public:\n"
+      "  Foo();\n"
+      " private:\n"
+      "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo)\n"
+      "};\n",
+  };
+  for (const char* text : texts) {
+    LexerFastPathResult result = ClassifyMacroUses(text);
+    EXPECT_EQ(result.num_macro_uses, 1u) << text;
+    EXPECT_EQ(result.num_fallbacks, 1u) << text;
+    EXPECT_TRUE(result.edits.empty()) << text;
+  }
+}
+
+}  // namespace
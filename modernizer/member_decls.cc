@@ -0,0 +1,36 @@
+#include "modernizer/member_decls.h"
+
+#include "clang/AST/DeclTemplate.h"
+
+namespace modernizer {
+
+std::vector<clang::Decl*> CollectMemberDecls(
+    const clang::CXXRecordDecl* record_decl) {
+  std::vector<clang::Decl*> member_decls;
+  if (const auto* specialization_decl =
+          llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(record_decl);
+      specialization_decl && specialization_decl->getSpecializationKind() !=
+                                 clang::TSK_ExplicitSpecialization) {
+    return member_decls;
+  }
+  for (clang::Decl* decl : record_decl->decls()) {
+    if (llvm::isa<clang::CXXMethodDecl, clang::AccessSpecDecl,
+                  clang::FieldDecl, clang::VarDecl>(decl)) {
+      member_decls.push_back(decl);
+    }
+  }
+  return member_decls;
+}
+
+const std::vector<clang::Decl*>& MemberDeclCache::Get(
+    const clang::CXXRecordDecl* record_decl) {
+  auto [iter, inserted] =
+      member_decls_.try_emplace(record_decl->getCanonicalDecl());
+  if (inserted) {
+    iter->second = CollectMemberDecls(record_decl);
+    ++num_collected_;
+  }
+  return iter->second;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,40 @@
+#ifndef MODERNIZER_MEMBER_DECLS_H_
+#define MODERNIZER_MEMBER_DECLS_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "llvm/ADT/DenseMap.h"
+
+namespace modernizer {
+
+// Returns the methods, access specifiers, fields and variables declared
+// directly in |record_decl|, implicit ones included, in declaration order.
+// Members of implicit instantiations are not looked at.
+std::vector<clang::Decl*> CollectMemberDecls(
+    const clang::CXXRecordDecl* record_decl);
+
+// The members of the classes of one translation unit, collected once per
+// class.
+class MemberDeclCache {
+ public:
+  // Returns CollectMemberDecls() of the first declaration of the class of
+  // |record_decl| passed in.
+  const std::vector<clang::Decl*>& Get(const clang::CXXRecordDecl* record_decl);
+
+  // Forgets every class, as at the end of a translation unit.
+  void Clear() { member_decls_.clear(); }
+
+  size_t GetNumCollected() const { return num_collected_; }
+
+ private:
+  llvm::DenseMap<const clang::CXXRecordDecl*, std::vector<clang::Decl*>>
+      member_decls_;
+  size_t num_collected_ = 0;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_MEMBER_DECLS_H_
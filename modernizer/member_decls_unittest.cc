@@ -0,0 +1,176 @@
+#include "modernizer/member_decls.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/AST/DeclTemplate.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using namespace clang::ast_matchers;
+
+constexpr char kCode[] = R"cc(
+class Outer;
+
+class Outer {
+ public:
+  Outer();
+
+  class Inner {
+   public:
+    Inner();
+    int inner_field;
+  };
+
+ private:
+  int field;
+  static int variable;
+};
+
+template <typename T>
+class Box {
+ public:
+  Box();
+  T value;
+};
+
+template <>
+class Box<int> {
+ public:
+  Box();
+  int value;
+  int extra;
+};
+
+Box<char> char_box;
+)cc";
+
+class MemberDeclsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ast_ = clang::tooling::buildASTFromCodeWithArgs(kCode, {"-std=c++17"});
+    ASSERT_TRUE(ast_);
+  }
+
+  // Returns the definition of the class |name| if |definition|, or its first
+  // declaration otherwise.
+  const clang::CXXRecordDecl* FindClass(const std::string& name,
+                                        bool definition = true) {
+    for (const BoundNodes& nodes :
+         match(cxxRecordDecl(hasName(name), unless(isImplicit()))
+                   .bind("record"),
+               ast_->getASTContext())) {
+      const auto* record_decl =
+          nodes.getNodeAs<clang::CXXRecordDecl>("record");
+      if (record_decl->isThisDeclarationADefinition() == definition &&
+          !llvm::isa<clang::ClassTemplateSpecializationDecl>(record_decl)) {
+        return record_decl;
+      }
+    }
+    return nullptr;
+  }
+
+  const clang::ClassTemplateSpecializationDecl* FindBox(
+      const std::string& argument) {
+    for (const BoundNodes& nodes :
+         match(classTemplateSpecializationDecl(
+                   hasName("Box"), hasTemplateArgument(
+                                       0, refersToType(asString(argument))))
+                   .bind("specialization"),
+               ast_->getASTContext())) {
+      return nodes.getNodeAs<clang::ClassTemplateSpecializationDecl>(
+          "specialization");
+    }
+    return nullptr;
+  }
+
+  std::unique_ptr<clang::ASTUnit> ast_;
+};
+
+// Describes the members that are not implicit, like "Field extra".
+// Constructors have no identifier, so they are only described by kind.
+std::vector<std::string> Describe(const std::vector<clang::Decl*>& decls) {
+  std::vector<std::string> descriptions;
+  for (const clang::Decl* decl : decls) {
+    if (decl->isImplicit()) {
+      continue;
+    }
+    std::string description = decl->getDeclKindName();
+    if (const auto* named_decl = llvm::dyn_cast<clang::NamedDecl>(decl);
+        named_decl && named_decl->getIdentifier()) {
+      description += " " + named_decl->getName().str();
+    }
+    descriptions.push_back(description);
+  }
+  return descriptions;
+}
+
+TEST_F(MemberDeclsTest, SkipsNestedClasses) {
+  const clang::CXXRecordDecl* outer = FindClass("Outer");
+  ASSERT_TRUE(outer);
+  EXPECT_EQ(Describe(modernizer::CollectMemberDecls(outer)),
+            (std::vector<std::string>{"AccessSpec", "CXXConstructor",
+                                      "AccessSpec", "Field field",
+                                      "Var variable"}));
+
+  const clang::CXXRecordDecl* inner = FindClass("Inner");
+  ASSERT_TRUE(inner);
+  EXPECT_EQ(Describe(modernizer::CollectMemberDecls(inner)),
+            (std::vector<std::string>{"AccessSpec", "CXXConstructor",
+                                      "Field inner_field"}));
+}
+
+TEST_F(MemberDeclsTest, OnlyLooksAtExplicitSpecializations) {
+  const clang::CXXRecordDecl* primary = FindClass("Box");
+  ASSERT_TRUE(primary);
+  EXPECT_EQ(Describe(modernizer::CollectMemberDecls(primary)),
+            (std::vector<std::string>{"AccessSpec", "CXXConstructor",
+                                      "Field value"}));
+
+  const clang::ClassTemplateSpecializationDecl* explicit_specialization =
+      FindBox("int");
+  ASSERT_TRUE(explicit_specialization);
+  EXPECT_EQ(explicit_specialization->getSpecializationKind(),
+            clang::TSK_ExplicitSpecialization);
+  EXPECT_EQ(Describe(modernizer::CollectMemberDecls(explicit_specialization)),
+            (std::vector<std::string>{"AccessSpec", "CXXConstructor",
+                                      "Field value", "Field extra"}));
+
+  const clang::ClassTemplateSpecializationDecl* implicit_instantiation =
+      FindBox("char");
+  ASSERT_TRUE(implicit_instantiation);
+  EXPECT_EQ(implicit_instantiation->getSpecializationKind(),
+            clang::TSK_ImplicitInstantiation);
+  EXPECT_TRUE(modernizer::CollectMemberDecls(implicit_instantiation).empty());
+}
+
+TEST_F(MemberDeclsTest, CollectsEachClassOnce) {
+  const clang::CXXRecordDecl* definition = FindClass("Outer");
+  const clang::CXXRecordDecl* declaration =
+      FindClass("Outer", /*definition=*/false);
+  ASSERT_TRUE(definition);
+  ASSERT_TRUE(declaration);
+  ASSERT_NE(definition, declaration);
+
+  modernizer::MemberDeclCache cache;
+  const std::vector<clang::Decl*>& members = cache.Get(definition);
+  EXPECT_EQ(Describe(members).size(), 5u);
+  EXPECT_EQ(&cache.Get(definition), &members);
+  // Any declaration of the class finds the members of its definition.
+  EXPECT_EQ(&cache.Get(declaration), &members);
+  EXPECT_EQ(cache.GetNumCollected(), 1u);
+
+  cache.Get(FindClass("Inner"));
+  EXPECT_EQ(cache.GetNumCollected(), 2u);
+  cache.Clear();
+  cache.Get(definition);
+  EXPECT_EQ(cache.GetNumCollected(), 3u);
+}
+
+}  // namespace
@@ -1,26 +1,56 @@
 #include "modernizer/modernizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+
 #include "absl/algorithm/container.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
-#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Edit/Commit.h"
 #include "clang/Edit/EditedSource.h"
 #include "clang/Edit/EditsReceiver.h"
+#include "clang/Format/Format.h"
 #include "clang/Frontend/CompilerInstance.h"
-#include "clang/Frontend/TextDiagnosticPrinter.h"
-#include "clang/Rewrite/Core/Rewriter.h"
-#include "clang/Tooling/AllTUsExecution.h"
-#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Tooling/Inclusions/HeaderIncludes.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Refactoring/AtomicChange.h"
-#include "clang/Tooling/StandaloneExecution.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/xxhash.h"
+#include "modernizer/compilation_database.h"
+#include "modernizer/constructor_matcher.h"
+#include "modernizer/depfile.h"
 #include "modernizer/diff.h"
+#include "modernizer/file_coverage.h"
+#include "modernizer/file_system_cache.h"
 #include "modernizer/filesystem.h"
+#include "modernizer/format_windows.h"
+#include "modernizer/git.h"
+#include "modernizer/header_cost.h"
+#include "modernizer/in_place_writer.h"
+#include "modernizer/include_index.h"
+#include "modernizer/journal.h"
+#include "modernizer/lexer_fast_path.h"
+#include "modernizer/member_decls.h"
 #include "modernizer/mutex_lock.h"
 #include "modernizer/path_pattern.h"
-#include "re2/re2.h"
+#include "modernizer/perf_record.h"
+#include "modernizer/pipeline.h"
+#include "modernizer/prefetcher.h"
+#include "modernizer/raw_token_cache.h"
+#include "modernizer/replacements.h"
+#include "modernizer/style_cache.h"
+#include "modernizer/tool_executor.h"
+#include "modernizer/translation_unit_cache.h"
+#include "modernizer/worker_pool.h"
 
 using namespace clang;
 using namespace clang::ast_matchers;
@@ -29,102 +59,32 @@ using namespace clang::tooling;
 namespace modernizer {
 namespace {
 
-constexpr std::string_view kModernizeMacroRegex =
-    "(RTC_DISALLOW_COPY_AND_ASSIGN\\(\\s*(\\S(|.*\\S))\\s*\\);)";
+// The macro and its argument, as in "RTC_DISALLOW_COPY_AND_ASSIGN(Foo);", span
+// at most this many tokens.
+constexpr size_t kMaxMacroTokens = 10;
 
 constexpr std::string_view kModernizeHeader = "rtc_base/constructor_magic.h";
 
-struct SimpleSourceLocation {
-  int line;
-  int column;
-
-  constexpr bool operator<(const SimpleSourceLocation& other) const {
-    return std::tie(line, column) < std::tie(other.line, other.column);
-  }
-};
-
-class LOCKABLE ReplacementsContext {
- public:
-  void lock() EXCLUSIVE_LOCK_FUNCTION() { mutex_.Lock(); }
-
-  void unlock() UNLOCK_FUNCTION() { mutex_.Unlock(); }
-
-  std::map<std::string, std::map<SimpleSourceLocation, Replacements>>&
-  GetReplacements() EXCLUSIVE_LOCKS_REQUIRED(this) {
-    return impl_;
-  }
-
- private:
-  mutable absl::Mutex mutex_;
-  std::map<std::string, std::map<SimpleSourceLocation, Replacements>> impl_
-      GUARDED_BY(mutex_);
-};
-
-class ClassMemberFunctionVisitor
-    : public RecursiveASTVisitor<ClassMemberFunctionVisitor> {
- public:
-  using Base = RecursiveASTVisitor<ClassMemberFunctionVisitor>;
-  friend class RecursiveASTVisitor<ClassMemberFunctionVisitor>;
-
-  explicit ClassMemberFunctionVisitor(const CXXRecordDecl* record_decl)
-      : record_decl_(record_decl) {}
-
-  bool shouldVisitImplicitCode() const { return true; }
-
-  void Visit() {
-    inner_decls_.clear();
-    depth_ = 0;
-    Base::TraverseDecl(const_cast<CXXRecordDecl*>(record_decl_));
-  }
-
-  const std::vector<Decl*>& GetInnerDecls() const { return inner_decls_; }
-
- private:
-  bool TraverseDecl(Decl* node) {
-    if (!node) {
-      return Base::TraverseDecl(node);
-    }
-
-    ++depth_;
-    bool should_continue = true;
-    if (depth_ <= 1) {
-      should_continue = Base::TraverseDecl(node);
-    }
-    --depth_;
-    return should_continue;
-  }
-
-  bool VisitCXXMethodDecl(CXXMethodDecl* decl) {
-    if (depth_ == 1) {
-      inner_decls_.emplace_back(decl);
-    }
-    return true;
-  }
-
-  bool VisitAccessSpecDecl(AccessSpecDecl* decl) {
-    if (depth_ == 1) {
-      inner_decls_.emplace_back(decl);
-    }
-    return true;
-  }
-
-  bool VisitFieldDecl(FieldDecl* decl) {
-    if (depth_ == 1) {
-      inner_decls_.emplace_back(decl);
-    }
-    return true;
-  }
-
-  bool VisitVarDecl(VarDecl* decl) {
-    if (depth_ == 1) {
-      inner_decls_.emplace_back(decl);
-    }
-    return true;
-  }
+// Returns the declarations that replace the macro in |class_name|.
+std::string GetDeletedMembers(const std::string& class_name) {
+  std::string deleted_members;
+  llvm::raw_string_ostream deleted_members_stream(deleted_members);
+  deleted_members_stream << llvm::format(
+      "\n\n%s(const %s&) = delete;\n%s& operator=(const %s&) = delete;\n",
+      class_name.c_str(), class_name.c_str(), class_name.c_str(),
+      class_name.c_str());
+  return deleted_members;
+}
 
-  const CXXRecordDecl* record_decl_;
-  int depth_ = 0;
-  std::vector<Decl*> inner_decls_;
+// Summed over the translation units parsed in this process.
+struct ParseStatistics {
+  std::atomic<size_t> files_read = 0;
+  // Building the line table of a file is costly for large headers.
+  std::atomic<size_t> line_tables_built = 0;
+  std::atomic<size_t> top_level_decls = 0;
+  std::atomic<size_t> skipped_top_level_decls = 0;
+  std::atomic<int64_t> matching_microseconds = 0;
+  std::atomic<size_t> candidates = 0;
 };
 
 class ModernizerCallback : public MatchFinder::MatchCallback {
@@ -132,19 +92,34 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
   explicit ModernizerCallback(const std::filesystem::path& root_path,
                               const std::filesystem::path& build_path,
                               ReplacementsContext* replacements_context,
-                              const PathPattern* path_pattern)
+                              FileSystemCache* file_system_cache,
+                              const PathPattern* path_pattern,
+                              bool verbose,
+                              ParseStatistics* parse_statistics)
       : root_path_(root_path),
         build_path_(build_path),
         replacements_context_(replacements_context),
-        path_pattern_(path_pattern) {
+        file_system_cache_(file_system_cache),
+        path_pattern_(path_pattern),
+        verbose_(verbose),
+        parse_statistics_(parse_statistics) {
     assert(replacements_context_);
+    assert(file_system_cache_);
   }
 
   ~ModernizerCallback() override = default;
 
+  void onEndOfTranslationUnit() override {
+    raw_token_cache_.Clear();
+    member_decls_.Clear();
+  }
+
   void run(const MatchFinder::MatchResult& result) override {
     assert(result.SourceManager);
     assert(result.Context);
+    if (parse_statistics_) {
+      ++parse_statistics_->candidates;
+    }
     const SourceManager& sm = *result.SourceManager;
     LangOptions lang_opts = result.Context->getLangOpts();
     const CXXConstructorDecl* decl =
@@ -185,11 +160,15 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
       }
     }
 
-    auto simple_source_loc = GetSimpleSourceLocation(source_loc);
-    assert(simple_source_loc);
-    llvm::errs() << "candidate <file:" << *rel_file_path_over_buildroot
-                 << ",line:" << simple_source_loc->line
-                 << ",column:" << simple_source_loc->column << ">\n";
+    // Line and column numbers make the source manager build the line table
+    // of the file, so only compute them when asked to.
+    llvm::errs() << "candidate <file:" << *rel_file_path_over_buildroot;
+    if (verbose_) {
+      llvm::errs() << ",line:" << source_loc.getLineNumber()
+                   << ",column:" << source_loc.getColumnNumber() << ">\n";
+    } else {
+      llvm::errs() << ",offset:" << source_loc.getFileOffset() << ">\n";
+    }
 
     const CXXRecordDecl* class_decl = decl->getParent();
     assert(class_decl);
@@ -197,15 +176,13 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
         (class_decl->getTagKind() == clang::TTK_Class)
             ? AccessSpecifier::AS_private
             : AccessSpecifier::AS_public;
-    ClassMemberFunctionVisitor visitor(class_decl);
-    visitor.Visit();
-    const auto& inner_decls = visitor.GetInnerDecls();
+    const std::vector<Decl*>& inner_decls = member_decls_.Get(class_decl);
 
     std::optional<SourceLocation> remove_decl_source_location =
         CheckIfRemovablePrivateDeclLocation(class_access_specifier, decl,
                                             inner_decls, sm, lang_opts);
     std::optional<std::pair<SourceRange, std::string>> macro_source_range_name =
-        FindMacro(decl, kModernizeMacroRegex, sm, lang_opts);
+        FindMacro(decl, sm, lang_opts);
     if (!macro_source_range_name) {
       return;
     }
@@ -221,90 +198,95 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
       return;
     }
 
-    std::map<SimpleSourceLocation, Replacements> loc_replacements;
+    // The records point to the texts of the changes, which must outlive them.
+    std::vector<ReplacementRecord> records;
+    auto add_records = [&records](unsigned key_offset,
+                                  const Replacements& replacements) {
+      for (const Replacement& replacement : replacements) {
+        records.push_back({.key_offset = key_offset,
+                           .offset = replacement.getOffset(),
+                           .length = replacement.getLength(),
+                           .text = replacement.getReplacementText()});
+      }
+    };
+    AtomicChange remove_change(sm, macro_source_range.getBegin());
     {
-      AtomicChange change(sm, macro_source_range.getBegin());
-      llvm::Error result =
-          change.replace(sm, CharSourceRange(macro_source_range, false), "");
+      llvm::Error result = remove_change.replace(
+          sm, CharSourceRange(macro_source_range, false), "");
       assert(!result);
-      std::optional<SimpleSourceLocation> simple_source_loc =
-          GetSimpleSourceLocation(
-              FullSourceLoc(macro_source_range.getBegin(), sm));
-      assert(simple_source_loc);
-      loc_replacements[*simple_source_loc] = change.getReplacements();
+      add_records(sm.getFileOffset(macro_source_range.getBegin()),
+                  remove_change.getReplacements());
     }
+    SourceLocation insert_offset_loc = insertable_loc->getLocWithOffset(1);
+    assert(insert_offset_loc.isValid());
+    AtomicChange insert_change(sm, insert_offset_loc);
     {
-      SourceLocation insert_offset_loc = insertable_loc->getLocWithOffset(1);
-      assert(insert_offset_loc.isValid());
-      AtomicChange change(sm, insert_offset_loc);
-      std::string deleted_decl;
-      llvm::raw_string_ostream deleted_decl_stream(deleted_decl);
-      deleted_decl_stream << llvm::format(
-          "\n\n%s(const %s&) = delete;\n%s& operator=(const %s&) = delete;\n",
-          class_name.c_str(), class_name.c_str(), class_name.c_str(),
-          class_name.c_str());
-      llvm::Error result =
-          change.insert(sm, insert_offset_loc, deleted_decl_stream.str(), true);
+      llvm::Error result = insert_change.insert(
+          sm, insert_offset_loc, GetDeletedMembers(class_name), true);
       assert(!result);
-      std::optional<SimpleSourceLocation> simple_source_loc =
-          GetSimpleSourceLocation(FullSourceLoc(insert_offset_loc, sm));
-      assert(simple_source_loc);
-      loc_replacements[*simple_source_loc] = change.getReplacements();
+      add_records(sm.getFileOffset(insert_offset_loc),
+                  insert_change.getReplacements());
     }
 
-    MutexLock guard(*replacements_context_);
-    auto& replacements = replacements_context_->GetReplacements();
-    auto replacements_iter = replacements.find(rel_file_path_str);
-    if (replacements_iter == replacements.end()) {
-      auto result2 = replacements.insert(
-          std::remove_reference<decltype(replacements)>::type::value_type(
-              rel_file_path_str, {}));
-      assert(result2.second);
-      replacements_iter = result2.first;
-    }
-    for (const auto& loc_replacement : loc_replacements) {
-      replacements_iter->second.insert(loc_replacement);
+    // Keep a handle to the buffer the replacements were computed against, so
+    // that the output phase applies them to the very same bytes.
+    llvm::StringRef buffer = sm.getBufferData(source_loc.getFileID());
+    std::shared_ptr<const FileSystemCache::Contents> contents =
+        file_system_cache_->FindContents(file_entry->tryGetRealPathName());
+    if (!contents ||
+        (contents->buffer->getBufferStart() != buffer.data() &&
+         contents->hash != llvm::xxHash64(buffer))) {
+      llvm::errs() << "No cached contents for " << rel_file_path_str << "\n";
+      return;
     }
+
+    MutexLock guard(*replacements_context_);
+    replacements_context_->Add(rel_file_path_str, std::move(contents), records);
   }
 
  private:
-  static std::optional<std::pair<SourceRange, std::string>> FindMacro(
+  // Finds "RTC_DISALLOW_COPY_AND_ASSIGN(<class name>);" starting at the
+  // expansion of |decl|, with the class name on a single line, and returns
+  // its range and the class name.
+  std::optional<std::pair<SourceRange, std::string>> FindMacro(
       const Decl* decl,
-      std::string_view regex_text,
       const SourceManager& sm,
       const LangOptions& lang_opts) {
-    re2::RE2 regex{re2::StringPiece(regex_text)};
-    assert(regex.ok());
-    SourceLocation source_location_begin =
-        sm.getExpansionLoc(decl->getLocation());
-    SourceLocation source_location_end = source_location_begin;
-    for (int i = 0; i < 10; ++i) {
-      SourceRange source_range(source_location_begin, source_location_end);
-      if (source_range.isInvalid()) {
-        return std::nullopt;
-      }
-      CharSourceRange char_source_range =
-          Lexer::getAsCharRange(source_range, sm, lang_opts);
-      if (char_source_range.isInvalid()) {
-        return std::nullopt;
-      }
-      std::string source_text =
-          Lexer::getSourceText(char_source_range, sm, lang_opts).str();
-
-      re2::StringPiece match0;
-      re2::StringPiece match1;
-      if (re2::RE2::FullMatch(source_text, regex, &match0, &match1)) {
-        return std::make_pair(
-            SourceRange(source_location_begin,
-                        source_location_end.getLocWithOffset(1)),
-            match1.as_string());
+    SourceLocation begin_loc = sm.getExpansionLoc(decl->getLocation());
+    auto [file_id, begin_offset] = sm.getDecomposedLoc(begin_loc);
+    const FileTokens* file_tokens =
+        raw_token_cache_.Get(file_id, sm, lang_opts);
+    if (!file_tokens) {
+      return std::nullopt;
+    }
+    const std::vector<RawToken>& tokens = file_tokens->tokens;
+    std::optional<size_t> begin = file_tokens->Find(begin_offset);
+    if (!begin || tokens[*begin].offset != begin_offset ||
+        file_tokens->GetText(*begin) != kModernizeMacro ||
+        *begin + 1 >= tokens.size() ||
+        tokens[*begin + 1].kind != clang::tok::l_paren) {
+      return std::nullopt;
+    }
+    size_t end = std::min(*begin + kMaxMacroTokens, tokens.size());
+    for (size_t i = *begin + 3; i < end; ++i) {
+      const RawToken& r_paren = tokens[i - 1];
+      const RawToken& semi = tokens[i];
+      if (semi.kind != clang::tok::semi ||
+          r_paren.kind != clang::tok::r_paren ||
+          r_paren.offset + 1 != semi.offset) {
+        continue;
       }
-      llvm::Optional<Token> tok =
-          Lexer::findNextToken(source_location_end, sm, lang_opts);
-      if (!tok) {
-        return std::nullopt;
+      llvm::StringRef class_name =
+          file_tokens->buffer
+              .slice(tokens[*begin + 1].offset + 1, r_paren.offset)
+              .trim();
+      if (class_name.empty() || class_name.contains('\n')) {
+        continue;
       }
-      source_location_end = tok->getLocation();
+      return std::make_pair(
+          SourceRange(begin_loc, sm.getLocForStartOfFile(file_id)
+                                     .getLocWithOffset(semi.offset + 1)),
+          class_name.str());
     }
     return std::nullopt;
   }
@@ -355,7 +337,7 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
     return std::nullopt;
   }
 
-  static std::optional<SourceLocation> FindInsertableLocation(
+  std::optional<SourceLocation> FindInsertableLocation(
       AccessSpecifier class_access_specifier,
       const std::vector<Decl*>& all_decls,
       const SourceManager& sm,
@@ -459,360 +441,2329 @@ class ModernizerCallback : public MatchFinder::MatchCallback {
     return next_semi_loc;
   }
 
-  static std::optional<SourceLocation> FindNextSemi(
-      SourceLocation loc,
-      const SourceManager& sm,
-      const LangOptions& lang_opts) {
-    while (true) {
-      llvm::Optional<Token> token = Lexer::findNextToken(loc, sm, lang_opts);
-      if (!token) {
-        return std::nullopt;
-      }
-      loc = token->getLocation();
-      if (token->getKind() == clang::tok::semi) {
-        return loc;
-      }
+  // Returns the location of the first semicolon after the token at |loc|.
+  std::optional<SourceLocation> FindNextSemi(SourceLocation loc,
+                                             const SourceManager& sm,
+                                             const LangOptions& lang_opts) {
+    if (loc.isMacroID() &&
+        !Lexer::isAtEndOfMacroExpansion(loc, sm, lang_opts, &loc)) {
+      return std::nullopt;
     }
-  }
-
-  static std::optional<SimpleSourceLocation> GetSimpleSourceLocation(
-      const FullSourceLoc& source_loc) {
-    SimpleSourceLocation simple_source_loc;
-    bool invalid = false;
-    simple_source_loc.line = source_loc.getLineNumber(&invalid);
-    if (invalid) {
+    auto [file_id, offset] = sm.getDecomposedLoc(loc);
+    const FileTokens* file_tokens =
+        raw_token_cache_.Get(file_id, sm, lang_opts);
+    if (!file_tokens) {
       return std::nullopt;
     }
-    simple_source_loc.column = source_loc.getColumnNumber(&invalid);
-    if (invalid) {
+    std::optional<size_t> index = file_tokens->Find(offset);
+    if (!index) {
       return std::nullopt;
     }
-    return simple_source_loc;
+    const std::vector<RawToken>& tokens = file_tokens->tokens;
+    for (size_t i = *index + 1; i < tokens.size(); ++i) {
+      if (tokens[i].kind == clang::tok::semi) {
+        return sm.getLocForStartOfFile(file_id).getLocWithOffset(
+            tokens[i].offset);
+      }
+    }
+    return std::nullopt;
   }
 
   const std::filesystem::path root_path_;
   const std::filesystem::path build_path_;
   ReplacementsContext* replacements_context_;
+  FileSystemCache* file_system_cache_;
   const PathPattern* path_pattern_;
+  const bool verbose_;
+  ParseStatistics* parse_statistics_;
+  RawTokenCache raw_token_cache_;
+  MemberDeclCache member_decls_;
+};
+
+// The files whose declarations are matched.
+struct TraversalScope {
+  std::filesystem::path root_path;
+  const PathPattern* path_pattern;
+  // If set, every declaration is matched instead, which is only useful to
+  // measure the effect of the scope.
+  bool all_declarations;
 };
 
-class StoredCompilationDatabase : public CompilationDatabase {
+// Restricts matching to the top-level declarations of files under the
+// project root that match the source pattern, so that declarations of system
+// and third-party headers are skipped before any matcher runs.
+class TraversalScopeConsumer : public ASTConsumer {
  public:
-  ~StoredCompilationDatabase() override = default;
+  TraversalScopeConsumer(std::unique_ptr<ASTConsumer> matcher_consumer,
+                         const TraversalScope* traversal_scope,
+                         ParseStatistics* parse_statistics)
+      : matcher_consumer_(std::move(matcher_consumer)),
+        traversal_scope_(traversal_scope),
+        parse_statistics_(parse_statistics) {}
+
+  void HandleTranslationUnit(ASTContext& context) override {
+    const SourceManager& sm = context.getSourceManager();
+    size_t num_decls = 0;
+    std::vector<Decl*> scope;
+    for (Decl* decl : context.getTranslationUnitDecl()->decls()) {
+      ++num_decls;
+      if (traversal_scope_->all_declarations || IsInScope(decl, sm)) {
+        scope.push_back(decl);
+      }
+    }
+    if (!traversal_scope_->all_declarations) {
+      context.setTraversalScope(scope);
+    }
 
-  std::vector<CompileCommand> getCompileCommands(
-      llvm::StringRef file_path) const override {
-    std::vector<CompileCommand> result;
-    auto iter = impl_.lower_bound(file_path.str());
-    const auto iter_end = impl_.upper_bound(file_path.str());
-    for (; iter != impl_.end() && iter != iter_end; ++iter) {
-      result.emplace_back(iter->second.directory, iter->first,
-                          iter->second.command_line, iter->second.output);
+    auto start = std::chrono::steady_clock::now();
+    matcher_consumer_->HandleTranslationUnit(context);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    if (parse_statistics_) {
+      parse_statistics_->top_level_decls += num_decls;
+      parse_statistics_->skipped_top_level_decls += num_decls - scope.size();
+      parse_statistics_->matching_microseconds += elapsed.count();
     }
-    return result;
   }
-  std::vector<std::string> getAllFiles() const override {
-    std::vector<std::string> result;
-    for (const auto& iter : impl_) {
-      result.push_back(iter.first);
+
+ private:
+  bool IsInScope(const Decl* decl, const SourceManager& sm) {
+    SourceLocation loc = decl->getLocation();
+    if (loc.isInvalid()) {
+      return false;
     }
-    return result;
+    FileID file_id = sm.getFileID(sm.getExpansionLoc(loc));
+    auto [iter, inserted] = file_scopes_.try_emplace(file_id, false);
+    if (!inserted) {
+      return iter->second;
+    }
+    const FileEntry* file_entry = sm.getFileEntryForID(file_id);
+    if (!file_entry) {
+      return false;
+    }
+    std::filesystem::path file_path(
+        std::string_view(file_entry->tryGetRealPathName()));
+    const std::filesystem::path& root_path = traversal_scope_->root_path;
+    if (std::mismatch(root_path.begin(), root_path.end(), file_path.begin(),
+                      file_path.end())
+            .first != root_path.end()) {
+      return false;
+    }
+    if (traversal_scope_->path_pattern) {
+      auto rel_file_path = Relative(file_path, root_path);
+      if (!rel_file_path) {
+        llvm::consumeError(rel_file_path.takeError());
+        return false;
+      }
+      if (!traversal_scope_->path_pattern->Match(rel_file_path->string())) {
+        return false;
+      }
+    }
+    iter->second = true;
+    return true;
   }
-  std::vector<CompileCommand> getAllCompileCommands() const override {
-    std::vector<CompileCommand> result;
-    for (const auto& iter : impl_) {
-      result.emplace_back(iter.second.directory, iter.first,
-                          iter.second.command_line, iter.second.output);
+
+  std::unique_ptr<ASTConsumer> matcher_consumer_;
+  const TraversalScope* traversal_scope_;
+  ParseStatistics* parse_statistics_;
+  llvm::DenseMap<FileID, bool> file_scopes_;
+};
+
+// Passes the files the preprocessor enters and leaves to a
+// HeaderCostRecorder, timed with the CPU time of the parsing thread. Files
+// under |root_path| are named relative to it, and other files by their real
+// paths.
+class HeaderCostCallbacks : public PPCallbacks {
+ public:
+  HeaderCostCallbacks(const SourceManager& sm,
+                      const std::filesystem::path& root_path,
+                      HeaderCostRecorder* recorder)
+      : sm_(sm), root_prefix_(root_path.string() + "/"), recorder_(recorder) {}
+
+  void FileChanged(SourceLocation loc,
+                   FileChangeReason reason,
+                   SrcMgr::CharacteristicKind file_type,
+                   FileID prev_fid) override {
+    if (reason == EnterFile) {
+      recorder_->EnterFile(GetName(loc), GetThreadCpuMicroseconds());
+    } else if (reason == ExitFile) {
+      recorder_->ExitFile(GetThreadCpuMicroseconds());
     }
-    return result;
   }
 
-  void Add(std::string&& file_name,
-           std::string&& directory,
-           std::vector<std::string>&& command_line,
-           std::string&& output);
+  // Work done after the end of the main file is not attributed to it.
+  void EndOfMainFile() override {
+    recorder_->ExitAllFiles(GetThreadCpuMicroseconds());
+  }
 
  private:
-  struct CompilationData {
-    std::string directory;
-    std::vector<std::string> command_line;
-    std::string output;
-  };
+  const std::string& GetName(SourceLocation loc) {
+    FileID file_id = sm_.getFileID(loc);
+    const FileEntry* file_entry = sm_.getFileEntryForID(file_id);
+    auto [iter, inserted] = names_.try_emplace(file_entry);
+    if (inserted) {
+      StringRef name = sm_.getBufferName(loc);
+      if (file_entry && !file_entry->tryGetRealPathName().empty()) {
+        name = file_entry->tryGetRealPathName();
+      }
+      name.consume_front(root_prefix_);
+      iter->second = name.str();
+    }
+    return iter->second;
+  }
 
-  std::multimap<std::string, CompilationData> impl_;
+  const SourceManager& sm_;
+  const std::string root_prefix_;
+  HeaderCostRecorder* recorder_;
+  // Buffers without a file entry, like the predefines, share the null key.
+  llvm::DenseMap<const FileEntry*, std::string> names_;
 };
 
-void StoredCompilationDatabase::Add(std::string&& file_name,
-                                    std::string&& directory,
-                                    std::vector<std::string>&& command_line,
-                                    std::string&& output) {
-  impl_.insert(
-      std::make_pair(file_name, CompilationData{.directory = directory,
-                                                .command_line = command_line,
-                                                .output = output}));
-}
+class ModernizerFrontendAction : public ASTFrontendAction {
+ public:
+  ModernizerFrontendAction(MatchFinder* finder,
+                           const TraversalScope* traversal_scope,
+                           std::vector<std::string>* files_read,
+                           ParseStatistics* parse_statistics,
+                           HeaderCostRecorder* header_cost_recorder)
+      : finder_(finder),
+        traversal_scope_(traversal_scope),
+        files_read_(files_read),
+        parse_statistics_(parse_statistics),
+        header_cost_recorder_(header_cost_recorder) {}
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& ci,
+                                                 StringRef in_file) override {
+    if (header_cost_recorder_) {
+      ci.getPreprocessor().addPPCallbacks(std::make_unique<HeaderCostCallbacks>(
+          ci.getSourceManager(), traversal_scope_->root_path,
+          header_cost_recorder_));
+    }
+    return std::make_unique<TraversalScopeConsumer>(
+        finder_->newASTConsumer(), traversal_scope_, parse_statistics_);
+  }
 
-}  // namespace
+  void EndSourceFileAction() override {
+    if (header_cost_recorder_) {
+      // The main file does not end if the parse stops on a fatal error.
+      header_cost_recorder_->ExitAllFiles(GetThreadCpuMicroseconds());
+    }
+    const SourceManager& sm = getCompilerInstance().getSourceManager();
+    size_t files_read = 0;
+    size_t line_tables_built = 0;
+    for (auto iter = sm.fileinfo_begin(); iter != sm.fileinfo_end(); ++iter) {
+      ++files_read;
+      StringRef real_path = iter->first->tryGetRealPathName();
+      if (!real_path.empty()) {
+        files_read_->push_back(real_path.str());
+      }
+      if (iter->second->SourceLineCache) {
+        ++line_tables_built;
+      }
+    }
+    if (parse_statistics_) {
+      parse_statistics_->files_read += files_read;
+      parse_statistics_->line_tables_built += line_tables_built;
+    }
+  }
 
-int RunModernizer(const RunModernizerOptions& options) {
-  auto project_root_or_error = Canonical(options.project_root);
-  if (!project_root_or_error) {
-    llvm::errs() << "Invalid project root: " << options.project_root
-                 << " error: "
-                 << llvm::toString(project_root_or_error.takeError()) << "\n";
-    return 1;
+ private:
+  MatchFinder* finder_;
+  const TraversalScope* traversal_scope_;
+  std::vector<std::string>* files_read_;
+  ParseStatistics* parse_statistics_;
+  HeaderCostRecorder* header_cost_recorder_;
+};
+
+// Runs the matchers over one translation unit. The replacements go to a
+// context of its own, so that the results of each file can be told apart.
+class ModernizerActionFactory : public FrontendActionFactory {
+ public:
+  ModernizerActionFactory(const std::filesystem::path& root_path,
+                          const std::filesystem::path& build_path,
+                          FileSystemCache* file_system_cache,
+                          const PathPattern* path_pattern,
+                          bool verbose,
+                          bool traverse_all_declarations,
+                          ParseStatistics* parse_statistics,
+                          bool record_header_costs)
+      : callback_(root_path,
+                  build_path,
+                  &replacements_context_,
+                  file_system_cache,
+                  path_pattern,
+                  verbose,
+                  parse_statistics),
+        traversal_scope_{.root_path = root_path,
+                         .path_pattern = path_pattern,
+                         .all_declarations = traverse_all_declarations},
+        parse_statistics_(parse_statistics) {
+    if (record_header_costs) {
+      header_cost_recorder_.emplace();
+    }
+    finder_.addMatcher(MacroConstructorMatcher(kModernizeMacro), &callback_);
   }
 
-  const auto& project_root = *project_root_or_error;
-  const auto& compile_commands = options.compile_commands;
-  bool in_place = options.in_place;
-  llvm::raw_ostream* out_stream = options.out_stream;
-  std::error_code ec;
-  if (!std::filesystem::exists(project_root, ec) ||
-      !std::filesystem::is_directory(project_root, ec)) {
-    llvm::errs() << "Project Root does not exist or not a directory: "
-                 << ec.message() << "\n";
-    return 1;
+  std::unique_ptr<FrontendAction> create() override {
+    return std::make_unique<ModernizerFrontendAction>(
+        &finder_, &traversal_scope_, &files_read_, parse_statistics_,
+        header_cost_recorder_ ? &*header_cost_recorder_ : nullptr);
   }
-  if (!std::filesystem::exists(compile_commands, ec)) {
-    llvm::errs() << "compile_commands.json does not exist: " << ec.message()
-                 << "\n";
-    return 1;
+
+  ReplacementsContext& GetReplacementsContext() {
+    return replacements_context_;
   }
 
-  std::optional<PathPattern> source_file_pattern;
-  if (!options.source_file_pattern.empty()) {
-    source_file_pattern = PathPattern::Create(options.source_file_pattern);
-    if (!source_file_pattern) {
-      llvm::errs() << "Bad source file pattern: " << options.source_file_pattern
-                   << "\n";
-      return 1;
-    }
+  // Real paths of every file read by any compile command of the file.
+  const std::vector<std::string>& GetFilesRead() const { return files_read_; }
+
+  // Null unless the factory records header costs.
+  const HeaderCostRecorder* GetHeaderCostRecorder() const {
+    return header_cost_recorder_ ? &*header_cost_recorder_ : nullptr;
   }
 
-  if (!in_place && !out_stream) {
-    llvm::errs() << "Output stream is not set.\n";
-    return 1;
+ private:
+  ReplacementsContext replacements_context_;
+  ModernizerCallback callback_;
+  MatchFinder finder_;
+  const TraversalScope traversal_scope_;
+  std::vector<std::string> files_read_;
+  ParseStatistics* parse_statistics_;
+  std::optional<HeaderCostRecorder> header_cost_recorder_;
+};
+
+struct RewrittenFile {
+  // Relative to the build root.
+  std::string file_path;
+  std::shared_ptr<const FileSystemCache::Contents> contents;
+  std::string new_contents;
+};
+
+// Sorts the includes and formats the lines touched by |replacements| like
+// format::formatReplacements(), without going over the whole file: includes
+// are sorted up to the last one, and the touched lines are formatted within
+// the windows GetFormatWindows() finds, if it does.
+llvm::Expected<Replacements> FormatTouchedLines(
+    const std::string& file_path,
+    llvm::StringRef buffer,
+    const Replacements& replacements,
+    const format::FormatStyle& style) {
+  if (replacements.empty()) {
+    return replacements;
   }
+  llvm::Expected<std::string> code = applyAllReplacements(buffer, replacements);
+  if (!code) {
+    return code.takeError();
+  }
+  Replacements sorted_replacements = replacements.merge(
+      format::sortIncludes(style, GetIncludeLines(*code),
+                           replacements.getAffectedRanges(), file_path));
 
-  StoredCompilationDatabase stored_compilation_database;
-  std::filesystem::path build_root;
-  std::vector<std::string> source_paths;
-  {
-    std::string error_message;
-    auto compilation_database = JSONCompilationDatabase::loadFromFile(
-        compile_commands.string(), error_message, JSONCommandLineSyntax::Gnu);
-    if (!compilation_database) {
-      llvm::errs() << "Parsing compile_commands.json failed: " << error_message
-                   << "\n";
-      return 1;
-    }
-    for (auto compile_command : compilation_database->getAllCompileCommands()) {
-      if (build_root.empty()) {
-        build_root = compile_command.Directory;
-      } else if (build_root != compile_command.Directory) {
-        llvm::errs() << "Multiple directory not supported: first: "
-                     << build_root.string()
-                     << ", second: " << compile_command.Directory << "\n";
-        return 1;
+  code = applyAllReplacements(buffer, sorted_replacements);
+  if (!code) {
+    return code.takeError();
+  }
+  std::vector<Range> ranges = sorted_replacements.getAffectedRanges();
+  std::optional<std::vector<FormatWindow>> windows;
+  if (style.NamespaceIndentation == format::FormatStyle::NI_None) {
+    windows = GetFormatWindows(*code, ranges);
+  }
+  if (!windows) {
+    return sorted_replacements.merge(
+        format::reformat(style, *code, ranges, file_path));
+  }
+  Replacements format_replacements;
+  for (const FormatWindow& window : *windows) {
+    std::vector<Range> window_ranges;
+    for (const Range& range : ranges) {
+      if (range.getOffset() >= window.offset &&
+          range.getOffset() + range.getLength() <=
+              window.offset + window.length) {
+        window_ranges.emplace_back(range.getOffset() - window.offset,
+                                   range.getLength());
       }
-      std::filesystem::path file_path(compile_command.Filename);
-      if (file_path.is_relative()) {
-        auto new_file_path = std::filesystem::path(
-            compile_command.Directory /
-            std::filesystem::path(compile_command.Filename));
-        auto file_path_result = Canonical(new_file_path);
-        if (!file_path_result) {
-          llvm::errs() << "filesystem::canonical for " << new_file_path
-                       << " returned error: "
-                       << llvm::toString(file_path_result.takeError()) << "\n";
-          continue;
-        }
-        file_path = *file_path_result;
-      }
-      if (source_file_pattern) {
-        auto relative_file_path = Relative(file_path, project_root);
-        if (!relative_file_path) {
-          llvm::errs() << "filesystem::relative for " << file_path
-                       << " returned error: "
-                       << llvm::toString(relative_file_path.takeError())
-                       << "\n";
-          continue;
-        }
-        if (!source_file_pattern->Match(relative_file_path->string())) {
-          llvm::errs()
-              << "Skip " << *relative_file_path
-              << " because it does not match the source file pattern\n";
-          continue;
-        }
+    }
+    llvm::StringRef window_code =
+        llvm::StringRef(*code).substr(window.offset, window.length);
+    for (const Replacement& replacement :
+         format::reformat(style, window_code, window_ranges, file_path)) {
+      if (llvm::Error error = format_replacements.add(Replacement(
+              file_path, replacement.getOffset() + window.offset,
+              replacement.getLength(), replacement.getReplacementText()))) {
+        return std::move(error);
       }
-      source_paths.push_back(file_path.string());
-      stored_compilation_database.Add(file_path.string(),
-                                      std::move(compile_command.Directory),
-                                      std::move(compile_command.CommandLine),
-                                      std::move(compile_command.Output));
     }
   }
+  return sorted_replacements.merge(format_replacements);
+}
 
-  ReplacementsContext replacements_context;
-  std::unique_ptr<ToolExecutor> executor;
-  if (options.num_jobs > 1) {
-    executor = std::make_unique<AllTUsToolExecutor>(stored_compilation_database,
-                                                    options.num_jobs);
-  } else {
-    executor = std::make_unique<StandaloneToolExecutor>(
-        stored_compilation_database, source_paths);
+// Applies |file_replacements| to the exact buffer they were computed against,
+// removes the include of kModernizeHeader and formats the touched lines.
+// Returns std::nullopt if the file should be left alone. If set,
+// |applied_replacements| receives the replacements that were applied.
+std::optional<std::string> RewriteFile(
+    const std::string& file_path,
+    const FileReplacements& file_replacements,
+    llvm::vfs::FileSystem& file_system,
+    StyleCache& style_cache,
+    Replacements* applied_replacements = nullptr) {
+  llvm::StringRef buffer = file_replacements.contents->buffer->getBuffer();
+
+  auto style = style_cache.GetStyle(file_path, file_system);
+  if (!style) {
+    llvm::errs() << llvm::toString(style.takeError()) << "\n";
+    return std::nullopt;
   }
 
-  ArgumentsAdjuster arguments_adjuster = combineAdjusters(
-      getClangStripDependencyFileAdjuster(),
-      combineAdjusters(getClangSyntaxOnlyAdjuster(),
-                       combineAdjusters(getStripPluginsAdjuster(),
-                                        getClangStripOutputAdjuster())));
+  Replacements merged_replacements;
+  if (std::optional<Replacements> replacements =
+          MergeReplacements(file_path, file_replacements)) {
+    merged_replacements = std::move(*replacements);
+  } else {
+    // Overlapping edits are composed one at a time, as each merge maps the
+    // offsets of the next edit through the previous ones.
+    llvm::errs() << "Overlapping replacements in " << file_path << "\n";
+    std::vector<Replacements> loc_replacements =
+        GroupReplacements(file_path, file_replacements);
+    for (auto iter = loc_replacements.rbegin();
+         iter != loc_replacements.rend(); ++iter) {
+      merged_replacements = merged_replacements.merge(*iter);
+    }
+  }
 
-  MatchFinder finder;
-  ModernizerCallback callback(
-      project_root, build_root, &replacements_context,
-      (source_file_pattern ? &(*source_file_pattern) : nullptr));
+  // The include block is all HeaderIncludes looks at, and there is nothing
+  // around the removed include for format::cleanup() to clean up.
+  tooling::HeaderIncludes header_includes(file_path, buffer,
+                                          style->IncludeStyle);
+  merged_replacements = merged_replacements.merge(
+      header_includes.remove(kModernizeHeader, /*IsAngled=*/false));
+
+  llvm::Expected<Replacements> formatted_replacements =
+      FormatTouchedLines(file_path, buffer, merged_replacements, *style);
+  if (!formatted_replacements) {
+    llvm::errs() << llvm::toString(formatted_replacements.takeError()) << "\n";
+    return std::nullopt;
+  }
 
-  finder.addMatcher(
-      namedDecl(cxxConstructorDecl(), isExpandedFromMacro(kModernizeMacro))
-          .bind("decl"),
-      &callback);
+  llvm::Expected<std::string> new_contents =
+      applyAllReplacements(buffer, *formatted_replacements);
+  if (!new_contents) {
+    llvm::errs() << "Apply Replacements failed for " << file_path << ": "
+                 << llvm::toString(new_contents.takeError()) << "\n";
+    return std::nullopt;
+  }
+  if (applied_replacements) {
+    *applied_replacements = std::move(*formatted_replacements);
+  }
+  return std::move(*new_contents);
+}
 
-  llvm::Error error =
-      executor->execute(newFrontendActionFactory(&finder), arguments_adjuster);
-  if (error) {
-    llvm::errs() << "Execute error: " << toString(std::move(error)) << "\n";
-    return 1;
+// Returns false if |file_path| must be left alone because its contents on
+// disk, or in |base_file_system| if set, are not the ones every replacement
+// was computed against.
+bool CheckContents(const std::string& file_path,
+                   const FileReplacements& file_replacements,
+                   FileSystemCache& file_system_cache,
+                   llvm::vfs::FileSystem* base_file_system) {
+  if (file_replacements.conflicting_contents) {
+    llvm::errs() << "Skip " << file_path
+                 << " because translation units saw different contents\n";
+    return false;
   }
+  if (!file_system_cache.IsUnchangedOnDisk(*file_replacements.contents,
+                                          base_file_system)) {
+    llvm::errs() << "Skip " << file_path
+                 << " because it was modified during the run\n";
+    return false;
+  }
+  return true;
+}
 
-  // boilerplate
-  LangOptions default_lang_options;
-  llvm::IntrusiveRefCntPtr<DiagnosticOptions> diag_opts =
-      llvm::makeIntrusiveRefCnt<DiagnosticOptions>();
-  TextDiagnosticPrinter diagnostic_printer(llvm::errs(), &*diag_opts);
-  DiagnosticsEngine diagnostics(
-      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), &*diag_opts,
-      &diagnostic_printer, false);
-  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system(
-      llvm::vfs::createPhysicalFileSystem().release());
-  file_system->setCurrentWorkingDirectory(build_root.string());
-  llvm::IntrusiveRefCntPtr<FileManager> files =
-      llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(), file_system);
-
-  SourceManager sm(diagnostics, *files);
-  Rewriter rewrite(sm, default_lang_options);
-  {
-    FileManager& file_manager = sm.getFileManager();
-    MutexLock guard(replacements_context);
-    const std::map<std::string, std::map<SimpleSourceLocation, Replacements>>&
-        replacements = replacements_context.GetReplacements();
-
-    for (const auto& file_replacements : replacements) {
-      const std::string& file_path = file_replacements.first;
-      const FileEntry* entry = nullptr;
-      if (auto file = file_manager.getFile(file_path)) {
-        entry = *file;
-      } else {
-        llvm::errs() << "getFile failed for " << file_path
-                     << " with error: " << file.getError().message() << "\n";
-        continue;
-      }
+bool WriteDiff(const RewrittenFile& rewritten_file,
+               const std::filesystem::path& build_root,
+               const std::filesystem::path& project_root,
+               llvm::raw_ostream& out_stream) {
+  std::filesystem::path file_path(build_root);
+  file_path /= rewritten_file.file_path;
+
+  auto file_name_result = Relative(file_path, project_root);
+  if (!file_name_result) {
+    llvm::errs() << "filesystem::relative failed: "
+                 << file_name_result.takeError() << "\n";
+    return false;
+  }
+  CreateDiff(file_name_result->string(),
+             std::string_view(rewritten_file.contents->buffer->getBuffer()),
+             rewritten_file.new_contents, out_stream);
+  return true;
+}
 
-      FileID id = sm.getOrCreateFileID(entry, SrcMgr::C_User);
-      llvm::StringRef buffer = sm.getBufferData(id);
+// Returns the files |source_path| reads according to the depfiles of its
+// compile commands, relative to |build_root|, or std::nullopt if any of them
+// is missing, malformed or older than |source_path|. If
+// |modification_times| is set, which caches the modification times of the
+// files read, std::nullopt is also returned if any of those files changed
+// after its depfile was written, since it may now include other files.
+std::optional<std::vector<std::string>> ReadDependencies(
+    const CompilationDatabase& compilation_database,
+    const std::string& source_path,
+    const std::filesystem::path& build_root,
+    std::unordered_map<std::string, std::optional<std::string>>*
+        canonical_paths,
+    std::unordered_map<std::string, llvm::sys::TimePoint<>>*
+        modification_times = nullptr) {
+  llvm::sys::fs::file_status source_status;
+  if (llvm::sys::fs::status(source_path, source_status)) {
+    return std::nullopt;
+  }
 
-      auto style = format::getStyle("file", file_path, "LLVM", "",
-                                    &file_manager.getVirtualFileSystem());
-      if (!style) {
-        llvm::errs() << llvm::toString(style.takeError()) << "\n";
-        continue;
-      }
+  std::vector<std::string> dependencies;
+  for (const CompileCommand& compile_command :
+       compilation_database.getCompileCommands(source_path)) {
+    std::optional<std::filesystem::path> depfile_path = FindDepfilePath(
+        compile_command.CommandLine, compile_command.Directory);
+    if (!depfile_path) {
+      return std::nullopt;
+    }
+    llvm::sys::fs::file_status depfile_status;
+    if (llvm::sys::fs::status(depfile_path->string(), depfile_status) ||
+        depfile_status.getLastModificationTime() <
+            source_status.getLastModificationTime()) {
+      return std::nullopt;
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(depfile_path->string());
+    if (!buffer) {
+      return std::nullopt;
+    }
+    std::optional<std::vector<std::string>> prerequisites =
+        ParseDepfile(std::string_view((*buffer)->getBuffer()));
+    if (!prerequisites) {
+      llvm::errs() << "Malformed depfile: " << depfile_path->string() << "\n";
+      return std::nullopt;
+    }
+    prerequisites->push_back(source_path);
 
-      Replacements merged_replacements;
-      for (auto iter = file_replacements.second.rbegin();
-           iter != file_replacements.second.rend(); ++iter) {
-        merged_replacements = merged_replacements.merge(iter->second);
+    for (const std::string& prerequisite : *prerequisites) {
+      std::filesystem::path path(prerequisite);
+      if (path.is_relative()) {
+        path = compile_command.Directory / path;
       }
-
-      do {
-        if (!id.isValid()) {
-          break;
+      if (modification_times) {
+        auto [time_iter, time_inserted] =
+            modification_times->try_emplace(path.string());
+        if (time_inserted) {
+          llvm::sys::fs::file_status status;
+          // A file that is gone cannot be older than the depfile.
+          time_iter->second = llvm::sys::fs::status(path.string(), status)
+                                  ? llvm::sys::TimePoint<>::max()
+                                  : status.getLastModificationTime();
         }
-        Replacements current_replacements;
-
-        llvm::Error err = current_replacements.add(
-            Replacement(file_path, UINT_MAX, 1, kModernizeHeader));
-        if (err) {
-          llvm::errs() << llvm::toString(std::move(err)) << "\n";
-          break;
+        if (time_iter->second > depfile_status.getLastModificationTime()) {
+          return std::nullopt;
         }
-        llvm::Expected<Replacements> header_replacements =
-            clang::format::cleanupAroundReplacements(
-                buffer, current_replacements, *style);
-        if (!header_replacements) {
-          llvm::errs() << llvm::toString(header_replacements.takeError())
-                       << "\n";
-          break;
+      }
+      auto [iter, inserted] = canonical_paths->try_emplace(path.string());
+      if (inserted) {
+        // Replacements are keyed by the real path relative to the build
+        // root, so resolve symlinks the same way.
+        auto canonical_path = Canonical(path);
+        if (!canonical_path) {
+          llvm::consumeError(canonical_path.takeError());
+        } else if (auto relative_path = Relative(*canonical_path, build_root);
+                   !relative_path) {
+          llvm::consumeError(relative_path.takeError());
+        } else {
+          iter->second = relative_path->string();
         }
-        merged_replacements = merged_replacements.merge(*header_replacements);
-      } while (0);
-
-      auto formatted_replacements =
-          format::formatReplacements(buffer, merged_replacements, *style);
-      if (!formatted_replacements) {
-        llvm::errs() << llvm::toString(formatted_replacements.takeError())
-                     << "\n";
-        continue;
       }
+      if (iter->second) {
+        dependencies.push_back(*iter->second);
+      }
+    }
+  }
+  return dependencies;
+}
 
-      if (formatted_replacements &&
-          !applyAllReplacements(*formatted_replacements, rewrite)) {
-        llvm::errs() << "Apply Replacements failed\n";
-        return 1;
+// Registers every translation unit of |source_paths| with |file_coverage|,
+// with the files it reads according to its depfiles, which are read on up
+// to |num_jobs| threads.
+void AddTranslationUnits(const CompilationDatabase& compilation_database,
+                         const std::vector<std::string>& source_paths,
+                         const std::filesystem::path& build_root,
+                         int num_jobs,
+                         FileCoverage* file_coverage) {
+  if (source_paths.empty()) {
+    return;
+  }
+  size_t num_chunks = std::clamp<size_t>(num_jobs, 1, source_paths.size());
+  auto add_chunk = [&](size_t chunk) {
+    // Each chunk resolves its own paths, so that no lock is held while
+    // reading depfiles.
+    std::unordered_map<std::string, std::optional<std::string>>
+        canonical_paths;
+    for (size_t i = chunk; i < source_paths.size(); i += num_chunks) {
+      file_coverage->AddTranslationUnit(
+          source_paths[i],
+          ReadDependencies(compilation_database, source_paths[i], build_root,
+                           &canonical_paths));
+    }
+  };
+  if (num_chunks <= 1) {
+    add_chunk(0);
+    return;
+  }
+  llvm::ThreadPool pool(llvm::hardware_concurrency(num_chunks));
+  for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    pool.async(add_chunk, chunk);
+  }
+  pool.wait();
+}
+
+// Returns the files |source_path| reads, including itself, as told by
+// |include_index| if it knows them or by the depfiles of the build otherwise.
+std::vector<std::string> GetPrefetchFiles(
+    const CompilationDatabase& compilation_database,
+    const std::string& source_path,
+    const std::filesystem::path& build_root,
+    const IncludeIndex* include_index,
+    std::unordered_map<std::string, std::optional<std::string>>*
+        canonical_paths) {
+  std::vector<std::string> files = {source_path};
+  if (include_index) {
+    auto relative_path = Relative(source_path, build_root);
+    if (!relative_path) {
+      llvm::consumeError(relative_path.takeError());
+    } else if (std::optional<uint32_t> id =
+                   include_index->Find(relative_path->string());
+               id && include_index->AreDependenciesKnown(*id)) {
+      for (uint32_t dependency : include_index->GetDependencies(*id)) {
+        files.push_back(
+            (build_root / include_index->GetPath(dependency)).string());
       }
+      return files;
+    }
+  }
+  if (std::optional<std::vector<std::string>> dependencies = ReadDependencies(
+          compilation_database, source_path, build_root, canonical_paths)) {
+    for (const std::string& dependency : *dependencies) {
+      files.push_back((build_root / dependency).string());
     }
   }
+  return files;
+}
 
-  if (in_place) {
-    // TODO(bc-lee): Remove chdir
-    errno = 0;
-    chdir(build_root.c_str());
-    assert(errno == 0);
-    if (rewrite.overwriteChangedFiles()) {
-      llvm::errs() << "write to file failed\n";
-      return 1;
+// Marks as emitted and returns the ids of the files of |replacements_context|
+// that are final and were not emitted yet, among |final_files|, as returned
+// by FileCoverage::CompleteTranslationUnit(), and the files added since the
+// previous call, which start at |next_file_id|. Every file is looked at
+// again if |final_files| is std::nullopt. Other files are not looked at, so
+// that each completed translation unit does not cost a pass over every file.
+std::vector<uint32_t> TakeFinalFileIds(
+    const std::optional<std::vector<std::string>>& final_files,
+    const FileCoverage& file_coverage,
+    ReplacementsContext& replacements_context,
+    uint32_t* next_file_id) EXCLUSIVE_LOCKS_REQUIRED(replacements_context) {
+  std::vector<uint32_t> ids;
+  auto take = [&](uint32_t id) {
+    FileReplacements& file_replacements =
+        replacements_context.GetFileReplacements(id);
+    if (!file_replacements.emitted) {
+      file_replacements.emitted = true;
+      ids.push_back(id);
     }
-    return 0;
-  }
-  for (auto iter = rewrite.buffer_begin(); iter != rewrite.buffer_end();
-       ++iter) {
-    llvm::Optional<llvm::MemoryBufferRef> buffer_before =
-        sm.getBufferOrNone(iter->first);
-    assert(buffer_before);
-    std::string_view file_name =
-        std::string_view(buffer_before->getBufferIdentifier());
-    std::filesystem::path file_path(build_root);
-    file_path /= file_name;
-
-    std::string buffer_after;
-    llvm::raw_string_ostream buffer_after_stream(buffer_after);
-    iter->second.write(buffer_after_stream);
-    buffer_after_stream.flush();
-
-    auto file_name_result = Relative(file_path, project_root);
-    if (!file_name_result) {
-      llvm::errs() << "filesystem::relative failed: "
-                   << file_name_result.takeError() << "\n";
-      return 1;
+  };
+  if (!final_files) {
+    *next_file_id = 0;
+  } else {
+    for (const std::string& file_path : *final_files) {
+      if (std::optional<uint32_t> id =
+              replacements_context.FindFileId(file_path)) {
+        take(*id);
+      }
+    }
+  }
+  // Files that got their first replacements after they became final.
+  for (; *next_file_id < replacements_context.GetNumFiles(); ++*next_file_id) {
+    if (file_coverage.IsFinal(
+            replacements_context.GetFilePath(*next_file_id).str())) {
+      take(*next_file_id);
     }
-    CreateDiff(file_name_result->string(),
-               std::string_view(buffer_before->getBuffer()), buffer_after,
-               *out_stream);
   }
+  return ids;
+}
 
-  return 0;
+// Streams the patch of a file as soon as every translation unit that reads
+// the file has completed, instead of after the whole run.
+class PatchStreamer {
+ public:
+  PatchStreamer(const std::filesystem::path& project_root,
+                const std::filesystem::path& build_root,
+                ReplacementsContext* replacements_context,
+                FileSystemCache* file_system_cache,
+                StyleCache* style_cache,
+                FileCoverage* file_coverage,
+                llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+                    base_file_system,
+                const std::atomic<bool>* cancelled,
+                llvm::raw_ostream* out_stream)
+      : project_root_(project_root),
+        build_root_(build_root),
+        replacements_context_(replacements_context),
+        file_system_cache_(file_system_cache),
+        style_cache_(style_cache),
+        file_coverage_(file_coverage),
+        base_file_system_(std::move(base_file_system)),
+        cancelled_(cancelled),
+        out_stream_(out_stream) {}
+
+  // Emits every file that became final when |source_path| completed. Nothing
+  // is emitted once the run is cancelled.
+  void OnTranslationUnitCompleted(const std::string& source_path) {
+    if (IsCancelled()) {
+      return;
+    }
+    std::optional<std::vector<std::string>> final_files =
+        file_coverage_->CompleteTranslationUnit(source_path);
+    std::vector<std::pair<std::string, FileReplacements>> files;
+    {
+      MutexLock guard(*replacements_context_);
+      for (uint32_t id : TakeFinalFileIds(final_files, *file_coverage_,
+                                          *replacements_context_,
+                                          &next_file_id_)) {
+        files.emplace_back(replacements_context_->GetFilePath(id).str(),
+                           replacements_context_->GetFileReplacements(id));
+      }
+    }
+    EmitFiles(std::move(files));
+  }
+
+  // Emits the remaining files in order. Returns the number of files that
+  // were skipped or whose streamed patch turned out to be incomplete.
+  int Finish() {
+    std::vector<std::pair<std::string, FileReplacements>> files;
+    {
+      MutexLock guard(*replacements_context_);
+      for (uint32_t id = 0; id < replacements_context_->GetNumFiles(); ++id) {
+        FileReplacements& file_replacements =
+            replacements_context_->GetFileReplacements(id);
+        if (!file_replacements.emitted) {
+          file_replacements.emitted = true;
+          files.emplace_back(replacements_context_->GetFilePath(id).str(),
+                             file_replacements);
+        }
+      }
+    }
+    EmitFiles(std::move(files));
+    MutexLock guard(*replacements_context_);
+    for (uint32_t id = 0; id < replacements_context_->GetNumFiles(); ++id) {
+      if (replacements_context_->GetFileReplacements(id).late_replacements) {
+        llvm::errs() << "The patch of "
+                     << replacements_context_->GetFilePath(id)
+                     << " was emitted before all of its replacements were "
+                        "known; its depfiles are probably stale\n";
+        ++failed_files_;
+      }
+    }
+    return failed_files_;
+  }
+
+ private:
+  // Emits |files|, copied from the context when they were marked as emitted,
+  // in path order.
+  void EmitFiles(std::vector<std::pair<std::string, FileReplacements>> files) {
+    absl::c_sort(files, [](const auto& lhs, const auto& rhs) {
+      return lhs.first < rhs.first;
+    });
+    for (const auto& [file_path, file_replacements] : files) {
+      if (IsCancelled()) {
+        return;
+      }
+      EmitFile(file_path, file_replacements);
+    }
+  }
+
+  bool IsCancelled() const { return cancelled_ && *cancelled_; }
+
+  void EmitFile(const std::string& file_path,
+                const FileReplacements& file_replacements) {
+    if (!CheckContents(file_path, file_replacements, *file_system_cache_,
+                       base_file_system_.get())) {
+      ++failed_files_;
+      return;
+    }
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+        CreateCachedFileSystem(*file_system_cache_, base_file_system_);
+    file_system->setCurrentWorkingDirectory(build_root_.string());
+    std::optional<std::string> new_contents = RewriteFile(
+        file_path, file_replacements, *file_system, *style_cache_);
+    if (!new_contents ||
+        *new_contents == file_replacements.contents->buffer->getBuffer()) {
+      return;
+    }
+
+    std::string diff;
+    llvm::raw_string_ostream diff_stream(diff);
+    if (!WriteDiff(RewrittenFile{.file_path = file_path,
+                                 .contents = file_replacements.contents,
+                                 .new_contents = std::move(*new_contents)},
+                   build_root_, project_root_, diff_stream)) {
+      ++failed_files_;
+      return;
+    }
+    absl::MutexLock lock(&out_stream_mutex_);
+    *out_stream_ << diff_stream.str();
+    out_stream_->flush();
+  }
+
+  const std::filesystem::path project_root_;
+  const std::filesystem::path build_root_;
+  ReplacementsContext* replacements_context_;
+  FileSystemCache* file_system_cache_;
+  StyleCache* style_cache_;
+  FileCoverage* file_coverage_;
+  const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system_;
+  const std::atomic<bool>* const cancelled_;
+  // Guarded by |replacements_context_|.
+  uint32_t next_file_id_ = 0;
+  absl::Mutex out_stream_mutex_;
+  llvm::raw_ostream* out_stream_ GUARDED_BY(out_stream_mutex_);
+  std::atomic<int> failed_files_{0};
+};
+
+// An item passed between the stages of RunModernizer(): a translation unit
+// to parse and collect, or a file to format.
+struct PipelineItem {
+  std::string path;
+  // Set by the parse stage.
+  std::unique_ptr<ModernizerActionFactory> action_factory;
+  int result = 0;
+};
+
+// Formats files on the threads of a pipeline as soon as every translation
+// unit that reads them has completed, instead of after the last one. The
+// results are kept until the end of the run and returned in path order, so
+// the output does not depend on the order files became final in, unless
+// they are passed to |on_file_result| as they come.
+class FileFormatter {
+ public:
+  // Without |file_coverage|, no file is final before the end of the run.
+  FileFormatter(const std::filesystem::path& project_root,
+                const std::filesystem::path& build_root,
+                ReplacementsContext* replacements_context,
+                FileSystemCache* file_system_cache,
+                StyleCache* style_cache,
+                const FileCoverage* file_coverage,
+                llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+                    base_file_system,
+                FileResultFunction on_file_result)
+      : project_root_(project_root),
+        build_root_(build_root),
+        replacements_context_(replacements_context),
+        file_system_cache_(file_system_cache),
+        style_cache_(style_cache),
+        file_coverage_(file_coverage),
+        base_file_system_(std::move(base_file_system)),
+        on_file_result_(std::move(on_file_result)) {}
+
+  // Returns the files not formatted yet that became final, among
+  // |final_files| as returned by FileCoverage::CompleteTranslationUnit() and
+  // the files added since the previous call, or among every file if
+  // |final_files| is std::nullopt.
+  std::vector<std::string> TakeFinalFiles(
+      const std::optional<std::vector<std::string>>& final_files) {
+    assert(file_coverage_);
+    std::vector<std::string> file_paths;
+    MutexLock guard(*replacements_context_);
+    for (uint32_t id : TakeFinalFileIds(final_files, *file_coverage_,
+                                        *replacements_context_,
+                                        &next_file_id_)) {
+      file_paths.push_back(replacements_context_->GetFilePath(id).str());
+    }
+    return file_paths;
+  }
+
+  // Returns every file not formatted yet and every file that was formatted
+  // before all of its replacements or contents were known, which means the
+  // depfile of some translation unit was stale.
+  std::vector<std::string> TakeRemainingFiles() {
+    std::vector<std::string> file_paths;
+    MutexLock guard(*replacements_context_);
+    for (uint32_t id = 0; id < replacements_context_->GetNumFiles(); ++id) {
+      std::string file_path = replacements_context_->GetFilePath(id).str();
+      FileReplacements& file_replacements =
+          replacements_context_->GetFileReplacements(id);
+      if (file_replacements.emitted &&
+          !file_replacements.late_replacements &&
+          (!file_replacements.conflicting_contents || IsSkipped(file_path))) {
+        continue;
+      }
+      file_replacements.emitted = true;
+      file_replacements.late_replacements = false;
+      file_paths.push_back(std::move(file_path));
+    }
+    return file_paths;
+  }
+
+  void Format(const std::string& file_path) {
+    FileReplacements file_replacements;
+    {
+      MutexLock guard(*replacements_context_);
+      file_replacements = replacements_context_->GetFileReplacements(
+          replacements_context_->GetFileId(file_path));
+    }
+    FormattedFile formatted_file;
+    if (!CheckContents(file_path, file_replacements, *file_system_cache_,
+                       base_file_system_.get())) {
+      formatted_file.skipped = true;
+    } else {
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+          CreateCachedFileSystem(*file_system_cache_, base_file_system_);
+      file_system->setCurrentWorkingDirectory(build_root_.string());
+      Replacements replacements;
+      std::optional<std::string> new_contents =
+          RewriteFile(file_path, file_replacements, *file_system,
+                      *style_cache_, &replacements);
+      if (new_contents &&
+          *new_contents != file_replacements.contents->buffer->getBuffer()) {
+        RewrittenFile rewritten_file{.file_path = file_path,
+                                     .contents = file_replacements.contents,
+                                     .new_contents = std::move(*new_contents)};
+        if (on_file_result_) {
+          PassFileResult(rewritten_file, std::move(replacements));
+        } else {
+          formatted_file.rewritten_file = std::move(rewritten_file);
+        }
+      }
+    }
+    absl::MutexLock lock(&mutex_);
+    formatted_files_[file_path] = std::move(formatted_file);
+  }
+
+  // Returns the files that changed, in path order, and adds the number of
+  // files that had to be skipped to |skipped_files|.
+  std::vector<RewrittenFile> TakeRewrittenFiles(int* skipped_files) {
+    absl::MutexLock lock(&mutex_);
+    std::vector<RewrittenFile> rewritten_files;
+    for (auto& [file_path, formatted_file] : formatted_files_) {
+      if (formatted_file.skipped) {
+        ++*skipped_files;
+      } else if (formatted_file.rewritten_file) {
+        rewritten_files.push_back(std::move(*formatted_file.rewritten_file));
+      }
+    }
+    formatted_files_.clear();
+    return rewritten_files;
+  }
+
+ private:
+  struct FormattedFile {
+    // Set if CheckContents() failed.
+    bool skipped = false;
+    // Unset if the file does not change, or was passed to |on_file_result_|.
+    std::optional<RewrittenFile> rewritten_file;
+  };
+
+  bool IsSkipped(const std::string& file_path) {
+    absl::MutexLock lock(&mutex_);
+    auto iter = formatted_files_.find(file_path);
+    return iter != formatted_files_.end() && iter->second.skipped;
+  }
+
+  void PassFileResult(const RewrittenFile& rewritten_file,
+                      Replacements replacements) {
+    FileResult result{.file_path = rewritten_file.file_path,
+                      .real_path = rewritten_file.contents->real_path,
+                      .replacements = std::move(replacements),
+                      .new_contents = rewritten_file.new_contents};
+    llvm::raw_string_ostream diff_stream(result.diff);
+    if (!WriteDiff(rewritten_file, build_root_, project_root_, diff_stream)) {
+      result.diff.clear();
+    }
+    diff_stream.flush();
+    absl::MutexLock lock(&on_file_result_mutex_);
+    on_file_result_(result);
+  }
+
+  const std::filesystem::path project_root_;
+  const std::filesystem::path build_root_;
+  ReplacementsContext* replacements_context_;
+  FileSystemCache* file_system_cache_;
+  StyleCache* style_cache_;
+  const FileCoverage* file_coverage_;
+  const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system_;
+  const FileResultFunction on_file_result_;
+  // Guarded by |replacements_context_|.
+  uint32_t next_file_id_ = 0;
+  absl::Mutex on_file_result_mutex_;
+  absl::Mutex mutex_;
+  std::map<std::string, FormattedFile> formatted_files_ GUARDED_BY(mutex_);
+};
+
+// Tells whether files, named relative to the build root like in a
+// ReplacementsContext, match the source file pattern. Each file is only
+// resolved once. Thread-safe.
+class SourceFileFilter {
+ public:
+  SourceFileFilter(const std::filesystem::path& project_root,
+                   const std::filesystem::path& build_root,
+                   const PathPattern* path_pattern)
+      : project_root_(project_root),
+        build_root_(build_root),
+        path_pattern_(path_pattern) {
+    assert(path_pattern_);
+  }
+
+  bool Match(llvm::StringRef file_path) {
+    absl::MutexLock lock(&mutex_);
+    auto [iter, inserted] = matches_.try_emplace(file_path.str(), false);
+    if (!inserted) {
+      return iter->second;
+    }
+    auto relative_path = Relative(build_root_ / file_path.str(), project_root_);
+    if (!relative_path) {
+      llvm::errs() << "filesystem::relative failed: "
+                   << llvm::toString(relative_path.takeError()) << "\n";
+      return false;
+    }
+    iter->second = path_pattern_->Match(relative_path->string());
+    if (!iter->second) {
+      llvm::errs() << "Skip " << relative_path->string()
+                   << " because it does not match the source file pattern\n";
+    }
+    return iter->second;
+  }
+
+ private:
+  const std::filesystem::path project_root_;
+  const std::filesystem::path build_root_;
+  const PathPattern* path_pattern_;
+  absl::Mutex mutex_;
+  std::unordered_map<std::string, bool> matches_ GUARDED_BY(mutex_);
+};
+
+// Merges replacements serialized by a worker process, or stored in the
+// journal or in the translation unit cache, skipping the files that
+// |source_file_filter| rejects if set. The worker's buffers are gone, so
+// every file is read again in this process and compared against the hash
+// the worker saw.
+bool MergeSerializedReplacements(std::string_view data,
+                                 ReplacementsContext* replacements_context,
+                                 FileSystemCache* file_system_cache,
+                                 llvm::vfs::FileSystem& file_system,
+                                 SourceFileFilter* source_file_filter) {
+  std::optional<std::vector<SerializedFileReplacements>> files =
+      DeserializeReplacements(data);
+  if (!files) {
+    llvm::errs() << "Malformed replacements from a worker process\n";
+    return false;
+  }
+  for (const SerializedFileReplacements& file : *files) {
+    if (source_file_filter && !source_file_filter->Match(file.file_path)) {
+      continue;
+    }
+    std::shared_ptr<const FileSystemCache::Contents> contents;
+    if (file_system.getBufferForFile(file.real_path)) {
+      contents = file_system_cache->FindContents(file.real_path);
+    }
+    if (!contents) {
+      llvm::errs() << "Cannot read " << file.real_path << "\n";
+      return false;
+    }
+    MutexLock guard(*replacements_context);
+    replacements_context->Add(file.file_path, contents, file.replacements);
+    if (contents->hash != file.hash) {
+      replacements_context
+          ->GetFileReplacements(replacements_context->GetFileId(file.file_path))
+          .conflicting_contents = true;
+    }
+  }
+  return true;
+}
+
+// Parses every file of |source_paths| in worker processes forked from this
+// one, so that a crash in clang or in the callback only loses a single
+// translation unit. Returns the number of files that failed.
+int ParseInWorkerProcesses(
+    const CompilationDatabase& compilation_database,
+    const std::vector<std::string>& source_paths,
+    const ArgumentsAdjuster& arguments_adjuster,
+    const std::function<std::unique_ptr<ModernizerActionFactory>()>&
+        create_action_factory,
+    const WorkerPoolOptions& worker_pool_options,
+    ReplacementsContext* replacements_context,
+    FileSystemCache* file_system_cache,
+    const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>& base_file_system,
+    SourceFileFilter* source_file_filter,
+    Journal* journal,
+    PatchStreamer* patch_streamer) {
+  auto run_task =
+      [&](const std::string& source_path) -> std::optional<std::string> {
+    ClangTool tool(
+        compilation_database, {source_path},
+        std::make_shared<PCHContainerOperations>(),
+        CreateCachedFileSystem(*file_system_cache, base_file_system));
+    tool.appendArgumentsAdjuster(arguments_adjuster);
+    std::unique_ptr<ModernizerActionFactory> action_factory =
+        create_action_factory();
+    if (tool.run(action_factory.get())) {
+      return std::nullopt;
+    }
+    ReplacementsContext& tu_context = action_factory->GetReplacementsContext();
+    MutexLock guard(tu_context);
+    return SerializeReplacements(tu_context);
+  };
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+      CreateCachedFileSystem(*file_system_cache, base_file_system);
+  size_t counter = 0;
+  const std::string total_str = std::to_string(source_paths.size());
+  int failed_files = 0;
+  auto on_result = [&](const std::string& source_path,
+                       std::optional<std::string> result) {
+    llvm::errs() << "[" << ++counter << "/" << total_str
+                 << "] Processed file " << source_path << "\n";
+    if (result) {
+      if (!MergeSerializedReplacements(*result, replacements_context,
+                                       file_system_cache, *file_system,
+                                       source_file_filter)) {
+        ++failed_files;
+      } else if (journal) {
+        if (llvm::Error error = journal->Append(source_path, *result)) {
+          llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        }
+      }
+    }
+    if (patch_streamer) {
+      patch_streamer->OnTranslationUnitCompleted(source_path);
+    }
+  };
+
+  for (const std::string& source_path : RunInWorkerProcesses(
+           source_paths, worker_pool_options, run_task, on_result)) {
+    llvm::errs() << "Failed to run action on " << source_path << "\n";
+    ++failed_files;
+  }
+  return failed_files;
+}
+
+// Covers everything besides the files read that affects the replacements
+// found in |source_path|, when they are not filtered by the source pattern.
+uint64_t GetTranslationUnitKey(const CompilationDatabase& compilation_database,
+                               const std::string& source_path) {
+  std::string key;
+  for (const CompileCommand& compile_command :
+       compilation_database.getCompileCommands(source_path)) {
+    key.push_back('\0');
+    key += compile_command.Directory;
+    for (const std::string& argument : compile_command.CommandLine) {
+      key.push_back('\0');
+      key += argument;
+    }
+  }
+  return llvm::xxHash64(key);
+}
+
+// Keeps the files of |source_paths| that read any of |changed_files|
+// according to |include_index| if set, or to their depfiles otherwise, and
+// the files whose dependencies are unknown.
+void KeepAffectedTranslationUnits(
+    const CompilationDatabase& compilation_database,
+    const std::vector<std::filesystem::path>& changed_files,
+    const std::filesystem::path& build_root,
+    const IncludeIndex* include_index,
+    std::vector<std::string>* source_paths) {
+  // Matches the paths of ReadDependencies(). Deleted files still resolve, as
+  // relative() does not require the path to exist.
+  std::unordered_set<std::string> changed_paths;
+  for (const std::filesystem::path& changed_file : changed_files) {
+    auto relative_path = Relative(changed_file, build_root);
+    if (!relative_path) {
+      llvm::consumeError(relative_path.takeError());
+      continue;
+    }
+    changed_paths.insert(relative_path->string());
+  }
+
+  std::unordered_set<std::string_view> affected_paths;
+  if (include_index) {
+    std::vector<uint32_t> changed_ids;
+    for (const std::string& changed_path : changed_paths) {
+      if (std::optional<uint32_t> id = include_index->Find(changed_path)) {
+        changed_ids.push_back(*id);
+      }
+    }
+    for (uint32_t id :
+         include_index->GetAffectedTranslationUnits(changed_ids)) {
+      affected_paths.insert(include_index->GetPath(id));
+    }
+  }
+
+  std::unordered_map<std::string, std::optional<std::string>> canonical_paths;
+  size_t num_total = source_paths->size();
+  size_t num_unknown = 0;
+  // Returns whether |source_path| reads a changed file, or std::nullopt if
+  // that is not known.
+  auto is_affected =
+      [&](const std::string& source_path) -> std::optional<bool> {
+    if (!include_index) {
+      std::optional<std::vector<std::string>> dependencies = ReadDependencies(
+          compilation_database, source_path, build_root, &canonical_paths);
+      if (!dependencies) {
+        return std::nullopt;
+      }
+      return absl::c_any_of(*dependencies, [&](const std::string& dependency) {
+        return changed_paths.count(dependency);
+      });
+    }
+    auto relative_path = Relative(source_path, build_root);
+    if (!relative_path) {
+      llvm::consumeError(relative_path.takeError());
+      return std::nullopt;
+    }
+    std::optional<uint32_t> id = include_index->Find(relative_path->string());
+    if (!id || !include_index->AreDependenciesKnown(*id)) {
+      return std::nullopt;
+    }
+    return affected_paths.count(relative_path->string()) != 0;
+  };
+  source_paths->erase(
+      std::remove_if(source_paths->begin(), source_paths->end(),
+                     [&](const std::string& source_path) {
+                       std::optional<bool> affected = is_affected(source_path);
+                       if (!affected) {
+                         ++num_unknown;
+                         return false;
+                       }
+                       return !*affected;
+                     }),
+      source_paths->end());
+  llvm::errs() << changed_paths.size() << " changed files affect "
+               << source_paths->size() << " of " << num_total << " files";
+  if (num_unknown) {
+    llvm::errs() << ", including " << num_unknown << " of unknown dependencies";
+  }
+  llvm::errs() << "\n";
+}
+
+struct LexerFastPathStatistics {
+  size_t files_scanned = 0;
+  size_t macro_uses = 0;
+  size_t fallbacks = 0;
+  size_t translation_units = 0;
+  // Translation units without fresh depfiles, which are always parsed.
+  size_t unknown_dependencies = 0;
+  size_t skipped_translation_units = 0;
+  int64_t microseconds = 0;
+};
+
+// Classifies the uses of the macro in the project files read by each of
+// |source_paths|, as told by the depfiles of the build, without parsing.
+// The edits of every file whose uses were all classified go to
+// |fast_path_context|, and the files with uses to |classified_files|.
+// Returns the translation units that read no other file with uses, which
+// need not be parsed.
+std::unordered_set<std::string> RunLexerFastPath(
+    const CompilationDatabase& compilation_database,
+    const std::vector<std::string>& source_paths,
+    const std::filesystem::path& project_root,
+    const std::filesystem::path& build_root,
+    const PathPattern* path_pattern,
+    FileSystemCache* file_system_cache,
+    const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>& base_file_system,
+    ReplacementsContext* fast_path_context,
+    std::vector<std::string>* classified_files,
+    LexerFastPathStatistics* statistics) {
+  auto start = std::chrono::steady_clock::now();
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+      CreateCachedFileSystem(*file_system_cache, base_file_system);
+
+  // Returns true if the AST path has to parse |file_path|, relative to the
+  // build root.
+  auto classify_file = [&](const std::string& file_path) {
+    std::filesystem::path real_path =
+        (build_root / file_path).lexically_normal();
+    // The AST path does not look at files outside of its traversal scope.
+    if (std::mismatch(project_root.begin(), project_root.end(),
+                      real_path.begin(), real_path.end())
+            .first != project_root.end()) {
+      return false;
+    }
+    if (path_pattern) {
+      auto rel_file_path = Relative(real_path, project_root);
+      if (!rel_file_path) {
+        llvm::consumeError(rel_file_path.takeError());
+        return true;
+      }
+      if (!path_pattern->Match(rel_file_path->string())) {
+        return false;
+      }
+    }
+    std::shared_ptr<const FileSystemCache::Contents> contents;
+    if (file_system->getBufferForFile(real_path.string())) {
+      contents = file_system_cache->FindContents(real_path.string());
+    }
+    if (!contents) {
+      return true;
+    }
+    ++statistics->files_scanned;
+    LexerFastPathResult result =
+        ClassifyMacroUses(contents->buffer->getBuffer());
+    statistics->macro_uses += result.num_macro_uses;
+    statistics->fallbacks += result.num_fallbacks;
+    if (result.num_fallbacks) {
+      return true;
+    }
+    if (!result.num_macro_uses) {
+      return false;
+    }
+    classified_files->push_back(file_path);
+
+    // The records point to the texts, which must outlive them.
+    std::vector<std::string> deleted_members;
+    deleted_members.reserve(result.edits.size());
+    std::vector<ReplacementRecord> records;
+    for (const MacroUseEdits& edits : result.edits) {
+      deleted_members.push_back(GetDeletedMembers(edits.class_name));
+      records.push_back({.key_offset = edits.remove_offset,
+                         .offset = edits.remove_offset,
+                         .length = edits.remove_length,
+                         .text = ""});
+      records.push_back({.key_offset = edits.insert_offset,
+                         .offset = edits.insert_offset,
+                         .length = 0,
+                         .text = deleted_members.back()});
+    }
+    if (!records.empty()) {
+      MutexLock guard(*fast_path_context);
+      fast_path_context->Add(file_path, std::move(contents), records);
+    }
+    return false;
+  };
+
+  std::unordered_map<std::string, std::optional<std::string>> canonical_paths;
+  std::unordered_map<std::string, llvm::sys::TimePoint<>> modification_times;
+  // Whether the AST path has to parse each file read.
+  std::unordered_map<std::string, bool> needs_parse;
+  std::unordered_set<std::string> skipped_paths;
+  for (const std::string& source_path : source_paths) {
+    ++statistics->translation_units;
+    // A translation unit is only skipped if its depfiles list every file it
+    // reads now, which they may not if any of those files changed since.
+    std::optional<std::vector<std::string>> dependencies =
+        ReadDependencies(compilation_database, source_path, build_root,
+                         &canonical_paths, &modification_times);
+    if (!dependencies) {
+      ++statistics->unknown_dependencies;
+      continue;
+    }
+    bool skip = true;
+    for (const std::string& dependency : *dependencies) {
+      auto [iter, inserted] = needs_parse.try_emplace(dependency, false);
+      if (inserted) {
+        iter->second = classify_file(dependency);
+      }
+      if (iter->second) {
+        skip = false;
+        break;
+      }
+    }
+    if (skip) {
+      skipped_paths.insert(source_path);
+    }
+  }
+  statistics->skipped_translation_units = skipped_paths.size();
+  statistics->microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  return skipped_paths;
+}
+
+void PrintLexerFastPathStatistics(const LexerFastPathStatistics& statistics) {
+  llvm::errs() << "Lexer fast path classified "
+               << statistics.macro_uses - statistics.fallbacks << " of "
+               << statistics.macro_uses << " uses of " << kModernizeMacro
+               << " in " << statistics.files_scanned << " files in "
+               << llvm::format("%.3f", statistics.microseconds / 1000.0)
+               << " ms, and made " << statistics.skipped_translation_units
+               << " of " << statistics.translation_units
+               << " translation units unnecessary to parse";
+  if (statistics.unknown_dependencies) {
+    llvm::errs() << " (" << statistics.unknown_dependencies
+                 << " without fresh depfiles)";
+  }
+  llvm::errs() << "\n";
+}
+
+// Compares the edits of the lexer fast path in |classified_files| with the
+// edits the AST path found in the same files. Returns the number of files
+// where they differ.
+size_t CheckLexerFastPath(const std::vector<std::string>& classified_files,
+                          const ReplacementsContext& fast_path_context,
+                          const ReplacementsContext& replacements_context)
+    EXCLUSIVE_LOCKS_REQUIRED(fast_path_context, replacements_context) {
+  using Edit = std::tuple<unsigned, unsigned, unsigned, llvm::StringRef>;
+  auto get_edits = [](const ReplacementsContext& context) {
+    std::unordered_map<std::string, std::vector<Edit>> edits;
+    for (uint32_t id = 0; id < context.GetNumFiles(); ++id) {
+      std::vector<Edit>& file_edits = edits[context.GetFilePath(id).str()];
+      for (const ReplacementRecord& record :
+           context.GetFileReplacements(id).replacements) {
+        file_edits.emplace_back(record.key_offset, record.offset,
+                                record.length, record.text);
+      }
+      std::sort(file_edits.begin(), file_edits.end());
+    }
+    return edits;
+  };
+  std::unordered_map<std::string, std::vector<Edit>> fast_path_edits =
+      get_edits(fast_path_context);
+  std::unordered_map<std::string, std::vector<Edit>> ast_edits =
+      get_edits(replacements_context);
+
+  size_t mismatches = 0;
+  for (const std::string& file_path : classified_files) {
+    if (fast_path_edits[file_path] != ast_edits[file_path]) {
+      llvm::errs() << "Lexer fast path disagrees with the AST path in "
+                   << file_path << "\n";
+      ++mismatches;
+    }
+  }
+  llvm::errs() << "Lexer fast path matched the AST path in "
+               << classified_files.size() - mismatches << " of "
+               << classified_files.size() << " files\n";
+  return mismatches;
+}
+
+void PrintReplacementsStatistics(const ReplacementsContext& context)
+    EXCLUSIVE_LOCKS_REQUIRED(context) {
+  llvm::errs() << "Collected " << context.GetNumReplacements()
+               << " replacements in " << context.GetNumFiles() << " files, "
+               << context.GetTextPoolSize() << " bytes of text\n";
+}
+
+void PrintParseStatistics(const ParseStatistics& statistics) {
+  llvm::errs() << "Line tables: built for " << statistics.line_tables_built
+               << " of " << statistics.files_read << " files read\n";
+  llvm::errs() << "Matching: skipped " << statistics.skipped_top_level_decls
+               << " of " << statistics.top_level_decls
+               << " top-level declarations, " << statistics.candidates
+               << " candidates, " << statistics.matching_microseconds / 1000
+               << " ms in total\n";
+}
+
+void PrintPrefetchStatistics(const PrefetchStatistics& statistics) {
+  llvm::errs() << "Prefetch: read ahead " << statistics.files << " files, "
+               << statistics.bytes << " bytes, for "
+               << statistics.translation_units << " files to parse";
+  if (statistics.failed_files) {
+    llvm::errs() << ", " << statistics.failed_files << " files not found";
+  }
+  llvm::errs() << "\n";
+}
+
+void PrintStageStatistics(const std::vector<StageStatistics>& statistics) {
+  for (const StageStatistics& stage : statistics) {
+    if (!stage.items) {
+      continue;
+    }
+    llvm::errs() << "Stage " << stage.name << ": " << stage.items
+                 << " items, busy "
+                 << llvm::format("%.3f", stage.busy_microseconds / 1000.0)
+                 << " ms, queue depth "
+                 << llvm::format("%.1f", static_cast<double>(
+                                             stage.total_queue_depth) /
+                                             stage.items)
+                 << " on average, " << stage.max_queue_depth << " at most, "
+                 << stage.full_queue_pushes << " pushes to a full queue";
+    if (stage.blocked_microseconds) {
+      llvm::errs() << " blocked for "
+                   << llvm::format("%.3f", stage.blocked_microseconds / 1000.0)
+                   << " ms";
+    }
+    llvm::errs() << "\n";
+  }
+}
+
+void PrintFileSystemCacheStatistics(const FileSystemCache& file_system_cache) {
+  FileSystemCache::Statistics statistics = file_system_cache.GetStatistics();
+  llvm::errs() << "File system cache: " << statistics.status_requests
+               << " stats (" << statistics.status_misses << " from disk), "
+               << statistics.open_requests << " opens ("
+               << statistics.open_misses << " from disk), "
+               << statistics.bytes_read << " bytes read\n";
+}
+
+// Prints the most expensive headers and writes the report to |path|.
+bool WriteHeaderCostReport(const HeaderCostTable& table,
+                           const std::string& path) {
+  constexpr size_t kMaxPrintedRows = 20;
+  constexpr size_t kMaxWrittenChains = 10000;
+  PrintHeaderCosts(table, kMaxPrintedRows, llvm::errs());
+  std::error_code error;
+  llvm::raw_fd_ostream stream(path, error);
+  if (error) {
+    llvm::errs() << "Cannot write " << path << ": " << error.message()
+                 << "\n";
+    return false;
+  }
+  WriteHeaderCostJson(table, kMaxWrittenChains, stream);
+  // A stream destroyed with an unchecked error aborts the process.
+  stream.close();
+  if (stream.has_error()) {
+    llvm::errs() << "Cannot write " << path << ": "
+                 << stream.error().message() << "\n";
+    stream.clear_error();
+    return false;
+  }
+  return true;
+}
+
+// Returns the current status of |path|, reusing the hash of |previous| if
+// the size and modification time did not change. A missing file has an
+// empty status.
+IncludeIndexFileStatus GetIncludeIndexFileStatus(
+    const std::filesystem::path& path,
+    const std::optional<IncludeIndexFileStatus>& previous,
+    size_t* num_hashed) {
+  llvm::sys::fs::file_status file_status;
+  if (llvm::sys::fs::status(path.string(), file_status) ||
+      !llvm::sys::fs::is_regular_file(file_status)) {
+    return {};
+  }
+  IncludeIndexFileStatus status = {
+      .hash = 0,
+      .modification_time = file_status.getLastModificationTime()
+                               .time_since_epoch()
+                               .count(),
+      .size = file_status.getSize()};
+  if (previous && previous->modification_time == status.modification_time &&
+      previous->size == status.size) {
+    status.hash = previous->hash;
+    return status;
+  }
+  auto buffer = llvm::MemoryBuffer::getFile(path.string(), /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return {};
+  }
+  status.hash = llvm::xxHash64((*buffer)->getBuffer());
+  ++*num_hashed;
+  return status;
+}
+
+int BuildIncludeIndex(const RunIndexOptions& options) {
+  LoadedCompilationDatabase loaded;
+  if (!LoadCompilationDatabase(options.compile_commands, /*project_root=*/{},
+                               /*source_file_pattern=*/std::nullopt,
+                               &loaded)) {
+    return 1;
+  }
+  const StoredCompilationDatabase& compilation_database =
+      loaded.compilation_database;
+  const std::filesystem::path& build_root = loaded.build_root;
+
+  // Files whose size and modification time are unchanged since the previous
+  // index keep their hash instead of being read again.
+  std::unique_ptr<IncludeIndex> previous_index;
+  if (auto index_or_error = IncludeIndex::Open(options.index_path)) {
+    if ((*index_or_error)->GetBuildRoot() == build_root.string()) {
+      previous_index = std::move(*index_or_error);
+    }
+  } else {
+    llvm::consumeError(index_or_error.takeError());
+  }
+
+  IncludeIndexBuilder builder(build_root.string());
+  std::unordered_map<std::string, std::optional<std::string>> canonical_paths;
+  size_t num_unknown = 0;
+  for (const std::string& source_path : loaded.source_paths) {
+    auto relative_path = Relative(source_path, build_root);
+    if (!relative_path) {
+      llvm::errs() << "filesystem::relative for " << source_path
+                   << " returned error: "
+                   << llvm::toString(relative_path.takeError()) << "\n";
+      continue;
+    }
+    uint32_t id = builder.AddFile(relative_path->string());
+    std::optional<std::vector<std::string>> dependencies = ReadDependencies(
+        compilation_database, source_path, build_root, &canonical_paths);
+    std::optional<std::vector<uint32_t>> dependency_ids;
+    if (dependencies) {
+      dependency_ids.emplace();
+      for (const std::string& dependency : *dependencies) {
+        dependency_ids->push_back(builder.AddFile(dependency));
+      }
+    } else {
+      ++num_unknown;
+    }
+    builder.SetTranslationUnit(id, dependency_ids);
+  }
+
+  size_t num_hashed = 0;
+  for (uint32_t id = 0; id < builder.GetNumFiles(); ++id) {
+    const std::string& path = builder.GetPath(id);
+    std::optional<IncludeIndexFileStatus> previous_status;
+    if (previous_index) {
+      if (std::optional<uint32_t> previous_id = previous_index->Find(path)) {
+        previous_status = previous_index->GetStatus(*previous_id);
+      }
+    }
+    builder.SetStatus(id, GetIncludeIndexFileStatus(build_root / path,
+                                                    previous_status,
+                                                    &num_hashed));
+  }
+
+  std::string data = builder.Build();
+  if (llvm::Error error = llvm::writeToOutput(
+          options.index_path, [&](llvm::raw_ostream& stream) {
+            stream << data;
+            return llvm::Error::success();
+          })) {
+    llvm::errs() << "Cannot write " << options.index_path << ": "
+                 << llvm::toString(std::move(error)) << "\n";
+    return 1;
+  }
+  llvm::errs() << "Indexed " << builder.GetNumFiles() << " files, hashed "
+               << num_hashed << " of them";
+  if (num_unknown) {
+    llvm::errs() << "; " << num_unknown
+                 << " files have no up-to-date depfile";
+  }
+  llvm::errs() << "\n";
+  return 0;
+}
+
+int InspectIncludeIndex(const IncludeIndex& include_index,
+                        const std::vector<std::string>& paths,
+                        llvm::raw_ostream& out_stream) {
+  size_t num_translation_units = 0;
+  size_t num_unknown = 0;
+  for (uint32_t id = 0; id < include_index.GetNumFiles(); ++id) {
+    if (include_index.IsTranslationUnit(id)) {
+      ++num_translation_units;
+      num_unknown += !include_index.AreDependenciesKnown(id);
+    }
+  }
+  out_stream << "Build root: " << include_index.GetBuildRoot() << "\n"
+             << "Files: " << include_index.GetNumFiles() << "\n"
+             << "Translation units: " << num_translation_units << " ("
+             << num_unknown << " of unknown dependencies)\n"
+             << "Edges: " << include_index.GetNumEdges() << "\n"
+             << "Size: " << include_index.GetSizeInBytes() << " bytes\n";
+
+  std::filesystem::path build_root(include_index.GetBuildRoot());
+  for (const std::string& path : paths) {
+    auto relative_path = Relative(std::filesystem::absolute(path), build_root);
+    if (!relative_path) {
+      llvm::errs() << "filesystem::relative for " << path
+                   << " returned error: "
+                   << llvm::toString(relative_path.takeError()) << "\n";
+      return 1;
+    }
+    std::optional<uint32_t> id = include_index.Find(relative_path->string());
+    if (!id) {
+      llvm::errs() << path << " is not in the index\n";
+      return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> affected_ids =
+        include_index.GetAffectedTranslationUnits({*id});
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    out_stream << path << " is read by " << affected_ids.size()
+               << " translation units (" << elapsed.count() << " ms):\n";
+    for (uint32_t affected_id : affected_ids) {
+      out_stream << "  " << include_index.GetPath(affected_id) << "\n";
+    }
+  }
+  return 0;
+}
+
+int VerifyIncludeIndex(const IncludeIndex& include_index) {
+  if (llvm::Error error = include_index.Verify()) {
+    llvm::errs() << llvm::toString(std::move(error)) << "\n";
+    return 1;
+  }
+  std::filesystem::path build_root(include_index.GetBuildRoot());
+  size_t num_hashed = 0;
+  size_t num_stale = 0;
+  for (uint32_t id = 0; id < include_index.GetNumFiles(); ++id) {
+    IncludeIndexFileStatus status = include_index.GetStatus(id);
+    if (GetIncludeIndexFileStatus(build_root / include_index.GetPath(id),
+                                  status, &num_hashed)
+            .hash != status.hash) {
+      llvm::errs() << "Changed since indexed: " << include_index.GetPath(id)
+                   << "\n";
+      ++num_stale;
+    }
+  }
+  llvm::errs() << "Checked " << include_index.GetNumFiles() << " files, "
+               << num_stale << " changed since indexed\n";
+  return num_stale ? 1 : 0;
+}
+
+// Runs the modernizer, timing its phases and parses with |perf_recorder|.
+int RunModernizerWithRecorder(const RunModernizerOptions& options,
+                              PerfRecorder* perf_recorder) {
+  perf_recorder->StartPhase("load");
+  auto project_root_or_error = Canonical(options.project_root);
+  if (!project_root_or_error) {
+    llvm::errs() << "Invalid project root: " << options.project_root
+                 << " error: "
+                 << llvm::toString(project_root_or_error.takeError()) << "\n";
+    return 1;
+  }
+
+  const auto& project_root = *project_root_or_error;
+  const auto& compile_commands = options.compile_commands;
+  bool in_memory_compile_commands = options.compilation_database ||
+                                    !options.compile_command_list.empty();
+  // Results passed to |on_file_result| are not written anywhere.
+  bool in_place = options.in_place && !options.on_file_result;
+  llvm::raw_ostream* out_stream = options.out_stream;
+  std::error_code ec;
+  if (!std::filesystem::exists(project_root, ec) ||
+      !std::filesystem::is_directory(project_root, ec)) {
+    llvm::errs() << "Project Root does not exist or not a directory: "
+                 << ec.message() << "\n";
+    return 1;
+  }
+  if (!in_memory_compile_commands &&
+      !std::filesystem::exists(compile_commands, ec)) {
+    llvm::errs() << "compile_commands.json does not exist: " << ec.message()
+                 << "\n";
+    return 1;
+  }
+
+  std::optional<PathPattern> source_file_pattern;
+  if (!options.source_file_pattern.empty()) {
+    source_file_pattern = PathPattern::Create(options.source_file_pattern);
+    if (!source_file_pattern) {
+      llvm::errs() << "Bad source file pattern: " << options.source_file_pattern
+                   << "\n";
+      return 1;
+    }
+  }
+
+  if (!in_place && !out_stream && !options.on_file_result) {
+    llvm::errs() << "Output stream is not set.\n";
+    return 1;
+  }
+  if (!options.header_cost_report_path.empty() && options.worker_processes) {
+    llvm::errs() << "Header costs cannot be recorded in worker processes\n";
+    return 1;
+  }
+
+  // The server keeps compile databases loaded from disk until the file
+  // changes.
+  std::shared_ptr<const LoadedCompilationDatabase> loaded;
+  std::string compilation_database_key;
+  llvm::sys::fs::file_status compile_commands_status;
+  bool cache_compilation_database =
+      options.compilation_database_cache && !in_memory_compile_commands &&
+      !llvm::sys::fs::status(compile_commands.string(),
+                             compile_commands_status);
+  if (cache_compilation_database) {
+    compilation_database_key = std::filesystem::absolute(compile_commands)
+                                   .lexically_normal()
+                                   .string();
+    for (const std::string& part :
+         {project_root.string(), options.source_file_pattern,
+          std::string(options.parse_define_variants ? "1" : "0")}) {
+      compilation_database_key.push_back('\0');
+      compilation_database_key += part;
+    }
+    loaded = options.compilation_database_cache->Find(
+        compilation_database_key, compile_commands_status);
+    if (loaded) {
+      llvm::errs() << "Reusing the compile database loaded from "
+                   << compile_commands.string() << "\n";
+    }
+  }
+  if (!loaded) {
+    auto new_loaded = std::make_shared<LoadedCompilationDatabase>();
+    bool loaded_ok;
+    if (options.compilation_database) {
+      loaded_ok = AddCompileCommands(
+          options.compilation_database->getAllCompileCommands(), project_root,
+          source_file_pattern, new_loaded.get());
+    } else if (!options.compile_command_list.empty()) {
+      loaded_ok =
+          AddCompileCommands(options.compile_command_list, project_root,
+                             source_file_pattern, new_loaded.get());
+    } else {
+      loaded_ok = LoadCompilationDatabase(compile_commands, project_root,
+                                          source_file_pattern,
+                                          new_loaded.get());
+    }
+    if (!loaded_ok) {
+      return 1;
+    }
+    new_loaded->num_compile_commands =
+        new_loaded->compilation_database.GetNumCompileCommands();
+    new_loaded->num_removed = new_loaded->compilation_database.Deduplicate(
+        options.parse_define_variants);
+    if (cache_compilation_database) {
+      options.compilation_database_cache->Store(
+          compilation_database_key, compile_commands_status, new_loaded);
+    }
+    loaded = std::move(new_loaded);
+  }
+  const StoredCompilationDatabase& stored_compilation_database =
+      loaded->compilation_database;
+  const std::filesystem::path& build_root = loaded->build_root;
+  std::vector<std::string> source_paths = loaded->source_paths;
+  llvm::errs() << "Skipped " << loaded->num_removed << " of "
+               << loaded->num_compile_commands
+               << " compile commands that preprocess a file like another\n";
+
+  std::unique_ptr<IncludeIndex> include_index;
+  if (!options.include_index_path.empty() &&
+      (!options.changed_since.empty() ||
+       options.prefetch_translation_units > 0)) {
+    auto include_index_or_error =
+        IncludeIndex::Open(options.include_index_path);
+    if (!include_index_or_error) {
+      llvm::errs() << llvm::toString(include_index_or_error.takeError())
+                   << "\n";
+      return 1;
+    }
+    include_index = std::move(*include_index_or_error);
+    if (include_index->GetBuildRoot() != build_root.string()) {
+      llvm::errs() << "Include index " << options.include_index_path
+                   << " was built for " << include_index->GetBuildRoot()
+                   << "\n";
+      return 1;
+    }
+  }
+
+  if (!options.changed_since.empty()) {
+    auto changed_files = GetChangedFiles(project_root, options.changed_since);
+    if (!changed_files) {
+      llvm::errs() << llvm::toString(changed_files.takeError()) << "\n";
+      return 1;
+    }
+    KeepAffectedTranslationUnits(stored_compilation_database, *changed_files,
+                                 build_root, include_index.get(),
+                                 &source_paths);
+  }
+
+  ReplacementsContext replacements_context;
+  FileSystemCache local_file_system_cache;
+  FileSystemCache& file_system_cache = options.file_system_cache
+                                           ? *options.file_system_cache
+                                           : local_file_system_cache;
+  StyleCache local_style_cache;
+  StyleCache& style_cache =
+      options.style_cache ? *options.style_cache : local_style_cache;
+  TranslationUnitCache* translation_unit_cache = options.translation_unit_cache;
+
+  std::optional<SourceFileFilter> source_file_filter;
+  std::function<bool(llvm::StringRef file_path)> merge_filter;
+  if (source_file_pattern) {
+    source_file_filter.emplace(project_root, build_root,
+                               &*source_file_pattern);
+    merge_filter = [&](llvm::StringRef file_path) {
+      return source_file_filter->Match(file_path);
+    };
+  }
+  // Results kept between runs are not filtered by the source pattern, so
+  // that runs with another pattern can reuse them, and are filtered when
+  // merged instead. The pattern then does not narrow the traversal scope.
+  const PathPattern* parse_path_pattern =
+      (source_file_pattern && !translation_unit_cache) ? &*source_file_pattern
+                                                       : nullptr;
+
+  std::unique_ptr<Journal> journal;
+  if (!options.journal_path.empty()) {
+    std::string journal_key;
+    if (in_memory_compile_commands) {
+      for (const CompileCommand& compile_command :
+           stored_compilation_database.getAllCompileCommands()) {
+        journal_key += compile_command.Directory;
+        journal_key.push_back('\0');
+        journal_key += compile_command.Filename;
+        journal_key.push_back('\0');
+        for (const std::string& argument : compile_command.CommandLine) {
+          journal_key += argument;
+          journal_key.push_back('\0');
+        }
+      }
+    } else {
+      auto compile_commands_buffer =
+          llvm::MemoryBuffer::getFile(compile_commands.string());
+      if (!compile_commands_buffer) {
+        llvm::errs() << "Cannot read " << compile_commands.string() << ": "
+                     << compile_commands_buffer.getError().message() << "\n";
+        return 1;
+      }
+      journal_key = std::string((*compile_commands_buffer)->getBuffer());
+    }
+    // The source pattern also filters headers, and the compile commands
+    // parsed depend on |parse_define_variants|, so results only carry over
+    // between runs with the same options.
+    journal_key.push_back('\0');
+    journal_key += options.source_file_pattern;
+    journal_key.push_back(options.parse_define_variants ? '1' : '0');
+
+    std::unordered_set<std::string> pending_paths(source_paths.begin(),
+                                                  source_paths.end());
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+        CreateCachedFileSystem(file_system_cache, options.base_file_system);
+    size_t num_replayed = 0;
+    auto journal_or_error = Journal::Open(
+        options.journal_path, llvm::xxHash64(journal_key),
+        [&](std::string_view source_path, std::string_view data) {
+          // Skips files that are not part of this run or seen already.
+          auto iter = pending_paths.find(std::string(source_path));
+          if (iter == pending_paths.end()) {
+            return;
+          }
+          if (MergeSerializedReplacements(
+                  data, &replacements_context, &file_system_cache,
+                  *file_system,
+                  source_file_filter ? &*source_file_filter : nullptr)) {
+            pending_paths.erase(iter);
+            ++num_replayed;
+          }
+        });
+    if (!journal_or_error) {
+      llvm::errs() << llvm::toString(journal_or_error.takeError()) << "\n";
+      return 1;
+    }
+    journal = std::move(*journal_or_error);
+    if (num_replayed) {
+      llvm::errs() << "Resumed " << num_replayed << " of "
+                   << source_paths.size() << " files from the journal\n";
+      source_paths.erase(
+          std::remove_if(source_paths.begin(), source_paths.end(),
+                         [&](const std::string& source_path) {
+                           return !pending_paths.count(source_path);
+                         }),
+          source_paths.end());
+    }
+  }
+
+  if (translation_unit_cache) {
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system =
+        CreateCachedFileSystem(file_system_cache, options.base_file_system);
+    size_t num_total = source_paths.size();
+    size_t num_reused = 0;
+    source_paths.erase(
+        std::remove_if(
+            source_paths.begin(), source_paths.end(),
+            [&](const std::string& source_path) {
+              std::optional<std::string> data = translation_unit_cache->Find(
+                  source_path, GetTranslationUnitKey(
+                                   stored_compilation_database, source_path));
+              if (!data ||
+                  !MergeSerializedReplacements(
+                      *data, &replacements_context, &file_system_cache,
+                      *file_system,
+                      source_file_filter ? &*source_file_filter : nullptr)) {
+                return false;
+              }
+              ++num_reused;
+              return true;
+            }),
+        source_paths.end());
+    llvm::errs() << "Reused the results of " << num_reused << " of "
+                 << num_total << " files\n";
+  }
+
+  // Holds the edits of the lexer fast path, which only join the others if
+  // they are not being checked.
+  ReplacementsContext fast_path_context;
+  std::vector<std::string> classified_files;
+  std::unordered_set<std::string> fast_path_skipped_paths;
+  if (options.lexer_fast_path || options.check_lexer_fast_path) {
+    perf_recorder->StartPhase("lexer_fast_path");
+    LexerFastPathStatistics statistics;
+    fast_path_skipped_paths = RunLexerFastPath(
+        stored_compilation_database, source_paths, project_root, build_root,
+        (source_file_pattern ? &(*source_file_pattern) : nullptr),
+        &file_system_cache, options.base_file_system, &fast_path_context,
+        &classified_files, &statistics);
+    PrintLexerFastPathStatistics(statistics);
+    perf_recorder->SetCount("lexer_fast_path.macro_uses",
+                            statistics.macro_uses);
+    perf_recorder->SetCount("lexer_fast_path.fallbacks", statistics.fallbacks);
+    perf_recorder->SetCount("lexer_fast_path.translation_units",
+                            statistics.translation_units);
+    perf_recorder->SetCount("lexer_fast_path.unknown_dependencies",
+                            statistics.unknown_dependencies);
+    perf_recorder->SetCount("lexer_fast_path.skipped_translation_units",
+                            statistics.skipped_translation_units);
+    if (!options.check_lexer_fast_path) {
+      source_paths.erase(std::remove_if(source_paths.begin(),
+                                        source_paths.end(),
+                                        [&](const std::string& source_path) {
+                                          return fast_path_skipped_paths.count(
+                                              source_path);
+                                        }),
+                         source_paths.end());
+      MutexLock guard(replacements_context);
+      MutexLock fast_path_guard(fast_path_context);
+      replacements_context.Merge(fast_path_context);
+    }
+  }
+
+  // Streaming only applies to patch output; in-place writes happen at the
+  // end of the run anyway.
+  std::optional<FileCoverage> file_coverage;
+  std::optional<PatchStreamer> patch_streamer;
+  if (options.stream_output && !in_place && !options.on_file_result) {
+    file_coverage.emplace();
+    // Worker processes refuse to fork while other threads exist, and joined
+    // threads may take a moment to leave the process.
+    AddTranslationUnits(stored_compilation_database, source_paths, build_root,
+                        options.worker_processes ? 1 : options.num_jobs,
+                        &*file_coverage);
+    patch_streamer.emplace(project_root, build_root, &replacements_context,
+                           &file_system_cache, &style_cache, &*file_coverage,
+                           options.base_file_system, options.cancelled,
+                           out_stream);
+  }
+
+  ArgumentsAdjuster arguments_adjuster = combineAdjusters(
+      getClangStripDependencyFileAdjuster(),
+      combineAdjusters(getClangSyntaxOnlyAdjuster(),
+                       combineAdjusters(getStripPluginsAdjuster(),
+                                        getClangStripOutputAdjuster())));
+
+  // Counted in this process only, so not with worker processes.
+  ParseStatistics parse_statistics;
+  std::atomic<int64_t> parse_microseconds = 0;
+  std::atomic<int64_t> fast_path_skipped_parse_microseconds = 0;
+  std::optional<HeaderCostTable> header_cost_table;
+  if (!options.header_cost_report_path.empty()) {
+    header_cost_table.emplace();
+  }
+  auto create_action_factory = [&]() {
+    return std::make_unique<ModernizerActionFactory>(
+        project_root, build_root, &file_system_cache, parse_path_pattern,
+        options.verbose, options.traverse_all_declarations, &parse_statistics,
+        header_cost_table.has_value());
+  };
+
+  std::unique_ptr<ParallelToolExecutor> executor;
+  // Only used on the thread of |prefetcher|.
+  std::unordered_map<std::string, std::optional<std::string>>
+      prefetch_canonical_paths;
+  std::unique_ptr<Prefetcher> prefetcher;
+  if (!options.worker_processes) {
+    executor = std::make_unique<ParallelToolExecutor>(
+        stored_compilation_database, std::move(source_paths),
+        &file_system_cache, options.base_file_system);
+    if (options.prefetch_translation_units > 0) {
+      prefetcher = std::make_unique<Prefetcher>(
+          executor->GetFiles(), options.prefetch_translation_units,
+          [&](const std::string& source_path) {
+            return GetPrefetchFiles(stored_compilation_database, source_path,
+                                    build_root, include_index.get(),
+                                    &prefetch_canonical_paths);
+          });
+    }
+  }
+
+  // Without streaming, files are formatted while the remaining translation
+  // units parse, as soon as those reading them have completed.
+  bool format_early = !patch_streamer && executor;
+  if (format_early) {
+    file_coverage.emplace();
+    AddTranslationUnits(stored_compilation_database, executor->GetFiles(),
+                        build_root, options.num_jobs, &*file_coverage);
+  }
+  FileFormatter file_formatter(
+      project_root, build_root, &replacements_context, &file_system_cache,
+      &style_cache, format_early ? &*file_coverage : nullptr,
+      options.base_file_system, options.on_file_result);
+  absl::Mutex parse_errors_mutex;
+  std::string parse_errors;  // Guarded by |parse_errors_mutex|.
+
+  // The stages share a pool of |num_jobs| threads, which drain the later
+  // stages first, and a full queue holds back the stages feeding it. With
+  // worker processes, only the format stage runs here, after the parse.
+  Pipeline<PipelineItem> pipeline(options.num_jobs);
+  auto is_cancelled = [&] { return options.cancelled && *options.cancelled; };
+  size_t parse_stage = 0;
+  size_t collect_stage = 0;
+  size_t format_stage = 0;
+  auto push_files_to_format = [&](std::vector<std::string> file_paths) {
+    for (std::string& file_path : file_paths) {
+      pipeline.Push(format_stage, PipelineItem{.path = std::move(file_path)});
+    }
+  };
+  parse_stage = pipeline.AddStage(
+      "parse", 2 * options.num_jobs, [&](PipelineItem item) {
+        if (is_cancelled()) {
+          return;
+        }
+        if (prefetcher) {
+          prefetcher->OnStarted(item.path);
+        }
+        item.result = executor->RunFile(
+            item.path,
+            [&](ClangTool& tool, const std::string& source_path) {
+              item.action_factory = create_action_factory();
+              auto start = std::chrono::steady_clock::now();
+              int result = tool.run(item.action_factory.get());
+              int64_t elapsed =
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+              parse_microseconds += elapsed;
+              if (fast_path_skipped_paths.count(source_path)) {
+                fast_path_skipped_parse_microseconds += elapsed;
+              }
+              perf_recorder->AddTranslationUnit(source_path, elapsed);
+              return result;
+            },
+            arguments_adjuster);
+        pipeline.Push(collect_stage, std::move(item));
+      });
+  collect_stage = pipeline.AddStage(
+      "collect", options.num_jobs, [&](PipelineItem item) {
+        const std::string& source_path = item.path;
+        if (item.result) {
+          absl::MutexLock lock(&parse_errors_mutex);
+          parse_errors += "Failed to run action on " + source_path + "\n";
+        }
+        if (header_cost_table) {
+          header_cost_table->AddTranslationUnit(
+              *item.action_factory->GetHeaderCostRecorder());
+        }
+        ReplacementsContext& tu_context =
+            item.action_factory->GetReplacementsContext();
+        {
+          MutexLock guard(tu_context);
+          if (!item.result && (journal || translation_unit_cache)) {
+            std::string data = SerializeReplacements(tu_context);
+            if (journal) {
+              if (llvm::Error error = journal->Append(source_path, data)) {
+                llvm::errs() << llvm::toString(std::move(error)) << "\n";
+              }
+            }
+            if (translation_unit_cache) {
+              translation_unit_cache->Store(
+                  source_path,
+                  GetTranslationUnitKey(stored_compilation_database,
+                                        source_path),
+                  std::move(data), item.action_factory->GetFilesRead());
+            }
+          }
+          MutexLock context_guard(replacements_context);
+          replacements_context.Merge(tu_context, merge_filter);
+        }
+        if (patch_streamer) {
+          patch_streamer->OnTranslationUnitCompleted(source_path);
+        }
+        if (format_early) {
+          push_files_to_format(file_formatter.TakeFinalFiles(
+              file_coverage->CompleteTranslationUnit(source_path)));
+        }
+      });
+  format_stage = pipeline.AddStage(
+      "format", 4 * options.num_jobs, [&](PipelineItem item) {
+        if (!is_cancelled()) {
+          file_formatter.Format(item.path);
+        }
+      });
+
+  perf_recorder->StartPhase("parse");
+  // Files that failed in worker processes. Without worker processes, any
+  // failure ends the run right away.
+  int failed_files = 0;
+  if (options.worker_processes) {
+    failed_files = ParseInWorkerProcesses(
+        stored_compilation_database, source_paths, arguments_adjuster,
+        create_action_factory,
+        WorkerPoolOptions{.num_workers = options.num_jobs,
+                          .timeout = options.worker_timeout,
+                          .cancelled = options.cancelled},
+        &replacements_context, &file_system_cache, options.base_file_system,
+        source_file_filter ? &*source_file_filter : nullptr, journal.get(),
+        patch_streamer ? &*patch_streamer : nullptr);
+    if (is_cancelled()) {
+      llvm::errs() << "Cancelled\n";
+      return 1;
+    }
+    // Worker processes are forked from a process without threads.
+    pipeline.Start();
+  } else {
+    pipeline.Start();
+    for (const std::string& source_path : executor->GetFiles()) {
+      pipeline.Push(parse_stage, PipelineItem{.path = source_path});
+    }
+    pipeline.Wait();
+    if (is_cancelled()) {
+      llvm::errs() << "Cancelled\n";
+      return 1;
+    }
+    if (header_cost_table &&
+        !WriteHeaderCostReport(*header_cost_table,
+                               options.header_cost_report_path)) {
+      return 1;
+    }
+    {
+      absl::MutexLock lock(&parse_errors_mutex);
+      if (!parse_errors.empty()) {
+        llvm::errs() << "Execute error: " << parse_errors << "\n";
+        return 1;
+      }
+    }
+    PrintParseStatistics(parse_statistics);
+    if (prefetcher) {
+      PrintPrefetchStatistics(prefetcher->GetStatistics());
+    }
+  }
+  perf_recorder->StartPhase("output");
+  perf_recorder->SetCount("candidates", parse_statistics.candidates);
+  perf_recorder->SetCount("parse.files_read", parse_statistics.files_read);
+  perf_recorder->SetCount("parse.line_tables_built",
+                          parse_statistics.line_tables_built);
+  perf_recorder->SetCount("parse.top_level_decls",
+                          parse_statistics.top_level_decls);
+  perf_recorder->SetCount("parse.skipped_top_level_decls",
+                          parse_statistics.skipped_top_level_decls);
+  perf_recorder->SetMilliseconds(
+      "parse.matching_ms", parse_statistics.matching_microseconds / 1000.0);
+  {
+    MutexLock guard(replacements_context);
+    perf_recorder->SetCount("replacements",
+                            replacements_context.GetNumReplacements());
+    perf_recorder->SetCount("files_with_replacements",
+                            replacements_context.GetNumFiles());
+  }
+
+  if (options.check_lexer_fast_path) {
+    {
+      MutexLock guard(replacements_context);
+      MutexLock fast_path_guard(fast_path_context);
+      failed_files += CheckLexerFastPath(classified_files, fast_path_context,
+                                         replacements_context);
+    }
+    if (!options.worker_processes) {
+      double skipped_milliseconds =
+          fast_path_skipped_parse_microseconds / 1000.0;
+      llvm::errs() << "Parsing the translation units the lexer fast path "
+                      "makes unnecessary took "
+                   << llvm::format("%.3f", skipped_milliseconds) << " of "
+                   << llvm::format("%.3f", parse_microseconds / 1000.0)
+                   << " ms\n";
+      perf_recorder->SetMilliseconds("lexer_fast_path.skipped_parse_ms",
+                                     skipped_milliseconds);
+      perf_recorder->SetMilliseconds("lexer_fast_path.parse_ms",
+                                     parse_microseconds / 1000.0);
+    }
+  }
+
+  if (patch_streamer) {
+    failed_files += patch_streamer->Finish();
+    PrintStageStatistics(pipeline.GetStatistics());
+    PrintFileSystemCacheStatistics(file_system_cache);
+    return failed_files ? 1 : 0;
+  }
+
+  {
+    MutexLock guard(replacements_context);
+    PrintReplacementsStatistics(replacements_context);
+  }
+  push_files_to_format(file_formatter.TakeRemainingFiles());
+  pipeline.Wait();
+  PrintStageStatistics(pipeline.GetStatistics());
+  if (is_cancelled()) {
+    llvm::errs() << "Cancelled\n";
+    return 1;
+  }
+
+  int skipped_files = 0;
+  std::vector<RewrittenFile> rewritten_files =
+      file_formatter.TakeRewrittenFiles(&skipped_files);
+
+  PrintFileSystemCacheStatistics(file_system_cache);
+
+  // Every changed file was passed to |on_file_result| already.
+  if (options.on_file_result) {
+    return (skipped_files || failed_files) ? 1 : 0;
+  }
+  if (in_place) {
+    std::vector<InPlaceWrite> writes;
+    writes.reserve(rewritten_files.size());
+    for (const RewrittenFile& rewritten_file : rewritten_files) {
+      writes.push_back(InPlaceWrite{.path = rewritten_file.contents->real_path,
+                                    .contents = rewritten_file.new_contents});
+    }
+    InPlaceWriteStatistics statistics = WriteFilesInPlace(
+        writes, options.num_jobs, options.skip_unchanged_files);
+    PrintInPlaceWriteStatistics(statistics, llvm::errs());
+    if (journal) {
+      // Replaying the journal against the rewritten files would only
+      // produce conflicts.
+      journal.reset();
+      llvm::sys::fs::remove(options.journal_path);
+    }
+    if (statistics.files_failed) {
+      return 1;
+    }
+    return (skipped_files || failed_files) ? 1 : 0;
+  }
+  for (const RewrittenFile& rewritten_file : rewritten_files) {
+    if (!WriteDiff(rewritten_file, build_root, project_root, *out_stream)) {
+      return 1;
+    }
+  }
+
+  return (skipped_files || failed_files) ? 1 : 0;
+}
+
+}  // namespace
+
+int RunModernizer(const RunModernizerOptions& options) {
+  PerfRecorder perf_recorder;
+  int result = RunModernizerWithRecorder(options, &perf_recorder);
+  if (options.perf_record_path.empty() && options.perf_compare_path.empty()) {
+    return result;
+  }
+  PerfRecord record = perf_recorder.Finish();
+  if (!options.perf_record_path.empty()) {
+    if (llvm::Error error = WritePerfRecord(record, options.perf_record_path)) {
+      llvm::errs() << llvm::toString(std::move(error)) << "\n";
+      return result ? result : 1;
+    }
+  }
+  if (!options.perf_compare_path.empty()) {
+    llvm::Expected<PerfRecord> baseline =
+        ReadPerfRecord(options.perf_compare_path);
+    if (!baseline) {
+      llvm::errs() << llvm::toString(baseline.takeError()) << "\n";
+      return result ? result : 1;
+    }
+    // A failed run reports its own error rather than a regression.
+    if (PrintPerfComparison(*baseline, record,
+                            options.perf_threshold_percent, llvm::errs()) &&
+        result == 0) {
+      return kPerfRegressionResult;
+    }
+  }
+  return result;
+}
+
+int RunIndex(const RunIndexOptions& options) {
+  if (options.command == IndexCommand::kBuild) {
+    return BuildIncludeIndex(options);
+  }
+  auto include_index = IncludeIndex::Open(options.index_path);
+  if (!include_index) {
+    llvm::errs() << llvm::toString(include_index.takeError()) << "\n";
+    return 1;
+  }
+  if (options.command == IndexCommand::kInspect) {
+    return InspectIncludeIndex(**include_index, options.paths,
+                               *options.out_stream);
+  }
+  return VerifyIncludeIndex(**include_index);
 }
 
 }  // namespace modernizer
@@ -1,26 +1,180 @@
 #ifndef MODERNIZER_MODERNIZER_H_
 #define MODERNIZER_MODERNIZER_H_
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <functional>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace modernizer {
 
+class CompilationDatabaseCache;
+class FileSystemCache;
+class StyleCache;
+class TranslationUnitCache;
+
 inline constexpr const char* kModernizeMacro = "RTC_DISALLOW_COPY_AND_ASSIGN";
 
+// A file rewritten by RunModernizer(), for callers embedding it.
+struct FileResult {
+  // Relative to the build root.
+  std::string file_path;
+  std::string real_path;
+  // The edits from the contents the file was parsed with to |new_contents|,
+  // formatting included.
+  clang::tooling::Replacements replacements;
+  std::string new_contents;
+  // The patch of the file, as it would be written to the output stream.
+  std::string diff;
+};
+
+using FileResultFunction = std::function<void(const FileResult& result)>;
+
 struct RunModernizerOptions {
   std::filesystem::path project_root;
   std::filesystem::path compile_commands;
+  // If either is set, the compile commands are taken from it instead of
+  // |compile_commands|. Like those of compile_commands.json, they must all
+  // have the same directory, which is the build root.
+  const clang::tooling::CompilationDatabase* compilation_database = nullptr;
+  std::vector<clang::tooling::CompileCommand> compile_command_list;
   std::string source_file_pattern;
   int num_jobs = std::thread::hardware_concurrency();
   bool in_place = false;
+  // With |in_place|, leave files alone whose contents on disk already equal
+  // the rewritten contents.
+  bool skip_unchanged_files = false;
+  // Without |in_place|, write the patch of each file as soon as every
+  // translation unit reading it has been parsed, as told by the depfiles of
+  // the build. Files are then written in completion order instead of sorted
+  // by path.
+  bool stream_output = false;
+  // Parse in |num_jobs| worker processes instead of threads. A crash or
+  // timeout then only loses the translation unit being parsed, which is
+  // retried once and then reported. Workers are forked, so the run fails if
+  // the calling process has any other thread.
+  bool worker_processes = false;
+  // With |worker_processes|, kill a worker that spends longer than this on a
+  // translation unit. Zero means no limit.
+  std::chrono::seconds worker_timeout{0};
+  // If set, every parsed file and its replacements are appended to this
+  // journal. A later run with the same compile database and source pattern
+  // replays the journal and only parses the remaining files.
+  std::string journal_path;
+  // If set, only parse the files that read a file changed since this git
+  // revision, as told by |include_index_path| if set or by the depfiles of
+  // the build otherwise. Files of unknown dependencies are always parsed.
+  std::string changed_since;
+  std::string include_index_path;
+  // Compile commands of a file that only differ in arguments not affecting
+  // preprocessing are parsed once. If set, commands with different -D or -U
+  // arguments are each parsed; otherwise only the first of them is.
+  bool parse_define_variants = false;
+  // Log the line and column of every candidate found instead of its file
+  // offset, which builds the line table of every file with a candidate.
+  bool verbose = false;
+  // Match in every declaration of every translation unit, instead of only
+  // those of files under |project_root| that match |source_file_pattern|.
+  bool traverse_all_declarations = false;
+  // Rewrite the uses of the macro the raw tokens of their file classify,
+  // and only parse the translation units that read other uses, as told by
+  // the depfiles of the build. A stale depfile that still looks fresh can
+  // hide a file, whose edits are then lost.
+  bool lexer_fast_path = false;
+  // Like |lexer_fast_path|, but parses every translation unit anyway and
+  // fails if the edits of the fast path differ from those of the AST path.
+  bool check_lexer_fast_path = false;
+  // Without |worker_processes|, read ahead the files of up to this many
+  // translation units past the last one started, as told by
+  // |include_index_path| if set or by the depfiles of the build otherwise.
+  // Zero disables it.
+  int prefetch_translation_units = 0;
+  // If set, time the headers read by each translation unit parsed, and
+  // write the total and self time of every header and include chain to this
+  // file as JSON. The most expensive ones are also printed. Translation units
+  // not parsed, like those replayed from |journal_path|, are not counted.
+  // Not supported with |worker_processes|.
+  std::string header_cost_report_path;
+  // If set, the timings, peak memory and counts of the run are written to
+  // |perf_record_path| as JSON and compared with |perf_compare_path|, as by
+  // ComparePerfRecords(). RunModernizer() returns kPerfRegressionResult if a
+  // measurement regressed and the run succeeded. Memory and CPU time are
+  // those of the process; in the server, peak memory spans every run.
+  std::string perf_record_path;
+  std::string perf_compare_path;
+  int perf_threshold_percent = 10;
+  // Caches kept by a long-lived process between runs. If not set, every run
+  // starts with empty caches. Results parsed in worker processes are not
+  // added to |translation_unit_cache|. With |translation_unit_cache|, files
+  // are parsed without |source_file_pattern|, which only filters the results,
+  // so that a run with another pattern reuses them.
+  // |compilation_database_cache| keeps |compile_commands| loaded until the
+  // file changes, and |style_cache| keeps the formatting style of each
+  // directory until a .clang-format file is passed to its Invalidate().
+  CompilationDatabaseCache* compilation_database_cache = nullptr;
+  FileSystemCache* file_system_cache = nullptr;
+  StyleCache* style_cache = nullptr;
+  TranslationUnitCache* translation_unit_cache = nullptr;
+  // If set, files are read through this file system instead of the real one,
+  // for example an overlay with contents that are not on disk. A file is
+  // skipped if its contents in this file system change during the run.
+  // |file_system_cache| and |style_cache| must not be shared with runs
+  // reading through another file system.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system = nullptr;
+  // If set, every rewritten file is passed to |on_file_result| instead of
+  // being written in place or to |out_stream|. Without |worker_processes|,
+  // files are passed as soon as every translation unit reading them has been
+  // parsed, as told by the depfiles of the build, and the others at the end.
+  // A file passed before all of its results were known, because of a stale
+  // depfile, is passed again. Called on the threads of the run, one file at a
+  // time.
+  FileResultFunction on_file_result;
+  // If set, setting it to true stops the run as soon as possible: files not
+  // parsed or formatted yet are skipped, no more patches are streamed,
+  // nothing is written in place or passed to |on_file_result| anymore, and
+  // RunModernizer() returns 1. Patches streamed with |stream_output| before
+  // then stay written. Worker processes finish the translation unit they are
+  // parsing, but are given no other.
+  const std::atomic<bool>* cancelled = nullptr;
   llvm::raw_ostream* out_stream = nullptr;
 };
 
+// Returned by RunModernizer() when the run regressed against the record of
+// |perf_compare_path|.
+inline constexpr int kPerfRegressionResult = 2;
+
 int RunModernizer(const RunModernizerOptions& options);
 
+enum class IndexCommand {
+  // Writes the index of every file of the compile database and the files it
+  // reads according to its depfiles. Files unchanged since the previous index
+  // are not hashed again.
+  kBuild,
+  // Prints statistics, and the translation units reading each of |paths|.
+  kInspect,
+  // Checks the structure of the index and whether any file changed since.
+  kVerify,
+};
+
+struct RunIndexOptions {
+  IndexCommand command = IndexCommand::kInspect;
+  std::filesystem::path compile_commands;
+  std::string index_path;
+  std::vector<std::string> paths;
+  llvm::raw_ostream* out_stream = nullptr;
+};
+
+int RunIndex(const RunIndexOptions& options);
+
 }  // namespace modernizer
 
 #endif  // MODERNIZER_MODERNIZER_H_
@@ -1,4 +1,7 @@
+#include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -6,11 +9,107 @@
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetSelect.h"
 #include "modernizer/modernizer.h"
+#include "modernizer/server.h"
 
 ABSL_FLAG(std::string, project_root, "", "Path of project root");
 ABSL_FLAG(std::string, compile_commands, "", "Path of compile_commands.json");
 ABSL_FLAG(std::string, source_pattern, "", "Source file pattern");
 ABSL_FLAG(bool, in_place, false, "Inplace edit <file>s, if specified.");
+ABSL_FLAG(bool,
+          skip_unchanged,
+          false,
+          "With --in_place, do not rewrite files whose contents are unchanged");
+ABSL_FLAG(bool,
+          stream_output,
+          false,
+          "Write the patch of each file as soon as it is ready, in completion "
+          "order, using the depfiles of the build");
+ABSL_FLAG(bool,
+          worker_processes,
+          false,
+          "Parse in worker processes, so that a crash only loses one file");
+ABSL_FLAG(int,
+          worker_timeout,
+          0,
+          "With --worker_processes, seconds after which a file is given up "
+          "on; 0 means no limit");
+ABSL_FLAG(std::string,
+          journal,
+          "",
+          "Record parsed files in this journal and resume from it");
+ABSL_FLAG(std::string,
+          changed_since,
+          "",
+          "Only parse files affected by changes since this git revision");
+ABSL_FLAG(std::string,
+          include_index,
+          "",
+          "Path of the include index used by --changed_since and written by "
+          "the index command");
+ABSL_FLAG(bool,
+          parse_define_variants,
+          false,
+          "Parse every compile command of a file with different -D or -U "
+          "arguments, instead of the first one");
+ABSL_FLAG(bool,
+          verbose,
+          false,
+          "Log the line and column of every candidate instead of its file "
+          "offset, which builds the line table of its file");
+ABSL_FLAG(bool,
+          traverse_all_declarations,
+          false,
+          "Also match in declarations of files outside the project root and "
+          "the source pattern");
+ABSL_FLAG(bool,
+          lexer_fast_path,
+          false,
+          "Rewrite regular classes from their tokens, and only parse the "
+          "files that read other uses of the macro, as told by the depfiles. "
+          "The depfiles must come from a build with the current compile "
+          "commands, or the edits of files they miss are lost");
+ABSL_FLAG(bool,
+          check_lexer_fast_path,
+          false,
+          "Run the lexer fast path, parse every file anyway and fail if the "
+          "results differ. The hit rate and the parse time saved are printed "
+          "and added to --perf_record");
+ABSL_FLAG(int,
+          prefetch,
+          0,
+          "Read ahead the files of the next N files to parse, as told by the "
+          "include index or the depfiles; 0 disables it");
+ABSL_FLAG(std::string,
+          header_cost_report,
+          "",
+          "Time the headers of every parsed file and write the cost of each "
+          "header and include chain to this JSON file");
+ABSL_FLAG(std::string,
+          perf_record,
+          "",
+          "Write the phase, parse and memory measurements of the run and its "
+          "result counts to this JSON file. With --server, memory and CPU "
+          "time are those of the server process, whose peak memory spans "
+          "every run since it started");
+ABSL_FLAG(std::string,
+          perf_compare,
+          "",
+          "Compare the measurements of the run with this file written by "
+          "--perf_record, and exit with 2 if any regressed in a run that "
+          "otherwise succeeded");
+ABSL_FLAG(int,
+          perf_threshold,
+          10,
+          "With --perf_compare, the growth of a time or memory measurement, "
+          "in percent, that counts as a regression");
+ABSL_FLAG(std::string,
+          serve,
+          "",
+          "Keep caches between runs and serve them on this Unix socket");
+ABSL_FLAG(std::string,
+          server,
+          "",
+          "Send the run to the server listening on this Unix socket");
 ABSL_FLAG(int,
           jobs,
           std::thread::hardware_concurrency(),
@@ -22,8 +121,41 @@ int main(int argc, char* argv[]) {
   llvm::InitializeNativeTargetAsmParser();
   absl::SetProgramUsageMessage(
       "Usage: ./modernizer --project_root=/path/to/project "
-      "--compile_commands=/path/to/project/out/compile_commands.json");
-  absl::ParseCommandLine(argc, argv);
+      "--compile_commands=/path/to/project/out/compile_commands.json\n"
+      "       ./modernizer index build|inspect|verify "
+      "--compile_commands=... --include_index=... [paths...]");
+  std::vector<char*> arguments = absl::ParseCommandLine(argc, argv);
+
+  if (arguments.size() >= 2 && std::string_view(arguments[1]) == "index") {
+    std::string_view command = arguments.size() >= 3 ? arguments[2] : "";
+    modernizer::RunIndexOptions index_options{
+        .command = modernizer::IndexCommand::kInspect,
+        .compile_commands = absl::GetFlag(FLAGS_compile_commands),
+        .index_path = absl::GetFlag(FLAGS_include_index),
+        .paths = {},
+        .out_stream = &llvm::outs()};
+    if (command == "build") {
+      index_options.command = modernizer::IndexCommand::kBuild;
+    } else if (command == "verify") {
+      index_options.command = modernizer::IndexCommand::kVerify;
+    } else if (command != "inspect") {
+      llvm::errs() << "Unknown index command: " << command << "\n";
+      return 1;
+    }
+    if (index_options.index_path.empty()) {
+      llvm::errs() << "--include_index is not set\n";
+      return 1;
+    }
+    for (size_t i = 3; i < arguments.size(); ++i) {
+      index_options.paths.push_back(arguments[i]);
+    }
+    return modernizer::RunIndex(index_options);
+  }
+
+  if (std::string socket_path = absl::GetFlag(FLAGS_serve);
+      !socket_path.empty()) {
+    return modernizer::RunServer(socket_path);
+  }
 
   modernizer::RunModernizerOptions modernizer_options{
       .project_root = absl::GetFlag(FLAGS_project_root),
@@ -31,8 +163,32 @@ int main(int argc, char* argv[]) {
       .source_file_pattern = absl::GetFlag(FLAGS_source_pattern),
       .num_jobs = absl::GetFlag(FLAGS_jobs),
       .in_place = absl::GetFlag(FLAGS_in_place),
+      .skip_unchanged_files = absl::GetFlag(FLAGS_skip_unchanged),
+      .stream_output = absl::GetFlag(FLAGS_stream_output),
+      .worker_processes = absl::GetFlag(FLAGS_worker_processes),
+      .worker_timeout =
+          std::chrono::seconds(absl::GetFlag(FLAGS_worker_timeout)),
+      .journal_path = absl::GetFlag(FLAGS_journal),
+      .changed_since = absl::GetFlag(FLAGS_changed_since),
+      .include_index_path = absl::GetFlag(FLAGS_include_index),
+      .parse_define_variants = absl::GetFlag(FLAGS_parse_define_variants),
+      .verbose = absl::GetFlag(FLAGS_verbose),
+      .traverse_all_declarations =
+          absl::GetFlag(FLAGS_traverse_all_declarations),
+      .lexer_fast_path = absl::GetFlag(FLAGS_lexer_fast_path),
+      .check_lexer_fast_path = absl::GetFlag(FLAGS_check_lexer_fast_path),
+      .prefetch_translation_units = absl::GetFlag(FLAGS_prefetch),
+      .header_cost_report_path = absl::GetFlag(FLAGS_header_cost_report),
+      .perf_record_path = absl::GetFlag(FLAGS_perf_record),
+      .perf_compare_path = absl::GetFlag(FLAGS_perf_compare),
+      .perf_threshold_percent = absl::GetFlag(FLAGS_perf_threshold),
       .out_stream =
           (absl::GetFlag(FLAGS_in_place) ? &llvm::nulls() : &llvm::outs())};
+  if (std::string socket_path = absl::GetFlag(FLAGS_server);
+      !socket_path.empty()) {
+    return modernizer::RunClient(socket_path, modernizer_options,
+                                 llvm::outs());
+  }
   int run_result = modernizer::RunModernizer(modernizer_options);
   return run_result;
 }
@@ -0,0 +1,238 @@
+#include "modernizer/modernizer.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/compilation_database.h"
+
+namespace {
+
+using clang::tooling::CompileCommand;
+using modernizer::FileResult;
+using modernizer::RunModernizerOptions;
+
+constexpr char kConstructorMagic[] =
+    "#define RTC_DISALLOW_COPY_AND_ASSIGN(TypeName) \\\n"
+    "  TypeName(const TypeName&) = delete;          \\\n"
+    "  TypeName& operator=(const TypeName&) = delete\n";
+
+constexpr char kOsInfo[] =
+    "#ifndef OSINFO_H_\n"
+    "#define OSINFO_H_\n"
+    "\n"
+    "#include \"rtc_base/constructor_magic.h\"\n"
+    "\n"
+    "class OSInfo {\n"
+    " public:\n"
+    "  static OSInfo* GetInstance();\n"
+    "\n"
+    " private:\n"
+    "  OSInfo();\n"
+    "  ~OSInfo();\n"
+    "\n"
+    "  RTC_DISALLOW_COPY_AND_ASSIGN(OSInfo);\n"
+    "};\n"
+    "\n"
+    "#endif  // OSINFO_H_\n";
+
+constexpr char kOsInfoExpected[] =
+    "#ifndef OSINFO_H_\n"
+    "#define OSINFO_H_\n"
+    "\n"
+    "class OSInfo {\n"
+    " public:\n"
+    "  static OSInfo* GetInstance();\n"
+    "\n"
+    " private:\n"
+    "  OSInfo();\n"
+    "  ~OSInfo();\n"
+    "\n"
+    "  OSInfo(const OSInfo&) = delete;\n"
+    "  OSInfo& operator=(const OSInfo&) = delete;\n"
+    "};\n"
+    "\n"
+    "#endif  // OSINFO_H_\n";
+
+// Runs the whole tool, so the project root is a real directory: it must
+// exist on disk even when the files are read from another file system.
+class RunModernizerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    llvm::SmallString<128> directory;
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("modernizer", directory));
+    ASSERT_FALSE(llvm::sys::fs::real_path(directory, root_));
+    ASSERT_FALSE(llvm::sys::fs::create_directories(GetPath("out")));
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(root_); }
+
+  std::string GetPath(const std::string& name) const {
+    llvm::SmallString<128> path(root_);
+    llvm::sys::path::append(path, name);
+    return std::string(path);
+  }
+
+  void WriteFile(const std::string& name, const std::string& contents) {
+    llvm::SmallString<128> path(GetPath(name));
+    llvm::sys::path::remove_filename(path);
+    ASSERT_FALSE(llvm::sys::fs::create_directories(path));
+    std::error_code error;
+    llvm::raw_fd_ostream stream(GetPath(name), error);
+    ASSERT_FALSE(error);
+    stream << contents;
+  }
+
+  // The compile command of |source_name|, which writes its depfile to
+  // out/|depfile_name| if set.
+  std::vector<std::string> GetCommandLine(
+      const std::string& source_name,
+      const std::vector<std::string>& flags,
+      const std::string& depfile_name = "") const {
+    std::vector<std::string> command_line = {"clang++", "-std=c++17",
+                                             "-I" + std::string(root_)};
+    command_line.insert(command_line.end(), flags.begin(), flags.end());
+    if (!depfile_name.empty()) {
+      command_line.insert(command_line.end(),
+                          {"-MD", "-MF", GetPath("out/" + depfile_name)});
+    }
+    command_line.insert(command_line.end(), {"-c", GetPath(source_name)});
+    return command_line;
+  }
+
+  RunModernizerOptions GetOptions() {
+    return RunModernizerOptions{
+        .project_root = std::string(root_),
+        .num_jobs = 1,
+        .on_file_result = [this](const FileResult& result) {
+          results_.push_back(result);
+        }};
+  }
+
+  llvm::SmallString<128> root_;
+  std::vector<FileResult> results_;
+};
+
+TEST_F(RunModernizerTest, RewritesFilesOfInMemoryFileSystem) {
+  auto file_system = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  auto add_file = [&](const std::string& name, const std::string& contents) {
+    file_system->addFile(GetPath(name), 0,
+                         llvm::MemoryBuffer::getMemBufferCopy(contents));
+  };
+  add_file(".clang-format", "BasedOnStyle: Chromium\n");
+  add_file("rtc_base/constructor_magic.h", kConstructorMagic);
+  add_file("osinfo.h", kOsInfo);
+  add_file("osinfo.cc", "#include \"osinfo.h\"\n");
+
+  RunModernizerOptions options = GetOptions();
+  options.compile_command_list = {
+      CompileCommand(GetPath("out"), GetPath("osinfo.cc"),
+                     GetCommandLine("osinfo.cc", {}), "osinfo.o")};
+  options.base_file_system = file_system;
+  EXPECT_EQ(modernizer::RunModernizer(options), 0);
+
+  ASSERT_EQ(results_.size(), 1u);
+  const FileResult& result = results_[0];
+  EXPECT_EQ(result.file_path, "../osinfo.h");
+  EXPECT_EQ(result.real_path, GetPath("osinfo.h"));
+  EXPECT_EQ(result.new_contents, kOsInfoExpected);
+  llvm::Expected<std::string> applied =
+      clang::tooling::applyAllReplacements(kOsInfo, result.replacements);
+  ASSERT_TRUE(static_cast<bool>(applied))
+      << llvm::toString(applied.takeError());
+  EXPECT_EQ(*applied, result.new_contents);
+  EXPECT_EQ(result.diff.find("--- a/osinfo.h\n+++ b/osinfo.h\n"), 0u);
+  EXPECT_NE(result.diff.find("\n-  RTC_DISALLOW_COPY_AND_ASSIGN(OSInfo);\n"),
+            std::string::npos);
+  EXPECT_NE(result.diff.find("\n+  OSInfo(const OSInfo&) = delete;\n"),
+            std::string::npos);
+  // Nothing was written to disk.
+  EXPECT_FALSE(llvm::sys::fs::exists(GetPath("osinfo.h")));
+}
+
+TEST_F(RunModernizerTest, PassesFileAgainAfterStaleDepfile) {
+  WriteFile(".clang-format", "BasedOnStyle: Chromium\n");
+  WriteFile("rtc_base/constructor_magic.h", kConstructorMagic);
+  WriteFile("classes.h",
+            "#include \"rtc_base/constructor_magic.h\"\n"
+            "\n"
+            "class Foo {\n"
+            " public:\n"
+            "  Foo();\n"
+            "\n"
+            " private:\n"
+            "  int foo_ = 0;\n"
+            "  RTC_DISALLOW_COPY_AND_ASSIGN(Foo);\n"
+            "};\n"
+            "\n"
+            "#ifdef WITH_BAR\n"
+            "class Bar {\n"
+            " public:\n"
+            "  Bar();\n"
+            "\n"
+            " private:\n"
+            "  int bar_ = 0;\n"
+            "  RTC_DISALLOW_COPY_AND_ASSIGN(Bar);\n"
+            "};\n"
+            "#endif\n");
+  WriteFile("a.cc", "#include \"classes.h\"\n");
+  WriteFile("b.cc", "#include \"classes.h\"\n");
+  // Written after the sources, so that both look fresh. The depfile of b.cc
+  // misses the header, as if it had been written before the include was
+  // added.
+  WriteFile("out/a.d",
+            "a.o: ../a.cc ../classes.h ../rtc_base/constructor_magic.h\n");
+  WriteFile("out/b.d", "b.o: ../b.cc\n");
+
+  modernizer::StoredCompilationDatabase compilation_database;
+  compilation_database.Add(GetPath("a.cc"), GetPath("out"),
+                           GetCommandLine("a.cc", {}, "a.d"), "a.o");
+  compilation_database.Add(GetPath("b.cc"), GetPath("out"),
+                           GetCommandLine("b.cc", {"-DWITH_BAR"}, "b.d"),
+                           "b.o");
+  RunModernizerOptions options = GetOptions();
+  options.compilation_database = &compilation_database;
+  EXPECT_EQ(modernizer::RunModernizer(options), 0);
+
+  // With a single thread, the header is formatted as soon as a.cc completes,
+  // before b.cc is parsed, and again at the end of the run.
+  ASSERT_EQ(results_.size(), 2u);
+  EXPECT_EQ(results_[0].file_path, "../classes.h");
+  EXPECT_NE(results_[0].new_contents.find("  Foo(const Foo&) = delete;\n"),
+            std::string::npos);
+  EXPECT_NE(
+      results_[0].new_contents.find("  RTC_DISALLOW_COPY_AND_ASSIGN(Bar);\n"),
+      std::string::npos);
+  EXPECT_EQ(results_[1].file_path, "../classes.h");
+  EXPECT_NE(results_[1].new_contents.find("  Foo(const Foo&) = delete;\n"),
+            std::string::npos);
+  EXPECT_NE(results_[1].new_contents.find("  Bar(const Bar&) = delete;\n"),
+            std::string::npos);
+  EXPECT_EQ(results_[1].new_contents.find("RTC_DISALLOW_COPY_AND_ASSIGN("),
+            std::string::npos);
+}
+
+TEST_F(RunModernizerTest, CancelledRunReturnsError) {
+  WriteFile("rtc_base/constructor_magic.h", kConstructorMagic);
+  WriteFile("osinfo.h", kOsInfo);
+  WriteFile("osinfo.cc", "#include \"osinfo.h\"\n");
+
+  std::atomic<bool> cancelled = true;
+  RunModernizerOptions options = GetOptions();
+  options.compile_command_list = {
+      CompileCommand(GetPath("out"), GetPath("osinfo.cc"),
+                     GetCommandLine("osinfo.cc", {}), "osinfo.o")};
+  options.cancelled = &cancelled;
+  EXPECT_EQ(modernizer::RunModernizer(options), 1);
+  EXPECT_TRUE(results_.empty());
+}
+
+}  // namespace
@@ -1,15 +1,46 @@
 #include "modernizer/path_pattern.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
 #include "absl/strings/str_split.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace modernizer {
 
-PathPattern::PathPattern(std::vector<PatternElement>&& patterns)
-    : patterns_(std::move(patterns)) {}
+namespace {
+
+constexpr std::string_view kRegexSyntax = "\\.+*?()|[]{}^$";
+
+constexpr int64_t kRegexSetMaxMemory = 64 << 20;
+
+const char* GetErrorName(re2::RE2::Set::ErrorKind kind) {
+  switch (kind) {
+    case re2::RE2::Set::kNoError:
+      return "no error";
+    case re2::RE2::Set::kNotCompiled:
+      return "not compiled";
+    case re2::RE2::Set::kOutOfMemory:
+      return "out of memory";
+    case re2::RE2::Set::kInconsistent:
+      return "inconsistent result";
+  }
+  return "unknown error";
+}
+
+}  // namespace
 
 std::optional<PathPattern> PathPattern::Create(std::string_view path_patterns) {
-  std::vector<PatternElement> compiled_patterns;
+  PathPattern result;
+  result.prefix_trie_.emplace_back();
+  // The set runs as a single DFA, whose states for long pattern lists do not
+  // fit in the default memory budget.
+  re2::RE2::Options options;
+  options.set_max_mem(kRegexSetMaxMemory);
+  auto regex_set =
+      std::make_unique<re2::RE2::Set>(options, re2::RE2::ANCHOR_BOTH);
   auto split = absl::StrSplit(path_patterns, ":", absl::SkipEmpty());
   for (auto iter = split.begin(); !iter.at_end(); ++iter) {
     const char* str_begin = iter->begin();
@@ -31,51 +62,156 @@ std::optional<PathPattern> PathPattern::Create(std::string_view path_patterns) {
       remainder = std::string_view(str_begin, str_end - str_begin);
     }
 
+    int pattern_index = result.negate_.size();
+    result.negate_.push_back(negate);
+    if (absolute_path &&
+        remainder.find_first_of(kRegexSyntax) == std::string_view::npos) {
+      result.AddPrefix(remainder, pattern_index);
+      continue;
+    }
+
     std::string pattern_string;
     llvm::raw_string_ostream pattern_string_stream(pattern_string);
-    pattern_string_stream << "^";
     if (absolute_path) {
       pattern_string_stream << "/";
     } else {
       pattern_string_stream << ".*";
     }
-
-    if (!remainder.empty()) {
-      pattern_string_stream << remainder << ".*";
-    } else if (absolute_path) {
-      pattern_string_stream << ".*";
-    }
-    pattern_string_stream << "$";
+    pattern_string_stream << remainder << ".*";
     pattern_string_stream.flush();
 
-    std::unique_ptr<re2::RE2> pattern =
-        std::make_unique<re2::RE2>(pattern_string);
-    if (!pattern->ok()) {
-      llvm::errs() << "Bad regex pattern: " << pattern_string << "\n";
+    std::string error;
+    if (regex_set->Add(pattern_string, &error) < 0) {
+      llvm::errs() << "Bad regex pattern: " << pattern_string << ": " << error
+                   << "\n";
+      return std::nullopt;
+    }
+    result.regex_pattern_indices_.push_back(pattern_index);
+    result.regexes_.push_back(std::make_unique<re2::RE2>(pattern_string));
+    if (!result.regexes_.back()->ok()) {
+      llvm::errs() << "Bad regex pattern: " << pattern_string << ": "
+                   << result.regexes_.back()->error() << "\n";
       return std::nullopt;
     }
-    compiled_patterns.push_back(
-        PatternElement{.regex = std::move(pattern), .negate = negate});
   }
-  if (compiled_patterns.empty()) {
+  if (result.negate_.empty()) {
     llvm::errs() << "No patterns given\n";
     return std::nullopt;
   }
-  return PathPattern(std::move(compiled_patterns));
+  if (!result.regex_pattern_indices_.empty()) {
+    if (!regex_set->Compile()) {
+      llvm::errs() << "Failed to compile path patterns\n";
+      return std::nullopt;
+    }
+    result.regex_set_ = std::move(regex_set);
+  }
+  return result;
 }
 
-bool PathPattern::Match(std::string_view path) const {
-  bool result = false;
-  std::string converted_path;
-  llvm::raw_string_ostream converted_path_stream(converted_path);
-  converted_path_stream << "/";
-  converted_path_stream << path;
-  converted_path_stream.flush();
+uint32_t PathPattern::FindChild(uint32_t node, char c) const {
+  for (const auto& [child_char, child] : prefix_trie_[node].children) {
+    if (child_char == c) {
+      return child;
+    }
+  }
+  return 0;
+}
 
-  for (const auto& pattern : patterns_) {
-    if (re2::RE2::FullMatch(converted_path, *pattern.regex)) {
-      result = !pattern.negate;
+void PathPattern::AddPrefix(std::string_view prefix, int pattern_index) {
+  uint32_t node = 0;
+  for (char c : prefix) {
+    uint32_t child = FindChild(node, c);
+    if (!child) {
+      child = prefix_trie_.size();
+      prefix_trie_[node].children.emplace_back(c, child);
+      prefix_trie_.emplace_back();
     }
+    node = child;
+  }
+  prefix_trie_[node].pattern_index = pattern_index;
+}
+
+int PathPattern::FindLastMatch(std::string_view path_with_slash,
+                               std::vector<int>* set_matches) const {
+  uint32_t node = 0;
+  int result = prefix_trie_[node].pattern_index;
+  for (char c : path_with_slash.substr(1)) {
+    node = FindChild(node, c);
+    if (!node) {
+      break;
+    }
+    result = std::max(result, prefix_trie_[node].pattern_index);
+  }
+
+  // The regex set only needs to run if a later pattern may override the
+  // prefix that matched.
+  if (regex_set_ && regex_pattern_indices_.back() > result) {
+    if (!set_matches) {
+      return FindLastRegexMatch(path_with_slash, result);
+    }
+    set_matches->clear();
+    re2::RE2::Set::ErrorInfo error_info = {.kind = re2::RE2::Set::kNoError};
+    if (regex_set_->Match(re2::StringPiece(path_with_slash.data(),
+                                           path_with_slash.size()),
+                          set_matches, &error_info)) {
+      for (int set_index : *set_matches) {
+        result = std::max(result, regex_pattern_indices_[set_index]);
+      }
+    } else if (error_info.kind != re2::RE2::Set::kNoError) {
+      // Logged once, as the DFA usually fails again for the next paths.
+      static std::atomic<bool> logged = false;
+      if (!logged.exchange(true)) {
+        llvm::errs() << "Path pattern set failed ("
+                     << GetErrorName(error_info.kind)
+                     << "); matching the patterns one at a time\n";
+      }
+      result = FindLastRegexMatch(path_with_slash, result);
+    }
+  }
+  return result;
+}
+
+int PathPattern::FindLastRegexMatch(std::string_view path_with_slash,
+                                    int min_pattern_index) const {
+  re2::StringPiece text(path_with_slash.data(), path_with_slash.size());
+  for (size_t i = regexes_.size(); i-- > 0;) {
+    if (regex_pattern_indices_[i] <= min_pattern_index) {
+      break;
+    }
+    if (re2::RE2::FullMatch(text, *regexes_[i])) {
+      return regex_pattern_indices_[i];
+    }
+  }
+  return min_pattern_index;
+}
+
+bool PathPattern::Match(std::string_view path) const {
+  llvm::SmallString<256> path_with_slash("/");
+  path_with_slash += llvm::StringRef(path.data(), path.size());
+  std::vector<int> set_matches;
+  int pattern_index = FindLastMatch(path_with_slash.str(), &set_matches);
+  return pattern_index >= 0 && !negate_[pattern_index];
+}
+
+bool PathPattern::MatchEachRegex(std::string_view path) const {
+  llvm::SmallString<256> path_with_slash("/");
+  path_with_slash += llvm::StringRef(path.data(), path.size());
+  int pattern_index =
+      FindLastMatch(path_with_slash.str(), /*set_matches=*/nullptr);
+  return pattern_index >= 0 && !negate_[pattern_index];
+}
+
+std::vector<bool> PathPattern::MatchAll(
+    llvm::ArrayRef<std::string_view> paths) const {
+  std::vector<bool> result;
+  result.reserve(paths.size());
+  llvm::SmallString<256> path_with_slash;
+  std::vector<int> set_matches;
+  for (std::string_view path : paths) {
+    path_with_slash = "/";
+    path_with_slash += llvm::StringRef(path.data(), path.size());
+    int pattern_index = FindLastMatch(path_with_slash.str(), &set_matches);
+    result.push_back(pattern_index >= 0 && !negate_[pattern_index]);
   }
   return result;
 }
@@ -1,13 +1,22 @@
 #ifndef MODERNIZER_PATH_PATTERN_H_
 #define MODERNIZER_PATH_PATTERN_H_
 
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "llvm/ADT/ArrayRef.h"
 #include "re2/re2.h"
+#include "re2/set.h"
 
 namespace modernizer {
 
+// A colon-separated list of patterns, where the last pattern matching a path
+// decides. A pattern starting with "!" excludes the paths it matches. A
+// pattern starting with "/" matches from the start of the path, and any
+// other pattern matches anywhere. Patterns are regular expressions.
 class PathPattern {
  public:
   ~PathPattern() = default;
@@ -22,15 +31,50 @@ class PathPattern {
 
   bool Match(std::string_view path) const;
 
+  // Same as calling Match() for each of |paths|, without allocating per
+  // path.
+  std::vector<bool> MatchAll(llvm::ArrayRef<std::string_view> paths) const;
+
+  // Same as Match(), but matches the regex patterns one at a time, as when
+  // the regex set fails. Exposed for testing.
+  bool MatchEachRegex(std::string_view path) const;
+
  private:
-  struct PatternElement {
-    std::unique_ptr<re2::RE2> regex;
-    bool negate = false;
+  // Patterns starting with "/" and without regex syntax are plain prefixes,
+  // and are looked up in a trie instead of the regex set.
+  struct PrefixTrieNode {
+    std::vector<std::pair<char, uint32_t>> children;
+    // The last pattern ending at this node, or -1.
+    int pattern_index = -1;
   };
 
-  explicit PathPattern(std::vector<PatternElement>&& patterns);
+  PathPattern() = default;
+
+  // Returns 0, the root, if |node| has no child for |c|.
+  uint32_t FindChild(uint32_t node, char c) const;
+
+  void AddPrefix(std::string_view prefix, int pattern_index);
+
+  // Returns the index of the last pattern matching |path_with_slash|, which
+  // is the path with "/" prepended, or -1. Without |set_matches|, the regex
+  // patterns are matched one at a time.
+  int FindLastMatch(std::string_view path_with_slash,
+                    std::vector<int>* set_matches) const;
+
+  // Returns the index of the last pattern of |regexes_| matching
+  // |path_with_slash| after |min_pattern_index|, or |min_pattern_index|.
+  int FindLastRegexMatch(std::string_view path_with_slash,
+                         int min_pattern_index) const;
 
-  std::vector<PatternElement> patterns_;
+  std::vector<bool> negate_;
+  std::vector<PrefixTrieNode> prefix_trie_;
+  // Every other pattern, matched in a single pass.
+  std::unique_ptr<re2::RE2::Set> regex_set_;
+  // The same patterns one by one, matched when the DFA of |regex_set_| runs
+  // out of memory.
+  std::vector<std::unique_ptr<re2::RE2>> regexes_;
+  // The pattern index of each regex of |regex_set_|.
+  std::vector<int> regex_pattern_indices_;
 };
 
 }  // namespace modernizer
@@ -0,0 +1,152 @@
+// Times compiling and matching a long source pattern, and checks the results
+// against matching every pattern one by one on a sample of the paths.
+//
+// Usage: ./path_pattern_benchmark [patterns] [paths] [checked paths]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/path_pattern.h"
+#include "re2/re2.h"
+
+namespace {
+
+struct ReferencePattern {
+  std::unique_ptr<re2::RE2> regex;
+  bool negate;
+};
+
+// Mixes plain prefixes, negated prefixes, substrings and regexes.
+std::string MakePatterns(int num_patterns,
+                         std::vector<ReferencePattern>* reference_patterns) {
+  std::string patterns;
+  for (int i = 0; i < num_patterns; ++i) {
+    std::string dir = "dir" + std::to_string(i);
+    std::string pattern;
+    std::string regex;
+    switch (i % 4) {
+      case 0:
+        pattern = "/" + dir;
+        regex = "/" + dir + ".*";
+        break;
+      case 1:
+        pattern = "!/" + dir + "/gen";
+        regex = "/" + dir + "/gen.*";
+        break;
+      case 2:
+        pattern = "sub" + std::to_string(i) + "/";
+        regex = ".*sub" + std::to_string(i) + "/.*";
+        break;
+      default:
+        pattern = "!/" + dir + "/.*_unittest\\.cc";
+        regex = "/" + dir + "/.*_unittest\\.cc.*";
+        break;
+    }
+    if (!patterns.empty()) {
+      patterns += ":";
+    }
+    patterns += pattern;
+    reference_patterns->push_back(
+        ReferencePattern{.regex = std::make_unique<re2::RE2>(regex),
+                         .negate = pattern[0] == '!'});
+  }
+  return patterns;
+}
+
+bool ReferenceMatch(const std::vector<ReferencePattern>& reference_patterns,
+                    std::string_view path) {
+  std::string path_with_slash = "/" + std::string(path);
+  bool result = false;
+  for (const ReferencePattern& pattern : reference_patterns) {
+    if (re2::RE2::FullMatch(path_with_slash, *pattern.regex)) {
+      result = !pattern.negate;
+    }
+  }
+  return result;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_patterns = argc >= 2 ? std::atoi(argv[1]) : 1000;
+  int num_paths = argc >= 3 ? std::atoi(argv[2]) : 100000;
+  int num_checked_paths = argc >= 4 ? std::atoi(argv[3]) : 1000;
+  if (num_patterns <= 0 || num_paths <= 0 || num_checked_paths < 0) {
+    llvm::errs() << "Usage: " << argv[0]
+                 << " [patterns] [paths] [checked paths]\n";
+    return 1;
+  }
+
+  std::vector<ReferencePattern> reference_patterns;
+  std::string patterns = MakePatterns(num_patterns, &reference_patterns);
+  std::vector<std::string> path_storage;
+  path_storage.reserve(num_paths);
+  for (int i = 0; i < num_paths; ++i) {
+    int dir = (i * 7) % (num_patterns + num_patterns / 5);
+    path_storage.push_back("dir" + std::to_string(dir) +
+                           (i % 3 ? "/sub" : "/gen/sub") +
+                           std::to_string(i % num_patterns) + "/file" +
+                           std::to_string(i) +
+                           (i % 2 ? ".cc" : "_unittest.cc"));
+  }
+  std::vector<std::string_view> paths(path_storage.begin(),
+                                      path_storage.end());
+
+  auto start = std::chrono::steady_clock::now();
+  std::optional<modernizer::PathPattern> path_pattern =
+      modernizer::PathPattern::Create(patterns);
+  double compile = MillisecondsSince(start);
+  if (!path_pattern) {
+    return 1;
+  }
+
+  // The first pass builds the states of the regex automaton.
+  start = std::chrono::steady_clock::now();
+  std::vector<bool> results = path_pattern->MatchAll(paths);
+  double first_match_all = MillisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  size_t num_matches = 0;
+  for (std::string_view path : paths) {
+    num_matches += path_pattern->Match(path);
+  }
+  double match = MillisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  results = path_pattern->MatchAll(paths);
+  double match_all = MillisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  int num_checked = std::min(num_checked_paths, num_paths);
+  for (int i = 0; i < num_checked; ++i) {
+    if (ReferenceMatch(reference_patterns, paths[i]) != results[i]) {
+      llvm::errs() << "Mismatch for " << paths[i] << "\n";
+      return 1;
+    }
+  }
+  double reference = MillisecondsSince(start);
+
+  llvm::outs() << num_patterns << " patterns, " << num_paths << " paths, "
+               << num_matches << " matches\n"
+               << "compile: " << llvm::format("%.3f", compile) << " ms\n"
+               << "first MatchAll: " << llvm::format("%.3f", first_match_all)
+               << " ms\n"
+               << "Match: " << llvm::format("%.3f", match) << " ms\n"
+               << "MatchAll: " << llvm::format("%.3f", match_all) << " ms\n"
+               << "one regex per pattern, " << num_checked
+               << " paths: " << llvm::format("%.3f", reference) << " ms\n";
+  return 0;
+}
@@ -46,3 +46,46 @@ TEST(PathPatternTest, Negate2) {
   ASSERT_FALSE(
       pattern->Match("sdk/objc/api/peerconnection/RTCPeerConnection.h"));
 }
+
+TEST(PathPatternTest, LastMatchWins) {
+  std::optional<modernizer::PathPattern> pattern =
+      modernizer::PathPattern::Create("/api:!_unittest\\.cc$:/api/test");
+  ASSERT_TRUE(pattern);
+
+  ASSERT_TRUE(pattern->Match("api/array_view.h"));
+  ASSERT_FALSE(pattern->Match("api/array_view_unittest.cc"));
+  ASSERT_TRUE(pattern->Match("api/test/foo_unittest.cc"));
+  ASSERT_FALSE(pattern->Match("call/call.h"));
+}
+
+TEST(PathPatternTest, MatchAll) {
+  std::optional<modernizer::PathPattern> pattern =
+      modernizer::PathPattern::Create("/:!/third_party:libyuv/.*\\.h");
+  ASSERT_TRUE(pattern);
+
+  std::vector<std::string_view> paths = {
+      "api/array_view.h", "third_party/libyuv/include/libyuv.h",
+      "third_party/abseil-cpp/absl/base/macros.h"};
+  EXPECT_EQ(pattern->MatchAll(paths), std::vector<bool>({true, true, false}));
+}
+
+TEST(PathPatternTest, MatchEachRegexAgreesWithSet) {
+  std::optional<modernizer::PathPattern> pattern =
+      modernizer::PathPattern::Create(
+          "/:!/third_party:libyuv/.*\\.h:!_unittest\\.cc$:"
+          "/third_party/.*/test/");
+  ASSERT_TRUE(pattern);
+
+  for (const char* path :
+       {"api/array_view.h", "api/array_view_unittest.cc",
+        "third_party/libyuv/include/libyuv.h",
+        "third_party/libyuv/unit_unittest.cc",
+        "third_party/abseil-cpp/absl/test/foo_unittest.cc",
+        "third_party/abseil-cpp/absl/base/macros.h"}) {
+    EXPECT_EQ(pattern->MatchEachRegex(path), pattern->Match(path)) << path;
+  }
+  EXPECT_TRUE(pattern->MatchEachRegex("third_party/libyuv/include/libyuv.h"));
+  EXPECT_FALSE(pattern->MatchEachRegex("third_party/libyuv/unit_unittest.cc"));
+  EXPECT_TRUE(pattern->MatchEachRegex(
+      "third_party/abseil-cpp/absl/test/foo_unittest.cc"));
+}
@@ -0,0 +1,423 @@
+#include "modernizer/perf_record.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace modernizer {
+
+namespace {
+
+// Changes smaller than these are noise, whatever the threshold.
+constexpr double kMinRegressedMilliseconds = 10;
+constexpr double kMinRegressedKilobytes = 1024;
+// The translation units listed by PrintPerfComparison().
+constexpr size_t kMaxPrintedTranslationUnits = 10;
+// The counts of the results of a run, which are the same for the same input
+// whatever the caches and options measured. Other counts, like candidates or
+// files read, legitimately change with the translation unit cache or the
+// lexer fast path.
+constexpr llvm::StringLiteral kResultCounts[] = {"replacements",
+                                                 "files_with_replacements"};
+
+int64_t ToMicroseconds(const timeval& time) {
+  return static_cast<int64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+}
+
+// Returns the user and system time of the process and of its waited-for
+// children.
+int64_t GetProcessCpuMicroseconds() {
+  int64_t microseconds = 0;
+  for (int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+    rusage usage;
+    if (getrusage(who, &usage) == 0) {
+      microseconds += ToMicroseconds(usage.ru_utime);
+      microseconds += ToMicroseconds(usage.ru_stime);
+    }
+  }
+  return microseconds;
+}
+
+// Returns the peak resident set size of |who|, in kilobytes.
+int64_t GetPeakRssKilobytes(int who) {
+  rusage usage;
+  return getrusage(who, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+double ToMilliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+const char* GetKindName(PerfMetricKind kind) {
+  switch (kind) {
+    case PerfMetricKind::kMilliseconds:
+      return "ms";
+    case PerfMetricKind::kKilobytes:
+      return "kb";
+    case PerfMetricKind::kCount:
+      return "count";
+  }
+  return "count";
+}
+
+std::optional<PerfMetricKind> ParseKind(llvm::StringRef name) {
+  for (PerfMetricKind kind :
+       {PerfMetricKind::kMilliseconds, PerfMetricKind::kKilobytes,
+        PerfMetricKind::kCount}) {
+    if (name == GetKindName(kind)) {
+      return kind;
+    }
+  }
+  return std::nullopt;
+}
+
+llvm::Error MakeError(const std::string& message) {
+  return llvm::make_error<llvm::StringError>(message,
+                                             llvm::inconvertibleErrorCode());
+}
+
+bool IsResultCount(llvm::StringRef name) {
+  return llvm::is_contained(kResultCounts, name);
+}
+
+bool IsRegressed(llvm::StringRef name,
+                 PerfMetricKind kind,
+                 double baseline,
+                 double current,
+                 double threshold_percent) {
+  double delta = current - baseline;
+  switch (kind) {
+    case PerfMetricKind::kMilliseconds:
+      return delta >= kMinRegressedMilliseconds &&
+             delta > baseline * threshold_percent / 100;
+    case PerfMetricKind::kKilobytes:
+      return delta >= kMinRegressedKilobytes &&
+             delta > baseline * threshold_percent / 100;
+    case PerfMetricKind::kCount:
+      return IsResultCount(name) && current != baseline;
+  }
+  return false;
+}
+
+std::string FormatValue(PerfMetricKind kind,
+                        const std::optional<double>& value) {
+  if (!value) {
+    return "-";
+  }
+  std::string text;
+  llvm::raw_string_ostream stream(text);
+  if (kind == PerfMetricKind::kMilliseconds) {
+    stream << llvm::format("%.3f", *value);
+  } else {
+    stream << llvm::format("%.0f", *value);
+  }
+  return stream.str();
+}
+
+std::string FormatChange(const PerfComparison& comparison) {
+  if (!comparison.baseline || !comparison.current) {
+    return comparison.baseline ? "missing" : "new";
+  }
+  double delta = *comparison.current - *comparison.baseline;
+  std::string text;
+  llvm::raw_string_ostream stream(text);
+  if (comparison.kind == PerfMetricKind::kCount) {
+    stream << llvm::format("%+.0f", delta);
+  } else if (*comparison.baseline) {
+    stream << llvm::format("%+.1f%%", 100 * delta / *comparison.baseline);
+  } else {
+    stream << llvm::format("%+.3f", delta);
+  }
+  return stream.str();
+}
+
+}  // namespace
+
+void WritePerfRecordJson(const PerfRecord& record, llvm::raw_ostream& out) {
+  llvm::json::OStream json(out, /*IndentSize=*/2);
+  json.object([&] {
+    json.attributeArray("metrics", [&] {
+      for (const PerfMetric& metric : record.metrics) {
+        json.object([&] {
+          json.attribute("name", metric.name);
+          json.attribute("kind", GetKindName(metric.kind));
+          json.attribute("value", metric.value);
+        });
+      }
+    });
+    json.attributeObject("translation_units", [&] {
+      for (const auto& [path, milliseconds] : record.translation_units) {
+        json.attribute(path, milliseconds);
+      }
+    });
+  });
+  out << "\n";
+}
+
+llvm::Expected<PerfRecord> ParsePerfRecordJson(llvm::StringRef json) {
+  llvm::Expected<llvm::json::Value> value = llvm::json::parse(json);
+  if (!value) {
+    return value.takeError();
+  }
+  const llvm::json::Object* object = value->getAsObject();
+  const llvm::json::Array* metrics =
+      object ? object->getArray("metrics") : nullptr;
+  const llvm::json::Object* translation_units =
+      object ? object->getObject("translation_units") : nullptr;
+  if (!metrics || !translation_units) {
+    return MakeError("Malformed performance record");
+  }
+
+  PerfRecord record;
+  for (const llvm::json::Value& element : *metrics) {
+    const llvm::json::Object* metric = element.getAsObject();
+    if (!metric) {
+      return MakeError("Malformed metric in performance record");
+    }
+    auto name = metric->getString("name");
+    auto kind_name = metric->getString("kind");
+    auto metric_value = metric->getNumber("value");
+    std::optional<PerfMetricKind> kind;
+    if (kind_name) {
+      kind = ParseKind(*kind_name);
+    }
+    if (!name || !kind || !metric_value) {
+      return MakeError("Malformed metric in performance record");
+    }
+    record.metrics.push_back(PerfMetric{
+        .name = name->str(), .kind = *kind, .value = *metric_value});
+  }
+  for (const auto& [path, milliseconds] : *translation_units) {
+    auto number = milliseconds.getAsNumber();
+    if (!number) {
+      return MakeError("Malformed parse time in performance record");
+    }
+    record.translation_units.emplace(path.str(), *number);
+  }
+  return record;
+}
+
+llvm::Error WritePerfRecord(const PerfRecord& record, const std::string& path) {
+  std::error_code error;
+  llvm::raw_fd_ostream stream(path, error);
+  if (error) {
+    return llvm::createStringError(error, "Cannot write %s", path.c_str());
+  }
+  WritePerfRecordJson(record, stream);
+  // A stream destroyed with an unchecked error aborts the process.
+  stream.close();
+  if (stream.has_error()) {
+    error = stream.error();
+    stream.clear_error();
+    return llvm::createStringError(error, "Cannot write %s", path.c_str());
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<PerfRecord> ReadPerfRecord(const std::string& path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    return llvm::createStringError(buffer.getError(), "Cannot read %s",
+                                   path.c_str());
+  }
+  return ParsePerfRecordJson((*buffer)->getBuffer());
+}
+
+PerfRecorder::PerfRecorder()
+    : start_(std::chrono::steady_clock::now()),
+      start_cpu_microseconds_(GetProcessCpuMicroseconds()) {}
+
+void PerfRecorder::StartPhase(std::string name) {
+  EndPhase();
+  phase_ = Phase{.name = std::move(name),
+                 .start = std::chrono::steady_clock::now(),
+                 .start_cpu_microseconds = GetProcessCpuMicroseconds()};
+}
+
+void PerfRecorder::SetCount(std::string name, int64_t count) {
+  metrics_.push_back(PerfMetric{.name = std::move(name),
+                                .kind = PerfMetricKind::kCount,
+                                .value = static_cast<double>(count)});
+}
+
+void PerfRecorder::SetMilliseconds(std::string name, double milliseconds) {
+  metrics_.push_back(PerfMetric{.name = std::move(name),
+                                .kind = PerfMetricKind::kMilliseconds,
+                                .value = milliseconds});
+}
+
+void PerfRecorder::AddTranslationUnit(const std::string& path,
+                                      int64_t parse_microseconds) {
+  absl::MutexLock lock(&mutex_);
+  translation_units_[path] += parse_microseconds / 1000.0;
+}
+
+PerfRecord PerfRecorder::Finish() {
+  EndPhase();
+  PerfRecord record;
+  record.metrics.push_back(PerfMetric{
+      .name = "total.wall_ms",
+      .kind = PerfMetricKind::kMilliseconds,
+      .value = ToMilliseconds(std::chrono::steady_clock::now() - start_)});
+  record.metrics.push_back(PerfMetric{
+      .name = "total.cpu_ms",
+      .kind = PerfMetricKind::kMilliseconds,
+      .value = (GetProcessCpuMicroseconds() - start_cpu_microseconds_) /
+               1000.0});
+  record.metrics.push_back(
+      PerfMetric{.name = "peak_rss_kb",
+                 .kind = PerfMetricKind::kKilobytes,
+                 .value = static_cast<double>(GetPeakRssKilobytes(
+                     RUSAGE_SELF))});
+  if (int64_t children = GetPeakRssKilobytes(RUSAGE_CHILDREN)) {
+    record.metrics.push_back(
+        PerfMetric{.name = "children_peak_rss_kb",
+                   .kind = PerfMetricKind::kKilobytes,
+                   .value = static_cast<double>(children)});
+  }
+  record.metrics.insert(record.metrics.end(), metrics_.begin(),
+                        metrics_.end());
+
+  {
+    absl::MutexLock lock(&mutex_);
+    record.translation_units = translation_units_;
+  }
+  std::vector<double> parse_times;
+  for (const auto& [path, milliseconds] : record.translation_units) {
+    parse_times.push_back(milliseconds);
+  }
+  record.metrics.push_back(
+      PerfMetric{.name = "parse.translation_units",
+                 .kind = PerfMetricKind::kCount,
+                 .value = static_cast<double>(parse_times.size())});
+  if (!parse_times.empty()) {
+    std::sort(parse_times.begin(), parse_times.end());
+    double total = 0;
+    for (double milliseconds : parse_times) {
+      total += milliseconds;
+    }
+    auto add_time = [&](std::string name, double milliseconds) {
+      record.metrics.push_back(
+          PerfMetric{.name = std::move(name),
+                     .kind = PerfMetricKind::kMilliseconds,
+                     .value = milliseconds});
+    };
+    size_t last = parse_times.size() - 1;
+    add_time("parse.total_ms", total);
+    add_time("parse.p50_ms", parse_times[last / 2]);
+    add_time("parse.p90_ms", parse_times[last * 9 / 10]);
+    add_time("parse.max_ms", parse_times[last]);
+  }
+  return record;
+}
+
+void PerfRecorder::EndPhase() {
+  if (!phase_) {
+    return;
+  }
+  metrics_.push_back(PerfMetric{
+      .name = "phase." + phase_->name + ".wall_ms",
+      .kind = PerfMetricKind::kMilliseconds,
+      .value = ToMilliseconds(std::chrono::steady_clock::now() -
+                              phase_->start)});
+  metrics_.push_back(PerfMetric{
+      .name = "phase." + phase_->name + ".cpu_ms",
+      .kind = PerfMetricKind::kMilliseconds,
+      .value = (GetProcessCpuMicroseconds() - phase_->start_cpu_microseconds) /
+               1000.0});
+  phase_.reset();
+}
+
+std::vector<PerfComparison> ComparePerfRecords(const PerfRecord& baseline,
+                                               const PerfRecord& current,
+                                               double threshold_percent) {
+  std::vector<PerfComparison> comparisons;
+  std::unordered_map<std::string, size_t> indices;
+  for (const PerfMetric& metric : current.metrics) {
+    auto [iter, inserted] =
+        indices.try_emplace(metric.name, comparisons.size());
+    if (inserted) {
+      PerfComparison& comparison = comparisons.emplace_back();
+      comparison.name = metric.name;
+      comparison.kind = metric.kind;
+    }
+    comparisons[iter->second].current = metric.value;
+  }
+  for (const PerfMetric& metric : baseline.metrics) {
+    auto [iter, inserted] =
+        indices.try_emplace(metric.name, comparisons.size());
+    if (inserted) {
+      PerfComparison& comparison = comparisons.emplace_back();
+      comparison.name = metric.name;
+      comparison.kind = metric.kind;
+    }
+    comparisons[iter->second].baseline = metric.value;
+  }
+  for (PerfComparison& comparison : comparisons) {
+    comparison.regressed =
+        comparison.baseline && comparison.current &&
+        IsRegressed(comparison.name, comparison.kind, *comparison.baseline,
+                    *comparison.current, threshold_percent);
+  }
+  return comparisons;
+}
+
+size_t PrintPerfComparison(const PerfRecord& baseline,
+                           const PerfRecord& current,
+                           double threshold_percent,
+                           llvm::raw_ostream& out) {
+  std::vector<PerfComparison> comparisons =
+      ComparePerfRecords(baseline, current, threshold_percent);
+  size_t regressed = 0;
+  const char* columns[] = {"metric", "baseline", "current", "change"};
+  out << llvm::format("%-32s %14s %14s %10s\n", columns[0], columns[1],
+                      columns[2], columns[3]);
+  for (const PerfComparison& comparison : comparisons) {
+    out << llvm::format(
+        "%-32s %14s %14s %10s", comparison.name.c_str(),
+        FormatValue(comparison.kind, comparison.baseline).c_str(),
+        FormatValue(comparison.kind, comparison.current).c_str(),
+        FormatChange(comparison).c_str());
+    if (comparison.regressed) {
+      out << "  regressed";
+      ++regressed;
+    } else if (comparison.kind == PerfMetricKind::kCount &&
+               comparison.baseline && comparison.current &&
+               *comparison.baseline != *comparison.current) {
+      out << "  changed";
+    }
+    out << "\n";
+  }
+
+  std::vector<std::pair<double, std::string>> slowdowns;
+  for (const auto& [path, milliseconds] : current.translation_units) {
+    auto iter = baseline.translation_units.find(path);
+    if (iter != baseline.translation_units.end() &&
+        milliseconds > iter->second) {
+      slowdowns.emplace_back(milliseconds - iter->second, path);
+    }
+  }
+  size_t num_printed = std::min(kMaxPrintedTranslationUnits, slowdowns.size());
+  std::partial_sort(slowdowns.begin(), slowdowns.begin() + num_printed,
+                    slowdowns.end(), std::greater<>());
+  if (num_printed) {
+    out << "Largest parse time increases:\n";
+  }
+  for (size_t i = 0; i < num_printed; ++i) {
+    const auto& [delta, path] = slowdowns[i];
+    out << llvm::format("%+14.3f ms  ", delta) << path << "\n";
+  }
+  out << regressed << " of " << comparisons.size()
+      << " metrics regressed beyond "
+      << llvm::format("%.1f", threshold_percent) << "%\n";
+  return regressed;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,115 @@
+#ifndef MODERNIZER_PERF_RECORD_H_
+#define MODERNIZER_PERF_RECORD_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace modernizer {
+
+enum class PerfMetricKind {
+  kMilliseconds,
+  kKilobytes,
+  kCount,
+};
+
+struct PerfMetric {
+  std::string name;
+  PerfMetricKind kind = PerfMetricKind::kCount;
+  double value = 0;
+};
+
+// The measurements of one run, kept to compare runs across changes of the
+// modernizer or of the pinned LLVM revision.
+struct PerfRecord {
+  std::vector<PerfMetric> metrics;
+  // The parse time of each translation unit, in milliseconds.
+  std::map<std::string, double> translation_units;
+};
+
+void WritePerfRecordJson(const PerfRecord& record, llvm::raw_ostream& out);
+llvm::Expected<PerfRecord> ParsePerfRecordJson(llvm::StringRef json);
+
+llvm::Error WritePerfRecord(const PerfRecord& record, const std::string& path);
+llvm::Expected<PerfRecord> ReadPerfRecord(const std::string& path);
+
+// Records the wall and CPU time of the phases of a run, from its
+// construction, the parse time of each translation unit and any counts.
+// The CPU time of the process includes that of its children which have been
+// waited for, like worker processes.
+class PerfRecorder {
+ public:
+  PerfRecorder();
+  ~PerfRecorder() = default;
+
+  PerfRecorder(const PerfRecorder&) = delete;
+  PerfRecorder& operator=(const PerfRecorder&) = delete;
+
+  // Ends the current phase, if any, and starts |name|.
+  void StartPhase(std::string name);
+  void SetCount(std::string name, int64_t count);
+  // Records a time measured by the caller, like the sum of a step over
+  // every thread.
+  void SetMilliseconds(std::string name, double milliseconds);
+  // Thread-safe.
+  void AddTranslationUnit(const std::string& path, int64_t parse_microseconds);
+
+  // Ends the current phase and returns everything recorded, with the totals
+  // of the run, the peak resident set size and a summary of the parse times.
+  PerfRecord Finish();
+
+ private:
+  struct Phase {
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    int64_t start_cpu_microseconds = 0;
+  };
+
+  void EndPhase();
+
+  const std::chrono::steady_clock::time_point start_;
+  const int64_t start_cpu_microseconds_;
+  std::optional<Phase> phase_;
+  std::vector<PerfMetric> metrics_;
+  absl::Mutex mutex_;
+  std::map<std::string, double> translation_units_ GUARDED_BY(mutex_);
+};
+
+struct PerfComparison {
+  std::string name;
+  PerfMetricKind kind = PerfMetricKind::kCount;
+  // Unset if the metric is missing from one of the records.
+  std::optional<double> baseline;
+  std::optional<double> current;
+  bool regressed = false;
+};
+
+// Compares every metric of |current| with |baseline|. Times and memory
+// regress when they grow by more than |threshold_percent|, ignoring changes
+// too small to tell from noise. The counts of replacements and of files with
+// replacements regress when they change at all, since the same input should
+// always give the same results; other counts depend on caches and options,
+// so their changes are only printed.
+std::vector<PerfComparison> ComparePerfRecords(const PerfRecord& baseline,
+                                               const PerfRecord& current,
+                                               double threshold_percent);
+
+// Prints the comparison of every metric and the translation units whose
+// parse time grew the most. Returns the number of regressed metrics.
+size_t PrintPerfComparison(const PerfRecord& baseline,
+                           const PerfRecord& current,
+                           double threshold_percent,
+                           llvm::raw_ostream& out);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_PERF_RECORD_H_
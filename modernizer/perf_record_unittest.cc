@@ -0,0 +1,174 @@
+#include "modernizer/perf_record.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using modernizer::PerfComparison;
+using modernizer::PerfMetric;
+using modernizer::PerfMetricKind;
+using modernizer::PerfRecord;
+
+const PerfComparison* Find(const std::vector<PerfComparison>& comparisons,
+                           const std::string& name) {
+  for (const PerfComparison& comparison : comparisons) {
+    if (comparison.name == name) {
+      return &comparison;
+    }
+  }
+  return nullptr;
+}
+
+TEST(PerfRecordTest, RecordsPhasesAndTranslationUnits) {
+  modernizer::PerfRecorder recorder;
+  recorder.StartPhase("load");
+  recorder.StartPhase("parse");
+  recorder.AddTranslationUnit("a.cc", 3000);
+  recorder.AddTranslationUnit("b.cc", 1000);
+  recorder.AddTranslationUnit("a.cc", 1000);
+  recorder.SetCount("candidates", 5);
+  recorder.SetMilliseconds("parse.matching_ms", 2.5);
+  PerfRecord record = recorder.Finish();
+
+  std::vector<std::string> names;
+  for (const PerfMetric& metric : record.metrics) {
+    names.push_back(metric.name);
+  }
+  for (const char* name :
+       {"total.wall_ms", "total.cpu_ms", "peak_rss_kb", "phase.load.wall_ms",
+        "phase.parse.cpu_ms", "candidates", "parse.translation_units",
+        "parse.total_ms", "parse.max_ms", "parse.matching_ms"}) {
+    EXPECT_NE(std::find(names.begin(), names.end(), name), names.end())
+        << name;
+  }
+  EXPECT_EQ(record.translation_units["a.cc"], 4.0);
+  EXPECT_EQ(record.translation_units["b.cc"], 1.0);
+  for (const PerfMetric& metric : record.metrics) {
+    if (metric.name == "parse.total_ms") {
+      EXPECT_EQ(metric.value, 5.0);
+    } else if (metric.name == "parse.max_ms") {
+      EXPECT_EQ(metric.value, 4.0);
+    } else if (metric.name == "parse.translation_units") {
+      EXPECT_EQ(metric.value, 2.0);
+    } else if (metric.name == "parse.matching_ms") {
+      EXPECT_EQ(metric.kind, PerfMetricKind::kMilliseconds);
+      EXPECT_EQ(metric.value, 2.5);
+    }
+  }
+}
+
+TEST(PerfRecordTest, JsonRoundTrip) {
+  PerfRecord record{
+      .metrics = {{.name = "phase.parse.wall_ms",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 12.5},
+                  {.name = "peak_rss_kb",
+                   .kind = PerfMetricKind::kKilobytes,
+                   .value = 2048},
+                  {.name = "candidates",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 3}},
+      .translation_units = {{"a.cc", 1.25}}};
+  std::string json;
+  llvm::raw_string_ostream stream(json);
+  modernizer::WritePerfRecordJson(record, stream);
+  stream.flush();
+
+  llvm::Expected<PerfRecord> parsed = modernizer::ParsePerfRecordJson(json);
+  ASSERT_TRUE(static_cast<bool>(parsed)) << llvm::toString(parsed.takeError());
+  ASSERT_EQ(parsed->metrics.size(), 3u);
+  EXPECT_EQ(parsed->metrics[0].name, "phase.parse.wall_ms");
+  EXPECT_EQ(parsed->metrics[0].kind, PerfMetricKind::kMilliseconds);
+  EXPECT_EQ(parsed->metrics[0].value, 12.5);
+  EXPECT_EQ(parsed->metrics[1].kind, PerfMetricKind::kKilobytes);
+  EXPECT_EQ(parsed->metrics[2].kind, PerfMetricKind::kCount);
+  EXPECT_EQ(parsed->translation_units, record.translation_units);
+
+  llvm::Expected<PerfRecord> malformed =
+      modernizer::ParsePerfRecordJson(R"({"metrics": [{"name": "x"}]})");
+  EXPECT_FALSE(static_cast<bool>(malformed));
+  llvm::consumeError(malformed.takeError());
+}
+
+TEST(PerfRecordTest, ReportsWriteErrors) {
+  if (!llvm::sys::fs::exists("/dev/full")) {
+    GTEST_SKIP() << "No /dev/full";
+  }
+  llvm::Error error = modernizer::WritePerfRecord(PerfRecord(), "/dev/full");
+  EXPECT_TRUE(static_cast<bool>(error));
+  llvm::consumeError(std::move(error));
+}
+
+TEST(PerfRecordTest, ComparesAgainstThreshold) {
+  PerfRecord baseline{
+      .metrics = {{.name = "slower",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 1000},
+                  {.name = "within_threshold",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 1000},
+                  {.name = "noise",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 1},
+                  {.name = "candidates",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 3},
+                  {.name = "replacements",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 6},
+                  {.name = "removed",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 1}},
+      .translation_units = {{"a.cc", 10}, {"b.cc", 10}}};
+  PerfRecord current{
+      .metrics = {{.name = "slower",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 1200},
+                  {.name = "within_threshold",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 1050},
+                  {.name = "noise",
+                   .kind = PerfMetricKind::kMilliseconds,
+                   .value = 5},
+                  {.name = "candidates",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 4},
+                  {.name = "replacements",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 8},
+                  {.name = "added",
+                   .kind = PerfMetricKind::kCount,
+                   .value = 1}},
+      .translation_units = {{"a.cc", 30}, {"b.cc", 5}}};
+
+  std::vector<PerfComparison> comparisons =
+      modernizer::ComparePerfRecords(baseline, current, 10);
+  ASSERT_EQ(comparisons.size(), 7u);
+  EXPECT_TRUE(Find(comparisons, "slower")->regressed);
+  EXPECT_FALSE(Find(comparisons, "within_threshold")->regressed);
+  EXPECT_FALSE(Find(comparisons, "noise")->regressed);
+  // Only the counts of results fail a comparison.
+  EXPECT_FALSE(Find(comparisons, "candidates")->regressed);
+  EXPECT_TRUE(Find(comparisons, "replacements")->regressed);
+  EXPECT_FALSE(Find(comparisons, "added")->baseline);
+  EXPECT_FALSE(Find(comparisons, "added")->regressed);
+  EXPECT_FALSE(Find(comparisons, "removed")->current);
+
+  std::string output;
+  llvm::raw_string_ostream stream(output);
+  EXPECT_EQ(modernizer::PrintPerfComparison(baseline, current, 10, stream),
+            2u);
+  stream.flush();
+  EXPECT_NE(output.find("+20.0%"), std::string::npos) << output;
+  EXPECT_NE(output.find("changed"), std::string::npos) << output;
+  EXPECT_NE(output.find("a.cc"), std::string::npos) << output;
+  EXPECT_EQ(output.find("b.cc"), std::string::npos) << output;
+}
+
+}  // namespace
@@ -0,0 +1,211 @@
+#ifndef MODERNIZER_PIPELINE_H_
+#define MODERNIZER_PIPELINE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace modernizer {
+
+struct StageStatistics {
+  std::string name;
+  size_t items = 0;
+  // Time spent running the items of the stage, summed over threads.
+  int64_t busy_microseconds = 0;
+  // The depth of the queue seen by each push, summed, and its maximum.
+  uint64_t total_queue_depth = 0;
+  size_t max_queue_depth = 0;
+  // Pushes that found the queue full, and the time threads outside the pool
+  // waited for room in it.
+  size_t full_queue_pushes = 0;
+  int64_t blocked_microseconds = 0;
+};
+
+// Runs items through a chain of stages on a shared pool of threads. Each
+// stage has a bounded queue, and the function of a stage may only push items
+// to the stages added after it. Threads take the items of later stages first,
+// so that finished work drains before new work starts, and a full queue
+// holds back whoever feeds it: a thread of the pool runs the oldest item of
+// the queue itself, since every other thread may be blocked the same way,
+// and any other thread waits for room.
+template <class Item>
+class Pipeline {
+ public:
+  using StageFunction = std::function<void(Item item)>;
+
+  explicit Pipeline(int num_threads) : num_threads_(std::max(num_threads, 1)) {}
+  // Stops the threads. Items still queued are dropped, so call Wait() first.
+  ~Pipeline() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopped_ = true;
+    }
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  // Adds a stage whose queue holds at most |capacity| items, and returns its
+  // index. Must be called before Start().
+  size_t AddStage(std::string name, size_t capacity, StageFunction function) {
+    absl::MutexLock lock(&mutex_);
+    Stage& stage = stages_.emplace_back();
+    stage.statistics.name = std::move(name);
+    stage.capacity = std::max<size_t>(capacity, 1);
+    functions_.push_back(std::move(function));
+    return stages_.size() - 1;
+  }
+
+  // Starts the threads. Separate from the constructor for callers that fork
+  // before running anything here.
+  void Start() {
+    for (int i = 0; i < num_threads_; ++i) {
+      threads_.emplace_back(&Pipeline::Run, this);
+    }
+  }
+
+  // Thread-safe. Queues |item| for |stage|, blocking while the queue is full.
+  void Push(size_t stage, Item item) {
+    bool on_pool = GetCurrentPipeline() == this;
+    bool counted_full = false;
+    while (true) {
+      std::optional<Item> oldest_item;
+      {
+        absl::MutexLock lock(&mutex_);
+        Stage& target = stages_[stage];
+        if (target.queue.size() >= target.capacity && !counted_full) {
+          ++target.statistics.full_queue_pushes;
+          counted_full = true;
+          if (!on_pool) {
+            auto start = std::chrono::steady_clock::now();
+            mutex_.Await(absl::Condition(&Pipeline::HasRoom, &target));
+            target.statistics.blocked_microseconds +=
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+          }
+        }
+        if (HasRoom(&target)) {
+          target.queue.push_back(std::move(item));
+          target.statistics.total_queue_depth += target.queue.size();
+          target.statistics.max_queue_depth =
+              std::max(target.statistics.max_queue_depth, target.queue.size());
+          return;
+        }
+        oldest_item.emplace(std::move(target.queue.front()));
+        target.queue.pop_front();
+      }
+      RunItem(stage, std::move(*oldest_item));
+    }
+  }
+
+  // Waits until every queue is empty and no item is running. Items may be
+  // pushed again afterwards. Must not be called on a thread of the pool.
+  void Wait() {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(this, &Pipeline::IsIdle));
+  }
+
+  std::vector<StageStatistics> GetStatistics() const {
+    absl::MutexLock lock(&mutex_);
+    std::vector<StageStatistics> statistics;
+    for (const Stage& stage : stages_) {
+      statistics.push_back(stage.statistics);
+    }
+    return statistics;
+  }
+
+ private:
+  struct Stage {
+    StageStatistics statistics;
+    size_t capacity = 1;
+    std::deque<Item> queue;
+  };
+
+  static const void*& GetCurrentPipeline() {
+    static thread_local const void* pipeline = nullptr;
+    return pipeline;
+  }
+
+  static bool HasRoom(Stage* stage) {
+    return stage->queue.size() < stage->capacity;
+  }
+
+  void Run() {
+    GetCurrentPipeline() = this;
+    while (true) {
+      size_t stage = 0;
+      std::optional<Item> item;
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(this, &Pipeline::HasWork));
+        if (stopped_) {
+          return;
+        }
+        stage = stages_.size() - 1;
+        while (stages_[stage].queue.empty()) {
+          --stage;
+        }
+        item.emplace(std::move(stages_[stage].queue.front()));
+        stages_[stage].queue.pop_front();
+        ++running_items_;
+      }
+      RunItem(stage, std::move(*item));
+      absl::MutexLock lock(&mutex_);
+      --running_items_;
+    }
+  }
+
+  void RunItem(size_t stage, Item item) {
+    auto start = std::chrono::steady_clock::now();
+    functions_[stage](std::move(item));
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    absl::MutexLock lock(&mutex_);
+    ++stages_[stage].statistics.items;
+    stages_[stage].statistics.busy_microseconds += elapsed;
+  }
+
+  bool HasWork() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return stopped_ || absl::c_any_of(stages_, [](const Stage& stage) {
+             return !stage.queue.empty();
+           });
+  }
+
+  bool IsIdle() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return running_items_ == 0 &&
+           absl::c_all_of(stages_, [](const Stage& stage) {
+             return stage.queue.empty();
+           });
+  }
+
+  const int num_threads_;
+  // Only written before Start().
+  std::vector<StageFunction> functions_;
+  std::vector<std::thread> threads_;
+
+  mutable absl::Mutex mutex_;
+  std::vector<Stage> stages_ GUARDED_BY(mutex_);
+  // Items taken from a queue by Run() that have not finished yet.
+  int running_items_ GUARDED_BY(mutex_) = 0;
+  bool stopped_ GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_PIPELINE_H_
@@ -0,0 +1,88 @@
+#include "modernizer/pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using modernizer::Pipeline;
+using modernizer::StageStatistics;
+
+TEST(PipelineTest, RunsItemsThroughStages) {
+  absl::Mutex mutex;
+  std::vector<int> results;
+  Pipeline<int> pipeline(4);
+  size_t collect = 0;
+  size_t square = pipeline.AddStage("square", 2, [&](int item) {
+    pipeline.Push(collect, item * item);
+  });
+  collect = pipeline.AddStage("collect", 2, [&](int item) {
+    absl::MutexLock lock(&mutex);
+    results.push_back(item);
+  });
+  pipeline.Start();
+  for (int i = 0; i < 100; ++i) {
+    pipeline.Push(square, i);
+  }
+  pipeline.Wait();
+
+  absl::MutexLock lock(&mutex);
+  std::sort(results.begin(), results.end());
+  ASSERT_EQ(results.size(), 100u);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(results[i], i * i);
+  }
+  std::vector<StageStatistics> statistics = pipeline.GetStatistics();
+  ASSERT_EQ(statistics.size(), 2u);
+  EXPECT_EQ(statistics[0].name, "square");
+  EXPECT_EQ(statistics[0].items, 100u);
+  EXPECT_LE(statistics[0].max_queue_depth, 2u);
+  EXPECT_EQ(statistics[1].name, "collect");
+  EXPECT_EQ(statistics[1].items, 100u);
+  EXPECT_LE(statistics[1].max_queue_depth, 2u);
+}
+
+TEST(PipelineTest, FullQueueRunsOnPushingThread) {
+  // With a single thread, the only way through a full queue is for the
+  // pushing item to run the items of the next stage itself.
+  std::atomic<int> sum = 0;
+  Pipeline<int> pipeline(1);
+  size_t add = 0;
+  size_t split = pipeline.AddStage("split", 1, [&](int item) {
+    for (int i = 0; i < item; ++i) {
+      pipeline.Push(add, 1);
+    }
+  });
+  add = pipeline.AddStage("add", 1, [&](int item) { sum += item; });
+  pipeline.Start();
+  for (int i = 0; i < 10; ++i) {
+    pipeline.Push(split, 10);
+  }
+  pipeline.Wait();
+
+  EXPECT_EQ(sum, 100);
+  std::vector<StageStatistics> statistics = pipeline.GetStatistics();
+  EXPECT_EQ(statistics[1].items, 100u);
+  EXPECT_EQ(statistics[1].max_queue_depth, 1u);
+  EXPECT_GT(statistics[1].full_queue_pushes, 0u);
+}
+
+TEST(PipelineTest, PushesAfterWait) {
+  std::atomic<int> sum = 0;
+  Pipeline<int> pipeline(2);
+  size_t add = pipeline.AddStage("add", 4, [&](int item) { sum += item; });
+  pipeline.Start();
+  pipeline.Push(add, 1);
+  pipeline.Wait();
+  EXPECT_EQ(sum, 1);
+  pipeline.Push(add, 2);
+  pipeline.Wait();
+  EXPECT_EQ(sum, 3);
+  EXPECT_EQ(pipeline.GetStatistics()[0].items, 2u);
+}
+
+}  // namespace
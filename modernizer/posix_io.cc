@@ -0,0 +1,55 @@
+#include "modernizer/posix_io.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+
+namespace modernizer {
+
+bool WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+
+bool ReadAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t num_read = read(fd, data, size);
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read <= 0) {
+      return false;
+    }
+    data += num_read;
+    size -= num_read;
+  }
+  return true;
+}
+
+bool WriteMessage(int fd, std::string_view message) {
+  uint32_t size = message.size();
+  return WriteAll(fd, std::string_view(reinterpret_cast<const char*>(&size),
+                                       sizeof(size))) &&
+         WriteAll(fd, message);
+}
+
+bool ReadMessage(int fd, std::string& message) {
+  uint32_t size;
+  if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  message.resize(size);
+  return ReadAll(fd, message.data(), size);
+}
+
+}  // namespace modernizer
@@ -0,0 +1,24 @@
+#ifndef MODERNIZER_POSIX_IO_H_
+#define MODERNIZER_POSIX_IO_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace modernizer {
+
+// Writes all of |data| to |fd|, retrying on EINTR and short writes.
+bool WriteAll(int fd, std::string_view data);
+
+// Reads exactly |size| bytes from |fd|. Returns false on error or if the end
+// of the file comes first.
+bool ReadAll(int fd, char* data, size_t size);
+
+// A message is its size as a 4-byte integer followed by its bytes.
+bool WriteMessage(int fd, std::string_view message);
+
+bool ReadMessage(int fd, std::string& message);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_POSIX_IO_H_
@@ -0,0 +1,226 @@
+// Times how long workers block reading the headers of translation units on a
+// cold page cache, with and without the prefetcher reading ahead of them.
+// Translation units read overlapping sets of headers, and each one spends
+// some time computing after its reads, as parsing would.
+//
+// The files are evicted from the page cache before each pass, which only
+// works on a disk-backed file system: run it on the slow disk, not on tmpfs.
+// Dropping all caches instead ("echo 3 > /proc/sys/vm/drop_caches" as root,
+// in a local VM) gives the same results.
+//
+// Usage: ./prefetch_benchmark [directory] [translation units]
+//            [headers per unit] [header KB] [lookahead] [jobs] [compute ms]
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/posix_io.h"
+#include "modernizer/prefetcher.h"
+
+namespace {
+
+struct Pass {
+  double read_milliseconds = 0;
+  double wall_milliseconds = 0;
+};
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+bool WriteFiles(const std::vector<std::string>& paths, size_t size) {
+  std::string contents(size, 'x');
+  for (const std::string& path : paths) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !modernizer::WriteAll(fd, contents) || fsync(fd) != 0) {
+      llvm::errs() << "Cannot write " << path << "\n";
+      if (fd >= 0) {
+        close(fd);
+      }
+      return false;
+    }
+    close(fd);
+  }
+  return true;
+}
+
+// Drops the clean pages of |paths| from the page cache.
+void Evict(const std::vector<std::string>& paths) {
+  for (const std::string& path : paths) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+}
+
+void ReadFile(const std::string& path, std::vector<char>& buffer) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  while (read(fd, buffer.data(), buffer.size()) > 0) {
+  }
+  close(fd);
+}
+
+void Compute(std::chrono::microseconds duration) {
+  auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+  }
+}
+
+Pass RunPass(const std::vector<std::string>& source_paths,
+             const std::vector<std::vector<std::string>>& files,
+             int num_jobs,
+             std::chrono::microseconds compute,
+             modernizer::Prefetcher* prefetcher) {
+  std::atomic<size_t> next_index = 0;
+  std::atomic<int64_t> read_microseconds = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_jobs; ++i) {
+    threads.emplace_back([&] {
+      std::vector<char> buffer(64 * 1024);
+      for (size_t index = next_index++; index < source_paths.size();
+           index = next_index++) {
+        if (prefetcher) {
+          prefetcher->OnStarted(source_paths[index]);
+        }
+        auto read_start = std::chrono::steady_clock::now();
+        for (const std::string& path : files[index]) {
+          ReadFile(path, buffer);
+        }
+        read_microseconds +=
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - read_start)
+                .count();
+        Compute(compute);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return Pass{.read_milliseconds = read_microseconds / 1000.0,
+              .wall_milliseconds = MillisecondsSince(start)};
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string directory = argc >= 2 ? argv[1] : "";
+  int num_units = argc >= 3 ? std::atoi(argv[2]) : 200;
+  int headers_per_unit = argc >= 4 ? std::atoi(argv[3]) : 100;
+  int header_kilobytes = argc >= 5 ? std::atoi(argv[4]) : 16;
+  int lookahead = argc >= 6 ? std::atoi(argv[5]) : 16;
+  int num_jobs = argc >= 7 ? std::atoi(argv[6]) : 8;
+  int compute_milliseconds = argc >= 8 ? std::atoi(argv[7]) : 20;
+  if (num_units <= 0 || headers_per_unit <= 0 || header_kilobytes <= 0 ||
+      lookahead <= 0 || num_jobs <= 0 || compute_milliseconds < 0) {
+    llvm::errs() << "Usage: " << argv[0]
+                 << " [directory] [translation units] [headers per unit] "
+                    "[header KB] [lookahead] [jobs] [compute ms]\n";
+    return 1;
+  }
+
+  llvm::SmallString<128> root;
+  if (directory.empty()) {
+    if (llvm::sys::fs::createUniqueDirectory("prefetch_benchmark", root)) {
+      llvm::errs() << "Cannot create a directory\n";
+      return 1;
+    }
+  } else {
+    root = directory;
+    llvm::sys::path::append(root, "prefetch_benchmark");
+    if (llvm::sys::fs::create_directories(root)) {
+      llvm::errs() << "Cannot create " << root << "\n";
+      return 1;
+    }
+  }
+
+  // Each unit reads a window of the headers that overlaps with the next
+  // units, like translation units of one directory sharing its headers.
+  int num_headers = num_units * headers_per_unit / 4 + headers_per_unit;
+  std::vector<std::string> all_paths;
+  for (int i = 0; i < num_headers; ++i) {
+    llvm::SmallString<128> path(root);
+    llvm::sys::path::append(path, "header" + std::to_string(i) + ".h");
+    all_paths.push_back(std::string(path));
+  }
+  std::vector<std::string> source_paths;
+  std::vector<std::vector<std::string>> files;
+  for (int i = 0; i < num_units; ++i) {
+    llvm::SmallString<128> path(root);
+    llvm::sys::path::append(path, "unit" + std::to_string(i) + ".cc");
+    source_paths.push_back(std::string(path));
+    all_paths.push_back(std::string(path));
+    std::vector<std::string>& unit_files = files.emplace_back();
+    unit_files.push_back(source_paths.back());
+    for (int j = 0; j < headers_per_unit; ++j) {
+      unit_files.push_back(all_paths[i * headers_per_unit / 4 + j]);
+    }
+  }
+  if (!WriteFiles(all_paths, header_kilobytes * 1024)) {
+    llvm::sys::fs::remove_directories(root);
+    return 1;
+  }
+
+  auto compute = std::chrono::milliseconds(compute_milliseconds);
+  Evict(all_paths);
+  Pass cold = RunPass(source_paths, files, num_jobs, compute, nullptr);
+  Pass warm = RunPass(source_paths, files, num_jobs, compute, nullptr);
+
+  Evict(all_paths);
+  modernizer::PrefetchStatistics statistics;
+  Pass prefetched;
+  {
+    std::unordered_map<std::string, size_t> indices;
+    for (size_t i = 0; i < source_paths.size(); ++i) {
+      indices.emplace(source_paths[i], i);
+    }
+    modernizer::Prefetcher prefetcher(
+        source_paths, lookahead, [&](const std::string& source_path) {
+          return files[indices.at(source_path)];
+        });
+    prefetched = RunPass(source_paths, files, num_jobs, compute, &prefetcher);
+    statistics = prefetcher.GetStatistics();
+  }
+  llvm::sys::fs::remove_directories(root);
+
+  auto print = [](const char* name, const Pass& pass) {
+    llvm::outs() << name << ": blocked in reads "
+                 << llvm::format("%.3f", pass.read_milliseconds)
+                 << " ms, wall " << llvm::format("%.3f", pass.wall_milliseconds)
+                 << " ms\n";
+  };
+  llvm::outs() << num_units << " units, " << num_headers << " headers of "
+               << header_kilobytes << " KB, " << num_jobs << " jobs\n";
+  print("cold", cold);
+  print("warm", warm);
+  print("cold, prefetched", prefetched);
+  llvm::outs() << "read ahead " << statistics.files << " files of "
+               << statistics.translation_units << " units, lookahead "
+               << lookahead << "\n";
+  if (cold.read_milliseconds < warm.read_milliseconds * 2) {
+    llvm::outs() << "Cold reads are not slower than warm ones; the files may "
+                    "be on tmpfs, where they cannot be evicted\n";
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "modernizer/prefetcher.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+
+namespace modernizer {
+
+namespace {
+
+// Starts reading |path| into the page cache without waiting for the disk.
+// Returns the size of the file, or std::nullopt if it cannot be opened.
+std::optional<uint64_t> ReadAhead(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat status;
+  uint64_t size = fstat(fd, &status) == 0 ? status.st_size : 0;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  close(fd);
+  return size;
+}
+
+}  // namespace
+
+Prefetcher::Prefetcher(std::vector<std::string> source_paths,
+                       size_t lookahead,
+                       GetFilesFunction get_files)
+    : source_paths_(std::move(source_paths)),
+      lookahead_(lookahead),
+      get_files_(std::move(get_files)),
+      end_(std::min(lookahead, source_paths_.size())) {
+  for (size_t i = 0; i < source_paths_.size(); ++i) {
+    indices_.emplace(source_paths_[i], i);
+  }
+  thread_ = std::thread(&Prefetcher::Run, this);
+}
+
+Prefetcher::~Prefetcher() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  thread_.join();
+}
+
+void Prefetcher::OnStarted(const std::string& source_path) {
+  auto iter = indices_.find(source_path);
+  if (iter == indices_.end()) {
+    return;
+  }
+  size_t index = iter->second;
+  absl::MutexLock lock(&mutex_);
+  // The worker reads the files of a started translation unit by itself, so
+  // reading them ahead would only delay the next ones.
+  next_ = std::max(next_, index + 1);
+  end_ = std::max(end_, std::min(index + 1 + lookahead_, source_paths_.size()));
+}
+
+PrefetchStatistics Prefetcher::GetStatistics() const {
+  absl::MutexLock lock(&mutex_);
+  return statistics_;
+}
+
+void Prefetcher::Run() {
+  std::unordered_set<std::string> read_files;
+  while (true) {
+    size_t index;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &Prefetcher::IsReady));
+      if (stopped_) {
+        return;
+      }
+      index = next_++;
+    }
+
+    PrefetchStatistics statistics{.translation_units = 1};
+    for (const std::string& file : get_files_(source_paths_[index])) {
+      if (!read_files.insert(file).second) {
+        continue;
+      }
+      if (std::optional<uint64_t> size = ReadAhead(file)) {
+        ++statistics.files;
+        statistics.bytes += *size;
+      } else {
+        ++statistics.failed_files;
+      }
+    }
+
+    absl::MutexLock lock(&mutex_);
+    statistics_.translation_units += statistics.translation_units;
+    statistics_.files += statistics.files;
+    statistics_.bytes += statistics.bytes;
+    statistics_.failed_files += statistics.failed_files;
+  }
+}
+
+}  // namespace modernizer
@@ -0,0 +1,78 @@
+#ifndef MODERNIZER_PREFETCHER_H_
+#define MODERNIZER_PREFETCHER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace modernizer {
+
+struct PrefetchStatistics {
+  size_t translation_units = 0;
+  size_t files = 0;
+  uint64_t bytes = 0;
+  // Files that could not be opened.
+  size_t failed_files = 0;
+};
+
+// Asks the kernel to read ahead the files of the translation units workers
+// are about to parse, so that on a cold page cache the workers find their
+// headers in memory instead of blocking on the disk. Translation units are
+// expected to start in the order of |source_paths|, and the prefetcher keeps
+// at most |lookahead| of them ahead of the last one started. Each file is
+// read ahead once.
+class Prefetcher {
+ public:
+  // Returns the files |source_path| reads, including itself, or nothing if
+  // they are not known. Called on the thread of the prefetcher only.
+  using GetFilesFunction =
+      std::function<std::vector<std::string>(const std::string& source_path)>;
+
+  Prefetcher(std::vector<std::string> source_paths,
+             size_t lookahead,
+             GetFilesFunction get_files);
+  // Stops reading ahead, without waiting for reads the kernel started.
+  ~Prefetcher();
+
+  Prefetcher(const Prefetcher&) = delete;
+  Prefetcher& operator=(const Prefetcher&) = delete;
+
+  // Thread-safe. Lets the prefetcher move on to the translation units after
+  // |source_path|.
+  void OnStarted(const std::string& source_path);
+
+  PrefetchStatistics GetStatistics() const;
+
+ private:
+  void Run();
+
+  // Whether Run() has something to do.
+  bool IsReady() const EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return stopped_ || next_ < end_;
+  }
+
+  const std::vector<std::string> source_paths_;
+  const size_t lookahead_;
+  const GetFilesFunction get_files_;
+  std::unordered_map<std::string, size_t> indices_;
+
+  mutable absl::Mutex mutex_;
+  // The next translation unit to read ahead, and the end of those that may
+  // be read ahead.
+  size_t next_ GUARDED_BY(mutex_) = 0;
+  size_t end_ GUARDED_BY(mutex_);
+  bool stopped_ GUARDED_BY(mutex_) = false;
+  PrefetchStatistics statistics_ GUARDED_BY(mutex_);
+
+  std::thread thread_;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_PREFETCHER_H_
@@ -0,0 +1,98 @@
+#include "modernizer/prefetcher.h"
+
+#include <chrono>
+#include <map>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+using modernizer::Prefetcher;
+using modernizer::PrefetchStatistics;
+
+class PrefetcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("modernizer", directory_));
+  }
+
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory_);
+  }
+
+  std::string GetPath(const std::string& name) const {
+    llvm::SmallString<128> path(directory_);
+    llvm::sys::path::append(path, name);
+    return std::string(path);
+  }
+
+  void WriteFile(const std::string& name, const std::string& contents) {
+    std::error_code error;
+    llvm::raw_fd_ostream stream(GetPath(name), error);
+    ASSERT_FALSE(error);
+    stream << contents;
+  }
+
+  // Waits for the prefetcher to read ahead |translation_units|.
+  static PrefetchStatistics WaitFor(const Prefetcher& prefetcher,
+                                    size_t translation_units) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    PrefetchStatistics statistics = prefetcher.GetStatistics();
+    while (statistics.translation_units < translation_units &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      statistics = prefetcher.GetStatistics();
+    }
+    return statistics;
+  }
+
+  llvm::SmallString<128> directory_;
+};
+
+TEST_F(PrefetcherTest, ReadsAheadOfStartedTranslationUnits) {
+  WriteFile("a.h", "aa");
+  WriteFile("b.h", "bbb");
+  WriteFile("c.h", "cccc");
+  WriteFile("d.h", "d");
+  std::map<std::string, std::vector<std::string>> files = {
+      {"1.cc", {GetPath("a.h"), GetPath("b.h")}},
+      {"2.cc", {GetPath("b.h"), GetPath("c.h"), GetPath("missing.h")}},
+      {"3.cc", {GetPath("d.h")}},
+      {"4.cc", {GetPath("a.h")}},
+  };
+  Prefetcher prefetcher(
+      {"1.cc", "2.cc", "3.cc", "4.cc"}, 1,
+      [&](const std::string& source_path) { return files[source_path]; });
+
+  PrefetchStatistics statistics = WaitFor(prefetcher, 1);
+  EXPECT_EQ(statistics.translation_units, 1u);
+  EXPECT_EQ(statistics.files, 2u);
+  EXPECT_EQ(statistics.bytes, 5u);
+
+  prefetcher.OnStarted("1.cc");
+  statistics = WaitFor(prefetcher, 2);
+  EXPECT_EQ(statistics.translation_units, 2u);
+  // b.h was read ahead already.
+  EXPECT_EQ(statistics.files, 3u);
+  EXPECT_EQ(statistics.bytes, 9u);
+  EXPECT_EQ(statistics.failed_files, 1u);
+
+  // 3.cc started before it was read ahead, so only 4.cc is left.
+  prefetcher.OnStarted("3.cc");
+  statistics = WaitFor(prefetcher, 3);
+  EXPECT_EQ(statistics.translation_units, 3u);
+  EXPECT_EQ(statistics.files, 3u);
+
+  prefetcher.OnStarted("unknown.cc");
+  prefetcher.OnStarted("4.cc");
+  EXPECT_EQ(prefetcher.GetStatistics().translation_units, 3u);
+}
+
+}  // namespace
@@ -0,0 +1,74 @@
+#include "modernizer/raw_token_cache.h"
+
+#include <algorithm>
+
+#include "clang/Lex/Lexer.h"
+
+namespace modernizer {
+
+clang::LangOptions GetCpp17LangOptions() {
+  clang::LangOptions lang_opts;
+  lang_opts.CPlusPlus = true;
+  lang_opts.CPlusPlus11 = true;
+  lang_opts.CPlusPlus14 = true;
+  lang_opts.CPlusPlus17 = true;
+  lang_opts.LineComment = true;
+  return lang_opts;
+}
+
+std::vector<RawToken> LexRawTokens(llvm::StringRef buffer,
+                                   const clang::LangOptions& lang_opts) {
+  std::vector<RawToken> tokens;
+  clang::Lexer lexer(clang::SourceLocation(), lang_opts, buffer.begin(),
+                     buffer.begin(), buffer.end());
+  clang::Token token;
+  while (true) {
+    lexer.LexFromRawLexer(token);
+    if (token.is(clang::tok::eof)) {
+      break;
+    }
+    // The lexer stops right after the token in raw mode.
+    const char* token_end = lexer.getBufferLocation();
+    tokens.push_back(
+        {.offset = static_cast<unsigned>(token_end - buffer.begin() -
+                                         token.getLength()),
+         .length = token.getLength(),
+         .kind = token.getKind(),
+         .at_start_of_line = token.isAtStartOfLine()});
+  }
+  return tokens;
+}
+
+std::optional<size_t> FileTokens::Find(unsigned offset) const {
+  auto iter = std::upper_bound(
+      tokens.begin(), tokens.end(), offset,
+      [](unsigned value, const RawToken& token) {
+        return value < token.offset;
+      });
+  if (iter == tokens.begin()) {
+    return std::nullopt;
+  }
+  return iter - tokens.begin() - 1;
+}
+
+const FileTokens* RawTokenCache::Get(clang::FileID file_id,
+                                     const clang::SourceManager& sm,
+                                     const clang::LangOptions& lang_opts) {
+  auto [iter, inserted] = files_.try_emplace(file_id);
+  if (!inserted) {
+    return iter->second.get();
+  }
+
+  bool invalid = false;
+  llvm::StringRef buffer = sm.getBufferData(file_id, &invalid);
+  if (invalid) {
+    return nullptr;
+  }
+  auto file_tokens = std::make_unique<FileTokens>();
+  file_tokens->buffer = buffer;
+  file_tokens->tokens = LexRawTokens(buffer, lang_opts);
+  iter->second = std::move(file_tokens);
+  return iter->second.get();
+}
+
+}  // namespace modernizer
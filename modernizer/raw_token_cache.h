@@ -0,0 +1,71 @@
+#ifndef MODERNIZER_RAW_TOKEN_CACHE_H_
+#define MODERNIZER_RAW_TOKEN_CACHE_H_
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TokenKinds.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace modernizer {
+
+struct RawToken {
+  unsigned offset;
+  unsigned length;
+  clang::tok::TokenKind kind;
+  // Set for the first token of a line, such as the '#' of a directive.
+  bool at_start_of_line;
+};
+
+// Options to lex files as C++17 outside of a translation unit.
+clang::LangOptions GetCpp17LangOptions();
+
+// Returns the tokens of |buffer|, lexed in raw mode, without comments.
+std::vector<RawToken> LexRawTokens(llvm::StringRef buffer,
+                                   const clang::LangOptions& lang_opts);
+
+// The tokens of one file, lexed in raw mode, without comments.
+struct FileTokens {
+  llvm::StringRef buffer;
+  std::vector<RawToken> tokens;
+
+  // Returns the index of the last token starting at or before |offset|.
+  std::optional<size_t> Find(unsigned offset) const;
+
+  llvm::StringRef GetText(size_t index) const {
+    return buffer.substr(tokens[index].offset, tokens[index].length);
+  }
+};
+
+// Tokens of the files of one translation unit. Each file is lexed once, the
+// first time it is asked for, and the tokens are shared by every later
+// lookup in that file.
+class RawTokenCache {
+ public:
+  RawTokenCache() = default;
+  ~RawTokenCache() = default;
+
+  RawTokenCache(const RawTokenCache&) = delete;
+  RawTokenCache& operator=(const RawTokenCache&) = delete;
+
+  // Returns nullptr if the buffer of |file_id| cannot be read.
+  const FileTokens* Get(clang::FileID file_id,
+                        const clang::SourceManager& sm,
+                        const clang::LangOptions& lang_opts);
+
+  // Must be called before the source manager of the translation unit goes
+  // away.
+  void Clear() { files_.clear(); }
+
+ private:
+  llvm::DenseMap<clang::FileID, std::unique_ptr<FileTokens>> files_;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_RAW_TOKEN_CACHE_H_
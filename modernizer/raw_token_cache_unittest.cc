@@ -0,0 +1,42 @@
+#include "modernizer/raw_token_cache.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "gtest/gtest.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace {
+
+TEST(RawTokenCacheTest, LexesEachFileOnce) {
+  clang::FileManager file_manager{clang::FileSystemOptions()};
+  clang::DiagnosticsEngine diagnostics(
+      llvm::makeIntrusiveRefCnt<clang::DiagnosticIDs>(),
+      llvm::makeIntrusiveRefCnt<clang::DiagnosticOptions>());
+  clang::SourceManager sm(diagnostics, file_manager);
+  clang::FileID file_id = sm.createFileID(llvm::MemoryBuffer::getMemBuffer(
+      "class Foo {\n  // Comment.\n  MACRO(Foo);\n};\n"));
+  clang::LangOptions lang_opts;
+  lang_opts.CPlusPlus = true;
+
+  modernizer::RawTokenCache cache;
+  const modernizer::FileTokens* file_tokens =
+      cache.Get(file_id, sm, lang_opts);
+  ASSERT_TRUE(file_tokens);
+  EXPECT_EQ(cache.Get(file_id, sm, lang_opts), file_tokens);
+
+  const std::vector<modernizer::RawToken>& tokens = file_tokens->tokens;
+  ASSERT_EQ(tokens.size(), 10u);
+  EXPECT_EQ(file_tokens->GetText(0), "class");
+  EXPECT_EQ(file_tokens->GetText(3), "MACRO");
+  EXPECT_EQ(tokens[3].offset, 28u);
+  EXPECT_EQ(tokens[4].kind, clang::tok::l_paren);
+  EXPECT_EQ(tokens[7].kind, clang::tok::semi);
+
+  EXPECT_EQ(file_tokens->Find(28), 3u);
+  // Offsets within a token or the whitespace after it map to the token.
+  EXPECT_EQ(file_tokens->Find(30), 3u);
+  EXPECT_EQ(file_tokens->Find(12), 2u);
+}
+
+}  // namespace
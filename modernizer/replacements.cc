@@ -0,0 +1,241 @@
+#include "modernizer/replacements.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <numeric>
+#include <utility>
+
+#include "modernizer/serialization.h"
+
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+namespace modernizer {
+
+namespace {
+
+bool KeyOffsetLess(const ReplacementRecord& lhs,
+                   const ReplacementRecord& rhs) {
+  return lhs.key_offset < rhs.key_offset;
+}
+
+}  // namespace
+
+std::vector<Replacements> GroupReplacements(
+    llvm::StringRef file_path,
+    const FileReplacements& file_replacements) {
+  std::vector<Replacements> result;
+  const std::vector<ReplacementRecord>& records =
+      file_replacements.replacements;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (i == 0 || records[i - 1].key_offset != records[i].key_offset) {
+      result.emplace_back();
+    }
+    // Records of one edit came from a single Replacements, so they cannot
+    // conflict.
+    llvm::Error error = result.back().add(Replacement(
+        file_path, records[i].offset, records[i].length, records[i].text));
+    assert(!error);
+    llvm::consumeError(std::move(error));
+  }
+  return result;
+}
+
+std::optional<Replacements> MergeReplacements(
+    llvm::StringRef file_path,
+    const FileReplacements& file_replacements) {
+  // Sort once by offset, insertions first, and keep the order of edits for
+  // equal keys so that insertions at the same offset are concatenated in
+  // edit order.
+  std::vector<const ReplacementRecord*> sorted;
+  sorted.reserve(file_replacements.replacements.size());
+  for (const ReplacementRecord& record : file_replacements.replacements) {
+    sorted.push_back(&record);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const ReplacementRecord* lhs,
+                      const ReplacementRecord* rhs) {
+                     return std::make_pair(lhs->offset, lhs->length != 0) <
+                            std::make_pair(rhs->offset, rhs->length != 0);
+                   });
+
+  std::vector<Replacement> merged;
+  merged.reserve(sorted.size());
+  for (const ReplacementRecord* record : sorted) {
+    if (!merged.empty()) {
+      const Replacement& last = merged.back();
+      if (last.getOffset() + last.getLength() > record->offset) {
+        return std::nullopt;
+      }
+      if (last.getLength() == 0 && record->length == 0 &&
+          last.getOffset() == record->offset) {
+        merged.back() =
+            Replacement(file_path, last.getOffset(), 0,
+                        (last.getReplacementText() + record->text).str());
+        continue;
+      }
+    }
+    merged.emplace_back(file_path, record->offset, record->length,
+                        record->text);
+  }
+
+  // Sorted and disjoint, so adding them never conflicts.
+  Replacements result;
+  for (const Replacement& replacement : merged) {
+    if (llvm::Error error = result.add(replacement)) {
+      llvm::consumeError(std::move(error));
+      return std::nullopt;
+    }
+  }
+  return result;
+}
+
+uint32_t ReplacementsContext::GetFileId(llvm::StringRef file_path) {
+  auto [iter, inserted] = file_ids_.try_emplace(file_path, files_.size());
+  if (inserted) {
+    file_paths_.push_back(iter->first());
+    files_.emplace_back();
+  }
+  return iter->second;
+}
+
+std::optional<uint32_t> ReplacementsContext::FindFileId(
+    llvm::StringRef file_path) const {
+  auto iter = file_ids_.find(file_path);
+  if (iter == file_ids_.end()) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+std::vector<uint32_t> ReplacementsContext::GetFileIdsByPath() const {
+  std::vector<uint32_t> ids(files_.size());
+  std::iota(ids.begin(), ids.end(), 0);
+  std::sort(ids.begin(), ids.end(), [this](uint32_t lhs, uint32_t rhs) {
+    return file_paths_[lhs] < file_paths_[rhs];
+  });
+  return ids;
+}
+
+void ReplacementsContext::Add(
+    llvm::StringRef file_path,
+    std::shared_ptr<const FileSystemCache::Contents> contents,
+    llvm::ArrayRef<ReplacementRecord> replacements) {
+  FileReplacements& file_replacements = files_[GetFileId(file_path)];
+  if (!file_replacements.contents) {
+    file_replacements.contents = std::move(contents);
+  } else if (file_replacements.contents->hash != contents->hash) {
+    file_replacements.conflicting_contents = true;
+  }
+
+  std::vector<ReplacementRecord>& records = file_replacements.replacements;
+  size_t old_size = records.size();
+  for (const ReplacementRecord& replacement : replacements) {
+    // Edits already known keep the replacements they were added with.
+    if (std::binary_search(records.begin(), records.begin() + old_size,
+                           replacement, KeyOffsetLess)) {
+      continue;
+    }
+    ReplacementRecord& record = records.emplace_back(replacement);
+    record.text = text_pool_.save(replacement.text);
+  }
+  if (records.size() == old_size) {
+    return;
+  }
+  if (file_replacements.emitted) {
+    file_replacements.late_replacements = true;
+  }
+  std::stable_sort(records.begin() + old_size, records.end(), KeyOffsetLess);
+  std::inplace_merge(records.begin(), records.begin() + old_size,
+                     records.end(), KeyOffsetLess);
+}
+
+void ReplacementsContext::Merge(
+    const ReplacementsContext& other,
+    const std::function<bool(llvm::StringRef file_path)>& filter) {
+  for (uint32_t id = 0; id < other.files_.size(); ++id) {
+    if (filter && !filter(other.file_paths_[id])) {
+      continue;
+    }
+    const FileReplacements& other_file = other.files_[id];
+    Add(other.file_paths_[id], other_file.contents, other_file.replacements);
+    if (other_file.conflicting_contents) {
+      files_[GetFileId(other.file_paths_[id])].conflicting_contents = true;
+    }
+  }
+}
+
+size_t ReplacementsContext::GetNumReplacements() const {
+  size_t num_replacements = 0;
+  for (const FileReplacements& file_replacements : files_) {
+    num_replacements += file_replacements.replacements.size();
+  }
+  return num_replacements;
+}
+
+std::string SerializeReplacements(const ReplacementsContext& context) {
+  std::string out;
+  WriteVarint(context.GetNumFiles(), out);
+  for (uint32_t id = 0; id < context.GetNumFiles(); ++id) {
+    const FileReplacements& file_replacements =
+        context.GetFileReplacements(id);
+    WriteString(std::string_view(context.GetFilePath(id)), out);
+    WriteString(file_replacements.contents->real_path, out);
+    WriteVarint(file_replacements.contents->hash, out);
+    WriteVarint(file_replacements.replacements.size(), out);
+    for (const ReplacementRecord& record : file_replacements.replacements) {
+      WriteVarint(record.key_offset, out);
+      WriteVarint(record.offset, out);
+      WriteVarint(record.length, out);
+      WriteString(std::string_view(record.text), out);
+    }
+  }
+  return out;
+}
+
+std::optional<std::vector<SerializedFileReplacements>> DeserializeReplacements(
+    std::string_view data) {
+  SerializationReader reader(data);
+  uint64_t num_files;
+  if (!reader.ReadVarint(num_files)) {
+    return std::nullopt;
+  }
+  std::vector<SerializedFileReplacements> result;
+  for (uint64_t i = 0; i < num_files; ++i) {
+    SerializedFileReplacements& file = result.emplace_back();
+    uint64_t num_replacements;
+    if (!reader.ReadString(file.file_path) ||
+        !reader.ReadString(file.real_path) || !reader.ReadVarint(file.hash) ||
+        !reader.ReadVarint(num_replacements)) {
+      return std::nullopt;
+    }
+    for (uint64_t j = 0; j < num_replacements; ++j) {
+      ReplacementRecord record;
+      uint64_t key_offset;
+      uint64_t offset;
+      uint64_t length;
+      std::string_view text;
+      if (!reader.ReadVarint(key_offset) || !reader.ReadVarint(offset) ||
+          !reader.ReadVarint(length) || !reader.ReadStringView(text) ||
+          key_offset > UINT_MAX || offset > UINT_MAX || length > UINT_MAX) {
+        return std::nullopt;
+      }
+      record.key_offset = key_offset;
+      record.offset = offset;
+      record.length = length;
+      record.text = llvm::StringRef(text.data(), text.size());
+      if (!file.replacements.empty() &&
+          record.key_offset < file.replacements.back().key_offset) {
+        return std::nullopt;
+      }
+      file.replacements.push_back(record);
+    }
+  }
+  if (!reader.AtEnd()) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+}  // namespace modernizer
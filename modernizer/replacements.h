@@ -0,0 +1,150 @@
+#ifndef MODERNIZER_REPLACEMENTS_H_
+#define MODERNIZER_REPLACEMENTS_H_
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "modernizer/file_system_cache.h"
+
+namespace modernizer {
+
+// One replacement in a file. The path of the file is not repeated, and the
+// text points into the text pool of the context holding the record.
+struct ReplacementRecord {
+  // The file offset the edit the replacement belongs to was found at. Edits
+  // found by several translation units are only kept once.
+  unsigned key_offset;
+  unsigned offset;
+  unsigned length;
+  llvm::StringRef text;
+};
+
+struct FileReplacements {
+  // The buffer every replacement of the file was computed against.
+  std::shared_ptr<const FileSystemCache::Contents> contents;
+  // Sorted by |key_offset|.
+  std::vector<ReplacementRecord> replacements;
+  // Set if translation units disagree on the contents of the file.
+  bool conflicting_contents = false;
+  // Set once the patch of the file has been streamed out, or the file has
+  // been handed over to be formatted.
+  bool emitted = false;
+  // Set if replacements arrived after |emitted| was set, which means the
+  // depfile of some translation unit was stale.
+  bool late_replacements = false;
+};
+
+// Returns the replacements of each edit of |file_replacements|, in
+// |key_offset| order.
+std::vector<clang::tooling::Replacements> GroupReplacements(
+    llvm::StringRef file_path,
+    const FileReplacements& file_replacements);
+
+// Returns every replacement of |file_replacements| as a single Replacements,
+// with all offsets relative to the buffer the replacements were computed
+// against. Insertions at the same offset are kept in |key_offset| order.
+// Returns std::nullopt if replacements of different edits overlap.
+std::optional<clang::tooling::Replacements> MergeReplacements(
+    llvm::StringRef file_path,
+    const FileReplacements& file_replacements);
+
+// Replacements of every file. Files are identified by dense ids of their
+// paths relative to the build root, and the texts of all replacements are
+// interned in a single arena.
+class LOCKABLE ReplacementsContext {
+ public:
+  void lock() EXCLUSIVE_LOCK_FUNCTION() { mutex_.Lock(); }
+
+  void unlock() UNLOCK_FUNCTION() { mutex_.Unlock(); }
+
+  // Returns the id of |file_path|, adding an empty entry if needed.
+  uint32_t GetFileId(llvm::StringRef file_path) EXCLUSIVE_LOCKS_REQUIRED(this);
+
+  // Returns the id of |file_path|, or std::nullopt if it has no entry.
+  std::optional<uint32_t> FindFileId(llvm::StringRef file_path) const
+      EXCLUSIVE_LOCKS_REQUIRED(this);
+
+  uint32_t GetNumFiles() const EXCLUSIVE_LOCKS_REQUIRED(this) {
+    return files_.size();
+  }
+
+  llvm::StringRef GetFilePath(uint32_t id) const
+      EXCLUSIVE_LOCKS_REQUIRED(this) {
+    return file_paths_[id];
+  }
+
+  FileReplacements& GetFileReplacements(uint32_t id)
+      EXCLUSIVE_LOCKS_REQUIRED(this) {
+    return files_[id];
+  }
+
+  const FileReplacements& GetFileReplacements(uint32_t id) const
+      EXCLUSIVE_LOCKS_REQUIRED(this) {
+    return files_[id];
+  }
+
+  // Returns the ids of every file in path order.
+  std::vector<uint32_t> GetFileIdsByPath() const
+      EXCLUSIVE_LOCKS_REQUIRED(this);
+
+  // Merges |replacements|, computed against |contents|, into the entry of
+  // |file_path|. Their texts are copied into the text pool.
+  void Add(llvm::StringRef file_path,
+           std::shared_ptr<const FileSystemCache::Contents> contents,
+           llvm::ArrayRef<ReplacementRecord> replacements)
+      EXCLUSIVE_LOCKS_REQUIRED(this);
+
+  // Merges the entries of another context into this one, or only those
+  // whose path |filter| returns true for if set.
+  void Merge(const ReplacementsContext& other,
+             const std::function<bool(llvm::StringRef file_path)>& filter =
+                 nullptr) EXCLUSIVE_LOCKS_REQUIRED(this, other);
+
+  size_t GetNumReplacements() const EXCLUSIVE_LOCKS_REQUIRED(this);
+
+  size_t GetTextPoolSize() const EXCLUSIVE_LOCKS_REQUIRED(this) {
+    return text_allocator_.getBytesAllocated();
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  llvm::StringMap<uint32_t> file_ids_ GUARDED_BY(mutex_);
+  // Point to the keys of |file_ids_|.
+  std::vector<llvm::StringRef> file_paths_ GUARDED_BY(mutex_);
+  std::vector<FileReplacements> files_ GUARDED_BY(mutex_);
+  llvm::BumpPtrAllocator text_allocator_ GUARDED_BY(mutex_);
+  llvm::UniqueStringSaver text_pool_ GUARDED_BY(mutex_) =
+      llvm::UniqueStringSaver(text_allocator_);
+};
+
+// The replacements of one file as sent from a worker process. The worker's
+// buffer cannot be shared, so it is identified by its real path and hash.
+struct SerializedFileReplacements {
+  std::string file_path;
+  std::string real_path;
+  uint64_t hash = 0;
+  // The texts point into the serialized data.
+  std::vector<ReplacementRecord> replacements;
+};
+
+std::string SerializeReplacements(const ReplacementsContext& context)
+    EXCLUSIVE_LOCKS_REQUIRED(context);
+
+// Returns std::nullopt if |data| was not produced by SerializeReplacements().
+std::optional<std::vector<SerializedFileReplacements>> DeserializeReplacements(
+    std::string_view data);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_REPLACEMENTS_H_
@@ -0,0 +1,117 @@
+// Times merging the replacements of a header with many edits, one edit at a
+// time as before and in a single batch.
+//
+// Usage: ./replacements_benchmark [edits per file] [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/mutex_lock.h"
+#include "modernizer/replacements.h"
+
+using clang::tooling::Replacements;
+
+namespace {
+
+constexpr llvm::StringLiteral kFilePath = "gen/classes.h";
+
+// Mimics a generated header where every class has its macro removed and its
+// deleted members inserted.
+void AddEdits(int num_edits, modernizer::ReplacementsContext* context)
+    EXCLUSIVE_LOCKS_REQUIRED(context) {
+  std::string text;
+  for (int i = 0; i < num_edits; ++i) {
+    std::string name = "C" + std::to_string(i);
+    text += "class " + name + " {\n public:\n  " + name +
+            "();\n\n private:\n  RTC_DISALLOW_COPY_AND_ASSIGN(" + name +
+            ");\n};\n\n";
+  }
+  auto contents = std::make_shared<modernizer::FileSystemCache::Contents>();
+  contents->buffer = llvm::MemoryBuffer::getMemBufferCopy(text);
+  contents->real_path = kFilePath.str();
+  contents->hash = text.size();
+
+  size_t class_begin = 0;
+  for (int i = 0; i < num_edits; ++i) {
+    std::string name = "C" + std::to_string(i);
+    size_t insert_offset = text.find("();\n", class_begin) + 3;
+    size_t macro_offset = text.find("  RTC_", class_begin);
+    size_t macro_end = text.find(";\n", macro_offset) + 2;
+    std::string deleted = "\n\n" + name + "(const " + name + "&) = delete;\n" +
+                          name + "& operator=(const " + name +
+                          "&) = delete;\n";
+    context->Add(kFilePath, contents,
+                 {{.key_offset = static_cast<unsigned>(insert_offset),
+                   .offset = static_cast<unsigned>(insert_offset),
+                   .length = 0,
+                   .text = deleted}});
+    context->Add(kFilePath, contents,
+                 {{.key_offset = static_cast<unsigned>(macro_offset),
+                   .offset = static_cast<unsigned>(macro_offset),
+                   .length = static_cast<unsigned>(macro_end - macro_offset),
+                   .text = ""}});
+    class_begin = macro_end;
+  }
+}
+
+template <typename Function>
+double MeasureMilliseconds(int iterations, Function function) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    function();
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / iterations;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_edits = argc >= 2 ? std::atoi(argv[1]) : 300;
+  int iterations = argc >= 3 ? std::atoi(argv[2]) : 20;
+  if (num_edits <= 0 || iterations <= 0) {
+    llvm::errs() << "Usage: " << argv[0] << " [edits per file] [iterations]\n";
+    return 1;
+  }
+
+  modernizer::ReplacementsContext context;
+  modernizer::MutexLock guard(context);
+  AddEdits(num_edits, &context);
+  const modernizer::FileReplacements& file_replacements =
+      context.GetFileReplacements(context.GetFileId(kFilePath));
+
+  size_t sequential_size = 0;
+  double sequential = MeasureMilliseconds(iterations, [&] {
+    std::vector<Replacements> loc_replacements =
+        modernizer::GroupReplacements(kFilePath, file_replacements);
+    Replacements merged_replacements;
+    for (auto iter = loc_replacements.rbegin();
+         iter != loc_replacements.rend(); ++iter) {
+      merged_replacements = merged_replacements.merge(*iter);
+    }
+    sequential_size = merged_replacements.size();
+  });
+
+  size_t batch_size = 0;
+  double batch = MeasureMilliseconds(iterations, [&] {
+    std::optional<Replacements> merged_replacements =
+        modernizer::MergeReplacements(kFilePath, file_replacements);
+    batch_size = merged_replacements ? merged_replacements->size() : 0;
+  });
+
+  if (batch_size != sequential_size) {
+    llvm::errs() << "Batch merge produced " << batch_size
+                 << " replacements instead of " << sequential_size << "\n";
+    return 1;
+  }
+  llvm::outs() << file_replacements.replacements.size()
+               << " replacements: sequential merge "
+               << llvm::format("%.3f", sequential) << " ms, batch merge "
+               << llvm::format("%.3f", batch) << " ms\n";
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include "modernizer/replacements.h"
+
+#include "gtest/gtest.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "modernizer/mutex_lock.h"
+
+using clang::tooling::Replacements;
+
+namespace {
+
+std::shared_ptr<const modernizer::FileSystemCache::Contents> MakeContents(
+    llvm::StringRef text,
+    llvm::StringRef real_path) {
+  auto contents = std::make_shared<modernizer::FileSystemCache::Contents>();
+  contents->buffer = llvm::MemoryBuffer::getMemBufferCopy(text);
+  contents->real_path = real_path.str();
+  contents->hash = text.size();
+  return contents;
+}
+
+std::vector<modernizer::ReplacementRecord> MakeReplacements(
+    unsigned key_offset,
+    unsigned offset,
+    llvm::StringRef text) {
+  return {{.key_offset = key_offset,
+           .offset = offset,
+           .length = 0,
+           .text = text}};
+}
+
+TEST(ReplacementsTest, AddMergesAndDetectsConflicts) {
+  modernizer::ReplacementsContext context;
+  modernizer::MutexLock guard(context);
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(2, 5, "// b\n"));
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(1, 0, "// a\n"));
+  // Another translation unit finding the same candidate.
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(1, 0, "// a\n"));
+
+  ASSERT_EQ(context.GetNumFiles(), 1u);
+  uint32_t id = context.GetFileId("../../foo.h");
+  EXPECT_EQ(context.GetFilePath(id), "../../foo.h");
+  const modernizer::FileReplacements& file_replacements =
+      context.GetFileReplacements(id);
+  ASSERT_EQ(file_replacements.replacements.size(), 2u);
+  EXPECT_EQ(file_replacements.replacements[0].text, "// a\n");
+  EXPECT_EQ(file_replacements.replacements[1].text, "// b\n");
+  EXPECT_FALSE(file_replacements.conflicting_contents);
+
+  context.Add("../../foo.h", MakeContents("class Foo2 {};\n", "/src/foo.h"),
+              MakeReplacements(3, 7, "// c\n"));
+  EXPECT_TRUE(context.GetFileReplacements(id).conflicting_contents);
+}
+
+TEST(ReplacementsTest, MergeInternsFilesAndTexts) {
+  std::string text(100, 'x');
+  modernizer::ReplacementsContext context;
+  modernizer::ReplacementsContext other;
+  modernizer::MutexLock guard(context);
+  modernizer::MutexLock other_guard(other);
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(1, 0, text));
+  other.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+            MakeReplacements(2, 5, text));
+  other.Add("../../bar.h", MakeContents("class Bar {};\n", "/src/bar.h"),
+            MakeReplacements(1, 0, text));
+  size_t text_pool_size = context.GetTextPoolSize();
+  context.Merge(other);
+
+  EXPECT_EQ(context.GetNumFiles(), 2u);
+  EXPECT_EQ(context.GetNumReplacements(), 3u);
+  EXPECT_EQ(context.GetTextPoolSize(), text_pool_size);
+  std::vector<uint32_t> ids = context.GetFileIdsByPath();
+  ASSERT_EQ(ids.size(), 2u);
+  EXPECT_EQ(context.GetFilePath(ids[0]), "../../bar.h");
+  EXPECT_EQ(context.GetFilePath(ids[1]), "../../foo.h");
+  EXPECT_EQ(context.FindFileId("../../bar.h"), ids[0]);
+  EXPECT_EQ(context.FindFileId("../../baz.h"), std::nullopt);
+
+  std::vector<Replacements> groups = modernizer::GroupReplacements(
+      "../../foo.h", context.GetFileReplacements(ids[1]));
+  ASSERT_EQ(groups.size(), 2u);
+  ASSERT_EQ(groups[1].size(), 1u);
+  EXPECT_EQ(groups[1].begin()->getFilePath(), "../../foo.h");
+  EXPECT_EQ(groups[1].begin()->getOffset(), 5u);
+  EXPECT_EQ(groups[1].begin()->getReplacementText(), text);
+}
+
+TEST(ReplacementsTest, MergeFiltersFiles) {
+  modernizer::ReplacementsContext context;
+  modernizer::ReplacementsContext other;
+  modernizer::MutexLock guard(context);
+  modernizer::MutexLock other_guard(other);
+  other.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+            MakeReplacements(1, 0, "// a\n"));
+  other.Add("../../bar.h", MakeContents("class Bar {};\n", "/src/bar.h"),
+            MakeReplacements(1, 0, "// b\n"));
+  context.Merge(other, [](llvm::StringRef file_path) {
+    return file_path == "../../bar.h";
+  });
+
+  ASSERT_EQ(context.GetNumFiles(), 1u);
+  EXPECT_EQ(context.GetFilePath(0), "../../bar.h");
+  EXPECT_EQ(context.GetNumReplacements(), 1u);
+}
+
+TEST(ReplacementsTest, MergeReplacementsSortsByOffset) {
+  modernizer::ReplacementsContext context;
+  modernizer::MutexLock guard(context);
+  auto contents = MakeContents("class Foo {};\n", "/src/foo.h");
+  context.Add("../../foo.h", contents, MakeReplacements(1, 7, "b"));
+  context.Add("../../foo.h", contents, MakeReplacements(2, 0, "a"));
+  context.Add("../../foo.h", contents, MakeReplacements(3, 7, "c"));
+  context.Add("../../foo.h", contents,
+              {{.key_offset = 4, .offset = 7, .length = 2, .text = "d"}});
+
+  std::optional<Replacements> merged = modernizer::MergeReplacements(
+      "../../foo.h", context.GetFileReplacements(0));
+  ASSERT_TRUE(merged);
+  std::vector<clang::tooling::Replacement> replacements(merged->begin(),
+                                                        merged->end());
+  ASSERT_EQ(replacements.size(), 3u);
+  EXPECT_EQ(replacements[0].getOffset(), 0u);
+  EXPECT_EQ(replacements[1].getOffset(), 7u);
+  EXPECT_EQ(replacements[1].getLength(), 0u);
+  EXPECT_EQ(replacements[1].getReplacementText(), "bc");
+  EXPECT_EQ(replacements[2].getLength(), 2u);
+  EXPECT_EQ(replacements[2].getReplacementText(), "d");
+
+  context.Add("../../foo.h", contents,
+              {{.key_offset = 5, .offset = 8, .length = 2, .text = ""}});
+  EXPECT_FALSE(modernizer::MergeReplacements(
+      "../../foo.h", context.GetFileReplacements(0)));
+}
+
+TEST(ReplacementsTest, SerializationRoundTrip) {
+  modernizer::ReplacementsContext context;
+  modernizer::MutexLock guard(context);
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(1, 0, "// a\n"));
+  context.Add("../../foo.h", MakeContents("class Foo {};\n", "/src/foo.h"),
+              MakeReplacements(300, 5, std::string(200, 'x')));
+
+  std::string data = modernizer::SerializeReplacements(context);
+  auto files = modernizer::DeserializeReplacements(data);
+  ASSERT_TRUE(files);
+  ASSERT_EQ(files->size(), 1u);
+  const modernizer::SerializedFileReplacements& file = files->front();
+  EXPECT_EQ(file.file_path, "../../foo.h");
+  EXPECT_EQ(file.real_path, "/src/foo.h");
+  EXPECT_EQ(file.hash, 14u);
+  ASSERT_EQ(file.replacements.size(), 2u);
+  const modernizer::ReplacementRecord& last = file.replacements.back();
+  EXPECT_EQ(last.key_offset, 300u);
+  EXPECT_EQ(last.offset, 5u);
+  EXPECT_EQ(last.text, std::string(200, 'x'));
+
+  EXPECT_FALSE(modernizer::DeserializeReplacements(
+      std::string_view(data).substr(0, data.size() - 1)));
+}
+
+}  // namespace
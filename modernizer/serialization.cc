@@ -0,0 +1,64 @@
+#include "modernizer/serialization.h"
+
+#include <climits>
+
+namespace modernizer {
+
+void WriteVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void WriteString(std::string_view value, std::string& out) {
+  WriteVarint(value.size(), out);
+  out.append(value);
+}
+
+bool SerializationReader::ReadVarint(uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (data_.empty()) {
+      return false;
+    }
+    uint8_t byte = static_cast<uint8_t>(data_.front());
+    data_.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SerializationReader::ReadInt(int& value) {
+  uint64_t varint;
+  if (!ReadVarint(varint) || varint > INT_MAX) {
+    return false;
+  }
+  value = static_cast<int>(varint);
+  return true;
+}
+
+bool SerializationReader::ReadString(std::string& value) {
+  std::string_view view;
+  if (!ReadStringView(view)) {
+    return false;
+  }
+  value.assign(view);
+  return true;
+}
+
+bool SerializationReader::ReadStringView(std::string_view& value) {
+  uint64_t size;
+  if (!ReadVarint(size) || size > data_.size()) {
+    return false;
+  }
+  value = data_.substr(0, size);
+  data_.remove_prefix(size);
+  return true;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,39 @@
+#ifndef MODERNIZER_SERIALIZATION_H_
+#define MODERNIZER_SERIALIZATION_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace modernizer {
+
+// Compact binary encoding for data passed between processes. Integers are
+// written as LEB128 varints and strings are prefixed with their size.
+void WriteVarint(uint64_t value, std::string& out);
+
+void WriteString(std::string_view value, std::string& out);
+
+// Reads data written with the functions above. Every method returns false
+// if the data is truncated or malformed.
+class SerializationReader {
+ public:
+  explicit SerializationReader(std::string_view data) : data_(data) {}
+
+  bool ReadVarint(uint64_t& value);
+
+  bool ReadInt(int& value);
+
+  bool ReadString(std::string& value);
+
+  // Like ReadString(), but |value| points into the data being read.
+  bool ReadStringView(std::string_view& value);
+
+  bool AtEnd() const { return data_.empty(); }
+
+ private:
+  std::string_view data_;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_SERIALIZATION_H_
@@ -0,0 +1,445 @@
+#include "modernizer/server.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/Support/Path.h"
+#include "modernizer/compilation_database.h"
+#include "modernizer/file_system_cache.h"
+#include "modernizer/posix_io.h"
+#include "modernizer/serialization.h"
+#include "modernizer/style_cache.h"
+#include "modernizer/translation_unit_cache.h"
+
+namespace modernizer {
+
+namespace {
+
+constexpr uint64_t kProtocolVersion = 8;
+
+// The server answers with frames of a type byte followed by a message.
+constexpr char kOutputFrame = 'o';
+constexpr char kExitCodeFrame = 'x';
+
+constexpr uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO;
+
+bool WriteFrame(int fd, char type, std::string_view message) {
+  return WriteAll(fd, std::string_view(&type, 1)) &&
+         WriteMessage(fd, message);
+}
+
+// Sends everything written to it to the client as output frames.
+class FrameOutputStream : public llvm::raw_ostream {
+ public:
+  explicit FrameOutputStream(int fd) : fd_(fd) {}
+
+  ~FrameOutputStream() override { flush(); }
+
+ private:
+  void write_impl(const char* ptr, size_t size) override {
+    // A client that went away only loses its own output.
+    if (!failed_ && !WriteFrame(fd_, kOutputFrame, {ptr, size})) {
+      failed_ = true;
+    }
+    position_ += size;
+  }
+
+  uint64_t current_pos() const override { return position_; }
+
+  const int fd_;
+  bool failed_ = false;
+  uint64_t position_ = 0;
+};
+
+std::optional<sockaddr_un> MakeAddress(const std::string& socket_path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    llvm::errs() << "Socket path is too long: " << socket_path << "\n";
+    return std::nullopt;
+  }
+  std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+  return address;
+}
+
+std::filesystem::path MakeAbsolute(const std::filesystem::path& path) {
+  return path.empty() ? path : std::filesystem::absolute(path);
+}
+
+class Server {
+ public:
+  Server(int listen_fd, int inotify_fd)
+      : listen_fd_(listen_fd),
+        inotify_fd_(inotify_fd),
+        compilation_database_cache_(
+            std::make_unique<CompilationDatabaseCache>()),
+        file_system_cache_(std::make_unique<FileSystemCache>()),
+        style_cache_(std::make_unique<StyleCache>()),
+        translation_unit_cache_(std::make_unique<TranslationUnitCache>()) {}
+
+  ~Server() {
+    close(listen_fd_);
+    close(inotify_fd_);
+  }
+
+  int Run() {
+    while (true) {
+      pollfd poll_fds[] = {
+          {.fd = listen_fd_, .events = POLLIN, .revents = 0},
+          {.fd = inotify_fd_, .events = POLLIN, .revents = 0},
+      };
+      if (poll(poll_fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        llvm::errs() << "poll failed: " << std::strerror(errno) << "\n";
+        return 1;
+      }
+      if (poll_fds[1].revents) {
+        ProcessEvents();
+      }
+      if (poll_fds[0].revents & POLLIN) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+          HandleConnection(fd);
+          close(fd);
+        }
+      }
+    }
+  }
+
+ private:
+  void HandleConnection(int fd) {
+    std::string request;
+    if (!ReadMessage(fd, request)) {
+      return;
+    }
+    std::optional<RunModernizerOptions> options = DecodeOptions(request);
+    if (!options) {
+      llvm::errs() << "Malformed request\n";
+      WriteExitCode(fd, 1);
+      return;
+    }
+
+    // Changes made right before the request must not be missed.
+    ProcessEvents();
+
+    int exit_code;
+    {
+      FrameOutputStream out_stream(fd);
+      options->out_stream =
+          options->in_place ? &llvm::nulls() : &out_stream;
+      options->compilation_database_cache = compilation_database_cache_.get();
+      options->file_system_cache = file_system_cache_.get();
+      options->style_cache = style_cache_.get();
+      options->translation_unit_cache = translation_unit_cache_.get();
+      exit_code = RunModernizer(*options);
+    }
+    WriteExitCode(fd, exit_code);
+    WatchNewDirectories();
+  }
+
+  static void WriteExitCode(int fd, int exit_code) {
+    std::string message;
+    WriteVarint(exit_code, message);
+    WriteFrame(fd, kExitCodeFrame, message);
+  }
+
+  void WatchNewDirectories() {
+    std::vector<std::string> directories =
+        translation_unit_cache_->TakeNewDirectories();
+    for (std::string& directory : style_cache_->TakeNewDirectories()) {
+      directories.push_back(std::move(directory));
+    }
+    for (std::string& directory : file_system_cache_->TakeNewDirectories()) {
+      directories.push_back(std::move(directory));
+    }
+    for (const std::string& directory : directories) {
+      // A missing directory, probed for a file that does not exist, cannot
+      // be watched, but its creation shows up in the closest existing parent
+      // and invalidates what is cached under it.
+      llvm::StringRef watched_directory = directory;
+      int wd;
+      while ((wd = inotify_add_watch(inotify_fd_,
+                                     watched_directory.str().c_str(),
+                                     kWatchMask)) < 0 &&
+             errno == ENOENT &&
+             !llvm::sys::path::parent_path(watched_directory).empty()) {
+        watched_directory = llvm::sys::path::parent_path(watched_directory);
+      }
+      if (wd < 0) {
+        llvm::errs() << "Cannot watch " << directory << ": "
+                     << std::strerror(errno) << "\n";
+        continue;
+      }
+      watched_directories_[wd] = watched_directory.str();
+    }
+  }
+
+  void ProcessEvents() {
+    std::unordered_set<std::string> changed_paths;
+    bool overflowed = false;
+    alignas(inotify_event) char buffer[65536];
+    while (true) {
+      ssize_t size = read(inotify_fd_, buffer, sizeof(buffer));
+      if (size < 0 && errno == EINTR) {
+        continue;
+      }
+      if (size <= 0) {
+        break;
+      }
+      for (ssize_t offset = 0; offset < size;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(
+            buffer + offset);
+        offset += sizeof(inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          overflowed = true;
+          continue;
+        }
+        auto iter = watched_directories_.find(event->wd);
+        if (iter == watched_directories_.end()) {
+          continue;
+        }
+        if (event->mask & IN_IGNORED) {
+          watched_directories_.erase(iter);
+          continue;
+        }
+        std::string path = iter->second;
+        if (event->len) {
+          path += "/";
+          path += event->name;
+        }
+        changed_paths.insert(std::move(path));
+      }
+    }
+
+    if (overflowed) {
+      // Some changes are lost, so nothing cached can be trusted anymore.
+      llvm::errs() << "Too many file changes; dropping all caches\n";
+      file_system_cache_ = std::make_unique<FileSystemCache>();
+      style_cache_ = std::make_unique<StyleCache>();
+      translation_unit_cache_ = std::make_unique<TranslationUnitCache>();
+      for (const auto& [wd, directory] : watched_directories_) {
+        inotify_rm_watch(inotify_fd_, wd);
+      }
+      watched_directories_.clear();
+      return;
+    }
+    if (changed_paths.empty()) {
+      return;
+    }
+    std::vector<std::string> paths(changed_paths.begin(), changed_paths.end());
+    file_system_cache_->Invalidate(paths);
+    style_cache_->Invalidate(paths);
+    translation_unit_cache_->Invalidate(paths);
+  }
+
+  const int listen_fd_;
+  const int inotify_fd_;
+  // Checks the status of compile_commands.json itself, as its directory is
+  // not watched.
+  std::unique_ptr<CompilationDatabaseCache> compilation_database_cache_;
+  std::unique_ptr<FileSystemCache> file_system_cache_;
+  std::unique_ptr<StyleCache> style_cache_;
+  std::unique_ptr<TranslationUnitCache> translation_unit_cache_;
+  std::unordered_map<int, std::string> watched_directories_;
+};
+
+}  // namespace
+
+std::string EncodeOptions(const RunModernizerOptions& options) {
+  std::string data;
+  WriteVarint(kProtocolVersion, data);
+  WriteString(options.project_root.string(), data);
+  WriteString(options.compile_commands.string(), data);
+  WriteString(options.source_file_pattern, data);
+  WriteVarint(options.num_jobs, data);
+  WriteVarint(options.in_place, data);
+  WriteVarint(options.skip_unchanged_files, data);
+  WriteVarint(options.stream_output, data);
+  WriteVarint(options.worker_processes, data);
+  WriteVarint(options.worker_timeout.count(), data);
+  WriteString(options.journal_path, data);
+  WriteString(options.changed_since, data);
+  WriteString(options.include_index_path, data);
+  WriteVarint(options.parse_define_variants, data);
+  WriteVarint(options.verbose, data);
+  WriteVarint(options.traverse_all_declarations, data);
+  WriteVarint(options.lexer_fast_path, data);
+  WriteVarint(options.check_lexer_fast_path, data);
+  WriteVarint(options.prefetch_translation_units, data);
+  WriteString(options.header_cost_report_path, data);
+  WriteString(options.perf_record_path, data);
+  WriteString(options.perf_compare_path, data);
+  WriteVarint(options.perf_threshold_percent, data);
+  return data;
+}
+
+std::optional<RunModernizerOptions> DecodeOptions(std::string_view data) {
+  SerializationReader reader(data);
+  uint64_t version;
+  if (!reader.ReadVarint(version) || version != kProtocolVersion) {
+    return std::nullopt;
+  }
+  RunModernizerOptions options;
+  std::string project_root;
+  std::string compile_commands;
+  uint64_t in_place;
+  uint64_t skip_unchanged_files;
+  uint64_t stream_output;
+  uint64_t worker_processes;
+  uint64_t worker_timeout;
+  uint64_t parse_define_variants;
+  uint64_t verbose;
+  uint64_t traverse_all_declarations;
+  uint64_t lexer_fast_path;
+  uint64_t check_lexer_fast_path;
+  if (!reader.ReadString(project_root) ||
+      !reader.ReadString(compile_commands) ||
+      !reader.ReadString(options.source_file_pattern) ||
+      !reader.ReadInt(options.num_jobs) || !reader.ReadVarint(in_place) ||
+      !reader.ReadVarint(skip_unchanged_files) ||
+      !reader.ReadVarint(stream_output) ||
+      !reader.ReadVarint(worker_processes) ||
+      !reader.ReadVarint(worker_timeout) ||
+      !reader.ReadString(options.journal_path) ||
+      !reader.ReadString(options.changed_since) ||
+      !reader.ReadString(options.include_index_path) ||
+      !reader.ReadVarint(parse_define_variants) ||
+      !reader.ReadVarint(verbose) ||
+      !reader.ReadVarint(traverse_all_declarations) ||
+      !reader.ReadVarint(lexer_fast_path) ||
+      !reader.ReadVarint(check_lexer_fast_path) ||
+      !reader.ReadInt(options.prefetch_translation_units) ||
+      !reader.ReadString(options.header_cost_report_path) ||
+      !reader.ReadString(options.perf_record_path) ||
+      !reader.ReadString(options.perf_compare_path) ||
+      !reader.ReadInt(options.perf_threshold_percent) ||
+      !reader.AtEnd()) {
+    return std::nullopt;
+  }
+  options.project_root = project_root;
+  options.compile_commands = compile_commands;
+  options.in_place = in_place;
+  options.skip_unchanged_files = skip_unchanged_files;
+  options.stream_output = stream_output;
+  options.worker_processes = worker_processes;
+  options.worker_timeout = std::chrono::seconds(worker_timeout);
+  options.parse_define_variants = parse_define_variants;
+  options.verbose = verbose;
+  options.traverse_all_declarations = traverse_all_declarations;
+  options.lexer_fast_path = lexer_fast_path;
+  options.check_lexer_fast_path = check_lexer_fast_path;
+  return options;
+}
+
+int RunServer(const std::string& socket_path) {
+  std::optional<sockaddr_un> address = MakeAddress(socket_path);
+  if (!address) {
+    return 1;
+  }
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    llvm::errs() << "socket failed: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  // A socket left behind by a previous server would make bind() fail.
+  unlink(socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&*address),
+           sizeof(*address)) ||
+      listen(listen_fd, SOMAXCONN)) {
+    llvm::errs() << "Cannot listen on " << socket_path << ": "
+                 << std::strerror(errno) << "\n";
+    close(listen_fd);
+    return 1;
+  }
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    llvm::errs() << "inotify_init1 failed: " << std::strerror(errno) << "\n";
+    close(listen_fd);
+    return 1;
+  }
+  // A client that goes away must not kill the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  llvm::errs() << "Listening on " << socket_path << "\n";
+  return Server(listen_fd, inotify_fd).Run();
+}
+
+int RunClient(const std::string& socket_path,
+              const RunModernizerOptions& options,
+              llvm::raw_ostream& out_stream) {
+  std::optional<sockaddr_un> address = MakeAddress(socket_path);
+  if (!address) {
+    return 1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&*address),
+                        sizeof(*address))) {
+    llvm::errs() << "Cannot connect to " << socket_path << ": "
+                 << std::strerror(errno) << "\n";
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  // The server has a different working directory.
+  RunModernizerOptions absolute_options = options;
+  absolute_options.project_root = MakeAbsolute(options.project_root);
+  absolute_options.compile_commands = MakeAbsolute(options.compile_commands);
+  absolute_options.journal_path =
+      MakeAbsolute(options.journal_path).string();
+  absolute_options.include_index_path =
+      MakeAbsolute(options.include_index_path).string();
+  absolute_options.header_cost_report_path =
+      MakeAbsolute(options.header_cost_report_path).string();
+  absolute_options.perf_record_path =
+      MakeAbsolute(options.perf_record_path).string();
+  absolute_options.perf_compare_path =
+      MakeAbsolute(options.perf_compare_path).string();
+
+  int exit_code = 1;
+  if (!WriteMessage(fd, EncodeOptions(absolute_options))) {
+    llvm::errs() << "Cannot send the request: " << std::strerror(errno)
+                 << "\n";
+  } else {
+    while (true) {
+      char type;
+      std::string message;
+      if (!ReadAll(fd, &type, 1) || !ReadMessage(fd, message)) {
+        llvm::errs() << "The server closed the connection\n";
+        break;
+      }
+      if (type == kOutputFrame) {
+        out_stream << message;
+        continue;
+      }
+      int server_exit_code;
+      if (type == kExitCodeFrame &&
+          SerializationReader(message).ReadInt(server_exit_code)) {
+        exit_code = server_exit_code;
+      }
+      break;
+    }
+  }
+  close(fd);
+  out_stream.flush();
+  return exit_code;
+}
+
+}  // namespace modernizer
@@ -0,0 +1,34 @@
+#ifndef MODERNIZER_SERVER_H_
+#define MODERNIZER_SERVER_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/modernizer.h"
+
+namespace modernizer {
+
+// Serves RunModernizer() requests on the Unix socket |socket_path| until the
+// process is killed. The file system cache, the loaded compile databases,
+// the formatting styles and the results of every parsed translation unit are
+// kept between requests, and whatever inotify reports as changed is dropped
+// from them before the next request.
+int RunServer(const std::string& socket_path);
+
+// Sends |options| to the server listening on |socket_path| and writes the
+// patch it sends back to |out_stream|. Returns the exit code of the run on
+// the server, or 1 if the server cannot be reached.
+int RunClient(const std::string& socket_path,
+              const RunModernizerOptions& options,
+              llvm::raw_ostream& out_stream);
+
+// Exposed for testing. Caches and |out_stream| are not encoded.
+std::string EncodeOptions(const RunModernizerOptions& options);
+
+std::optional<RunModernizerOptions> DecodeOptions(std::string_view data);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_SERVER_H_
@@ -0,0 +1,70 @@
+#include "modernizer/server.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(ServerTest, OptionsRoundTrip) {
+  modernizer::RunModernizerOptions options{
+      .project_root = "/src",
+      .compile_commands = "/src/out/compile_commands.json",
+      .source_file_pattern = "base/**",
+      .num_jobs = 7,
+      .in_place = true,
+      .skip_unchanged_files = true,
+      .stream_output = false,
+      .worker_processes = true,
+      .worker_timeout = std::chrono::seconds(30),
+      .journal_path = "/tmp/journal",
+      .changed_since = "origin/main",
+      .include_index_path = "/src/out/include_index",
+      .parse_define_variants = true,
+      .verbose = true,
+      .traverse_all_declarations = false,
+      .lexer_fast_path = true,
+      .check_lexer_fast_path = false,
+      .prefetch_translation_units = 16,
+      .header_cost_report_path = "/tmp/header_costs.json",
+      .perf_record_path = "/tmp/perf.json",
+      .perf_compare_path = "/tmp/baseline.json",
+      .perf_threshold_percent = 5};
+
+  std::optional<modernizer::RunModernizerOptions> decoded =
+      modernizer::DecodeOptions(modernizer::EncodeOptions(options));
+  ASSERT_TRUE(decoded);
+  EXPECT_EQ(decoded->project_root, options.project_root);
+  EXPECT_EQ(decoded->compile_commands, options.compile_commands);
+  EXPECT_EQ(decoded->source_file_pattern, options.source_file_pattern);
+  EXPECT_EQ(decoded->num_jobs, 7);
+  EXPECT_TRUE(decoded->in_place);
+  EXPECT_TRUE(decoded->skip_unchanged_files);
+  EXPECT_FALSE(decoded->stream_output);
+  EXPECT_TRUE(decoded->worker_processes);
+  EXPECT_EQ(decoded->worker_timeout, std::chrono::seconds(30));
+  EXPECT_EQ(decoded->journal_path, options.journal_path);
+  EXPECT_EQ(decoded->changed_since, options.changed_since);
+  EXPECT_EQ(decoded->include_index_path, options.include_index_path);
+  EXPECT_TRUE(decoded->parse_define_variants);
+  EXPECT_TRUE(decoded->verbose);
+  EXPECT_FALSE(decoded->traverse_all_declarations);
+  EXPECT_TRUE(decoded->lexer_fast_path);
+  EXPECT_FALSE(decoded->check_lexer_fast_path);
+  EXPECT_EQ(decoded->prefetch_translation_units, 16);
+  EXPECT_EQ(decoded->header_cost_report_path,
+            options.header_cost_report_path);
+  EXPECT_EQ(decoded->perf_record_path, options.perf_record_path);
+  EXPECT_EQ(decoded->perf_compare_path, options.perf_compare_path);
+  EXPECT_EQ(decoded->perf_threshold_percent, 5);
+  EXPECT_EQ(decoded->out_stream, nullptr);
+}
+
+TEST(ServerTest, DecodeRejectsMalformedData) {
+  modernizer::RunModernizerOptions options;
+  options.project_root = "/src";
+  std::string data = modernizer::EncodeOptions(options);
+  EXPECT_FALSE(modernizer::DecodeOptions(data.substr(0, data.size() - 1)));
+  EXPECT_FALSE(modernizer::DecodeOptions(data + "x"));
+  EXPECT_FALSE(modernizer::DecodeOptions(""));
+}
+
+}  // namespace
@@ -0,0 +1,63 @@
+#include "modernizer/style_cache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+namespace modernizer {
+
+llvm::Expected<clang::format::FormatStyle> StyleCache::GetStyle(
+    llvm::StringRef file_path,
+    llvm::vfs::FileSystem& file_system) {
+  llvm::SmallString<256> directory(file_path);
+  if (file_system.makeAbsolute(directory)) {
+    return clang::format::getStyle("file", file_path, "LLVM", "",
+                                   &file_system);
+  }
+  llvm::sys::path::remove_dots(directory, /*remove_dot_dot=*/true);
+  llvm::sys::path::remove_filename(directory);
+  // getStyle() guesses the language from the name alone when the code is
+  // empty.
+  Key key(std::string(directory),
+          clang::format::guessLanguage(file_path, /*Code=*/""));
+  {
+    absl::MutexLock lock(&mutex_);
+    auto iter = styles_.find(key);
+    if (iter != styles_.end()) {
+      return iter->second;
+    }
+  }
+
+  llvm::Expected<clang::format::FormatStyle> style =
+      clang::format::getStyle("file", file_path, "LLVM", "", &file_system);
+  if (!style) {
+    return style.takeError();
+  }
+  absl::MutexLock lock(&mutex_);
+  styles_.emplace(key, *style);
+  for (llvm::StringRef parent = key.first; !parent.empty();
+       parent = llvm::sys::path::parent_path(parent)) {
+    if (!directories_.insert(parent.str()).second) {
+      break;
+    }
+    new_directories_.push_back(parent.str());
+  }
+  return style;
+}
+
+void StyleCache::Invalidate(const std::vector<std::string>& paths) {
+  for (const std::string& path : paths) {
+    llvm::StringRef name = llvm::sys::path::filename(path);
+    if (name == ".clang-format" || name == "_clang-format") {
+      absl::MutexLock lock(&mutex_);
+      styles_.clear();
+      return;
+    }
+  }
+}
+
+std::vector<std::string> StyleCache::TakeNewDirectories() {
+  absl::MutexLock lock(&mutex_);
+  return std::move(new_directories_);
+}
+
+}  // namespace modernizer
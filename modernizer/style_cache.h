@@ -0,0 +1,57 @@
+#ifndef MODERNIZER_STYLE_CACHE_H_
+#define MODERNIZER_STYLE_CACHE_H_
+
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "clang/Format/Format.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace modernizer {
+
+// The styles format::getStyle() finds for the files of a run, kept between
+// runs of a long-lived process. The style of a file only depends on its
+// language and on the .clang-format files of its directory and of those
+// above it, so it is looked up once per directory and language.
+class StyleCache {
+ public:
+  StyleCache() = default;
+  ~StyleCache() = default;
+
+  StyleCache(const StyleCache&) = delete;
+  StyleCache& operator=(const StyleCache&) = delete;
+
+  // Like format::getStyle("file", |file_path|, "LLVM", "", &|file_system|).
+  // Errors are not cached.
+  llvm::Expected<clang::format::FormatStyle> GetStyle(
+      llvm::StringRef file_path,
+      llvm::vfs::FileSystem& file_system);
+
+  // Drops every style if any of |paths| is a .clang-format file.
+  void Invalidate(const std::vector<std::string>& paths);
+
+  // Returns the directories searched for .clang-format files by stored
+  // styles that were not returned by a previous call, so that the caller
+  // can watch them.
+  std::vector<std::string> TakeNewDirectories();
+
+ private:
+  using Key =
+      std::pair<std::string, clang::format::FormatStyle::LanguageKind>;
+
+  absl::Mutex mutex_;
+  std::map<Key, clang::format::FormatStyle> styles_ GUARDED_BY(mutex_);
+  std::unordered_set<std::string> directories_ GUARDED_BY(mutex_);
+  std::vector<std::string> new_directories_ GUARDED_BY(mutex_);
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_STYLE_CACHE_H_
@@ -0,0 +1,69 @@
+#include "modernizer/style_cache.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace {
+
+class StyleCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    file_system_ = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    SetColumnLimit(100);
+    file_system_->addFile("/src/api/a.h", 0,
+                          llvm::MemoryBuffer::getMemBuffer(""));
+    file_system_->addFile("/src/api/b.h", 0,
+                          llvm::MemoryBuffer::getMemBuffer(""));
+  }
+
+  void SetColumnLimit(int column_limit) {
+    file_system_->addFile(
+        "/src/.clang-format", ++modification_time_,
+        llvm::MemoryBuffer::getMemBufferCopy(
+            "BasedOnStyle: Chromium\nColumnLimit: " +
+            std::to_string(column_limit) + "\n"));
+  }
+
+  unsigned GetColumnLimit(const std::string& file_path) {
+    llvm::Expected<clang::format::FormatStyle> style =
+        cache_.GetStyle(file_path, *file_system_);
+    EXPECT_TRUE(static_cast<bool>(style)) << llvm::toString(style.takeError());
+    return style ? style->ColumnLimit : 0;
+  }
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> file_system_;
+  modernizer::StyleCache cache_;
+  time_t modification_time_ = 0;
+};
+
+TEST_F(StyleCacheTest, KeepsStyleUntilInvalidated) {
+  EXPECT_EQ(GetColumnLimit("/src/api/a.h"), 100u);
+  EXPECT_EQ(cache_.TakeNewDirectories(),
+            (std::vector<std::string>{"/src/api", "/src", "/"}));
+
+  // InMemoryFileSystem cannot replace a file, so a new one stands in for the
+  // changed .clang-format.
+  file_system_ = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  SetColumnLimit(80);
+  file_system_->addFile("/src/api/b.h", 0,
+                        llvm::MemoryBuffer::getMemBuffer(""));
+  EXPECT_EQ(GetColumnLimit("/src/api/b.h"), 100u);
+  EXPECT_TRUE(cache_.TakeNewDirectories().empty());
+
+  cache_.Invalidate({"/src/api/b.h"});
+  EXPECT_EQ(GetColumnLimit("/src/api/b.h"), 100u);
+  cache_.Invalidate({"/src/.clang-format"});
+  EXPECT_EQ(GetColumnLimit("/src/api/b.h"), 80u);
+}
+
+TEST_F(StyleCacheTest, ResolvesRelativePaths) {
+  file_system_->setCurrentWorkingDirectory("/src/out");
+  EXPECT_EQ(GetColumnLimit("../api/a.h"), 100u);
+  EXPECT_EQ(cache_.TakeNewDirectories(),
+            (std::vector<std::string>{"/src/api", "/src", "/"}));
+}
+
+}  // namespace
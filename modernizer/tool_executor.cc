@@ -0,0 +1,42 @@
+#include "modernizer/tool_executor.h"
+
+#include <algorithm>
+
+#include "clang/Tooling/Tooling.h"
+
+using namespace clang::tooling;
+
+namespace modernizer {
+
+ParallelToolExecutor::ParallelToolExecutor(
+    const CompilationDatabase& compilations,
+    std::vector<std::string> files,
+    FileSystemCache* file_system_cache,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system)
+    : compilations_(compilations),
+      files_(std::move(files)),
+      file_system_cache_(file_system_cache),
+      base_file_system_(std::move(base_file_system)) {
+  assert(file_system_cache_);
+  // ClangTool runs every compile command of a file, so a file listed twice
+  // would be parsed twice per command.
+  std::sort(files_.begin(), files_.end());
+  files_.erase(std::unique(files_.begin(), files_.end()), files_.end());
+}
+
+int ParallelToolExecutor::RunFile(const std::string& file,
+                                  const RunFileFunction& run_file,
+                                  const ArgumentsAdjuster& adjuster) {
+  llvm::errs() << "[" << ++num_started_files_ << "/" << files_.size()
+               << "] Processing file " << file << "\n";
+  // Each TU gets its own view of the shared cache so that concurrent
+  // workers can use different working directories.
+  ClangTool tool(compilations_, {file},
+                 std::make_shared<clang::PCHContainerOperations>(),
+                 CreateCachedFileSystem(*file_system_cache_,
+                                        base_file_system_));
+  tool.appendArgumentsAdjuster(adjuster);
+  return run_file(tool, file);
+}
+
+}  // namespace modernizer
@@ -0,0 +1,58 @@
+#ifndef MODERNIZER_TOOL_EXECUTOR_H_
+#define MODERNIZER_TOOL_EXECUTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "modernizer/file_system_cache.h"
+
+namespace modernizer {
+
+// Runs the TUs in |files| on the threads of the caller, which schedules them.
+// Unlike clang::tooling::AllTUsToolExecutor, every TU reads files through
+// |file_system_cache|, so each header is stat'ed and read once per process
+// instead of once per TU. Files missing from the cache are read from
+// |base_file_system|, or from the real file system if it is null.
+class ParallelToolExecutor {
+ public:
+  ParallelToolExecutor(const clang::tooling::CompilationDatabase& compilations,
+                       std::vector<std::string> files,
+                       FileSystemCache* file_system_cache,
+                       llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+                           base_file_system = nullptr);
+  ~ParallelToolExecutor() = default;
+
+  ParallelToolExecutor(const ParallelToolExecutor&) = delete;
+  ParallelToolExecutor& operator=(const ParallelToolExecutor&) = delete;
+
+  // The files to run, sorted and without duplicates.
+  const std::vector<std::string>& GetFiles() const { return files_; }
+
+  // Called with a tool set up for the file, and returns the result of
+  // ClangTool::run().
+  using RunFileFunction =
+      std::function<int(clang::tooling::ClangTool& tool,
+                        const std::string& file)>;
+
+  // Runs |file|, one of GetFiles(), with |run_file| on the calling thread.
+  // Thread-safe. Returns the result of |run_file|.
+  int RunFile(const std::string& file,
+              const RunFileFunction& run_file,
+              const clang::tooling::ArgumentsAdjuster& adjuster);
+
+ private:
+  const clang::tooling::CompilationDatabase& compilations_;
+  std::vector<std::string> files_;
+  FileSystemCache* file_system_cache_;
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> base_file_system_;
+  std::atomic<size_t> num_started_files_ = 0;
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_TOOL_EXECUTOR_H_
@@ -0,0 +1,72 @@
+#include "modernizer/translation_unit_cache.h"
+
+#include "llvm/Support/Path.h"
+
+namespace modernizer {
+
+std::optional<std::string> TranslationUnitCache::Find(const std::string& tu,
+                                                      uint64_t key) const {
+  absl::MutexLock lock(&mutex_);
+  auto iter = results_.find(tu);
+  if (iter == results_.end() || iter->second.key != key) {
+    return std::nullopt;
+  }
+  return iter->second.data;
+}
+
+void TranslationUnitCache::Store(const std::string& tu,
+                                 uint64_t key,
+                                 std::string data,
+                                 const std::vector<std::string>& files_read) {
+  absl::MutexLock lock(&mutex_);
+  Erase(tu);
+  results_[tu] = Result{.key = key, .data = std::move(data)};
+  files_read_[tu] = files_read;
+  for (const std::string& file : files_read) {
+    readers_[file].insert(tu);
+    std::string directory(llvm::sys::path::parent_path(file));
+    if (directories_.insert(directory).second) {
+      new_directories_.push_back(std::move(directory));
+    }
+  }
+}
+
+void TranslationUnitCache::Invalidate(const std::vector<std::string>& paths) {
+  absl::MutexLock lock(&mutex_);
+  for (const std::string& path : paths) {
+    auto iter = readers_.find(path);
+    if (iter == readers_.end()) {
+      continue;
+    }
+    std::unordered_set<std::string> tus = std::move(iter->second);
+    for (const std::string& tu : tus) {
+      Erase(tu);
+    }
+  }
+}
+
+std::vector<std::string> TranslationUnitCache::TakeNewDirectories() {
+  absl::MutexLock lock(&mutex_);
+  return std::move(new_directories_);
+}
+
+void TranslationUnitCache::Erase(const std::string& tu) {
+  auto iter = files_read_.find(tu);
+  if (iter == files_read_.end()) {
+    return;
+  }
+  for (const std::string& file : iter->second) {
+    auto readers_iter = readers_.find(file);
+    if (readers_iter == readers_.end()) {
+      continue;
+    }
+    readers_iter->second.erase(tu);
+    if (readers_iter->second.empty()) {
+      readers_.erase(readers_iter);
+    }
+  }
+  files_read_.erase(iter);
+  results_.erase(tu);
+}
+
+}  // namespace modernizer
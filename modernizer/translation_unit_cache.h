@@ -0,0 +1,63 @@
+#ifndef MODERNIZER_TRANSLATION_UNIT_CACHE_H_
+#define MODERNIZER_TRANSLATION_UNIT_CACHE_H_
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace modernizer {
+
+// Serialized results of parsed translation units, kept between runs of a
+// long-lived process. A result is dropped as soon as any file it read is
+// invalidated.
+class TranslationUnitCache {
+ public:
+  TranslationUnitCache() = default;
+  ~TranslationUnitCache() = default;
+
+  TranslationUnitCache(const TranslationUnitCache&) = delete;
+  TranslationUnitCache& operator=(const TranslationUnitCache&) = delete;
+
+  // |key| covers everything besides the files read that affects the result,
+  // like the compile commands.
+  std::optional<std::string> Find(const std::string& tu, uint64_t key) const;
+
+  // |files_read| are the real paths of every file the TU read.
+  void Store(const std::string& tu,
+             uint64_t key,
+             std::string data,
+             const std::vector<std::string>& files_read);
+
+  void Invalidate(const std::vector<std::string>& paths);
+
+  // Returns the directories of files read by stored results that were not
+  // returned by a previous call, so that the caller can watch them.
+  std::vector<std::string> TakeNewDirectories();
+
+ private:
+  struct Result {
+    uint64_t key;
+    std::string data;
+  };
+
+  void Erase(const std::string& tu) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  std::unordered_map<std::string, Result> results_ GUARDED_BY(mutex_);
+  // The TUs of |results_| that read each file.
+  std::unordered_map<std::string, std::unordered_set<std::string>> readers_
+      GUARDED_BY(mutex_);
+  std::unordered_map<std::string, std::vector<std::string>> files_read_
+      GUARDED_BY(mutex_);
+  std::unordered_set<std::string> directories_ GUARDED_BY(mutex_);
+  std::vector<std::string> new_directories_ GUARDED_BY(mutex_);
+};
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_TRANSLATION_UNIT_CACHE_H_
@@ -0,0 +1,41 @@
+#include "modernizer/translation_unit_cache.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+TEST(TranslationUnitCacheTest, FindsByKey) {
+  modernizer::TranslationUnitCache cache;
+  cache.Store("/src/a.cc", 1, "a", {"/src/a.cc", "/src/api/a.h"});
+  EXPECT_EQ(cache.Find("/src/a.cc", 1), "a");
+  EXPECT_FALSE(cache.Find("/src/a.cc", 2));
+  EXPECT_FALSE(cache.Find("/src/b.cc", 1));
+}
+
+TEST(TranslationUnitCacheTest, InvalidatesReaders) {
+  modernizer::TranslationUnitCache cache;
+  cache.Store("/src/a.cc", 1, "a", {"/src/a.cc", "/src/api/common.h"});
+  cache.Store("/src/b.cc", 1, "b", {"/src/b.cc", "/src/api/common.h"});
+  cache.Store("/src/c.cc", 1, "c", {"/src/c.cc"});
+
+  cache.Invalidate({"/src/api/common.h"});
+  EXPECT_FALSE(cache.Find("/src/a.cc", 1));
+  EXPECT_FALSE(cache.Find("/src/b.cc", 1));
+  EXPECT_EQ(cache.Find("/src/c.cc", 1), "c");
+
+  // A result stored again only depends on its new files.
+  cache.Store("/src/a.cc", 1, "a2", {"/src/a.cc"});
+  cache.Invalidate({"/src/api/common.h"});
+  EXPECT_EQ(cache.Find("/src/a.cc", 1), "a2");
+}
+
+TEST(TranslationUnitCacheTest, TakeNewDirectories) {
+  modernizer::TranslationUnitCache cache;
+  cache.Store("/src/a.cc", 1, "a", {"/src/a.cc", "/src/api/a.h"});
+  EXPECT_THAT(cache.TakeNewDirectories(),
+              UnorderedElementsAre("/src", "/src/api"));
+  cache.Store("/src/b.cc", 1, "b", {"/src/b.cc"});
+  EXPECT_THAT(cache.TakeNewDirectories(), IsEmpty());
+}
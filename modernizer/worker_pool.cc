@@ -0,0 +1,371 @@
+#include "modernizer/worker_pool.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string_view>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "modernizer/posix_io.h"
+
+namespace modernizer {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Messages are written with WriteMessage(). Results from a worker start with
+// a status byte.
+constexpr size_t kLengthSize = sizeof(uint32_t);
+constexpr char kTaskSucceeded = 1;
+constexpr char kTaskFailed = 0;
+
+[[noreturn]] void RunWorker(int task_fd,
+                            int result_fd,
+                            const WorkerTaskFunction& run_task) {
+  while (true) {
+    std::string task;
+    if (!ReadMessage(task_fd, task)) {
+      // The parent closed the pipe: no more tasks.
+      _exit(0);
+    }
+    std::optional<std::string> result = run_task(task);
+    std::string message(1, result ? kTaskSucceeded : kTaskFailed);
+    if (result) {
+      message += *result;
+    }
+    if (!WriteMessage(result_fd, message)) {
+      _exit(1);
+    }
+  }
+}
+
+struct Worker {
+  pid_t pid = -1;
+  // The parent writes tasks to |task_fd| and reads results from |result_fd|.
+  int task_fd = -1;
+  int result_fd = -1;
+  std::optional<size_t> task;
+  Clock::time_point deadline;
+  std::string buffer;
+};
+
+class WorkerPool {
+ public:
+  WorkerPool(const std::vector<std::string>& tasks,
+             const WorkerPoolOptions& options,
+             const WorkerTaskFunction& run_task,
+             const WorkerResultFunction& on_result)
+      : tasks_(tasks),
+        options_(options),
+        run_task_(run_task),
+        on_result_(on_result),
+        workers_(std::max(options.num_workers, 1)),
+        attempts_(tasks.size(), 0) {
+    for (size_t i = 0; i < tasks_.size(); ++i) {
+      pending_.push_back(i);
+    }
+  }
+
+  ~WorkerPool() {
+    for (Worker& worker : workers_) {
+      // Closing the task pipe makes an idle worker exit.
+      Stop(worker, /*kill_worker=*/worker.task.has_value());
+    }
+  }
+
+  std::vector<std::string> Run() {
+    while (true) {
+      for (Worker& worker : workers_) {
+        if (!worker.task && !pending_.empty() && !IsCancelled()) {
+          StartTask(worker);
+        }
+      }
+      if (!WaitForResults()) {
+        break;
+      }
+    }
+    return std::move(failed_tasks_);
+  }
+
+ private:
+  bool Spawn(Worker& worker) {
+    int task_pipe[2];
+    int result_pipe[2];
+    if (pipe(task_pipe)) {
+      return false;
+    }
+    if (pipe(result_pipe)) {
+      close(task_pipe[0]);
+      close(task_pipe[1]);
+      return false;
+    }
+    // Buffered output would otherwise be written by both processes.
+    llvm::outs().flush();
+    llvm::errs().flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+      for (int fd : {task_pipe[0], task_pipe[1], result_pipe[0],
+                     result_pipe[1]}) {
+        close(fd);
+      }
+      return false;
+    }
+    if (pid == 0) {
+      close(task_pipe[1]);
+      close(result_pipe[0]);
+      for (const Worker& other : workers_) {
+        if (other.pid >= 0) {
+          close(other.task_fd);
+          close(other.result_fd);
+        }
+      }
+      RunWorker(task_pipe[0], result_pipe[1], run_task_);
+    }
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+    worker.pid = pid;
+    worker.task_fd = task_pipe[1];
+    worker.result_fd = result_pipe[0];
+    worker.buffer.clear();
+    return true;
+  }
+
+  void Stop(Worker& worker, bool kill_worker) {
+    if (worker.pid < 0) {
+      return;
+    }
+    if (kill_worker) {
+      kill(worker.pid, SIGKILL);
+    }
+    close(worker.task_fd);
+    close(worker.result_fd);
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    worker.pid = -1;
+    worker.task_fd = -1;
+    worker.result_fd = -1;
+    worker.task.reset();
+    worker.buffer.clear();
+    last_status_ = status;
+  }
+
+  void StartTask(Worker& worker) {
+    size_t task = pending_.front();
+    pending_.pop_front();
+    ++attempts_[task];
+    if (worker.pid < 0 && !Spawn(worker)) {
+      llvm::errs() << "Failed to start a worker process: "
+                   << std::strerror(errno) << "\n";
+      Fail(task);
+      return;
+    }
+    worker.task = task;
+    worker.deadline = Clock::now() + options_.timeout;
+    if (!WriteMessage(worker.task_fd, tasks_[task])) {
+      // The worker died while idle; its task never started.
+      Stop(worker, /*kill_worker=*/true);
+      --attempts_[task];
+      pending_.push_front(task);
+    }
+  }
+
+  // Waits until at least one busy worker finishes, crashes or times out.
+  // Returns false if no worker is busy.
+  bool WaitForResults() {
+    std::vector<pollfd> poll_fds;
+    std::vector<Worker*> busy_workers;
+    Clock::time_point deadline = Clock::time_point::max();
+    for (Worker& worker : workers_) {
+      if (!worker.task) {
+        continue;
+      }
+      poll_fds.push_back(
+          pollfd{.fd = worker.result_fd, .events = POLLIN, .revents = 0});
+      busy_workers.push_back(&worker);
+      if (options_.timeout.count() > 0) {
+        deadline = std::min(deadline, worker.deadline);
+      }
+    }
+    if (busy_workers.empty()) {
+      return false;
+    }
+
+    int timeout_ms = -1;
+    if (deadline != Clock::time_point::max()) {
+      timeout_ms = std::max<int64_t>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline - Clock::now())
+                  .count() +
+              1,
+          0);
+    }
+    int num_ready = poll(poll_fds.data(), poll_fds.size(), timeout_ms);
+    if (num_ready < 0 && errno != EINTR) {
+      llvm::errs() << "poll failed: " << std::strerror(errno) << "\n";
+      for (Worker* worker : busy_workers) {
+        size_t task = *worker->task;
+        Stop(*worker, /*kill_worker=*/true);
+        Fail(task);
+      }
+      return true;
+    }
+
+    for (size_t i = 0; i < busy_workers.size(); ++i) {
+      Worker& worker = *busy_workers[i];
+      if (num_ready > 0 && poll_fds[i].revents) {
+        ReadResult(worker);
+      } else if (options_.timeout.count() > 0 &&
+                 Clock::now() >= worker.deadline) {
+        size_t task = *worker.task;
+        Stop(worker, /*kill_worker=*/true);
+        llvm::errs() << "Timed out after " << options_.timeout.count()
+                     << "s: " << tasks_[task] << "\n";
+        Retry(task);
+      }
+    }
+    return true;
+  }
+
+  void ReadResult(Worker& worker) {
+    char chunk[65536];
+    ssize_t num_read = read(worker.result_fd, chunk, sizeof(chunk));
+    if (num_read < 0 && errno == EINTR) {
+      return;
+    }
+    size_t task = *worker.task;
+    if (num_read <= 0) {
+      Stop(worker, /*kill_worker=*/true);
+      llvm::errs() << "Worker process for " << tasks_[task] << " "
+                   << DescribeStatus(last_status_) << "\n";
+      Retry(task);
+      return;
+    }
+    worker.buffer.append(chunk, num_read);
+    if (worker.buffer.size() < kLengthSize) {
+      return;
+    }
+    uint32_t length;
+    std::memcpy(&length, worker.buffer.data(), kLengthSize);
+    if (worker.buffer.size() < kLengthSize + length) {
+      return;
+    }
+    if (length < 1 || worker.buffer.size() > kLengthSize + length) {
+      Stop(worker, /*kill_worker=*/true);
+      llvm::errs() << "Worker process for " << tasks_[task]
+                   << " sent a malformed result\n";
+      Retry(task);
+      return;
+    }
+    std::optional<std::string> result;
+    if (worker.buffer[kLengthSize] == kTaskSucceeded) {
+      result = worker.buffer.substr(kLengthSize + 1);
+    }
+    worker.buffer.clear();
+    worker.task.reset();
+    if (!result) {
+      failed_tasks_.push_back(tasks_[task]);
+    }
+    on_result_(tasks_[task], std::move(result));
+  }
+
+  bool IsCancelled() const {
+    return options_.cancelled && *options_.cancelled;
+  }
+
+  void Retry(size_t task) {
+    if (attempts_[task] < options_.max_attempts) {
+      llvm::errs() << "Retrying " << tasks_[task] << "\n";
+      pending_.push_back(task);
+      return;
+    }
+    Fail(task);
+  }
+
+  void Fail(size_t task) {
+    failed_tasks_.push_back(tasks_[task]);
+    on_result_(tasks_[task], std::nullopt);
+  }
+
+  static std::string DescribeStatus(int status) {
+    if (WIFSIGNALED(status)) {
+      return "was killed by signal " + std::to_string(WTERMSIG(status)) +
+             " (" + strsignal(WTERMSIG(status)) + ")";
+    }
+    if (WIFEXITED(status)) {
+      return "exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+    return "stopped unexpectedly";
+  }
+
+  const std::vector<std::string>& tasks_;
+  const WorkerPoolOptions& options_;
+  const WorkerTaskFunction& run_task_;
+  const WorkerResultFunction& on_result_;
+  std::vector<Worker> workers_;
+  std::vector<int> attempts_;
+  std::deque<size_t> pending_;
+  std::vector<std::string> failed_tasks_;
+  int last_status_ = 0;
+};
+
+// Returns the number of threads of this process, or std::nullopt if it
+// cannot be told.
+std::optional<int> GetNumThreads() {
+  auto buffer = llvm::MemoryBuffer::getFileAsStream("/proc/self/status");
+  if (!buffer) {
+    return std::nullopt;
+  }
+  llvm::SmallVector<llvm::StringRef, 64> lines;
+  (*buffer)->getBuffer().split(lines, '\n');
+  for (llvm::StringRef line : lines) {
+    int num_threads;
+    if (line.consume_front("Threads:") &&
+        !line.trim().getAsInteger(10, num_threads)) {
+      return num_threads;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+std::vector<std::string> RunInWorkerProcesses(
+    const std::vector<std::string>& tasks,
+    const WorkerPoolOptions& options,
+    const WorkerTaskFunction& run_task,
+    const WorkerResultFunction& on_result) {
+  // A child forked from a process with other threads inherits the locks
+  // those threads held, and can deadlock on them.
+  if (std::optional<int> num_threads = GetNumThreads(); num_threads > 1) {
+    llvm::errs() << "Cannot fork worker processes from a process with "
+                 << *num_threads << " threads\n";
+    return tasks;
+  }
+
+  // A worker that dies while the parent writes a task must not kill the
+  // parent.
+  struct sigaction ignore_sigpipe = {};
+  ignore_sigpipe.sa_handler = SIG_IGN;
+  struct sigaction old_sigpipe;
+  sigaction(SIGPIPE, &ignore_sigpipe, &old_sigpipe);
+
+  std::vector<std::string> failed_tasks =
+      WorkerPool(tasks, options, run_task, on_result).Run();
+
+  sigaction(SIGPIPE, &old_sigpipe, nullptr);
+  return failed_tasks;
+}
+
+}  // namespace modernizer
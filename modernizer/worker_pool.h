@@ -0,0 +1,50 @@
+#ifndef MODERNIZER_WORKER_POOL_H_
+#define MODERNIZER_WORKER_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace modernizer {
+
+struct WorkerPoolOptions {
+  int num_workers = 1;
+  // A task running longer than this kills its worker. Zero means no limit.
+  std::chrono::seconds timeout{0};
+  // Number of times a task is started before a crash or timeout is final.
+  int max_attempts = 2;
+  // If set, no task is started once it is true. Tasks already running are
+  // waited for and reported; the others are neither run nor reported.
+  const std::atomic<bool>* cancelled = nullptr;
+};
+
+// Runs in a worker process. Returns the result sent back to the parent, or
+// std::nullopt if the task failed in a way that retrying will not fix.
+using WorkerTaskFunction =
+    std::function<std::optional<std::string>(const std::string& task)>;
+
+// Runs in the parent process once per task, in completion order. |result| is
+// std::nullopt if the task failed.
+using WorkerResultFunction =
+    std::function<void(const std::string& task,
+                       std::optional<std::string> result)>;
+
+// Runs every task in |tasks| in worker processes forked from the calling
+// process, so that workers start with everything the caller has already set
+// up. A worker that crashes or times out only loses its current task, which
+// is retried on a fresh worker. The calling process must not have any other
+// thread, since a forked child could deadlock on the locks they hold; if it
+// has, every task fails without being run or reported. Returns the tasks
+// that failed.
+std::vector<std::string> RunInWorkerProcesses(
+    const std::vector<std::string>& tasks,
+    const WorkerPoolOptions& options,
+    const WorkerTaskFunction& run_task,
+    const WorkerResultFunction& on_result);
+
+}  // namespace modernizer
+
+#endif  // MODERNIZER_WORKER_POOL_H_
@@ -0,0 +1,105 @@
+#include "modernizer/worker_pool.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+
+std::optional<std::string> RunTask(const std::string& task) {
+  if (task == "crash") {
+    std::abort();
+  }
+  if (task == "hang") {
+    sleep(60);
+  }
+  if (task == "fail") {
+    return std::nullopt;
+  }
+  return "result of " + task;
+}
+
+TEST(WorkerPoolTest, RunsTasks) {
+  std::map<std::string, std::optional<std::string>> results;
+  std::vector<std::string> failed_tasks = modernizer::RunInWorkerProcesses(
+      {"a", "b", "c", "d", "e"}, {.num_workers = 2}, RunTask,
+      [&](const std::string& task, std::optional<std::string> result) {
+        results[task] = std::move(result);
+      });
+  EXPECT_TRUE(failed_tasks.empty());
+  EXPECT_THAT(results, ElementsAre(Pair("a", "result of a"),
+                                   Pair("b", "result of b"),
+                                   Pair("c", "result of c"),
+                                   Pair("d", "result of d"),
+                                   Pair("e", "result of e")));
+}
+
+TEST(WorkerPoolTest, IsolatesCrashes) {
+  std::map<std::string, std::optional<std::string>> results;
+  std::vector<std::string> failed_tasks = modernizer::RunInWorkerProcesses(
+      {"a", "crash", "fail", "b"}, {.num_workers = 2}, RunTask,
+      [&](const std::string& task, std::optional<std::string> result) {
+        EXPECT_FALSE(results.count(task));
+        results[task] = std::move(result);
+      });
+  EXPECT_THAT(failed_tasks, UnorderedElementsAre("crash", "fail"));
+  EXPECT_THAT(results, ElementsAre(Pair("a", "result of a"),
+                                   Pair("b", "result of b"),
+                                   Pair("crash", std::nullopt),
+                                   Pair("fail", std::nullopt)));
+}
+
+TEST(WorkerPoolTest, KillsTasksThatTimeOut) {
+  std::map<std::string, std::optional<std::string>> results;
+  std::vector<std::string> failed_tasks = modernizer::RunInWorkerProcesses(
+      {"hang", "a"},
+      {.num_workers = 1, .timeout = std::chrono::seconds(1),
+       .max_attempts = 1},
+      RunTask,
+      [&](const std::string& task, std::optional<std::string> result) {
+        results[task] = std::move(result);
+      });
+  EXPECT_THAT(failed_tasks, ElementsAre("hang"));
+  EXPECT_THAT(results, ElementsAre(Pair("a", "result of a"),
+                                   Pair("hang", std::nullopt)));
+}
+
+TEST(WorkerPoolTest, StartsNoTaskOnceCancelled) {
+  std::atomic<bool> cancelled = false;
+  std::map<std::string, std::optional<std::string>> results;
+  std::vector<std::string> failed_tasks = modernizer::RunInWorkerProcesses(
+      {"a", "b", "c"}, {.num_workers = 1, .cancelled = &cancelled}, RunTask,
+      [&](const std::string& task, std::optional<std::string> result) {
+        results[task] = std::move(result);
+        cancelled = true;
+      });
+  EXPECT_TRUE(failed_tasks.empty());
+  EXPECT_THAT(results, ElementsAre(Pair("a", "result of a")));
+}
+
+TEST(WorkerPoolTest, FailsWithOtherThreads) {
+  std::promise<void> done;
+  std::thread thread([future = done.get_future()] { future.wait(); });
+  bool reported = false;
+  std::vector<std::string> failed_tasks = modernizer::RunInWorkerProcesses(
+      {"a", "b"}, {.num_workers = 1}, RunTask,
+      [&](const std::string& task, std::optional<std::string> result) {
+        reported = true;
+      });
+  done.set_value();
+  thread.join();
+  EXPECT_THAT(failed_tasks, ElementsAre("a", "b"));
+  EXPECT_FALSE(reported);
+}
+
+}  // namespace
@@ -29,11 +29,17 @@ def main(argv):
   args = parser.parse_args(argv)
 
   program = Path(args.program).absolute()
-  keep_temp = args.keep_temp
+  # The lexer fast path must produce the same patch as the AST path.
+  for extra_args in [[], ["--lexer_fast_path"], ["--check_lexer_fast_path"]]:
+    print(f"args: {extra_args}")
+    check_patch(program, extra_args, args.keep_temp)
+
+
+def check_patch(program, extra_args, keep_temp):
   cmd = [
       f"{program}", f"--project_root={TEST_ROOT}",
       f"--compile_commands={COMPILE_COMMANDS_JSON}", "--in_place=false"
-  ]
+  ] + extra_args
 
   r = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=sys.stderr, check=True)
   patch = r.stdout.decode("UTF-8")
@@ -39,4 +39,10 @@ class Barrrrrrrrr {
 
   int bar = 0;
 };
+
+// Instantiates the ByteBufferWriterT template, which must still be rewritten
+// once, through its pattern.
+size_t WriterSize() {
+  return sizeof(ByteBufferWriterT<std::string>);
+}
 }  // namespace
@@ -38,4 +38,10 @@ class Barrrrrrrrr {
  private:
   RTC_DISALLOW_COPY_AND_ASSIGN(Barrrrrrrrr);
 };
+
+// Instantiates the ByteBufferWriterT template, which must still be rewritten
+// once, through its pattern.
+size_t WriterSize() {
+  return sizeof(ByteBufferWriterT<std::string>);
+}
 }  // namespace